@@ -0,0 +1,42 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                      GStreamer-free CODEC Library
+ *
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <bkr_codec.h>
+#include <rs.h>
+
+
+void bkr_rll_init(void);
+
+
+/*
+ * Build the library's look-up tables.  Must be called once before any
+ * other function, and is not thread safe.
+ */
+
+
+void bkr_codec_init(void)
+{
+	galois_field_init(GF00256);
+	bkr_rll_init();
+}
@@ -0,0 +1,302 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                      GStreamer-free CODEC Library
+ *
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * libbkrcodec holds the signal processing of the Backer tape format with
+ * none of the GStreamer plumbing:  the elements in libtapefile are thin
+ * wrappers around it, and programs that want to move sectors in and out
+ * of their own buffers can link against it directly.  Nothing here
+ * allocates memory on the data path.  All buffers are owned by the
+ * caller, and the size each function reads or writes is fixed by the
+ * format structure passed to it.  Codecs with working state (the SP/LP
+ * and ECC2 Reed-Solomon coders) are created with a _new() function and
+ * released with the matching _free();  decoder statistics live in
+ * caller-owned structures so that they can be reset or read at will.
+ *
+ * bkr_codec_init() must be called once before any other function.
+ *
+ * The stages, in encode order, with the size of the unit each consumes
+ * and produces:
+ *
+ *	ECC2	data			-> interleave byte sectors (EP only)
+ *	SP/LP	capacity bytes		-> data_size + parity_size byte sector
+ *	RLL	capacity bytes		-> capacity + modulation_pad bytes (EP)
+ *	frame	active_size - key_length -> field_size (+ interlace) bytes
+ */
+
+
+#ifndef __BKR_CODEC_H__
+#define __BKR_CODEC_H__
+
+
+#include <stddef.h>
+#include <linux/types.h>
+#include <backer.h>
+#include <rs.h>
+
+
+void bkr_codec_init(void);
+
+
+/*
+ * ========================================================================
+ *
+ *                              Framing CODEC
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Format information.
+ * 	interlace = number of extra bytes in an odd field
+ */
+
+
+struct bkr_frame_format {
+	int field_size;
+	int interlace;
+	int leader;
+	int trailer;
+	int active_size;
+	int key_interval;
+	int key_length;
+};
+
+
+/*
+ * Sector key correlation statistics:  the lowest correlation of a field
+ * that was accepted, and the highest of a position that was rejected.
+ */
+
+
+struct bkr_frame_stats {
+	int worst_key;
+	int best_nonkey;
+};
+
+
+int bkr_frame_format(struct bkr_frame_format *, enum bkr_videomode, enum bkr_bitdensity, enum bkr_sectorformat);
+void bkr_frame_reset_stats(const struct bkr_frame_format *, struct bkr_frame_stats *);
+void bkr_frame_encode(const struct bkr_frame_format *, unsigned char *dst, const unsigned char *src, int field_number);
+void bkr_frame_decode(const struct bkr_frame_format *, unsigned char *dst, const unsigned char *src);
+const unsigned char *bkr_frame_find(const struct bkr_frame_format *, const unsigned char *data, size_t length, struct bkr_frame_stats *);
+
+
+/*
+ * ========================================================================
+ *
+ *                              RLL CODEC
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Format information.
+ * 	capacity = corresponding frame codec capacity - modulation_pad
+ */
+
+
+struct bkr_rll_format {
+	int capacity;
+	int modulation_pad;
+};
+
+
+int bkr_rll_format(struct bkr_rll_format *, enum bkr_videomode, enum bkr_bitdensity);
+void bkr_rll_modulate(const struct bkr_rll_format *, unsigned char *dst, const unsigned char *src);
+void bkr_rll_demodulate(const struct bkr_rll_format *, unsigned char *dst, const unsigned char *src);
+
+
+/*
+ * ========================================================================
+ *
+ *                              SP/LP CODEC
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Format information.
+ *	capacity = data_size - sizeof(header)
+ */
+
+
+struct bkr_splp_format {
+	int data_size;
+	int parity_size;
+	int capacity;
+	int interleave;
+};
+
+
+struct bkr_splp_codec {
+	struct bkr_splp_format format;
+	rs_format_t *rs_format;
+};
+
+
+/*
+ * Error correction statistics.  worst_block is the most bytes corrected
+ * in any one block, recent_block the same since the caller last cleared
+ * it.
+ */
+
+
+struct bkr_splp_stats {
+	int bytes_corrected;
+	int worst_block;
+	int recent_block;
+};
+
+
+/*
+ * Result of decoding a sector.  BOR sectors have a negative sector
+ * number, and EOR sectors a length of 0.  The sector number and length
+ * are only meaningful if header_is_valid is set.
+ */
+
+
+struct bkr_splp_sector {
+	int sector_is_valid;	/* sector is error free */
+	int header_is_valid;	/* sector header is error free */
+	int sector_number;
+	int length;
+};
+
+
+int bkr_splp_format(struct bkr_splp_format *, enum bkr_videomode, enum bkr_bitdensity, enum bkr_sectorformat);
+struct bkr_splp_codec *bkr_splp_codec_new(enum bkr_videomode, enum bkr_bitdensity, enum bkr_sectorformat);
+void bkr_splp_codec_free(struct bkr_splp_codec *);
+void bkr_splp_encode_sector(const struct bkr_splp_codec *, unsigned char *sector, int length, int sector_number);
+void bkr_splp_decode_sector(const struct bkr_splp_codec *, unsigned char *sector, struct bkr_splp_sector *, struct bkr_splp_stats *);
+void bkr_splp_decode_header(const struct bkr_splp_codec *, unsigned char *sector, struct bkr_splp_sector *, struct bkr_splp_stats *);
+
+
+/*
+ * ========================================================================
+ *
+ *                              ECC2 CODEC
+ *
+ * ========================================================================
+ */
+
+
+#define  BKR_ECC2_BLOCK_SIZE         255
+#define  BKR_ECC2_DESCRIPTOR_COPIES  3
+
+
+/*
+ * Format information.
+ *	group_size = group_length * interleave
+ *	parity_size = parity * interleave
+ *	capacity = data_size - size of header
+ */
+
+
+struct bkr_ecc2_format {
+	int group_size;
+	int data_size;
+	int parity_size;
+	int capacity;
+	int interleave;
+	int group_length;
+	int parity;
+};
+
+
+/*
+ * Encoder state.  parity holds the parity of the group in progress,
+ * accumulated as its data sectors are encoded.  sector_number is the
+ * number within the group of the next sector, and group_bytes the bytes
+ * of data in the group so far.
+ */
+
+
+struct bkr_ecc2_encoder {
+	struct bkr_ecc2_format format;
+	rs_format_t *rs_format;
+	unsigned char *parity;
+	int sector_number;
+	int group_bytes;
+};
+
+
+/*
+ * Decoder state.  The erasure vector lists the numbers within the group
+ * of the sectors of the current group known to be bad, until
+ * bkr_ecc2_decode_group() translates them to code positions, and
+ * first_bad_sector is the first of them.  first_corrected_sector is the
+ * number of the first data sector bkr_ecc2_decode_group() found to be in
+ * error in the last group it decoded, INT_MAX if none.
+ */
+
+
+struct bkr_ecc2_decoder {
+	struct bkr_ecc2_format format;
+	rs_format_t *rs_format;
+	unsigned char *tile;
+	gf *erasure;
+	int num_erasure;
+	int first_bad_sector;
+	int first_corrected_sector;
+};
+
+
+/*
+ * Error correction statistics.  worst_group is the most sectors
+ * requiring correction in a sector group, extra_errors the number of bad
+ * sectors not identified as such by the sector codec.
+ */
+
+
+struct bkr_ecc2_stats {
+	int worst_group;
+	unsigned long extra_errors;
+};
+
+
+int bkr_ecc2_sector_capacity(enum bkr_videomode, enum bkr_bitdensity);
+int bkr_ecc2_format(struct bkr_ecc2_format *, int sector_capacity, int group_length, int parity);
+void bkr_ecc2_encode_descriptor(const struct bkr_ecc2_format *, unsigned char *sector);
+int bkr_ecc2_decode_descriptor(const unsigned char *sector, int *group_length, int *parity);
+
+struct bkr_ecc2_encoder *bkr_ecc2_encoder_new(const struct bkr_ecc2_format *);
+void bkr_ecc2_encoder_free(struct bkr_ecc2_encoder *);
+void bkr_ecc2_encoder_reset(struct bkr_ecc2_encoder *);
+int bkr_ecc2_encoder_room(const struct bkr_ecc2_encoder *, int last);
+int bkr_ecc2_encode_sector(struct bkr_ecc2_encoder *, unsigned char *sector, const unsigned char *data, int length, int *last);
+void bkr_ecc2_encode_parity(struct bkr_ecc2_encoder *, unsigned char *parity);
+
+struct bkr_ecc2_decoder *bkr_ecc2_decoder_new(const struct bkr_ecc2_format *);
+void bkr_ecc2_decoder_free(struct bkr_ecc2_decoder *);
+void bkr_ecc2_decoder_reset(struct bkr_ecc2_decoder *);
+void bkr_ecc2_add_erasure(struct bkr_ecc2_decoder *, int sector_number);
+int bkr_ecc2_expand_group(struct bkr_ecc2_decoder *, unsigned char *group, const unsigned char *sectors, int n);
+int bkr_ecc2_decode_group(struct bkr_ecc2_decoder *, unsigned char *group, int data_sectors, struct bkr_ecc2_stats *);
+
+
+#endif	/* __BKR_CODEC_H__ */
@@ -0,0 +1,678 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                          Data Compression Elements
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * bkr_compress and bkr_decompress sit in front of the sector codecs and
+ * compress the file data in-line.  Each record is a complete, independent
+ * gzip stream:  the compressor starts a new stream with the first data of
+ * a record and finishes it at end-of-stream, so a record can be restored
+ * without reading anything recorded before it, and the decoded output of
+ * a record is also readable by gunzip(1).  The decompressor accepts any
+ * number of consecutive streams.
+ */
+
+
+/*
+ * ========================================================================
+ *
+ *                                  Preamble
+ *
+ * ========================================================================
+ */
+
+
+#include <string.h>
+#include <zlib.h>
+
+
+#include <gst/gst.h>
+#include <backer.h>
+#include <bkr_elements.h>
+#include <bkr_compress.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                                 Parameters
+ *
+ * ========================================================================
+ */
+
+
+#define  BUFFER_SIZE        65536   /* output buffer size */
+#define  WINDOW_BITS        (15 + 16) /* 32 kB window, gzip wrapper */
+#define  MEM_LEVEL          8
+#define  DEFAULT_LEVEL      6
+
+
+/*
+ * ============================================================================
+ *
+ *                     GStreamer Compressor Support Code
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Properties
+ */
+
+
+enum enc_property {
+	ARG_ENC_LEVEL = 1
+};
+
+
+static void enc_set_property(GObject *object, enum enc_property id, const GValue *value, GParamSpec *pspec)
+{
+	BkrCompress *filter = BKR_COMPRESS(object);
+
+	switch(id) {
+	case ARG_ENC_LEVEL:
+		filter->level = g_value_get_int(value);
+		break;
+	}
+}
+
+
+static void enc_get_property(GObject *object, enum enc_property id, GValue *value, GParamSpec *pspec)
+{
+	BkrCompress *filter = BKR_COMPRESS(object);
+
+	switch(id) {
+	case ARG_ENC_LEVEL:
+		g_value_set_int(value, filter->level);
+		break;
+	}
+}
+
+
+/*
+ * Run the compressor over whatever input has been given to it, and push
+ * the output out the srcpad.  flush is passed to deflate().
+ */
+
+
+static GstFlowReturn deflate_buffer(BkrCompress *filter, GstCaps *caps, int flush)
+{
+	GstBuffer *srcbuf;
+	GstFlowReturn result;
+
+	do {
+		result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, BUFFER_SIZE, caps, &srcbuf);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("gst_pad_alloc_buffer() failed");
+			return result;
+		}
+
+		filter->stream.next_out = GST_BUFFER_DATA(srcbuf);
+		filter->stream.avail_out = BUFFER_SIZE;
+		if(deflate(&filter->stream, flush) == Z_STREAM_ERROR) {
+			GST_ELEMENT_ERROR(filter, LIBRARY, ENCODE, ("deflate() failed"), (NULL));
+			gst_buffer_unref(srcbuf);
+			return GST_FLOW_ERROR;
+		}
+		GST_BUFFER_SIZE(srcbuf) = BUFFER_SIZE - filter->stream.avail_out;
+
+		if(!GST_BUFFER_SIZE(srcbuf)) {
+			/* nothing yet */
+			gst_buffer_unref(srcbuf);
+			continue;
+		}
+
+		result = gst_pad_push(filter->srcpad, srcbuf);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("gst_pad_push() failed");
+			return result;
+		}
+	} while(!filter->stream.avail_out);
+
+	return GST_FLOW_OK;
+}
+
+
+/*
+ * Event function.  See
+ *
+ * file:///usr/share/doc/gstreamer0.10-doc/gstreamer-0.10/GstPad.html#GstPadEventFunction
+ */
+
+
+static gboolean enc_event(GstPad *pad, GstEvent *event)
+{
+	BkrCompress *filter = BKR_COMPRESS(gst_pad_get_parent(pad));
+	gboolean result;
+
+	switch(GST_EVENT_TYPE(event)) {
+	case GST_EVENT_EOS:
+		/*
+		 * end of the record.  finish the stream, then forward the
+		 * end-of-stream event.
+		 */
+
+		if(filter->stream_open) {
+			filter->stream.next_in = NULL;
+			filter->stream.avail_in = 0;
+			result = deflate_buffer(filter, GST_PAD_CAPS(pad), Z_FINISH) == GST_FLOW_OK;
+			deflateEnd(&filter->stream);
+			filter->stream_open = FALSE;
+			if(!result) {
+				GST_DEBUG("deflate_buffer() failed");
+				gst_event_unref(event);
+				break;
+			}
+		}
+
+		result = gst_pad_push_event(filter->srcpad, event);
+		break;
+
+	default:
+		result = gst_pad_event_default(pad, event);
+		break;
+	}
+
+	gst_object_unref(filter);
+	return result;
+}
+
+
+/*
+ * Chain function.  See
+ *
+ * file:///usr/share/doc/gstreamer0.8-doc/gstreamer-0.8/GstPad.html#GstPadChainFunction
+ */
+
+
+static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
+{
+	BkrCompress *filter = BKR_COMPRESS(gst_pad_get_parent(pad));
+	GstCaps *caps = gst_buffer_get_caps(sinkbuf);
+	GstFlowReturn result;
+
+	if(!caps || (caps != GST_PAD_CAPS(pad))) {
+		if(!caps)
+			GST_DEBUG("caps not set on buffer");
+		else if(caps != GST_PAD_CAPS(pad))
+			GST_DEBUG("buffer's caps don't match pad's caps");
+		result = GST_FLOW_NOT_NEGOTIATED;
+		goto done;
+	}
+
+	if(!filter->stream_open) {
+		memset(&filter->stream, 0, sizeof(filter->stream));
+		if(deflateInit2(&filter->stream, filter->level, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+			GST_ELEMENT_ERROR(filter, LIBRARY, INIT, ("deflateInit2() failed"), ("%s", filter->stream.msg ? filter->stream.msg : "unknown error"));
+			result = GST_FLOW_ERROR;
+			goto done;
+		}
+		filter->stream_open = TRUE;
+	}
+
+	filter->stream.next_in = GST_BUFFER_DATA(sinkbuf);
+	filter->stream.avail_in = GST_BUFFER_SIZE(sinkbuf);
+	result = deflate_buffer(filter, caps, Z_NO_FLUSH);
+	if(result != GST_FLOW_OK)
+		GST_DEBUG("deflate_buffer() failed");
+
+done:
+	if(caps)
+		gst_caps_unref(caps);
+	gst_buffer_unref(sinkbuf);
+	gst_object_unref(filter);
+	return result;
+}
+
+
+/*
+ * Parent class.
+ */
+
+
+static GstElementClass *enc_parent_class = NULL;
+
+
+/*
+ * Instance finalize function.  See ???
+ */
+
+
+static void enc_finalize(GObject *object)
+{
+	BkrCompress *filter = BKR_COMPRESS(object);
+
+	gst_object_unref(filter->srcpad);
+	filter->srcpad = NULL;
+	if(filter->stream_open)
+		deflateEnd(&filter->stream);
+	filter->stream_open = FALSE;
+
+	G_OBJECT_CLASS(enc_parent_class)->finalize(object);
+}
+
+
+/*
+ * Base init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GBaseInitFunc
+ */
+
+
+static void enc_base_init(gpointer class)
+{
+	static GstElementDetails plugin_details = {
+		"Backer Compressor",
+		"Filter",
+		"Backer record-aligned gzip data compressor",
+		"Kipp Cannon <kcannon@ligo.caltech.edu>"
+	};
+	GObjectClass *object_class = G_OBJECT_CLASS(class);
+	GstElementClass *element_class = GST_ELEMENT_CLASS(class);
+	GstPadTemplate *sinkpad_template = gst_pad_template_new(
+		"sink",
+		GST_PAD_SINK,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+	GstPadTemplate *srcpad_template = gst_pad_template_new(
+		"src",
+		GST_PAD_SRC,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+
+	gst_element_class_set_details(element_class, &plugin_details);
+
+	object_class->set_property = enc_set_property;
+	object_class->get_property = enc_get_property;
+	object_class->finalize = enc_finalize;
+
+	gst_element_class_add_pad_template(element_class, sinkpad_template);
+	gst_element_class_add_pad_template(element_class, srcpad_template);
+}
+
+
+/*
+ * Class init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GClassInitFunc
+ */
+
+
+static void enc_class_init(gpointer class, gpointer class_data)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+	g_object_class_install_property(object_class, ARG_ENC_LEVEL, g_param_spec_int("level", "Level", "Compression level, 0 (none) to 9 (best)", 0, 9, DEFAULT_LEVEL, G_PARAM_READWRITE));
+
+	enc_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+}
+
+
+/*
+ * Instance init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GInstanceInitFunc
+ */
+
+
+static void enc_instance_init(GTypeInstance *object, gpointer class)
+{
+	GstElement *element = GST_ELEMENT(object);
+	BkrCompress *filter = BKR_COMPRESS(object);
+	GstPad *pad;
+
+	gst_element_create_all_pads(element);
+
+	/* configure sink pad */
+	pad = gst_element_get_static_pad(element, "sink");
+	gst_pad_set_event_function(pad, enc_event);
+	gst_pad_set_chain_function(pad, enc_chain);
+	gst_object_unref(pad);
+
+	/* configure src pad */
+	pad = gst_element_get_static_pad(element, "src");
+
+	/* consider this to consume the reference */
+	filter->srcpad = pad;
+
+	/* internal state */
+	filter->level = DEFAULT_LEVEL;
+	filter->stream_open = FALSE;
+}
+
+
+/*
+ * bkr_compress_get_type().
+ */
+
+
+GType bkr_compress_get_type(void)
+{
+	static GType type = 0;
+
+	if(!type) {
+		static const GTypeInfo info = {
+			.class_size = sizeof(BkrCompressClass),
+			.class_init = enc_class_init,
+			.base_init = enc_base_init,
+			.instance_size = sizeof(BkrCompress),
+			.instance_init = enc_instance_init,
+		};
+		type = g_type_register_static(GST_TYPE_ELEMENT, "BkrCompress", &info, 0);
+	}
+	return type;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                    GStreamer Decompressor Support Code
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Run the decompressor over the input given to it, and push the output
+ * out the srcpad.  A new stream is started whenever input follows the end
+ * of the previous one.
+ */
+
+
+static GstFlowReturn inflate_buffer(BkrDecompress *filter, GstCaps *caps)
+{
+	GstBuffer *srcbuf;
+	gboolean more;
+	int status;
+	GstFlowReturn result;
+
+	do {
+		if(!filter->stream_open) {
+			if(inflateInit2(&filter->stream, WINDOW_BITS) != Z_OK) {
+				GST_ELEMENT_ERROR(filter, LIBRARY, INIT, ("inflateInit2() failed"), ("%s", filter->stream.msg ? filter->stream.msg : "unknown error"));
+				return GST_FLOW_ERROR;
+			}
+			filter->stream_open = TRUE;
+		}
+
+		result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, BUFFER_SIZE, caps, &srcbuf);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("gst_pad_alloc_buffer() failed");
+			return result;
+		}
+
+		filter->stream.next_out = GST_BUFFER_DATA(srcbuf);
+		filter->stream.avail_out = BUFFER_SIZE;
+		status = inflate(&filter->stream, Z_NO_FLUSH);
+		GST_BUFFER_SIZE(srcbuf) = BUFFER_SIZE - filter->stream.avail_out;
+
+		switch(status) {
+		case Z_OK:
+		case Z_BUF_ERROR:
+			/* output buffer full, or all input used */
+			more = !filter->stream.avail_out;
+			break;
+
+		case Z_STREAM_END:
+			/* end of record */
+			inflateEnd(&filter->stream);
+			filter->stream_open = FALSE;
+			more = FALSE;
+			break;
+
+		default:
+			GST_ELEMENT_ERROR(filter, STREAM, DECODE, ("corrupt compressed data"), ("%s", filter->stream.msg ? filter->stream.msg : "unknown error"));
+			gst_buffer_unref(srcbuf);
+			inflateEnd(&filter->stream);
+			filter->stream_open = FALSE;
+			return GST_FLOW_ERROR;
+		}
+
+		if(!GST_BUFFER_SIZE(srcbuf)) {
+			gst_buffer_unref(srcbuf);
+			continue;
+		}
+
+		result = gst_pad_push(filter->srcpad, srcbuf);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("gst_pad_push() failed");
+			return result;
+		}
+	} while(filter->stream.avail_in || more);
+
+	return GST_FLOW_OK;
+}
+
+
+/*
+ * Event function.  See
+ *
+ * file:///usr/share/doc/gstreamer0.10-doc/gstreamer-0.10/GstPad.html#GstPadEventFunction
+ */
+
+
+static gboolean dec_event(GstPad *pad, GstEvent *event)
+{
+	BkrDecompress *filter = BKR_DECOMPRESS(gst_pad_get_parent(pad));
+	gboolean result;
+
+	switch(GST_EVENT_TYPE(event)) {
+	case GST_EVENT_EOS:
+		/*
+		 * everything decoded has already been sent downstream, but
+		 * if the stream's trailer has not been seen then the record
+		 * is incomplete.
+		 */
+
+		if(filter->stream_open) {
+			GST_ELEMENT_ERROR(filter, STREAM, DECODE, ("compressed data ends early, record is incomplete"), (NULL));
+			inflateEnd(&filter->stream);
+			filter->stream_open = FALSE;
+		}
+
+		result = gst_pad_push_event(filter->srcpad, event);
+		break;
+
+	default:
+		result = gst_pad_event_default(pad, event);
+		break;
+	}
+
+	gst_object_unref(filter);
+	return result;
+}
+
+
+/*
+ * Chain function.  See
+ *
+ * file:///usr/share/doc/gstreamer0.8-doc/gstreamer-0.8/GstPad.html#GstPadChainFunction
+ */
+
+
+static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
+{
+	BkrDecompress *filter = BKR_DECOMPRESS(gst_pad_get_parent(pad));
+	GstCaps *caps = gst_buffer_get_caps(sinkbuf);
+	GstFlowReturn result;
+
+	if(!caps || (caps != GST_PAD_CAPS(pad))) {
+		if(!caps)
+			GST_DEBUG("caps not set on buffer");
+		else if(caps != GST_PAD_CAPS(pad))
+			GST_DEBUG("buffer's caps don't match pad's caps");
+		result = GST_FLOW_NOT_NEGOTIATED;
+		goto done;
+	}
+
+	filter->stream.next_in = GST_BUFFER_DATA(sinkbuf);
+	filter->stream.avail_in = GST_BUFFER_SIZE(sinkbuf);
+	result = inflate_buffer(filter, caps);
+	if(result != GST_FLOW_OK)
+		GST_DEBUG("inflate_buffer() failed");
+
+done:
+	if(caps)
+		gst_caps_unref(caps);
+	gst_buffer_unref(sinkbuf);
+	gst_object_unref(filter);
+	return result;
+}
+
+
+/*
+ * Parent class.
+ */
+
+
+static GstElementClass *dec_parent_class = NULL;
+
+
+/*
+ * Instance finalize function.  See ???
+ */
+
+
+static void dec_finalize(GObject *object)
+{
+	BkrDecompress *filter = BKR_DECOMPRESS(object);
+
+	gst_object_unref(filter->srcpad);
+	filter->srcpad = NULL;
+	if(filter->stream_open)
+		inflateEnd(&filter->stream);
+	filter->stream_open = FALSE;
+
+	G_OBJECT_CLASS(dec_parent_class)->finalize(object);
+}
+
+
+/*
+ * Base init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GBaseInitFunc
+ */
+
+
+static void dec_base_init(gpointer class)
+{
+	static GstElementDetails plugin_details = {
+		"Backer Decompressor",
+		"Filter",
+		"Backer record-aligned gzip data decompressor",
+		"Kipp Cannon <kcannon@ligo.caltech.edu>"
+	};
+	GObjectClass *object_class = G_OBJECT_CLASS(class);
+	GstElementClass *element_class = GST_ELEMENT_CLASS(class);
+	GstPadTemplate *sinkpad_template = gst_pad_template_new(
+		"sink",
+		GST_PAD_SINK,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+	GstPadTemplate *srcpad_template = gst_pad_template_new(
+		"src",
+		GST_PAD_SRC,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+
+	gst_element_class_set_details(element_class, &plugin_details);
+
+	object_class->finalize = dec_finalize;
+
+	gst_element_class_add_pad_template(element_class, sinkpad_template);
+	gst_element_class_add_pad_template(element_class, srcpad_template);
+}
+
+
+/*
+ * Class init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GClassInitFunc
+ */
+
+
+static void dec_class_init(gpointer class, gpointer class_data)
+{
+	dec_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+}
+
+
+/*
+ * Instance init function.  See
+ *
+ * http://developer.gnome.org/doc/API/2.0/gobject/gobject-Type-Information.html#GInstanceInitFunc
+ */
+
+
+static void dec_instance_init(GTypeInstance *object, gpointer class)
+{
+	GstElement *element = GST_ELEMENT(object);
+	BkrDecompress *filter = BKR_DECOMPRESS(object);
+	GstPad *pad;
+
+	gst_element_create_all_pads(element);
+
+	/* configure sink pad */
+	pad = gst_element_get_static_pad(element, "sink");
+	gst_pad_set_event_function(pad, dec_event);
+	gst_pad_set_chain_function(pad, dec_chain);
+	gst_object_unref(pad);
+
+	/* configure src pad */
+	pad = gst_element_get_static_pad(element, "src");
+
+	/* consider this to consume the reference */
+	filter->srcpad = pad;
+
+	/* internal state */
+	memset(&filter->stream, 0, sizeof(filter->stream));
+	filter->stream_open = FALSE;
+}
+
+
+/*
+ * bkr_decompress_get_type().
+ */
+
+
+GType bkr_decompress_get_type(void)
+{
+	static GType type = 0;
+
+	if(!type) {
+		static const GTypeInfo info = {
+			.class_size = sizeof(BkrDecompressClass),
+			.class_init = dec_class_init,
+			.base_init = dec_base_init,
+			.instance_size = sizeof(BkrDecompress),
+			.instance_init = dec_instance_init,
+		};
+		type = g_type_register_static(GST_TYPE_ELEMENT, "BkrDecompress", &info, 0);
+	}
+	return type;
+}
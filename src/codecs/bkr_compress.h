@@ -0,0 +1,106 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                          Data Compression Elements
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __BKR_COMPRESS_H__
+#define __BKR_COMPRESS_H__
+
+
+#include <zlib.h>
+#include <gst/gst.h>
+#include <backer.h>
+
+
+G_BEGIN_DECLS
+
+
+/*
+ * Compressor
+ */
+
+
+#define BKR_COMPRESS_TYPE		(bkr_compress_get_type())
+#define BKR_COMPRESS(obj)		(G_TYPE_CHECK_INSTANCE_CAST((obj), BKR_COMPRESS_TYPE, BkrCompress))
+#define BKR_COMPRESS_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST((klass), BKR_COMPRESS_TYPE, BkrCompressClass))
+#define GST_IS_BKR_COMPRESS(obj)	(G_TYPE_CHECK_INSTANCE_TYPE((obj), BKR_COMPRESS_TYPE))
+#define GST_IS_BKR_COMPRESS_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE((klass), BKR_COMPRESS_TYPE))
+
+
+typedef struct {
+	GstElementClass parent_class;
+} BkrCompressClass;
+
+
+typedef struct {
+	GstElement element;
+
+	GstPad *srcpad;
+
+	/* compression level, 0 (none) to 9 (best) */
+	gint level;
+
+	/* a stream is open, i.e. data has been received since the start
+	 * of the record */
+	gboolean stream_open;
+	z_stream stream;
+} BkrCompress;
+
+
+GType bkr_compress_get_type(void);
+
+
+/*
+ * Decompressor
+ */
+
+
+#define BKR_DECOMPRESS_TYPE		(bkr_decompress_get_type())
+#define BKR_DECOMPRESS(obj)		(G_TYPE_CHECK_INSTANCE_CAST((obj), BKR_DECOMPRESS_TYPE, BkrDecompress))
+#define BKR_DECOMPRESS_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST((klass), BKR_DECOMPRESS_TYPE, BkrDecompressClass))
+#define GST_IS_BKR_DECOMPRESS(obj)	(G_TYPE_CHECK_INSTANCE_TYPE((obj), BKR_DECOMPRESS_TYPE))
+#define GST_IS_BKR_DECOMPRESS_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE((klass), BKR_DECOMPRESS_TYPE))
+
+
+typedef struct {
+	GstElementClass parent_class;
+} BkrDecompressClass;
+
+
+typedef struct {
+	GstElement element;
+
+	GstPad *srcpad;
+
+	/* a stream is open, i.e. its header has been seen but not its
+	 * trailer */
+	gboolean stream_open;
+	z_stream stream;
+} BkrDecompress;
+
+
+GType bkr_decompress_get_type(void);
+
+
+G_END_DECLS
+
+
+#endif	/* __BKR_COMPRESS_H__ */
@@ -0,0 +1,1165 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                       Backer Device Source and Sink
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * These elements talk to a Backer unit directly, in place of fdsrc and
+ * fdsink on a redirected stdin or stdout.  The unit is opened
+ * non-blocking and its wake-up threshold set to the element's buffer
+ * length in video frames, so poll() returns only once a whole buffer's
+ * worth of frames can be moved, and each read() or write() is a single
+ * large, frame-aligned transfer.  The video mode, bit density and sector
+ * format come from the device node and are exposed as caps.  Source
+ * buffers are time stamped by video field number.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/base/gstpushsrc.h>
+#include <backer.h>
+#include <bkr_stream.h>
+#include <bkr_elements.h>
+#include <bkr_device.h>
+
+
+#define DEFAULT_FRAMES 8
+#define DEFAULT_TIMEOUT 1000
+
+
+/*
+ * ============================================================================
+ *
+ *                              Device Handling
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Open the unit and set it up for whole-frame transfers of the given
+ * length.  Returns the file descriptor, or -1 after posting an error on
+ * the element's bus.
+ */
+
+
+static gint open_device(GstElement *element, const gchar *device, int flags, gint frames, gint *mode, gint *frame_size)
+{
+	struct mtget mtget;
+	struct bkr_wakeup wakeup = {
+		.count = frames,
+		.units = BKR_WAKEUP_FRAMES
+	};
+	gint fd;
+
+	if(!device) {
+		GST_ELEMENT_ERROR(element, RESOURCE, NOT_FOUND, ("no device specified"), (NULL));
+		return -1;
+	}
+
+	fd = open(device, flags | O_NONBLOCK);
+	if(fd < 0) {
+		if(errno == EBUSY)
+			GST_ELEMENT_ERROR(element, RESOURCE, BUSY, ("%s is in use", device), GST_ERROR_SYSTEM);
+		else
+			GST_ELEMENT_ERROR(element, RESOURCE, OPEN_READ_WRITE, ("cannot open %s", device), GST_ERROR_SYSTEM);
+		return -1;
+	}
+
+	if(ioctl(fd, MTIOCGET, &mtget) < 0) {
+		GST_ELEMENT_ERROR(element, RESOURCE, SETTINGS, ("%s is not a Backer device", device), GST_ERROR_SYSTEM);
+		goto error;
+	}
+	*mode = mtget.mt_dsreg & BKR_MODE_MASK;
+	*frame_size = bkr_mode_to_frame_size(*mode);
+	if(*frame_size < 0) {
+		GST_ELEMENT_ERROR(element, RESOURCE, SETTINGS, ("%s reports an invalid mode 0x%x", device, *mode), (NULL));
+		goto error;
+	}
+
+	if(ioctl(fd, BKRIOCSETWAKEUP, &wakeup) < 0) {
+		GST_ELEMENT_ERROR(element, RESOURCE, SETTINGS, ("cannot set %s's wake-up threshold", device), GST_ERROR_SYSTEM);
+		goto error;
+	}
+
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+
+/*
+ * Start the transfer.  This resets the unit's statistics, so do it before
+ * the first I/O rather than leaving it to the first read() or write().
+ */
+
+
+static gboolean start_device(GstElement *element, gint fd, const gchar *device, int direction)
+{
+	if(ioctl(fd, BKRIOCSTART, &direction) < 0) {
+		GST_ELEMENT_ERROR(element, RESOURCE, FAILED, ("cannot start transfer on %s", device), GST_ERROR_SYSTEM);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+/*
+ * Caps describing the unit's mode.  The sector format is included only if
+ * the device node selects one.
+ */
+
+
+static GstCaps *caps_from_mode(gint mode)
+{
+	GstCaps *caps = gst_caps_new_simple(
+		"application/x-backer",
+		"videomode", G_TYPE_INT, BKR_VIDEOMODE(mode),
+		"bitdensity", G_TYPE_INT, BKR_DENSITY(mode),
+		NULL
+	);
+
+	if(BKR_CODEC(mode))
+		gst_caps_set_simple(caps, "sectorformat", G_TYPE_INT, BKR_CODEC(mode), NULL);
+
+	return caps;
+}
+
+
+/*
+ * How long poll() should wait for a transfer of the given number of
+ * frames:  as long as they take to arrive at the slowest frame rate the
+ * driver accepts, plus the user's timeout.  Returns a GstClockTime.
+ */
+
+
+static GstClockTime poll_timeout(gint frames, guint timeout)
+{
+	return gst_util_uint64_scale_int(frames, GST_SECOND, BKR_MIN_FRAME_FREQ) + timeout * GST_MSECOND;
+}
+
+
+/*
+ * Wait for the unit to reach its wake-up threshold.  Returns GST_FLOW_OK
+ * when it has, GST_FLOW_WRONG_STATE if the element is being flushed, or
+ * GST_FLOW_ERROR after posting an error.
+ */
+
+
+static GstFlowReturn wait_for_device(GstElement *element, GstPoll *poll, GstClockTime timeout, const gchar *device)
+{
+	while(1) {
+		switch(gst_poll_wait(poll, timeout)) {
+		case 0:
+			GST_ELEMENT_ERROR(element, RESOURCE, FAILED, ("timed out waiting for %s", device), ("no video frames for %" GST_TIME_FORMAT, GST_TIME_ARGS(timeout)));
+			return GST_FLOW_ERROR;
+
+		case -1:
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			if(errno == EBUSY)
+				return GST_FLOW_WRONG_STATE;
+			GST_ELEMENT_ERROR(element, RESOURCE, FAILED, ("poll() on %s failed", device), GST_ERROR_SYSTEM);
+			return GST_FLOW_ERROR;
+
+		default:
+			return GST_FLOW_OK;
+		}
+	}
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Source
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Parent class.
+ */
+
+
+static GstPushSrcClass *src_parent_class = NULL;
+
+
+enum devsrc_property {
+	ARG_DEVSRC_DEVICE = 1,
+	ARG_DEVSRC_FRAMES,
+	ARG_DEVSRC_TIMEOUT,
+	ARG_DEVSRC_FD
+};
+
+
+/*
+ * ============================================================================
+ *
+ *                       GstBaseSrc Method Overrides
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * start()
+ */
+
+
+static gboolean devsrc_start(GstBaseSrc *basesrc)
+{
+	BkrDevSrc *src = BKR_DEVSRC(basesrc);
+
+	src->fd = open_device(GST_ELEMENT(src), src->device, O_RDONLY, src->frames, &src->mode, &src->frame_size);
+	if(src->fd < 0)
+		return FALSE;
+
+	if(BKR_VIDEOMODE(src->mode) == BKR_NTSC)
+		gst_util_fraction_multiply(GST_SECOND, 1, 1001, 60000, &src->gst_seconds_per_field_a, &src->gst_seconds_per_field_b);
+	else
+		gst_util_fraction_multiply(GST_SECOND, 1, 1, 50, &src->gst_seconds_per_field_a, &src->gst_seconds_per_field_b);
+	src->field_number = 0;
+	src->overruns = 0;
+
+	if(!start_device(GST_ELEMENT(src), src->fd, src->device, BKRIOCSTART_READ)) {
+		close(src->fd);
+		src->fd = -1;
+		return FALSE;
+	}
+
+	gst_poll_fd_init(&src->pollfd);
+	src->pollfd.fd = src->fd;
+	gst_poll_add_fd(src->poll, &src->pollfd);
+	gst_poll_fd_ctl_read(src->poll, &src->pollfd, TRUE);
+
+	return TRUE;
+}
+
+
+/*
+ * stop()
+ */
+
+
+static gboolean devsrc_stop(GstBaseSrc *basesrc)
+{
+	BkrDevSrc *src = BKR_DEVSRC(basesrc);
+
+	if(src->fd >= 0) {
+		gst_poll_remove_fd(src->poll, &src->pollfd);
+		close(src->fd);
+		src->fd = -1;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * unlock() and unlock_stop()
+ */
+
+
+static gboolean devsrc_unlock(GstBaseSrc *basesrc)
+{
+	gst_poll_set_flushing(BKR_DEVSRC(basesrc)->poll, TRUE);
+	return TRUE;
+}
+
+
+static gboolean devsrc_unlock_stop(GstBaseSrc *basesrc)
+{
+	gst_poll_set_flushing(BKR_DEVSRC(basesrc)->poll, FALSE);
+	return TRUE;
+}
+
+
+/*
+ * get_caps()
+ */
+
+
+static GstCaps *devsrc_get_caps(GstBaseSrc *basesrc)
+{
+	BkrDevSrc *src = BKR_DEVSRC(basesrc);
+
+	if(src->fd < 0)
+		return bkr_get_template_caps();
+	return caps_from_mode(src->mode);
+}
+
+
+/*
+ * is_seekable()
+ */
+
+
+static gboolean devsrc_is_seekable(GstBaseSrc *basesrc)
+{
+	return FALSE;
+}
+
+
+/*
+ * create()
+ */
+
+
+static GstFlowReturn devsrc_create(GstPushSrc *pushsrc, GstBuffer **buffer)
+{
+	BkrDevSrc *src = BKR_DEVSRC(pushsrc);
+	GstClockTime timeout = poll_timeout(src->frames, src->timeout);
+	guint size = src->frames * src->frame_size;
+	guint filled = 0;
+	struct bkr_stats stats;
+	GstFlowReturn result;
+	GstBuffer *buf;
+	guint64 fields;
+
+	buf = gst_buffer_new_and_alloc(size);
+
+	/*
+	 * poll() returns once a buffer's worth of frames is in the ring,
+	 * so normally the first read() fills the buffer.
+	 */
+
+	while(filled < size) {
+		ssize_t n = read(src->fd, GST_BUFFER_DATA(buf) + filled, size - filled);
+
+		if(n > 0) {
+			filled += n;
+			continue;
+		}
+		if(n == 0)
+			break;
+		if(errno == EAGAIN) {
+			result = wait_for_device(GST_ELEMENT(src), src->poll, timeout, src->device);
+			if(result != GST_FLOW_OK)
+				goto error;
+			continue;
+		}
+		if(errno == EINTR)
+			continue;
+		GST_ELEMENT_ERROR(src, RESOURCE, READ, ("read from %s failed", src->device), GST_ERROR_SYSTEM);
+		result = GST_FLOW_ERROR;
+		goto error;
+	}
+
+	/*
+	 * at EOF, pass on the whole frames we have and drop the rest
+	 */
+
+	if(filled % src->frame_size)
+		GST_ELEMENT_WARNING(src, STREAM, FAILED, ("dropped %u bytes of a partial video frame at end of data", filled % src->frame_size), (NULL));
+	filled -= filled % src->frame_size;
+	if(!filled) {
+		result = GST_FLOW_UNEXPECTED;
+		goto error;
+	}
+	GST_BUFFER_SIZE(buf) = filled;
+
+	/*
+	 * report frames lost in the driver
+	 */
+
+	if(ioctl(src->fd, BKRIOCGETSTATS, &stats) >= 0 && stats.overruns != src->overruns) {
+		GST_ELEMENT_WARNING(src, RESOURCE, READ, ("%s overran %u time(s), data has been lost", src->device, stats.overruns - src->overruns), (NULL));
+		src->overruns = stats.overruns;
+	}
+
+	/*
+	 * time stamp by field number
+	 */
+
+	fields = 2 * (filled / src->frame_size);
+	GST_BUFFER_OFFSET(buf) = src->field_number;
+	GST_BUFFER_OFFSET_END(buf) = src->field_number + fields;
+	GST_BUFFER_TIMESTAMP(buf) = gst_util_uint64_scale_int_round(GST_BUFFER_OFFSET(buf), src->gst_seconds_per_field_a, src->gst_seconds_per_field_b);
+	GST_BUFFER_DURATION(buf) = gst_util_uint64_scale_int_round(GST_BUFFER_OFFSET_END(buf), src->gst_seconds_per_field_a, src->gst_seconds_per_field_b) - GST_BUFFER_TIMESTAMP(buf);
+	src->field_number += fields;
+
+	gst_buffer_set_caps(buf, GST_PAD_CAPS(GST_BASE_SRC_PAD(src)));
+	*buffer = buf;
+	return GST_FLOW_OK;
+
+error:
+	gst_buffer_unref(buf);
+	return result;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                          GObject Method Overrides
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * set_property()
+ */
+
+
+static void devsrc_set_property(GObject *object, enum devsrc_property id, const GValue *value, GParamSpec *pspec)
+{
+	BkrDevSrc *src = BKR_DEVSRC(object);
+
+	GST_OBJECT_LOCK(object);
+
+	switch(id) {
+	case ARG_DEVSRC_DEVICE:
+		g_free(src->device);
+		src->device = g_value_dup_string(value);
+		break;
+
+	case ARG_DEVSRC_FRAMES:
+		src->frames = g_value_get_int(value);
+		break;
+
+	case ARG_DEVSRC_TIMEOUT:
+		src->timeout = g_value_get_uint(value);
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+/*
+ * get_property()
+ */
+
+
+static void devsrc_get_property(GObject *object, enum devsrc_property id, GValue *value, GParamSpec *pspec)
+{
+	BkrDevSrc *src = BKR_DEVSRC(object);
+
+	GST_OBJECT_LOCK(object);
+
+	switch(id) {
+	case ARG_DEVSRC_DEVICE:
+		g_value_set_string(value, src->device);
+		break;
+
+	case ARG_DEVSRC_FRAMES:
+		g_value_set_int(value, src->frames);
+		break;
+
+	case ARG_DEVSRC_TIMEOUT:
+		g_value_set_uint(value, src->timeout);
+		break;
+
+	case ARG_DEVSRC_FD:
+		g_value_set_int(value, src->fd);
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+/*
+ * finalize()
+ */
+
+
+static void devsrc_finalize(GObject *object)
+{
+	BkrDevSrc *src = BKR_DEVSRC(object);
+
+	g_free(src->device);
+	src->device = NULL;
+	gst_poll_free(src->poll);
+	src->poll = NULL;
+
+	G_OBJECT_CLASS(src_parent_class)->finalize(object);
+}
+
+
+/*
+ * base_init()
+ */
+
+
+static void devsrc_base_init(gpointer klass)
+{
+	GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+	GstPadTemplate *srcpad_template = gst_pad_template_new(
+		"src",
+		GST_PAD_SRC,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+
+	gst_element_class_set_details_simple(
+		element_class,
+		"Backer device source",
+		"Source/File",
+		"Reads whole video frames from a Backer unit",
+		"Kipp Cannon <kipp.cannon@ligo.org>"
+	);
+
+	gst_element_class_add_pad_template(element_class, srcpad_template);
+}
+
+
+/*
+ * class_init()
+ */
+
+
+static void devsrc_class_init(gpointer klass, gpointer class_data)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS(klass);
+	GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS(klass);
+
+	object_class->set_property = GST_DEBUG_FUNCPTR(devsrc_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(devsrc_get_property);
+	object_class->finalize = GST_DEBUG_FUNCPTR(devsrc_finalize);
+
+	basesrc_class->start = GST_DEBUG_FUNCPTR(devsrc_start);
+	basesrc_class->stop = GST_DEBUG_FUNCPTR(devsrc_stop);
+	basesrc_class->unlock = GST_DEBUG_FUNCPTR(devsrc_unlock);
+	basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(devsrc_unlock_stop);
+	basesrc_class->get_caps = GST_DEBUG_FUNCPTR(devsrc_get_caps);
+	basesrc_class->is_seekable = GST_DEBUG_FUNCPTR(devsrc_is_seekable);
+	pushsrc_class->create = GST_DEBUG_FUNCPTR(devsrc_create);
+
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSRC_DEVICE,
+		g_param_spec_string(
+			"device",
+			"Device",
+			"Backer device node to read",
+			NULL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSRC_FRAMES,
+		g_param_spec_int(
+			"frames",
+			"Frames",
+			"Number of video frames in each buffer",
+			1, G_MAXINT, DEFAULT_FRAMES,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSRC_TIMEOUT,
+		g_param_spec_uint(
+			"timeout",
+			"Timeout",
+			"Milliseconds to wait for a buffer beyond its duration at the slowest frame rate",
+			0, G_MAXUINT, DEFAULT_TIMEOUT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSRC_FD,
+		g_param_spec_int(
+			"fd",
+			"File descriptor",
+			"The open device's file descriptor, or -1 if not open",
+			-1, G_MAXINT, -1,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
+	src_parent_class = g_type_class_ref(GST_TYPE_PUSH_SRC);
+}
+
+
+/*
+ * init()
+ */
+
+
+static void devsrc_instance_init(GTypeInstance *object, gpointer klass)
+{
+	BkrDevSrc *src = BKR_DEVSRC(object);
+
+	src->device = NULL;
+	src->fd = -1;
+	src->poll = gst_poll_new(TRUE);
+}
+
+
+/*
+ * bkr_devsrc_get_type().
+ */
+
+
+GType bkr_devsrc_get_type(void)
+{
+	static GType type = 0;
+
+	if(!type) {
+		static const GTypeInfo info = {
+			.class_size = sizeof(BkrDevSrcClass),
+			.class_init = devsrc_class_init,
+			.base_init = devsrc_base_init,
+			.instance_size = sizeof(BkrDevSrc),
+			.instance_init = devsrc_instance_init,
+		};
+		type = g_type_register_static(GST_TYPE_PUSH_SRC, "BkrDevSrc", &info, 0);
+	}
+	return type;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                    Sink
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Parent class.
+ */
+
+
+static GstBaseSinkClass *sink_parent_class = NULL;
+static GstPadQueryFunction sink_parent_pad_query = NULL;
+
+
+enum devsink_property {
+	ARG_DEVSINK_DEVICE = 1,
+	ARG_DEVSINK_FRAMES,
+	ARG_DEVSINK_TIMEOUT,
+	ARG_DEVSINK_FD
+};
+
+
+/*
+ * Write size bytes from the adapter to the unit.
+ */
+
+
+static GstFlowReturn devsink_write(BkrDevSink *sink, guint size)
+{
+	GstClockTime timeout = poll_timeout(size / sink->frame_size + 1, sink->timeout);
+	const guint8 *data = gst_adapter_peek(sink->adapter, size);
+	guint written = 0;
+	struct bkr_stats stats;
+	GstFlowReturn result;
+
+	while(written < size) {
+		ssize_t n = write(sink->fd, data + written, size - written);
+
+		if(n >= 0) {
+			written += n;
+			continue;
+		}
+		if(errno == EAGAIN) {
+			result = wait_for_device(GST_ELEMENT(sink), sink->poll, timeout, sink->device);
+			if(result != GST_FLOW_OK)
+				goto done;
+			continue;
+		}
+		if(errno == EINTR)
+			continue;
+		GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("write to %s failed", sink->device), GST_ERROR_SYSTEM);
+		result = GST_FLOW_ERROR;
+		goto done;
+	}
+
+	if(ioctl(sink->fd, BKRIOCGETSTATS, &stats) >= 0 && stats.underruns != sink->underruns) {
+		GST_ELEMENT_WARNING(sink, RESOURCE, WRITE, ("%s underran %u time(s), the recording has gaps", sink->device, stats.underruns - sink->underruns), (NULL));
+		sink->underruns = stats.underruns;
+	}
+	result = GST_FLOW_OK;
+
+done:
+	gst_adapter_flush(sink->adapter, written);
+	return result;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                       GstBaseSink Method Overrides
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * start()
+ */
+
+
+static gboolean devsink_start(GstBaseSink *basesink)
+{
+	BkrDevSink *sink = BKR_DEVSINK(basesink);
+
+	sink->fd = open_device(GST_ELEMENT(sink), sink->device, O_WRONLY, sink->frames, &sink->mode, &sink->frame_size);
+	if(sink->fd < 0)
+		return FALSE;
+
+	/*
+	 * the transfer is started when the first data arrives, so that
+	 * the video stays blank while the pipeline pre-rolls
+	 */
+
+	gst_adapter_clear(sink->adapter);
+	sink->started = FALSE;
+	sink->underruns = 0;
+
+	gst_poll_fd_init(&sink->pollfd);
+	sink->pollfd.fd = sink->fd;
+	gst_poll_add_fd(sink->poll, &sink->pollfd);
+	gst_poll_fd_ctl_write(sink->poll, &sink->pollfd, TRUE);
+
+	return TRUE;
+}
+
+
+/*
+ * stop()
+ */
+
+
+static gboolean devsink_stop(GstBaseSink *basesink)
+{
+	BkrDevSink *sink = BKR_DEVSINK(basesink);
+
+	if(sink->fd >= 0) {
+		gst_poll_remove_fd(sink->poll, &sink->pollfd);
+		close(sink->fd);
+		sink->fd = -1;
+	}
+	gst_adapter_clear(sink->adapter);
+
+	return TRUE;
+}
+
+
+/*
+ * unlock() and unlock_stop()
+ */
+
+
+static gboolean devsink_unlock(GstBaseSink *basesink)
+{
+	gst_poll_set_flushing(BKR_DEVSINK(basesink)->poll, TRUE);
+	return TRUE;
+}
+
+
+static gboolean devsink_unlock_stop(GstBaseSink *basesink)
+{
+	gst_poll_set_flushing(BKR_DEVSINK(basesink)->poll, FALSE);
+	return TRUE;
+}
+
+
+/*
+ * get_caps()
+ */
+
+
+static GstCaps *devsink_get_caps(GstBaseSink *basesink)
+{
+	BkrDevSink *sink = BKR_DEVSINK(basesink);
+
+	if(sink->fd < 0)
+		return bkr_get_template_caps();
+	return caps_from_mode(sink->mode);
+}
+
+
+/*
+ * event()
+ */
+
+
+static gboolean devsink_event(GstBaseSink *basesink, GstEvent *event)
+{
+	BkrDevSink *sink = BKR_DEVSINK(basesink);
+	guint available, partial;
+
+	switch(GST_EVENT_TYPE(event)) {
+	case GST_EVENT_EOS:
+		/*
+		 * write what's left, padding it out to a whole frame
+		 */
+
+		available = gst_adapter_available(sink->adapter);
+		partial = available % sink->frame_size;
+		if(partial) {
+			GstBuffer *pad = gst_buffer_new_and_alloc(sink->frame_size - partial);
+			memset(GST_BUFFER_DATA(pad), BKR_FILLER, GST_BUFFER_SIZE(pad));
+			gst_adapter_push(sink->adapter, pad);
+			available += GST_BUFFER_SIZE(pad);
+		}
+		if(available)
+			return devsink_write(sink, available) == GST_FLOW_OK;
+		break;
+
+	case GST_EVENT_FLUSH_STOP:
+		gst_adapter_clear(sink->adapter);
+		break;
+
+	default:
+		break;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * render()
+ */
+
+
+static GstFlowReturn devsink_render(GstBaseSink *basesink, GstBuffer *buf)
+{
+	BkrDevSink *sink = BKR_DEVSINK(basesink);
+	guint size = sink->frames * sink->frame_size;
+	GstFlowReturn result = GST_FLOW_OK;
+
+	if(!sink->started) {
+		if(!start_device(GST_ELEMENT(sink), sink->fd, sink->device, BKRIOCSTART_WRITE))
+			return GST_FLOW_ERROR;
+		sink->started = TRUE;
+	}
+
+	gst_buffer_ref(buf);
+	gst_adapter_push(sink->adapter, buf);
+
+	while(gst_adapter_available(sink->adapter) >= size && result == GST_FLOW_OK)
+		result = devsink_write(sink, size);
+
+	return result;
+}
+
+
+/*
+ * sink pad query().  Answers the lead query (see bkr_splpenc) with the
+ * fields in the driver's ring plus those still waiting in the adapter.
+ * Until the transfer has started the ring tells us nothing, and the query
+ * is left unanswered.
+ */
+
+
+static gboolean devsink_pad_query(GstPad *pad, GstQuery *query)
+{
+	BkrDevSink *sink = BKR_DEVSINK(gst_pad_get_parent(pad));
+	struct bkr_stats stats;
+	gint fields;
+	gboolean result;
+
+	if(!bkr_query_parse_lead(query, &fields)) {
+		result = sink_parent_pad_query(pad, query);
+		goto done;
+	}
+
+	if(sink->fd < 0 || !sink->started || ioctl(sink->fd, BKRIOCGETSTATS, &stats) < 0) {
+		result = FALSE;
+		goto done;
+	}
+
+	bkr_query_set_lead(query, 2 * ((stats.ring_fill + gst_adapter_available(sink->adapter)) / sink->frame_size));
+	result = TRUE;
+
+done:
+	gst_object_unref(sink);
+	return result;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                          GObject Method Overrides
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * set_property()
+ */
+
+
+static void devsink_set_property(GObject *object, enum devsink_property id, const GValue *value, GParamSpec *pspec)
+{
+	BkrDevSink *sink = BKR_DEVSINK(object);
+
+	GST_OBJECT_LOCK(object);
+
+	switch(id) {
+	case ARG_DEVSINK_DEVICE:
+		g_free(sink->device);
+		sink->device = g_value_dup_string(value);
+		break;
+
+	case ARG_DEVSINK_FRAMES:
+		sink->frames = g_value_get_int(value);
+		break;
+
+	case ARG_DEVSINK_TIMEOUT:
+		sink->timeout = g_value_get_uint(value);
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+/*
+ * get_property()
+ */
+
+
+static void devsink_get_property(GObject *object, enum devsink_property id, GValue *value, GParamSpec *pspec)
+{
+	BkrDevSink *sink = BKR_DEVSINK(object);
+
+	GST_OBJECT_LOCK(object);
+
+	switch(id) {
+	case ARG_DEVSINK_DEVICE:
+		g_value_set_string(value, sink->device);
+		break;
+
+	case ARG_DEVSINK_FRAMES:
+		g_value_set_int(value, sink->frames);
+		break;
+
+	case ARG_DEVSINK_TIMEOUT:
+		g_value_set_uint(value, sink->timeout);
+		break;
+
+	case ARG_DEVSINK_FD:
+		g_value_set_int(value, sink->fd);
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+/*
+ * finalize()
+ */
+
+
+static void devsink_finalize(GObject *object)
+{
+	BkrDevSink *sink = BKR_DEVSINK(object);
+
+	g_free(sink->device);
+	sink->device = NULL;
+	gst_poll_free(sink->poll);
+	sink->poll = NULL;
+	g_object_unref(sink->adapter);
+	sink->adapter = NULL;
+
+	G_OBJECT_CLASS(sink_parent_class)->finalize(object);
+}
+
+
+/*
+ * base_init()
+ */
+
+
+static void devsink_base_init(gpointer klass)
+{
+	GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+	GstPadTemplate *sinkpad_template = gst_pad_template_new(
+		"sink",
+		GST_PAD_SINK,
+		GST_PAD_ALWAYS,
+		bkr_get_template_caps()
+	);
+
+	gst_element_class_set_details_simple(
+		element_class,
+		"Backer device sink",
+		"Sink/File",
+		"Writes whole video frames to a Backer unit",
+		"Kipp Cannon <kipp.cannon@ligo.org>"
+	);
+
+	gst_element_class_add_pad_template(element_class, sinkpad_template);
+}
+
+
+/*
+ * class_init()
+ */
+
+
+static void devsink_class_init(gpointer klass, gpointer class_data)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS(klass);
+
+	object_class->set_property = GST_DEBUG_FUNCPTR(devsink_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(devsink_get_property);
+	object_class->finalize = GST_DEBUG_FUNCPTR(devsink_finalize);
+
+	basesink_class->start = GST_DEBUG_FUNCPTR(devsink_start);
+	basesink_class->stop = GST_DEBUG_FUNCPTR(devsink_stop);
+	basesink_class->unlock = GST_DEBUG_FUNCPTR(devsink_unlock);
+	basesink_class->unlock_stop = GST_DEBUG_FUNCPTR(devsink_unlock_stop);
+	basesink_class->get_caps = GST_DEBUG_FUNCPTR(devsink_get_caps);
+	basesink_class->event = GST_DEBUG_FUNCPTR(devsink_event);
+	basesink_class->render = GST_DEBUG_FUNCPTR(devsink_render);
+
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSINK_DEVICE,
+		g_param_spec_string(
+			"device",
+			"Device",
+			"Backer device node to write",
+			NULL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSINK_FRAMES,
+		g_param_spec_int(
+			"frames",
+			"Frames",
+			"Number of video frames in each write",
+			1, G_MAXINT, DEFAULT_FRAMES,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSINK_TIMEOUT,
+		g_param_spec_uint(
+			"timeout",
+			"Timeout",
+			"Milliseconds to wait for ring space beyond the write's duration at the slowest frame rate",
+			0, G_MAXUINT, DEFAULT_TIMEOUT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		ARG_DEVSINK_FD,
+		g_param_spec_int(
+			"fd",
+			"File descriptor",
+			"The open device's file descriptor, or -1 if not open",
+			-1, G_MAXINT, -1,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
+	sink_parent_class = g_type_class_ref(GST_TYPE_BASE_SINK);
+}
+
+
+/*
+ * init()
+ */
+
+
+static void devsink_instance_init(GTypeInstance *object, gpointer klass)
+{
+	BkrDevSink *sink = BKR_DEVSINK(object);
+
+	sink->adapter = gst_adapter_new();
+	sink->device = NULL;
+	sink->fd = -1;
+	sink->poll = gst_poll_new(TRUE);
+
+	/* the device sets the pace */
+	gst_base_sink_set_sync(GST_BASE_SINK(sink), FALSE);
+
+	/* answer the lead query */
+	sink_parent_pad_query = GST_PAD_QUERYFUNC(GST_BASE_SINK_PAD(sink));
+	gst_pad_set_query_function(GST_BASE_SINK_PAD(sink), GST_DEBUG_FUNCPTR(devsink_pad_query));
+}
+
+
+/*
+ * bkr_devsink_get_type().
+ */
+
+
+GType bkr_devsink_get_type(void)
+{
+	static GType type = 0;
+
+	if(!type) {
+		static const GTypeInfo info = {
+			.class_size = sizeof(BkrDevSinkClass),
+			.class_init = devsink_class_init,
+			.base_init = devsink_base_init,
+			.instance_size = sizeof(BkrDevSink),
+			.instance_init = devsink_instance_init,
+		};
+		type = g_type_register_static(GST_TYPE_BASE_SINK, "BkrDevSink", &info, 0);
+	}
+	return type;
+}
@@ -0,0 +1,141 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                       Backer Device Source and Sink
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef __BKR_DEVICE_H__
+#define __BKR_DEVICE_H__
+
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/base/gstpushsrc.h>
+#include <backer.h>
+
+
+G_BEGIN_DECLS
+
+
+/*
+ * Source
+ */
+
+
+#define BKR_DEVSRC_TYPE				(bkr_devsrc_get_type())
+#define BKR_DEVSRC(obj)				(G_TYPE_CHECK_INSTANCE_CAST((obj), BKR_DEVSRC_TYPE, BkrDevSrc))
+#define BKR_DEVSRC_CLASS(klass)			(G_TYPE_CHECK_CLASS_CAST((klass), BKR_DEVSRC_TYPE, BkrDevSrcClass))
+#define GST_IS_BKR_DEVSRC(obj)			(G_TYPE_CHECK_INSTANCE_TYPE((obj), BKR_DEVSRC_TYPE))
+#define GST_IS_BKR_DEVSRC_CLASS(klass)		(G_TYPE_CHECK_CLASS_TYPE((klass), BKR_DEVSRC_TYPE))
+
+
+typedef struct {
+	GstPushSrcClass parent_class;
+} BkrDevSrcClass;
+
+
+typedef struct {
+	GstPushSrc parent;
+
+	/*
+	 * properties
+	 */
+
+	gchar *device;
+	gint frames;	/* video frames per buffer */
+	guint timeout;	/* ms, beyond the buffer's own duration */
+
+	/*
+	 * device state
+	 */
+
+	gint fd;
+	GstPoll *poll;
+	GstPollFD pollfd;
+	gint mode;	/* as reported by MTIOCGET */
+	gint frame_size;
+	guint32 overruns;
+
+	/*
+	 * next field number (first field is number 0), and the length of
+	 * a field in GstClockTime units as a fraction
+	 */
+
+	guint64 field_number;
+	gint gst_seconds_per_field_a;
+	gint gst_seconds_per_field_b;
+} BkrDevSrc;
+
+
+GType bkr_devsrc_get_type(void);
+
+
+/*
+ * Sink
+ */
+
+
+#define BKR_DEVSINK_TYPE			(bkr_devsink_get_type())
+#define BKR_DEVSINK(obj)			(G_TYPE_CHECK_INSTANCE_CAST((obj), BKR_DEVSINK_TYPE, BkrDevSink))
+#define BKR_DEVSINK_CLASS(klass)		(G_TYPE_CHECK_CLASS_CAST((klass), BKR_DEVSINK_TYPE, BkrDevSinkClass))
+#define GST_IS_BKR_DEVSINK(obj)			(G_TYPE_CHECK_INSTANCE_TYPE((obj), BKR_DEVSINK_TYPE))
+#define GST_IS_BKR_DEVSINK_CLASS(klass)		(G_TYPE_CHECK_CLASS_TYPE((klass), BKR_DEVSINK_TYPE))
+
+
+typedef struct {
+	GstBaseSinkClass parent_class;
+} BkrDevSinkClass;
+
+
+typedef struct {
+	GstBaseSink parent;
+
+	GstAdapter *adapter;
+
+	/*
+	 * properties
+	 */
+
+	gchar *device;
+	gint frames;	/* video frames per write() */
+	guint timeout;	/* ms, beyond the write's own duration */
+
+	/*
+	 * device state
+	 */
+
+	gint fd;
+	GstPoll *poll;
+	GstPollFD pollfd;
+	gint mode;	/* as reported by MTIOCGET */
+	gint frame_size;
+	gboolean started;	/* BKRIOCSTART done */
+	guint32 underruns;
+} BkrDevSink;
+
+
+GType bkr_devsink_get_type(void);
+
+
+G_END_DECLS
+
+
+#endif	/* __BKR_DEVICE_H__ */
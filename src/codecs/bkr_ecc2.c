@@ -35,10 +35,9 @@
 
 #include <gst/gst.h>
 #include <backer.h>
+#include <bkr_codec.h>
 #include <bkr_elements.h>
-#include <bkr_bytes.h>
 #include <bkr_ecc2.h>
-#include <rs.h>
 
 
 /*
@@ -87,237 +86,315 @@
  *
  * Therefore, 20 parity sectors per group of 255 is probably a huge
  * over-kill.  One could probably reduce it to 10 or even fewer quite
- * safely, thereby increasing the tape capacity by 4% or more.
+ * safely, thereby increasing the tape capacity by 4% or more.  The
+ * defaults are left at the conservative values below for use with
+ * marginal media, but the encoder's "parity" and "group_length"
+ * properties can be used to select a different code.  The choice is
+ * recorded in a descriptor at the start of the record, from which the
+ * decoder configures itself.
  */
 
 
-#define  BLOCK_SIZE         255
+#define  BLOCK_SIZE         BKR_ECC2_BLOCK_SIZE
 #define  PARITY             20
 
 
 /*
- * Header definition
+ * ========================================================================
+ *
+ *              Multi-Sector Forward Error Correction CODEC
+ *
+ * ========================================================================
  */
 
 
-struct bkr_ecc2_header {
-	guint32 length;
-};
+/*
+ * Release the sectors held for low-latency forwarding, and reset the
+ * decoder to the start of a group.
+ */
+
+
+static void release_sectors(BkrECC2Dec *filter)
+{
+	int i;
+
+	if(!filter->sectors)
+		return;
+	for(i = 0; i < filter->codec->format.group_length; i++)
+		if(filter->sectors[i]) {
+			gst_buffer_unref(filter->sectors[i]);
+			filter->sectors[i] = NULL;
+		}
+}
+
+
+static void start_group(BkrECC2Dec *filter)
+{
+	release_sectors(filter);
+	if(filter->codec)
+		bkr_ecc2_decoder_reset(filter->codec);
+	filter->sector_number = 0;
+	filter->forwarded_sectors = 0;
+	filter->forwarded_bytes = 0;
+	filter->group_low_latency = filter->low_latency;
+}
+
+
+#ifndef min
+#define min(x,y) ({ \
+	const typeof(x) _x = (x); \
+	const typeof(y) _y = (y); \
+	(void) (&_x == &_y); \
+	_x < _y ? _x : _y ; \
+})
+#endif
 
 
 /*
- * Format info.
+ * Decode a sector group from the adapter.  data_sectors is the number of
+ * data sectors actually recorded in the group, which is less than the
+ * full complement if it has been shortened.  Note that the buffer
+ * returned by this function does not have any metadata set on it except
+ * its size.  If some of the group's data has already been forwarded by
+ * forward_sector(), only the remainder is returned, and if nothing
+ * remains *srcbuf is set to NULL.  If the decoder corrects a sector that
+ * has already been forwarded, the damage downstream can't be undone, so a
+ * warning is posted and the group counted in late_corrections.
  */
 
 
-static struct bkr_ecc2_format *compute_format(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity)
+static GstFlowReturn decode_group(BkrECC2Dec *filter, int data_sectors, GstBuffer **srcbuf)
 {
-	int sector_capacity;
-	struct bkr_ecc2_format *format;
+	int length;
 
-	switch(bitdensity) {
-	case BKR_LOW:
-		switch(videomode) {
-		case BKR_NTSC:
-			sector_capacity = 716;
-			break;
-		case BKR_PAL:
-			sector_capacity = 884;
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	case BKR_HIGH:
-		switch(videomode) {
-		case BKR_NTSC:
-			sector_capacity = 1844;
-			break;
-		case BKR_PAL:
-			sector_capacity = 2284;
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	default:
-		GST_DEBUG("unrecognized bitdensity");
-		return NULL;
+	/*
+	 * Extract the data from the adapter as a new buffer, and decode it
+	 * in place.
+	 */
+
+	*srcbuf = gst_adapter_take_buffer(filter->adapter, filter->codec->format.group_size);
+	if(!*srcbuf) {
+		GST_DEBUG("gst_adapter_take_buffer() failed");
+		start_group(filter);
+		return GST_FLOW_ERROR;
 	}
 
-	format = malloc(sizeof(*format));
-	if(!format) {
-		GST_DEBUG("memory allocation failure");
-		return NULL;
+	length = bkr_ecc2_decode_group(filter->codec, GST_BUFFER_DATA(*srcbuf), data_sectors, &filter->stats);
+	GST_BUFFER_SIZE(*srcbuf) = length;
+	if(filter->codec->first_corrected_sector < filter->forwarded_sectors) {
+		filter->late_corrections++;
+		GST_ELEMENT_WARNING(filter, STREAM, DECODE, ("low-latency mode sent corrupt data downstream"), ("sector %d of the group was corrected after being forwarded", filter->codec->first_corrected_sector));
 	}
 
-	*format = (struct bkr_ecc2_format) {
-		BLOCK_SIZE * sector_capacity,
-		(BLOCK_SIZE - PARITY) * sector_capacity,
-		PARITY * sector_capacity,
-		(BLOCK_SIZE - PARITY) * sector_capacity - sizeof(struct bkr_ecc2_header),
-		sector_capacity
-	};
+	/*
+	 * Remove whatever has already been sent downstream.
+	 */
 
-	return format;
+	if(filter->forwarded_bytes) {
+		GstBuffer *remainder = NULL;
+
+		if(length > filter->forwarded_bytes)
+			remainder = gst_buffer_create_sub(*srcbuf, filter->forwarded_bytes, length - filter->forwarded_bytes);
+		gst_buffer_unref(*srcbuf);
+		*srcbuf = remainder;
+	}
+	start_group(filter);
+
+	/*
+	 * Done
+	 */
+
+	return GST_FLOW_OK;
 }
 
 
 /*
- * ========================================================================
- *
- *              Multi-Sector Forward Error Correction CODEC
- *
- * ========================================================================
+ * Decode the shortened group at the end of a record.  The sectors
+ * received since the last full group are expanded to a full-length group
+ * (see bkr_ecc2_expand_group()), which is then decoded as usual.
  */
 
 
+static GstFlowReturn decode_short_group(BkrECC2Dec *filter, GstBuffer **srcbuf)
+{
+	int received = filter->sector_number * filter->codec->format.interleave;
+	GstBuffer *group;
+	int data_sectors;
+
+	if(filter->sector_number <= filter->codec->format.parity) {
+		GST_DEBUG("incomplete sector group at end of record, %d sectors discarded", filter->sector_number);
+		gst_adapter_clear(filter->adapter);
+		start_group(filter);
+		*srcbuf = NULL;
+		return GST_FLOW_OK;
+	}
+
+	group = gst_buffer_new_and_alloc(filter->codec->format.group_size);
+	data_sectors = bkr_ecc2_expand_group(filter->codec, GST_BUFFER_DATA(group), gst_adapter_peek(filter->adapter, received), filter->sector_number);
+	gst_adapter_flush(filter->adapter, received);
+	gst_adapter_push(filter->adapter, group);
+
+	return decode_group(filter, data_sectors, srcbuf);
+}
+
+
 /*
- * Header
+ * Low-latency mode.  The code is systematic, so as long as none of the
+ * group's sectors received so far have been flagged as bad, the data
+ * sectors can be sent downstream without waiting for the group to be
+ * decoded.  Once a bad sector is seen, it and everything after it in the
+ * group waits for decode_group().  Sectors are trusted if the sector
+ * codec reports them as good;  errors in them identified later by the
+ * group decoder cannot be repaired in the data already sent, and are
+ * reported by decode_group().
+ *
+ * The last group of a record may be shortened, and its length is not
+ * known until the record ends, so a sector is only known to be a data
+ * sector other than the last (which carries the header) once the sector
+ * parity + 1 places after it has arrived.  Sectors are held until then.
+ * Finally, to avoid sending out the zero padding of a group written by an
+ * encoder that did not shorten its last group, a trailing run of 0s is
+ * always held back.  Its contents are implicit, so all that needs to be
+ * remembered is how much data has been sent.
  */
 
 
-static struct bkr_ecc2_header get_header(const guint8 *data, const struct bkr_ecc2_format *format)
+static GstFlowReturn forward_sector(BkrECC2Dec *filter, GstBuffer *sinkbuf, GstCaps *caps)
 {
-	struct bkr_ecc2_header header;
+	const guint8 *data = GST_BUFFER_DATA(sinkbuf);
+	int length = filter->codec->format.interleave;
+	int held;
+	GstBuffer *srcbuf;
+	GstFlowReturn result;
+
+	/* find the end of the non-zero data, and the amount of data held
+	 * back from previous sectors */
+	while(length && !data[length - 1])
+		length--;
+	held = filter->forwarded_sectors * filter->codec->format.interleave - filter->forwarded_bytes;
+	filter->forwarded_sectors++;
+	if(!length)
+		return GST_FLOW_OK;
+
+	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, held + length, caps, &srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_alloc_buffer() failed");
+		return result;
+	}
+	memset(GST_BUFFER_DATA(srcbuf), 0, held);
+	memcpy(GST_BUFFER_DATA(srcbuf) + held, data, length);
+	filter->forwarded_bytes += held + length;
 
-	memcpy(&header, data + format->capacity, sizeof(header));
-	header.length = __le32_to_cpu(header.length);
+	result = gst_pad_push(filter->srcpad, srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_push() failed");
+		return result;
+	}
 
-	return header;
+	return GST_FLOW_OK;
 }
 
 
-static void put_header(guint8 *data, const struct bkr_ecc2_format *format, int length)
+static GstFlowReturn forward_sectors(BkrECC2Dec *filter, GstCaps *caps)
 {
-	struct bkr_ecc2_header header = {.length = length};
+	GstFlowReturn result;
 
-	header.length = __cpu_to_le32(header.length);
-	memcpy(data + format->capacity, &header, sizeof(header));
+	if(!filter->group_low_latency || filter->descriptor_sectors < BKR_ECC2_DESCRIPTOR_COPIES)
+		return GST_FLOW_OK;
+
+	while(filter->forwarded_sectors + filter->codec->format.parity + 1 < filter->sector_number && filter->forwarded_sectors < filter->codec->first_bad_sector) {
+		result = forward_sector(filter, filter->sectors[filter->forwarded_sectors], caps);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("forward_sector() failed");
+			return result;
+		}
+	}
+
+	return GST_FLOW_OK;
 }
 
 
 /*
- * Decode a sector from the adapter.  Note that the buffer returned by this
- * function does not have any metadata set on it except its size.
+ * Write the record descriptor.
  */
 
 
-static GstFlowReturn decode_group(BkrECC2Dec *filter, GstBuffer **srcbuf)
+static GstFlowReturn write_descriptor(BkrECC2Enc *filter, GstCaps *caps)
 {
-	guint8 *data;
-	int block;
-	int corrections;
-	struct bkr_ecc2_header header;
-
-	/*
-	 * Extract the data from the adapter as a new buffer.
-	 */
+	GstBuffer *srcbuf;
+	int i;
+	GstFlowReturn result;
 
-	*srcbuf = gst_adapter_take_buffer(filter->adapter, filter->format->group_size);
-	if(!*srcbuf) {
-		GST_DEBUG("gst_adapter_take_buffer() failed");
-		return GST_FLOW_ERROR;
+	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, BKR_ECC2_DESCRIPTOR_COPIES * filter->codec->format.interleave, caps, &srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_alloc_buffer() failed");
+		return result;
 	}
-	data = GST_BUFFER_DATA(*srcbuf);
 
-	/*
-	 * Do error correction.
-	 */
+	for(i = 0; i < BKR_ECC2_DESCRIPTOR_COPIES; i++)
+		bkr_ecc2_encode_descriptor(&filter->codec->format, GST_BUFFER_DATA(srcbuf) + i * filter->codec->format.interleave);
 
-	/* This pre-processor conditional disables error correction.
-	 * Useful for confirming that the decoding pipeline is, infact, the
-	 * inverse of the encoding pipeline (the error corrector could be
-	 * hiding off-by-one problems by just fixing the data). */
-#if 1
-	for(block = 0; block < filter->format->interleave; block++) {
-		memcpy(filter->rs_format->erasure, filter->erasure, filter->num_erasure * sizeof(gf));
-		corrections = reed_solomon_decode(data + filter->format->data_size + block, data + block, filter->num_erasure, *filter->rs_format);
-		if(corrections < 0) {
-			/* uncorrectable block.  ignore, there's nothing we
-			 * can do at this point anyway. */
-			continue;
-		}
-		if(corrections > filter->worst_group)
-			filter->worst_group = corrections;
-		if(corrections > filter->num_erasure) {
-			/* error corrector identified additional corrupt
-			 * sectors, beyond what the sector decoder told us
-			 * about.  add them to our list, and pass them in
-			 * as erasures for the next block.  */
-			filter->extra_errors += corrections - filter->num_erasure;
-			memcpy(filter->erasure, filter->rs_format->erasure, corrections * sizeof(gf));
-			filter->num_erasure = corrections;
-		}
+	result = gst_pad_push(filter->srcpad, srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_push() failed");
+		return result;
 	}
-#endif
-	filter->num_erasure = 0;
-
-	/*
-	 * Retrieve header, and resize the buffer.
-	 */
 
-	header = get_header(data, filter->format);
-	GST_BUFFER_SIZE(*srcbuf) = header.length;
-
-	/*
-	 * Done
-	 */
+	filter->descriptor_written = TRUE;
 
 	return GST_FLOW_OK;
 }
 
 
 /*
- * Write a (possibly short) sector group.  Takes as much data as will fit
- * into a sector group from the filter's adapter, encodes it, and pushes it
- * out the srcpad.  If there isn't enough data in the adapter to fill a
- * sector group then the data is padded to fill one.  This is a waste of
- * tape if this is not the end of the input stream.
+ * Write a data sector.  Takes as much data as will fit into the next
+ * sector of the current group from the filter's adapter, encodes it, and
+ * pushes it out the srcpad.  If there isn't enough data in the adapter to
+ * fill the sector then it is padded with 0s.  This is a waste of tape if
+ * this is not the end of the input stream.  Once the group's last data
+ * sector has been written the parity sectors are written.  If last is
+ * TRUE, the group is shortened to end with this sector (see
+ * bkr_ecc2_encode_sector()).
  */
 
 
-#ifndef min
-#define min(x,y) ({ \
-	const typeof(x) _x = (x); \
-	const typeof(y) _y = (y); \
-	(void) (&_x == &_y); \
-	_x < _y ? _x : _y ; \
-})
-#endif
-
-
-static GstFlowReturn write_group(BkrECC2Enc *filter, GstCaps *caps)
+static GstFlowReturn write_parity(BkrECC2Enc *filter, GstCaps *caps)
 {
-	size_t size = min(gst_adapter_available(filter->adapter), (unsigned) filter->format->capacity);
 	GstBuffer *srcbuf;
-	const guint8 *data;
-	int block;
 	GstFlowReturn result;
 
-	data = gst_adapter_peek(filter->adapter, size);
-
-	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, filter->format->group_size, caps, &srcbuf);
+	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, filter->codec->format.parity_size, caps, &srcbuf);
 	if(result != GST_FLOW_OK) {
 		GST_DEBUG("gst_pad_alloc_buffer() failed");
 		return result;
 	}
 
-	/* copy data from adapter into buffer */
-	memcpy(GST_BUFFER_DATA(srcbuf), data, size);
+	/* also starts the next group */
+	bkr_ecc2_encode_parity(filter->codec, GST_BUFFER_DATA(srcbuf));
+
+	result = gst_pad_push(filter->srcpad, srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_push() failed");
+		return result;
+	}
+
+	return GST_FLOW_OK;
+}
 
-	/* pad with 0 if short */
-	memset(GST_BUFFER_DATA(srcbuf) + size, 0, filter->format->capacity - size);
 
-	/* insert the header */
-	put_header(GST_BUFFER_DATA(srcbuf), filter->format, size);
+static GstFlowReturn write_sector(BkrECC2Enc *filter, GstCaps *caps, gboolean last)
+{
+	size_t size = min(gst_adapter_available(filter->adapter), (unsigned) filter->codec->format.interleave);
+	GstBuffer *srcbuf;
+	GstFlowReturn result;
 
-	/* compute parity */
-	for(block = 0; block < filter->format->interleave; block++)
-		reed_solomon_encode(GST_BUFFER_DATA(srcbuf) + filter->format->data_size + block, GST_BUFFER_DATA(srcbuf) + block, *filter->rs_format);
+	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, filter->codec->format.interleave, caps, &srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_alloc_buffer() failed");
+		return result;
+	}
 
+	size = bkr_ecc2_encode_sector(filter->codec, GST_BUFFER_DATA(srcbuf), gst_adapter_peek(filter->adapter, size), size, &last);
 	gst_adapter_flush(filter->adapter, size);
 
 	/* transmit buffer */
@@ -327,6 +404,15 @@ static GstFlowReturn write_group(BkrECC2Enc *filter, GstCaps *caps)
 		return result;
 	}
 
+	/* end of group? */
+	if(last) {
+		result = write_parity(filter, caps);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("write_parity() failed");
+			return result;
+		}
+	}
+
 	return GST_FLOW_OK;
 }
 
@@ -340,6 +426,49 @@ static GstFlowReturn write_group(BkrECC2Enc *filter, GstCaps *caps)
  */
 
 
+/*
+ * Properties
+ */
+
+
+enum enc_property {
+	ARG_ENC_GROUP_LENGTH = 1,
+	ARG_ENC_PARITY
+};
+
+
+static void enc_set_property(GObject *object, enum enc_property id, const GValue *value, GParamSpec *pspec)
+{
+	BkrECC2Enc *filter = BKR_ECC2ENC(object);
+
+	switch(id) {
+	case ARG_ENC_GROUP_LENGTH:
+		filter->group_length = g_value_get_int(value);
+		break;
+
+	case ARG_ENC_PARITY:
+		filter->parity_sectors = g_value_get_int(value);
+		break;
+	}
+}
+
+
+static void enc_get_property(GObject *object, enum enc_property id, GValue *value, GParamSpec *pspec)
+{
+	BkrECC2Enc *filter = BKR_ECC2ENC(object);
+
+	switch(id) {
+	case ARG_ENC_GROUP_LENGTH:
+		g_value_set_int(value, filter->group_length);
+		break;
+
+	case ARG_ENC_PARITY:
+		g_value_set_int(value, filter->parity_sectors);
+		break;
+	}
+}
+
+
 /*
  * Sink pad setcaps function.  See
  *
@@ -347,7 +476,7 @@ static GstFlowReturn write_group(BkrECC2Enc *filter, GstCaps *caps)
  */
 
 
-static struct bkr_ecc2_format *caps_to_format(GstCaps *caps)
+static gboolean caps_to_format(GstCaps *caps, int group_length, int parity, struct bkr_ecc2_format *format)
 {
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
@@ -355,38 +484,40 @@ static struct bkr_ecc2_format *caps_to_format(GstCaps *caps)
 
 	if(!bkr_parse_caps(caps, &videomode, &bitdensity, &sectorformat)) {
 		GST_DEBUG("failure parsing caps");
-		return NULL;
+		return FALSE;
 	}
 
 	if(sectorformat != BKR_EP) {
 		GST_DEBUG("sectorformat != BKR_EP");
-		return NULL;
+		return FALSE;
 	}
 
-	return compute_format(videomode, bitdensity);
+	if(bkr_ecc2_format(format, bkr_ecc2_sector_capacity(videomode, bitdensity), group_length, parity) < 0) {
+		GST_DEBUG("invalid code geometry:  group_length = %d, parity = %d", group_length, parity);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 
 static gboolean enc_setcaps(GstPad *pad, GstCaps *caps)
 {
 	BkrECC2Enc *filter = BKR_ECC2ENC(gst_pad_get_parent(pad));
+	struct bkr_ecc2_format format;
 	gboolean result;
 
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-
-	free(filter->format);
-	filter->format = caps_to_format(caps);
-	if(filter->format) {
-		filter->rs_format = reed_solomon_codec_new((filter->format->data_size + filter->format->parity_size) / filter->format->interleave, filter->format->data_size / filter->format->interleave, filter->format->interleave);
-		if(!filter->rs_format) {
-			GST_DEBUG("reed_solomon_codec_new() failed");
-			free(filter->format);
-			filter->format = NULL;
-		}
+	bkr_ecc2_encoder_free(filter->codec);
+	filter->codec = NULL;
+	filter->descriptor_written = FALSE;
+
+	if(caps_to_format(caps, filter->group_length, filter->parity_sectors, &format)) {
+		filter->codec = bkr_ecc2_encoder_new(&format);
+		if(!filter->codec)
+			GST_DEBUG("bkr_ecc2_encoder_new() failed");
 	}
 
-	result = filter->format ? TRUE : FALSE;
+	result = filter->codec ? TRUE : FALSE;
 
 	gst_object_unref(filter);
 
@@ -403,14 +534,37 @@ static gboolean enc_setcaps(GstPad *pad, GstCaps *caps)
 
 static GstFlowReturn enc_flush(BkrECC2Enc *filter, GstCaps *caps)
 {
+	GstFlowReturn result;
+
+	/*
+	 * EOS can arrive before caps, e.g. from an empty input, in which
+	 * case there's no codec and nothing has been written.
+	 */
+
+	if(!filter->codec)
+		return GST_FLOW_OK;
+
 	/*
-	 * write the last group if there's any data
+	 * write any remaining data, and end the last group.  if the data
+	 * won't fit in one sector with the header, the header goes in a
+	 * sector of its own.
 	 */
 
-	while(gst_adapter_available(filter->adapter)) {
-		GstFlowReturn result = write_group(filter, caps);
+	if(!gst_adapter_available(filter->adapter) && !filter->codec->sector_number)
+		return GST_FLOW_OK;
+
+	if((int) gst_adapter_available(filter->adapter) > bkr_ecc2_encoder_room(filter->codec, TRUE)) {
+		result = write_sector(filter, caps, FALSE);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("write_sector() failed");
+			return result;
+		}
+	}
+
+	if(gst_adapter_available(filter->adapter) || filter->codec->sector_number) {
+		result = write_sector(filter, caps, TRUE);
 		if(result != GST_FLOW_OK) {
-			GST_DEBUG("write_group() failed");
+			GST_DEBUG("write_sector() failed");
 			return result;
 		}
 	}
@@ -484,10 +638,18 @@ static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
 
 	gst_adapter_push(filter->adapter, sinkbuf);
 
-	while((int) gst_adapter_available(filter->adapter) >= filter->format->capacity) {
-		result = write_group(filter, caps);
+	if(!filter->descriptor_written) {
+		result = write_descriptor(filter, caps);
 		if(result != GST_FLOW_OK) {
-			GST_DEBUG("write_group() failed");
+			GST_DEBUG("failure writing record descriptor");
+			goto done;
+		}
+	}
+
+	while((int) gst_adapter_available(filter->adapter) >= bkr_ecc2_encoder_room(filter->codec, FALSE)) {
+		result = write_sector(filter, caps, FALSE);
+		if(result != GST_FLOW_OK) {
+			GST_DEBUG("write_sector() failed");
 			goto done;
 		}
 	}
@@ -522,10 +684,8 @@ static void enc_finalize(GObject *object)
 	filter->adapter = NULL;
 	gst_object_unref(filter->srcpad);
 	filter->srcpad = NULL;
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-	free(filter->format);
-	filter->format = NULL;
+	bkr_ecc2_encoder_free(filter->codec);
+	filter->codec = NULL;
 
 	G_OBJECT_CLASS(enc_parent_class)->finalize(object);
 }
@@ -563,6 +723,8 @@ static void enc_base_init(gpointer class)
 
 	gst_element_class_set_details(element_class, &plugin_details);
 
+	object_class->set_property = enc_set_property;
+	object_class->get_property = enc_get_property;
 	object_class->finalize = enc_finalize;
 
 	gst_element_class_add_pad_template(element_class, sinkpad_template);
@@ -579,6 +741,11 @@ static void enc_base_init(gpointer class)
 
 static void enc_class_init(gpointer class, gpointer class_data)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+	g_object_class_install_property(object_class, ARG_ENC_GROUP_LENGTH, g_param_spec_int("group_length", "Group length", "Number of sectors in a sector group", 2, BLOCK_SIZE, BLOCK_SIZE, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_ENC_PARITY, g_param_spec_int("parity", "Parity", "Number of parity sectors in a sector group", 1, BLOCK_SIZE - 1, PARITY, G_PARAM_READWRITE));
+
 	enc_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 }
 
@@ -613,8 +780,10 @@ static void enc_instance_init(GTypeInstance *object, gpointer class)
 
 	/* internal state */
 	filter->adapter = gst_adapter_new();
-	filter->rs_format = NULL;
-	filter->format = NULL;
+	filter->codec = NULL;
+	filter->group_length = BLOCK_SIZE;
+	filter->parity_sectors = PARITY;
+	filter->descriptor_written = FALSE;
 }
 
 
@@ -657,7 +826,9 @@ GType bkr_ecc2enc_get_type(void)
 
 enum property {
 	ARG_DEC_WORST_GROUP = 1,
-	ARG_DEC_EXTRA_ERRORS
+	ARG_DEC_EXTRA_ERRORS,
+	ARG_DEC_LOW_LATENCY,
+	ARG_DEC_LATE_CORRECTIONS
 };
 
 
@@ -667,11 +838,19 @@ static void dec_set_property(GObject *object, enum property id, const GValue *va
 
 	switch(id) {
 	case ARG_DEC_WORST_GROUP:
-		filter->worst_group = g_value_get_int(value);
+		filter->stats.worst_group = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_EXTRA_ERRORS:
-		filter->extra_errors = g_value_get_int(value);
+		filter->stats.extra_errors = g_value_get_int(value);
+		break;
+
+	case ARG_DEC_LOW_LATENCY:
+		filter->low_latency = g_value_get_boolean(value);
+		break;
+
+	case ARG_DEC_LATE_CORRECTIONS:
+		filter->late_corrections = g_value_get_int(value);
 		break;
 	}
 }
@@ -683,11 +862,19 @@ static void dec_get_property(GObject *object, enum property id, GValue *value, G
 
 	switch(id) {
 	case ARG_DEC_WORST_GROUP:
-		g_value_set_int(value, filter->worst_group);
+		g_value_set_int(value, filter->stats.worst_group);
 		break;
 
 	case ARG_DEC_EXTRA_ERRORS:
-		g_value_set_int(value, filter->extra_errors);
+		g_value_set_int(value, filter->stats.extra_errors);
+		break;
+
+	case ARG_DEC_LOW_LATENCY:
+		g_value_set_boolean(value, filter->low_latency);
+		break;
+
+	case ARG_DEC_LATE_CORRECTIONS:
+		g_value_set_int(value, filter->late_corrections);
 		break;
 	}
 }
@@ -702,45 +889,61 @@ static void dec_get_property(GObject *object, enum property id, GValue *value, G
 
 static void reset_statistics(BkrECC2Dec *filter)
 {
-	filter->worst_group = 0;
-	filter->extra_errors = 0;
+	filter->stats.worst_group = 0;
+	filter->stats.extra_errors = 0;
+	filter->late_corrections = 0;
+}
+
+
+/*
+ * Replace the decoder's codec with one for the given format, or with none
+ * if format is NULL.  On failure, the decoder is left without a codec.
+ */
+
+
+static gboolean set_format(BkrECC2Dec *filter, const struct bkr_ecc2_format *format)
+{
+	if(filter->codec)
+		start_group(filter);
+	free(filter->sectors);
+	filter->sectors = NULL;
+
+	bkr_ecc2_decoder_free(filter->codec);
+	filter->codec = NULL;
+
+	if(format) {
+		filter->codec = bkr_ecc2_decoder_new(format);
+		filter->sectors = calloc(format->group_length, sizeof(*filter->sectors));
+		if(!filter->codec || !filter->sectors) {
+			GST_DEBUG("bkr_ecc2_decoder_new() or calloc() failed");
+			bkr_ecc2_decoder_free(filter->codec);
+			filter->codec = NULL;
+			free(filter->sectors);
+			filter->sectors = NULL;
+		}
+	}
+	start_group(filter);
+
+	return filter->codec ? TRUE : FALSE;
 }
 
 
 static gboolean dec_setcaps(GstPad *pad, GstCaps *caps)
 {
 	BkrECC2Dec *filter = BKR_ECC2DEC(gst_pad_get_parent(pad));
+	struct bkr_ecc2_format format;
 	gboolean result;
 
 	gst_adapter_clear(filter->adapter);
 
-	filter->sector_number = 0;
+	filter->next_sector_invalid = FALSE;
+	filter->descriptor_sectors = 0;
+	filter->have_descriptor = FALSE;
 	reset_statistics(filter);
 
-	reed_solomon_codec_free(filter->rs_format);
-
-	free(filter->erasure);
-	filter->erasure = NULL;
-	filter->num_erasure = 0;
-
-	free(filter->format);
-	filter->format = caps_to_format(caps);
-
-	if(filter->format) {
-		filter->rs_format = reed_solomon_codec_new((filter->format->data_size + filter->format->parity_size) / filter->format->interleave, filter->format->data_size / filter->format->interleave, filter->format->interleave);
-		filter->erasure = malloc(PARITY * sizeof(*filter->erasure));
-		if(!filter->rs_format || !filter->erasure) {
-			GST_DEBUG("reed_solomon_codec_new() or malloc() failed");
-			free(filter->format);
-			filter->format = NULL;
-			reed_solomon_codec_free(filter->rs_format);
-			filter->rs_format = NULL;
-			free(filter->erasure);
-			filter->erasure = NULL;
-		}
-	}
-
-	result = filter->format ? TRUE : FALSE;
+	/* until the record descriptor tells us otherwise, assume the
+	 * default code */
+	result = set_format(filter, caps_to_format(caps, BLOCK_SIZE, PARITY, &format) ? &format : NULL);
 
 	gst_object_unref(filter);
 
@@ -748,6 +951,69 @@ static gboolean dec_setcaps(GstPad *pad, GstCaps *caps)
 }
 
 
+/*
+ * Record descriptor processing.  The first BKR_ECC2_DESCRIPTOR_COPIES sectors of a
+ * record are examined for a descriptor, and the first valid one found
+ * configures the decoder.  Until one is found, sectors are treated as
+ * data so that recordings made without a descriptor can still be
+ * decoded with the default code.  data = NULL indicates a skipped sector.
+ * On return, *discard is TRUE if the sector is part of the descriptor and
+ * should not be treated as data.
+ */
+
+
+static GstFlowReturn process_descriptor_sector(BkrECC2Dec *filter, const guint8 *data, gboolean valid, gboolean *discard)
+{
+	int group_length, parity;
+	struct bkr_ecc2_format format;
+
+	*discard = FALSE;
+
+	if(filter->descriptor_sectors >= BKR_ECC2_DESCRIPTOR_COPIES)
+		return GST_FLOW_OK;
+	filter->descriptor_sectors++;
+
+	if(filter->have_descriptor) {
+		/* redundant copy */
+		*discard = TRUE;
+		return GST_FLOW_OK;
+	}
+
+	if(!data || !valid)
+		/* can't tell yet */
+		return GST_FLOW_OK;
+
+	switch(bkr_ecc2_decode_descriptor(data, &group_length, &parity)) {
+	case 0:
+		/* no descriptor in this recording */
+		filter->descriptor_sectors = BKR_ECC2_DESCRIPTOR_COPIES;
+		return GST_FLOW_OK;
+
+	case 1:
+		if(!bkr_ecc2_format(&format, filter->codec->format.interleave, group_length, parity))
+			break;
+		/* fall through */
+
+	default:
+		GST_DEBUG("ignoring unusable record descriptor");
+		*discard = TRUE;
+		return GST_FLOW_OK;
+	}
+
+	if(!set_format(filter, &format)) {
+		GST_ELEMENT_ERROR(filter, CORE, FAILED, ("failure configuring decoder from record descriptor"), (NULL));
+		return GST_FLOW_ERROR;
+	}
+
+	/* anything received so far was the descriptor */
+	gst_adapter_clear(filter->adapter);
+	filter->have_descriptor = TRUE;
+	*discard = TRUE;
+
+	return GST_FLOW_OK;
+}
+
+
 /*
  * Event function.  See
  *
@@ -755,25 +1021,69 @@ static gboolean dec_setcaps(GstPad *pad, GstCaps *caps)
  */
 
 
+static GstFlowReturn push_group(BkrECC2Dec *filter, GstCaps *caps)
+{
+	int data_sectors = filter->codec->format.group_length - filter->codec->format.parity;
+	GstBuffer *srcbuf;
+	GstFlowReturn result;
+
+	/*
+	 * a full group, or the record's last group which has been
+	 * shortened.
+	 */
+
+	if(filter->sector_number == filter->codec->format.group_length)
+		result = decode_group(filter, data_sectors, &srcbuf);
+	else
+		result = decode_short_group(filter, &srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("decode_group() failed");
+		return result;
+	}
+	if(!srcbuf)
+		return GST_FLOW_OK;
+
+	gst_buffer_set_caps(srcbuf, caps);
+	result = gst_pad_push(filter->srcpad, srcbuf);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("gst_pad_push() failed");
+		return result;
+	}
+
+	return GST_FLOW_OK;
+}
+
+
 static gboolean dec_event(GstPad *pad, GstEvent *event)
 {
 	BkrECC2Dec *filter = BKR_ECC2DEC(gst_pad_get_parent(pad));
 	GstBuffer *zero_padding;
+	gboolean discard;
 	gboolean result;
 
 	switch(GST_EVENT_TYPE(event)) {
 	case GST_EVENT_CUSTOM_DOWNSTREAM:
 		switch(bkr_event_parse(event)) {
 		case BKR_EVENT_SKIPPED_SECTOR:
-			zero_padding = gst_buffer_new_and_alloc(filter->format->interleave);
+			gst_event_unref(event);
+			if(process_descriptor_sector(filter, NULL, FALSE, &discard) != GST_FLOW_OK) {
+				result = FALSE;
+				break;
+			}
+			result = TRUE;
+			if(discard)
+				break;
+			zero_padding = gst_buffer_new_and_alloc(filter->codec->format.interleave);
 			memset(GST_BUFFER_DATA(zero_padding), 0, GST_BUFFER_SIZE(zero_padding));
 			gst_adapter_push(filter->adapter, zero_padding);
-			filter->erasure[filter->num_erasure++] = filter->sector_number++;
-			result = TRUE;
+			bkr_ecc2_add_erasure(filter->codec, filter->sector_number++);
+			if(filter->sector_number == filter->codec->format.group_length)
+				result = push_group(filter, GST_PAD_CAPS(pad)) == GST_FLOW_OK;
 			break;
 
 		case BKR_EVENT_NEXT_SECTOR_INVALID:
-			filter->erasure[filter->num_erasure++] = filter->sector_number;
+			gst_event_unref(event);
+			filter->next_sector_invalid = TRUE;
 			result = TRUE;
 			break;
 
@@ -784,6 +1094,22 @@ static gboolean dec_event(GstPad *pad, GstEvent *event)
 		}
 		break;
 
+	case GST_EVENT_EOS:
+		/*
+		 * decode the last group, then forward the end-of-stream
+		 * event.
+		 */
+
+		if(filter->codec && filter->sector_number && push_group(filter, GST_PAD_CAPS(pad)) != GST_FLOW_OK) {
+			GST_DEBUG("push_group() failed");
+			gst_event_unref(event);
+			result = FALSE;
+			break;
+		}
+
+		result = gst_pad_push_event(filter->srcpad, event);
+		break;
+
 	default:
 		result = gst_pad_event_default(pad, event);
 		break;
@@ -805,7 +1131,7 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 {
 	BkrECC2Dec *filter = BKR_ECC2DEC(gst_pad_get_parent(pad));
 	GstCaps *caps = gst_buffer_get_caps(sinkbuf);
-	GstPad *srcpad = filter->srcpad;
+	gboolean discard;
 	GstFlowReturn result;
 
 	if(!caps || (caps != GST_PAD_CAPS(pad))) {
@@ -817,29 +1143,40 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
-	if((int) GST_BUFFER_SIZE(sinkbuf) != filter->format->interleave) {
-		GST_ELEMENT_ERROR(filter, STREAM, FAILED, ("recieved incorrect buffer size, got %d bytes expected %d bytes", GST_BUFFER_SIZE(sinkbuf), filter->format->interleave), (NULL));
+	if((int) GST_BUFFER_SIZE(sinkbuf) != filter->codec->format.interleave) {
+		GST_ELEMENT_ERROR(filter, STREAM, FAILED, ("recieved incorrect buffer size, got %d bytes expected %d bytes", GST_BUFFER_SIZE(sinkbuf), filter->codec->format.interleave), (NULL));
 		gst_buffer_unref(sinkbuf);
 		result = GST_FLOW_ERROR;
 		goto done;
 	}
 
-	gst_adapter_push(filter->adapter, sinkbuf);
+	result = process_descriptor_sector(filter, GST_BUFFER_DATA(sinkbuf), !filter->next_sector_invalid, &discard);
+	if(result != GST_FLOW_OK || discard) {
+		filter->next_sector_invalid = FALSE;
+		gst_buffer_unref(sinkbuf);
+		goto done;
+	}
 
+	if(filter->next_sector_invalid) {
+		bkr_ecc2_add_erasure(filter->codec, filter->sector_number);
+		filter->next_sector_invalid = FALSE;
+	}
+
+	if(filter->group_low_latency)
+		filter->sectors[filter->sector_number] = gst_buffer_ref(sinkbuf);
+	gst_adapter_push(filter->adapter, sinkbuf);
 	filter->sector_number++;
 
-	if((int) gst_adapter_available(filter->adapter) >= filter->format->group_size) {
-		GstBuffer *srcbuf;
-		result = decode_group(filter, &srcbuf);
-		filter->sector_number = 0;
-		if(result != GST_FLOW_OK) {
-			GST_DEBUG("decode_group() failed");
-			goto done;
-		}
-		gst_buffer_set_caps(srcbuf, caps);
-		result = gst_pad_push(srcpad, srcbuf);
+	result = forward_sectors(filter, caps);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("forward_sectors() failed");
+		goto done;
+	}
+
+	if(filter->sector_number == filter->codec->format.group_length) {
+		result = push_group(filter, caps);
 		if(result != GST_FLOW_OK) {
-			GST_DEBUG("gst_pad_push() failed");
+			GST_DEBUG("push_group() failed");
 			goto done;
 		}
 	}
@@ -874,12 +1211,11 @@ static void dec_finalize(GObject *object)
 	filter->adapter = NULL;
 	gst_object_unref(filter->srcpad);
 	filter->srcpad = NULL;
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-	free(filter->erasure);
-	filter->erasure = NULL;
-	free(filter->format);
-	filter->format = NULL;
+	release_sectors(filter);
+	free(filter->sectors);
+	filter->sectors = NULL;
+	bkr_ecc2_decoder_free(filter->codec);
+	filter->codec = NULL;
 
 	G_OBJECT_CLASS(dec_parent_class)->finalize(object);
 }
@@ -939,6 +1275,8 @@ static void dec_class_init(gpointer class, gpointer class_data)
 
 	g_object_class_install_property(object_class, ARG_DEC_WORST_GROUP, g_param_spec_int("worst_group", "Worst group", "Worst group", 0, INT_MAX, 0, G_PARAM_READWRITE));
 	g_object_class_install_property(object_class, ARG_DEC_EXTRA_ERRORS, g_param_spec_int("extra_errors", "Extra errors", "Extra errors", 0, INT_MAX, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_LOW_LATENCY, g_param_spec_boolean("low_latency", "Low latency", "Forward good data sectors without waiting for the rest of the sector group (takes effect at the next group).  Errors the sector codec missed in forwarded sectors cannot be corrected, see late_corrections", FALSE, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_LATE_CORRECTIONS, g_param_spec_int("late_corrections", "Late corrections", "Sector groups in which low-latency mode forwarded data later found to be bad", 0, INT_MAX, 0, G_PARAM_READWRITE));
 
 	dec_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 }
@@ -974,11 +1312,16 @@ static void dec_instance_init(GTypeInstance *object, gpointer class)
 
 	/* internal state */
 	filter->adapter = gst_adapter_new();
-	filter->rs_format = NULL;
-	filter->format = NULL;
-	filter->erasure = NULL;
-	filter->num_erasure = 0;
+	filter->codec = NULL;
+	filter->sectors = NULL;
 	filter->sector_number = 0;
+	filter->next_sector_invalid = FALSE;
+	filter->descriptor_sectors = 0;
+	filter->have_descriptor = FALSE;
+	filter->low_latency = FALSE;
+	filter->group_low_latency = FALSE;
+	filter->forwarded_sectors = 0;
+	filter->forwarded_bytes = 0;
 	reset_statistics(filter);
 }
 
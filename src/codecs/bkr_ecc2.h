@@ -28,7 +28,7 @@
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
 #include <backer.h>
-#include <rs.h>
+#include <bkr_codec.h>
 
 
 G_BEGIN_DECLS
@@ -61,15 +61,14 @@ typedef struct {
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
 
-	rs_format_t *rs_format;
+	struct bkr_ecc2_encoder *codec;
 
-	struct bkr_ecc2_format {
-		int group_size;
-		int data_size;
-		int parity_size;
-		int capacity;
-		int interleave;
-	} *format;
+	/* requested code geometry, in sectors */
+	int group_length;
+	int parity_sectors;
+
+	/* the record descriptor has been written */
+	gboolean descriptor_written;
 } BkrECC2Enc;
 
 
@@ -103,22 +102,35 @@ typedef struct {
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
 
-	struct bkr_ecc2_format *format;
-
-	rs_format_t *rs_format;
-
-	/* erasure vector and length for use by Reed-Solomon decoder */
-	gf *erasure;
-	int  num_erasure;
+	struct bkr_ecc2_decoder *codec;
 
 	/* the number within the group of the next sector to be received */
 	int sector_number;
 
-	/* most sectors requiring correction in a sector group */
-	int  worst_group;
+	/* the next sector has been flagged as invalid by the sector codec */
+	gboolean next_sector_invalid;
+
+	/* number of sectors received so far in the record descriptor, and
+	 * whether or not a valid descriptor has been found */
+	int descriptor_sectors;
+	gboolean have_descriptor;
+
+	/* forward good data sectors as they arrive.  the property is
+	 * latched into group_low_latency at the start of each group */
+	gboolean low_latency;
+	gboolean group_low_latency;
+
+	/* the group's sectors held for low-latency mode, and the number of
+	 * them and of bytes already sent downstream */
+	GstBuffer **sectors;
+	int forwarded_sectors;
+	int forwarded_bytes;
+
+	/* groups in which data already sent downstream was found to be
+	 * bad */
+	int late_corrections;
 
-	/* number of bad sectors not identified as such by the sector codec */
-	unsigned long  extra_errors;
+	struct bkr_ecc2_stats stats;
 } BkrECC2Dec;
 
 
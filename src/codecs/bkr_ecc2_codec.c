@@ -0,0 +1,624 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                   Sector Drop-Out Error Correction Codec
+ *
+ * Copyright (C) 2000,2001,2002,2008  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * ========================================================================
+ *
+ *                                  Preamble
+ *
+ * ========================================================================
+ */
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include <backer.h>
+#include <bkr_bytes.h>
+#include <bkr_codec.h>
+#include <rs.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                              Parameters
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * The Reed-Solomon code words run down the columns of a sector group, one
+ * symbol per sector, so walking one in place touches a new cache line for
+ * every symbol.  Instead, the group is processed TILE_COLUMNS code words
+ * at a time by transposing them into a work buffer in which each code
+ * word is contiguous.  Each row of a tile is then a single cache line of
+ * the group, and a tile of 255 sector code words fits in L1 cache.
+ */
+
+
+#define  TILE_COLUMNS       64
+
+
+/*
+ * Header definition.  On tape, the header is a single little-endian 32 bit
+ * word at the end of the group's last data sector.  The low
+ * HEADER_LENGTH_BITS bits hold the number of bytes of data in the group.
+ * The high bits hold the number of data sectors if the group has been
+ * shortened, or 0 for a full-length group.
+ */
+
+
+#define  HEADER_SIZE        4
+#define  HEADER_LENGTH_BITS 24
+
+
+struct bkr_ecc2_header {
+	int length;
+	int data_sectors;
+};
+
+
+/*
+ * Record descriptor definition.  The descriptor occupies the start of
+ * each of the first BKR_ECC2_DESCRIPTOR_COPIES sectors of a record, the remainder
+ * of those sectors being 0.  Several copies are written so that the loss
+ * of one of them does not leave the decoder guessing at the format.
+ */
+
+
+#define  DESCRIPTOR_MAGIC   "BKRECC2"
+#define  DESCRIPTOR_VERSION 1
+
+
+struct bkr_ecc2_descriptor {
+	unsigned char magic[8];
+	__u32 version;
+	__u32 group_length;
+	__u32 parity;
+};
+
+
+/*
+ * ========================================================================
+ *
+ *                              Format Info
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Sector capacity for the given mode, or < 0 if the mode is not
+ * recognized.
+ */
+
+
+int bkr_ecc2_sector_capacity(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity)
+{
+	switch(bitdensity) {
+	case BKR_LOW:
+		switch(videomode) {
+		case BKR_NTSC:
+			return 716;
+		case BKR_PAL:
+			return 884;
+		default:
+			return -1;
+		}
+	case BKR_HIGH:
+		switch(videomode) {
+		case BKR_NTSC:
+			return 1844;
+		case BKR_PAL:
+			return 2284;
+		default:
+			return -1;
+		}
+	default:
+		return -1;
+	}
+}
+
+
+/*
+ * Fill in the format for a code of group_length sectors, parity of them
+ * parity sectors.  Returns 0 on success, or < 0 if the geometry is
+ * invalid.
+ */
+
+
+int bkr_ecc2_format(struct bkr_ecc2_format *format, int sector_capacity, int group_length, int parity)
+{
+	if(sector_capacity <= 0)
+		return -1;
+
+	if(group_length > BKR_ECC2_BLOCK_SIZE || parity < 1 || parity >= group_length)
+		return -1;
+
+	if((group_length - parity) * sector_capacity <= HEADER_SIZE)
+		/* group has no room for data */
+		return -1;
+
+	*format = (struct bkr_ecc2_format) {
+		group_length * sector_capacity,
+		(group_length - parity) * sector_capacity,
+		parity * sector_capacity,
+		(group_length - parity) * sector_capacity - HEADER_SIZE,
+		sector_capacity,
+		group_length,
+		parity
+	};
+
+	return 0;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                 Headers and Record Descriptors
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Header.  data points to the group's last data sector.
+ */
+
+
+static struct bkr_ecc2_header get_header(const unsigned char *data, const struct bkr_ecc2_format *format)
+{
+	struct bkr_ecc2_header header;
+	__u32 word;
+
+	memcpy(&word, data + format->interleave - HEADER_SIZE, HEADER_SIZE);
+	word = __le32_to_cpu(word);
+	header.length = word & ((1 << HEADER_LENGTH_BITS) - 1);
+	header.data_sectors = word >> HEADER_LENGTH_BITS;
+
+	return header;
+}
+
+
+static void put_header(unsigned char *data, const struct bkr_ecc2_format *format, struct bkr_ecc2_header header)
+{
+	__u32 word = header.length | header.data_sectors << HEADER_LENGTH_BITS;
+
+	word = __cpu_to_le32(word);
+	memcpy(data + format->interleave - HEADER_SIZE, &word, HEADER_SIZE);
+}
+
+
+/*
+ * Record descriptor.  bkr_ecc2_encode_descriptor() fills one sector with
+ * a copy of the descriptor.  bkr_ecc2_decode_descriptor() returns 0 if
+ * the sector does not contain a descriptor, and < 0 if it does but the
+ * descriptor is not one we understand.
+ */
+
+
+void bkr_ecc2_encode_descriptor(const struct bkr_ecc2_format *format, unsigned char *data)
+{
+	struct bkr_ecc2_descriptor descriptor = {
+		.magic = DESCRIPTOR_MAGIC,
+		.version = __cpu_to_le32(DESCRIPTOR_VERSION),
+		.group_length = __cpu_to_le32(format->group_length),
+		.parity = __cpu_to_le32(format->parity)
+	};
+
+	memset(data, 0, format->interleave);
+	memcpy(data, &descriptor, sizeof(descriptor));
+}
+
+
+int bkr_ecc2_decode_descriptor(const unsigned char *data, int *group_length, int *parity)
+{
+	struct bkr_ecc2_descriptor descriptor;
+
+	memcpy(&descriptor, data, sizeof(descriptor));
+
+	if(memcmp(descriptor.magic, DESCRIPTOR_MAGIC, sizeof(descriptor.magic)))
+		return 0;
+	if(__le32_to_cpu(descriptor.version) != DESCRIPTOR_VERSION)
+		return -1;
+
+	*group_length = __le32_to_cpu(descriptor.group_length);
+	*parity = __le32_to_cpu(descriptor.parity);
+
+	return 1;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                                  Encoder
+ *
+ * ========================================================================
+ */
+
+
+struct bkr_ecc2_encoder *bkr_ecc2_encoder_new(const struct bkr_ecc2_format *format)
+{
+	struct bkr_ecc2_encoder *encoder = malloc(sizeof(*encoder));
+
+	if(!encoder)
+		return NULL;
+	encoder->format = *format;
+	encoder->rs_format = reed_solomon_codec_new(format->group_length, format->group_length - format->parity, format->interleave);
+	encoder->parity = calloc(format->parity_size, 1);
+	if(!encoder->rs_format || !encoder->parity) {
+		bkr_ecc2_encoder_free(encoder);
+		return NULL;
+	}
+	encoder->sector_number = 0;
+	encoder->group_bytes = 0;
+
+	return encoder;
+}
+
+
+void bkr_ecc2_encoder_free(struct bkr_ecc2_encoder *encoder)
+{
+	if(!encoder)
+		return;
+	reed_solomon_codec_free(encoder->rs_format);
+	free(encoder->parity);
+	free(encoder);
+}
+
+
+/*
+ * Discard the group in progress and start a new one.
+ */
+
+
+void bkr_ecc2_encoder_reset(struct bkr_ecc2_encoder *encoder)
+{
+	memset(encoder->parity, 0, encoder->format.parity_size);
+	encoder->sector_number = 0;
+	encoder->group_bytes = 0;
+}
+
+
+/*
+ * The number of bytes of data the next sector of the group can hold.  If
+ * last is set, or the sector is the group's last data sector, it carries
+ * the group's header.
+ */
+
+
+int bkr_ecc2_encoder_room(const struct bkr_ecc2_encoder *encoder, int last)
+{
+	if(last || encoder->sector_number == encoder->format.group_length - encoder->format.parity - 1)
+		return encoder->format.interleave - HEADER_SIZE;
+	return encoder->format.interleave;
+}
+
+
+/*
+ * Encode the next data sector of the group into sector (interleave
+ * bytes), taking as much of the length bytes at data as will fit.  If
+ * there is less than that the sector is padded with 0s.  The last data
+ * sector of the group carries the group's header.  The return value is
+ * the number of bytes of data consumed.
+ *
+ * If *last is set on input, the group is ended early with this sector.
+ * The remaining data sectors are omitted from the tape and taken to be 0,
+ * which leaves the parity unchanged (a shortened code).  This is used to
+ * end the last group of a record without wasting tape on padding.  On
+ * return, *last is set if the group has ended, in which case
+ * bkr_ecc2_encode_parity() must be called next.
+ */
+
+
+int bkr_ecc2_encode_sector(struct bkr_ecc2_encoder *encoder, unsigned char *sector, const unsigned char *data, int length, int *last)
+{
+	int data_sectors = encoder->format.group_length - encoder->format.parity;
+	int room = bkr_ecc2_encoder_room(encoder, *last);
+
+	if(encoder->sector_number == data_sectors - 1)
+		*last = 1;
+	if(length > room)
+		length = room;
+
+	/* copy data, pad with 0 if short */
+	memcpy(sector, data, length);
+	memset(sector + length, 0, encoder->format.interleave - length);
+	encoder->group_bytes += length;
+
+	/* insert the header */
+	if(*last) {
+		struct bkr_ecc2_header header = {
+			.length = encoder->group_bytes,
+			.data_sectors = encoder->sector_number + 1 < data_sectors ? encoder->sector_number + 1 : 0
+		};
+		put_header(sector, &encoder->format, header);
+	}
+
+	/* update parity */
+	reed_solomon_encode_accumulate(encoder->parity, sector, encoder->sector_number++, *encoder->rs_format);
+
+	return length;
+}
+
+
+/*
+ * Retrieve the parity sectors (parity_size bytes) of the group just
+ * ended, and start the next group.
+ */
+
+
+void bkr_ecc2_encode_parity(struct bkr_ecc2_encoder *encoder, unsigned char *parity)
+{
+	memcpy(parity, encoder->parity, encoder->format.parity_size);
+	bkr_ecc2_encoder_reset(encoder);
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                                  Decoder
+ *
+ * ========================================================================
+ */
+
+
+struct bkr_ecc2_decoder *bkr_ecc2_decoder_new(const struct bkr_ecc2_format *format)
+{
+	struct bkr_ecc2_decoder *decoder = malloc(sizeof(*decoder));
+
+	if(!decoder)
+		return NULL;
+	decoder->format = *format;
+	decoder->rs_format = reed_solomon_codec_new(format->group_length, format->group_length - format->parity, 1);
+	decoder->erasure = malloc(format->parity * sizeof(*decoder->erasure));
+	decoder->tile = malloc(TILE_COLUMNS * format->group_length);
+	if(!decoder->rs_format || !decoder->erasure || !decoder->tile) {
+		bkr_ecc2_decoder_free(decoder);
+		return NULL;
+	}
+	bkr_ecc2_decoder_reset(decoder);
+	decoder->first_corrected_sector = INT_MAX;
+
+	return decoder;
+}
+
+
+void bkr_ecc2_decoder_free(struct bkr_ecc2_decoder *decoder)
+{
+	if(!decoder)
+		return;
+	reed_solomon_codec_free(decoder->rs_format);
+	free(decoder->erasure);
+	free(decoder->tile);
+	free(decoder);
+}
+
+
+/*
+ * Forget the bad sectors of the group in progress.
+ */
+
+
+void bkr_ecc2_decoder_reset(struct bkr_ecc2_decoder *decoder)
+{
+	decoder->num_erasure = 0;
+	decoder->first_bad_sector = INT_MAX;
+}
+
+
+/*
+ * Translate a sector's position in a group of data_sectors data sectors
+ * to its symbol position in the Reed-Solomon code words.  The parity
+ * symbols occupy the low-order positions of each code word (see
+ * reed_solomon_encode()).
+ */
+
+
+static gf sector_to_erasure(const struct bkr_ecc2_format *format, int data_sectors, int sector_number)
+{
+	return sector_number < data_sectors ? format->parity + sector_number : sector_number - data_sectors;
+}
+
+
+/*
+ * Record an erasure at the given position in the current group.  Until
+ * the group ends it isn't known how many of its sectors are data, so the
+ * position is kept as is and translated by bkr_ecc2_decode_group().
+ * Beyond the code's capacity there's no point keeping track, the group is
+ * uncorrectable anyway.
+ */
+
+
+void bkr_ecc2_add_erasure(struct bkr_ecc2_decoder *decoder, int sector_number)
+{
+	if(!decoder->num_erasure)
+		decoder->first_bad_sector = sector_number;
+	if(decoder->num_erasure < decoder->format.parity)
+		decoder->erasure[decoder->num_erasure++] = sector_number;
+}
+
+
+#ifndef min
+#define min(x,y) ({ \
+	const typeof(x) _x = (x); \
+	const typeof(y) _y = (y); \
+	(void) (&_x == &_y); \
+	_x < _y ? _x : _y ; \
+})
+#endif
+
+
+/*
+ * Tile transposition.  Copy a block of rows x columns symbols between a
+ * group, in which rows are data_stride symbols apart, and a tile, in
+ * which columns are tile_stride symbols apart.
+ */
+
+
+static void tile_load(unsigned char *tile, int tile_stride, const unsigned char *data, int data_stride, int rows, int columns)
+{
+	int row, column;
+
+	for(row = 0; row < rows; row++, data += data_stride)
+		for(column = 0; column < columns; column++)
+			tile[column * tile_stride + row] = data[column];
+}
+
+
+static void tile_store(unsigned char *data, int data_stride, const unsigned char *tile, int tile_stride, int rows, int columns)
+{
+	int row, column;
+
+	for(row = 0; row < rows; row++, data += data_stride)
+		for(column = 0; column < columns; column++)
+			data[column] = tile[column * tile_stride + row];
+}
+
+
+/*
+ * Reconstruct the shortened group at the end of a record.  sectors holds
+ * the n sectors received since the last full group, which are the
+ * shortened group's data sectors followed by its parity sectors.  The
+ * data sectors that were omitted are implicitly 0, so the full-length
+ * group (group_size bytes) is rebuilt in group by re-inserting them.
+ * The return value is the number of data sectors in the group, which is
+ * < 1 if too few sectors were received to hold one, in which case group
+ * is left untouched.
+ */
+
+
+int bkr_ecc2_expand_group(struct bkr_ecc2_decoder *decoder, unsigned char *group, const unsigned char *sectors, int n)
+{
+	const struct bkr_ecc2_format *format = &decoder->format;
+	int data_sectors = n - format->parity;
+
+	if(data_sectors < 1)
+		return data_sectors;
+
+	memcpy(group, sectors, data_sectors * format->interleave);
+	memset(group + data_sectors * format->interleave, 0, format->data_size - data_sectors * format->interleave);
+	memcpy(group + format->data_size, sectors + data_sectors * format->interleave, format->parity_size);
+
+	return data_sectors;
+}
+
+
+/*
+ * Decode a sector group (group_size bytes) in place.  data_sectors is the
+ * number of data sectors actually recorded in the group, which is less
+ * than the full complement if it has been shortened.  The return value is
+ * the number of bytes of data at the start of the group, and the decoder
+ * is left ready for the next group.
+ */
+
+
+int bkr_ecc2_decode_group(struct bkr_ecc2_decoder *decoder, unsigned char *data, int data_sectors, struct bkr_ecc2_stats *stats)
+{
+	const struct bkr_ecc2_format *format = &decoder->format;
+	int n = format->group_length;
+	int k = n - format->parity;
+	int block, columns, column;
+	int corrections;
+	int i;
+	struct bkr_ecc2_header header;
+
+	/*
+	 * Translate the bad sectors' positions to code positions.
+	 */
+
+	for(i = 0; i < decoder->num_erasure; i++)
+		decoder->erasure[i] = sector_to_erasure(format, data_sectors, decoder->erasure[i]);
+	decoder->first_corrected_sector = INT_MAX;
+
+	/*
+	 * Do error correction.
+	 */
+
+	/* This pre-processor conditional disables error correction.
+	 * Useful for confirming that the decoding pipeline is, infact, the
+	 * inverse of the encoding pipeline (the error corrector could be
+	 * hiding off-by-one problems by just fixing the data). */
+#if 1
+	for(block = 0; block < format->interleave; block += columns) {
+		int corrected = 0;
+
+		columns = min(format->interleave - block, TILE_COLUMNS);
+		tile_load(decoder->tile, n, data + block, format->interleave, n, columns);
+
+		for(column = 0; column < columns; column++) {
+			unsigned char *codeword = decoder->tile + column * n;
+
+			memcpy(decoder->rs_format->erasure, decoder->erasure, decoder->num_erasure * sizeof(gf));
+			corrections = reed_solomon_decode(codeword + k, codeword, decoder->num_erasure, *decoder->rs_format);
+			if(corrections < 0) {
+				/* uncorrectable block.  ignore, there's
+				 * nothing we can do at this point anyway. */
+				continue;
+			}
+			if(corrections)
+				corrected = 1;
+			for(i = 0; i < corrections; i++)
+				if(decoder->rs_format->erasure[i] >= format->parity)
+					decoder->first_corrected_sector = min(decoder->first_corrected_sector, decoder->rs_format->erasure[i] - format->parity);
+			if(corrections > stats->worst_group)
+				stats->worst_group = corrections;
+			if(corrections > decoder->num_erasure) {
+				/* error corrector identified additional
+				 * corrupt sectors, beyond what the sector
+				 * decoder told us about.  add them to our
+				 * list, and pass them in as erasures for
+				 * the next block.  */
+				stats->extra_errors += corrections - decoder->num_erasure;
+				memcpy(decoder->erasure, decoder->rs_format->erasure, corrections * sizeof(gf));
+				decoder->num_erasure = corrections;
+			}
+		}
+
+		/* only the data needs to go back, and only if it's been
+		 * changed */
+		if(corrected)
+			tile_store(data + block, format->interleave, decoder->tile, n, k, columns);
+	}
+#endif
+
+	/*
+	 * Retrieve header.  A corrupt header can claim more data than the
+	 * group holds.
+	 */
+
+	header = get_header(data + (data_sectors - 1) * format->interleave, format);
+	if(header.length > data_sectors * format->interleave - HEADER_SIZE)
+		header.length = data_sectors * format->interleave - HEADER_SIZE;
+
+	bkr_ecc2_decoder_reset(decoder);
+
+	return header.length;
+}
@@ -0,0 +1,141 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                   Sector Drop-Out Error Correction Codec Tests
+ *
+ * Copyright (C) 2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Each test encodes one sector group, wipes some of its sectors as the
+ * tape would lose them, reports them to the decoder as erasures in the
+ * order they arrive, and checks that the group decodes to the original
+ * data.  Sectors in the hidden list are wiped without being reported, and
+ * must be found by the decoder itself.  The first data sector corrected
+ * must be the first bad one.
+ */
+
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include <backer.h>
+#include <bkr_codec.h>
+
+
+#define  GROUP_LENGTH  255
+#define  PARITY        20
+
+
+static int test_group(const char *name, int data_sectors, const int *bad, int n_bad, const int *hidden, int n_hidden)
+{
+	struct bkr_ecc2_format format;
+	struct bkr_ecc2_encoder *encoder;
+	struct bkr_ecc2_decoder *decoder;
+	struct bkr_ecc2_stats stats = {0, 0};
+	unsigned char *data, *sectors, *group;
+	int received, length, consumed = 0;
+	int first_bad = INT_MAX;
+	int last = 0;
+	int i, failed = 0;
+
+	if(bkr_ecc2_format(&format, bkr_ecc2_sector_capacity(BKR_NTSC, BKR_HIGH), GROUP_LENGTH, PARITY) < 0)
+		return 1;
+	encoder = bkr_ecc2_encoder_new(&format);
+	decoder = bkr_ecc2_decoder_new(&format);
+	data = malloc(format.data_size);
+	sectors = malloc(format.group_size);
+	group = malloc(format.group_size);
+	if(!encoder || !decoder || !data || !sectors || !group)
+		return 1;
+
+	/*
+	 * Encode data_sectors data sectors, shortening the group if that's
+	 * fewer than a full group holds, followed by the parity.
+	 */
+
+	for(i = 0; i < format.data_size; i++)
+		data[i] = rand();
+	for(i = 0; !last; i++) {
+		last = i == data_sectors - 1;
+		consumed += bkr_ecc2_encode_sector(encoder, sectors + i * format.interleave, data + consumed, format.data_size - consumed, &last);
+	}
+	bkr_ecc2_encode_parity(encoder, sectors + i * format.interleave);
+	received = i + format.parity;
+
+	/*
+	 * Lose the bad sectors, and decode.
+	 */
+
+	for(i = 0; i < n_bad; i++) {
+		memset(sectors + bad[i] * format.interleave, 0x5a, format.interleave);
+		bkr_ecc2_add_erasure(decoder, bad[i]);
+		if(bad[i] < data_sectors && bad[i] < first_bad)
+			first_bad = bad[i];
+	}
+	for(i = 0; i < n_hidden; i++) {
+		memset(sectors + hidden[i] * format.interleave, 0xa5, format.interleave);
+		if(hidden[i] < data_sectors && hidden[i] < first_bad)
+			first_bad = hidden[i];
+	}
+	if(received < format.group_length) {
+		if(bkr_ecc2_expand_group(decoder, group, sectors, received) != data_sectors)
+			failed = 1;
+	} else
+		memcpy(group, sectors, format.group_size);
+	length = bkr_ecc2_decode_group(decoder, group, data_sectors, &stats);
+
+	if(length != consumed || memcmp(group, data, consumed))
+		failed = 1;
+	if(stats.extra_errors != (unsigned long) n_hidden || decoder->first_corrected_sector != first_bad)
+		failed = 1;
+	fprintf(stderr, "%s: %s (%d data sectors, %d bad, %d hidden, %lu extra errors)\n", failed ? "FAIL" : "PASS", name, data_sectors, n_bad, n_hidden, stats.extra_errors);
+
+	bkr_ecc2_encoder_free(encoder);
+	bkr_ecc2_decoder_free(decoder);
+	free(data);
+	free(sectors);
+	free(group);
+
+	return failed;
+}
+
+
+int main(void)
+{
+	static const int full[] = {0, 100, 234, 235, 254};
+	static const int short_data[] = {3, 50, 229};
+	static const int short_parity[] = {3, 240, 245};
+	static const int short_both[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 240, 241, 242, 243, 244, 245, 246, 247, 248, 249};
+	static const int unflagged_bad[] = {150, 200};
+	static const int unflagged_hidden[] = {7, 120};
+	int failed = 0;
+
+	bkr_codec_init();
+	srand(1);
+	failed |= test_group("full group", GROUP_LENGTH - PARITY, full, sizeof(full) / sizeof(*full), NULL, 0);
+	failed |= test_group("shortened group, bad data", 230, short_data, sizeof(short_data) / sizeof(*short_data), NULL, 0);
+	failed |= test_group("shortened group, bad parity", 230, short_parity, sizeof(short_parity) / sizeof(*short_parity), NULL, 0);
+	failed |= test_group("shortened group, bad data and parity", 230, short_both, sizeof(short_both) / sizeof(*short_both), NULL, 0);
+	failed |= test_group("full group, unflagged errors", GROUP_LENGTH - PARITY, unflagged_bad, sizeof(unflagged_bad) / sizeof(*unflagged_bad), unflagged_hidden, sizeof(unflagged_hidden) / sizeof(*unflagged_hidden));
+
+	return failed;
+}
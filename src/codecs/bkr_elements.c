@@ -27,12 +27,14 @@
 
 #include <backer.h>
 #include <bkr_elements.h>
+#include <bkr_compress.h>
+#include <bkr_device.h>
 #include <bkr_frame.h>
 #include <bkr_rll.h>
 #include <bkr_splp.h>
 #include <bkr_ecc2.h>
 #include <bkr_video_out.h>
-#include <rs.h>
+#include <bkr_codec.h>
 
 
 /*
@@ -167,6 +169,35 @@ GstEvent *bkr_event_new_next_sector_invalid(void)
 }
 
 
+/*
+ * The lead query asks a sink how many fields it has queued ahead of the
+ * tape.  The answer is -1 if the sink can't tell.
+ */
+
+
+static GstQueryType bkr_query_type_lead(void)
+{
+	static GstQueryType type = GST_QUERY_NONE;
+
+	if(type == GST_QUERY_NONE)
+		type = gst_query_type_register("bkr_lead", "Fields queued ahead of the tape");
+
+	return type;
+}
+
+
+GstQuery *bkr_query_new_lead(void)
+{
+	return gst_query_new_application(bkr_query_type_lead(), gst_structure_new("bkr_lead", "fields", G_TYPE_INT, -1, NULL));
+}
+
+
+void bkr_query_set_lead(GstQuery *query, gint fields)
+{
+	gst_structure_set(gst_query_get_structure(query), "fields", G_TYPE_INT, fields, NULL);
+}
+
+
 /*
  * ============================================================================
  *
@@ -266,6 +297,22 @@ enum BkrEventType bkr_event_parse(GstEvent *event)
 }
 
 
+/*
+ * Parse a lead query.  Returns FALSE if the query is not a lead query,
+ * otherwise the lead is written to fields (-1 if not yet answered).
+ */
+
+
+int bkr_query_parse_lead(GstQuery *query, gint *fields)
+{
+	*fields = -1;
+	if(GST_QUERY_TYPE(query) != bkr_query_type_lead())
+		return FALSE;
+	gst_structure_get_int(gst_query_get_structure(query), "fields", fields);
+	return TRUE;
+}
+
+
 /*
  * ============================================================================
  *
@@ -281,6 +328,8 @@ static gboolean plugin_init(GstPlugin *plugin)
 		const gchar *name;
 		GType (*type)(void);
 	} *element, elements[] = {
+		{"bkr_compress", bkr_compress_get_type},
+		{"bkr_decompress", bkr_decompress_get_type},
 		{"bkr_ecc2enc", bkr_ecc2enc_get_type},
 		{"bkr_ecc2dec", bkr_ecc2dec_get_type},
 		{"bkr_splpenc", bkr_splpenc_get_type},
@@ -290,11 +339,13 @@ static gboolean plugin_init(GstPlugin *plugin)
 		{"bkr_frameenc", bkr_frameenc_get_type},
 		{"bkr_framedec", bkr_framedec_get_type},
 		{"bkr_video_out", bkr_video_out_get_type},
+		{"bkr_devsrc", bkr_devsrc_get_type},
+		{"bkr_devsink", bkr_devsink_get_type},
 		{NULL, NULL},
 	};
 
-	/* initialize Reed-Solomon coder/decoder */
-	galois_field_init(GF00256);
+	/* initialize the Reed-Solomon and RLL tables */
+	bkr_codec_init();
 
 	/* make sure the enums are created before a caps string has to be
 	 * parsed */
@@ -55,9 +55,12 @@ GType bkr_sectorformat_get_type(void);
 GstCaps *bkr_get_template_caps(void);
 GstEvent *bkr_event_new_skipped_sector(void);
 GstEvent *bkr_event_new_next_sector_invalid(void);
+GstQuery *bkr_query_new_lead(void);
+void bkr_query_set_lead(GstQuery *, gint);
 double bkr_fields_per_second(enum bkr_videomode);
 int bkr_parse_caps(GstCaps *, enum bkr_videomode *, enum bkr_bitdensity *, enum bkr_sectorformat *);
 enum BkrEventType bkr_event_parse(GstEvent *);
+int bkr_query_parse_lead(GstQuery *, gint *);
 
 
 G_END_DECLS
@@ -29,42 +29,11 @@
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
 #include <backer.h>
+#include <bkr_codec.h>
 #include <bkr_elements.h>
 #include <bkr_frame.h>
 
 
-/*
- * ========================================================================
- *
- *                              PARAMETERS
- *
- * ========================================================================
- */
-
-
-#define  BKR_LEADER             0xe2    /* leader is filled with this */
-#define  BKR_TRAILER            0x33    /* trailer is filled with this */
-#define  FRAME_THRESHOLD_A      21
-#define  FRAME_THRESHOLD_B      64
-
-
-/*
- * ========================================================================
- *
- *                              Global Data
- *
- * ========================================================================
- */
-
-
-static const guint8 sector_key[] = {
-	0xd4, 0x7c, 0xb1, 0x93, 0x66, 0x65, 0x6a, 0xb5,
-	0x63, 0xe4, 0x56, 0x59, 0x6c, 0xbe, 0xc5, 0xca,
-	0xf4, 0x9c, 0xa3, 0xac, 0x6d, 0xb3, 0xd2, 0x7e,
-	0x74, 0xa6, 0xe1, 0xa9, 0x5c, 0x9a, 0x4b, 0x5d
-};
-
-
 /*
  * ========================================================================
  *
@@ -75,49 +44,31 @@ static const guint8 sector_key[] = {
 
 
 /*
- * Counts the number of bytes in the frame that match the key sequence.
- */
-
-
-static guint correlate(const guint8 *data, gint key_interval, gint key_length, const guint8 *key)
-{
-	guint count;
-
-	for(count = 0; key_length--; data += key_interval)
-		count += *data == *(key++);
-
-	return count;
-}
-
-
-/*
- * Uses correlate() to scan a buffer until a sector key sequence is found.
- * On success, the return value is a pointer to the first byte following
- * the sector leader; otherwise the return value is NULL.
+ * Scans the adapter until a sector key sequence is found.  On success,
+ * the return value is a pointer to the first byte following the sector
+ * leader;  otherwise the return value is NULL.  The search is done in
+ * windows of at most two fields so that peeking at the adapter never
+ * copies more than that.
  */
 
 
-static const guint8 *find_field(BkrFrameDec *filter, const guint8 *key)
+static const guint8 *find_field(BkrFrameDec *filter)
 {
-	gint threshold = filter->format->key_length * FRAME_THRESHOLD_A / FRAME_THRESHOLD_B;
-	const guint8 *data;
-	gint corr;
-
-	while(1) {
-		data = gst_adapter_peek(filter->adapter, filter->format->active_size);
-		if(!data)
-			return NULL;
-
-		corr = correlate(data, filter->format->key_interval, filter->format->key_length, key);
-		if(corr >= threshold)
-			break;
-		if(corr > filter->best_nonkey)
-			filter->best_nonkey = corr;
-		gst_adapter_flush(filter->adapter, 1);
+	guint window = 2 * filter->format->active_size;
+	const guint8 *data, *field = NULL;
+	guint available, skip;
+
+	while(!field && (available = gst_adapter_available(filter->adapter)) >= (guint) filter->format->active_size) {
+		if(available > window)
+			available = window;
+		data = gst_adapter_peek(filter->adapter, available);
+		field = bkr_frame_find(filter->format, data, available, &filter->stats);
+		skip = field ? (guint) (field - data) : available - filter->format->active_size + 1;
+		gst_adapter_flush(filter->adapter, skip);
+		filter->offset += skip;
 	}
-
-	if(corr < filter->worst_key)
-		filter->worst_key = corr;
+	if(!field)
+		return NULL;
 
 #if 0
 	if(filter->last_field_offset >= 0) {
@@ -132,59 +83,7 @@ static const guint8 *find_field(BkrFrameDec *filter, const guint8 *key)
 	filter->last_field_offset = source->ring->tail;
 #endif
 
-	return data;
-}
-
-
-/*
- * Strips the sector data from a video field in the source buffer and
- * places it in the destination buffer.
- */
-
-
-static void decode_field(const struct bkr_frame_format *format, guint8 *dst, const guint8 *src)
-{
-	int key_length = format->key_length;
-	int key_interval_minus_1 = format->key_interval - 1;
-	int i;
-
-	for(i = 1; i < key_length; i++) {
-		src++;
-		memcpy(dst, src, key_interval_minus_1);
-		dst += key_interval_minus_1;
-		src += key_interval_minus_1;
-	}
-	src++;
-	memcpy(dst, src, format->active_size % format->key_interval - 1);
-}
-
-
-/*
- * Moves one field of data from the source buffer to the destination
- * buffer, adding leader trailer and sector key bytes as required.
- */
-
-
-static void encode_field(const struct bkr_frame_format *format, guint8 *dst, const guint8 *src, const guint8 *key, gint field_number)
-{
-	int key_length = format->key_length;
-	int key_interval_minus_1 = format->key_interval - 1;
-	int i;
-
-	memset(dst, BKR_LEADER, format->leader);
-	dst += format->leader;
-
-	for(i = 1; i < key_length; i++) {
-		*dst++ = *key++;
-		memcpy(dst, src, key_interval_minus_1);
-		dst += key_interval_minus_1;
-		src += key_interval_minus_1;
-	}
-	*dst++ = *key++;
-	memcpy(dst, src, format->active_size % format->key_interval - 1);
-	dst += format->active_size % format->key_interval - 1;
-
-	memset(dst, BKR_TRAILER, format->trailer + ((field_number & 1) ? format->interlace : 0));
+	return gst_adapter_peek(filter->adapter, filter->format->active_size);
 }
 
 
@@ -196,8 +95,7 @@ static void encode_field(const struct bkr_frame_format *format, guint8 *dst, con
 static void reset_statistics(BkrFrameDec *filter)
 {
 	/* NOTE: keep synchronized with defaults in dec_class_init() */
-	filter->worst_key = filter->format->key_length;
-	filter->best_nonkey = 0;
+	bkr_frame_reset_stats(filter->format, &filter->stats);
 	filter->frame_warnings = 0;
 	filter->last_field_offset = -1;
 	filter->smallest_field = INT_MAX;
@@ -205,100 +103,6 @@ static void reset_statistics(BkrFrameDec *filter)
 }
 
 
-/*
- * Format info.
- */
-
-
-static struct bkr_frame_format *compute_format(enum bkr_videomode v, enum bkr_bitdensity d, enum bkr_sectorformat f)
-{
-	struct bkr_frame_format initializer;
-	struct bkr_frame_format *format;
-
-	switch(d) {
-	case BKR_LOW:
-		switch(v) {
-		case BKR_NTSC:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_frame_format) {1012, 4,  40, 32,  940,  44, 22};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_frame_format) {1012, 4,  32, 28,  952,  45, 22};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		case BKR_PAL:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_frame_format) {1220, 0,  48, 36, 1136,  40, 29};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_frame_format) {1220, 0,  40, 36, 1144,  49, 24};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	case BKR_HIGH:
-		switch(v) {
-		case BKR_NTSC:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_frame_format) {2530, 10, 100, 70, 2360,  84, 29};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_frame_format) {2530, 10,  80, 70, 2380, 125, 20};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		case BKR_PAL:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_frame_format) {3050, 0, 120, 90, 2840,  91, 32};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_frame_format) {3050, 0, 100, 90, 2860, 136, 22};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	default:
-		GST_DEBUG("unrecognized bitdensity");
-		return NULL;
-	}
-
-	format = malloc(sizeof(*format));
-	if(!format) {
-		GST_DEBUG("memory allocation failure");
-		return NULL;
-	}
-
-	*format = initializer;
-
-	return format;
-}
-
-
 /*
  * ============================================================================
  *
@@ -387,13 +191,25 @@ static struct bkr_frame_format *caps_to_format(GstCaps *caps)
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
+	struct bkr_frame_format *format;
 
 	if(!bkr_parse_caps(caps, &videomode, &bitdensity, &sectorformat)) {
 		GST_DEBUG("failure parsing caps");
 		return NULL;
 	}
 
-	return compute_format(videomode, bitdensity, sectorformat);
+	format = malloc(sizeof(*format));
+	if(!format) {
+		GST_DEBUG("memory allocation failure");
+		return NULL;
+	}
+	if(bkr_frame_format(format, videomode, bitdensity, sectorformat) < 0) {
+		GST_DEBUG("unrecognized format");
+		free(format);
+		return NULL;
+	}
+
+	return format;
 }
 
 
@@ -494,7 +310,7 @@ static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
-	encode_field(filter->format, GST_BUFFER_DATA(srcbuf), GST_BUFFER_DATA(sinkbuf), sector_key, filter->odd_field);
+	bkr_frame_encode(filter->format, GST_BUFFER_DATA(srcbuf), GST_BUFFER_DATA(sinkbuf), filter->odd_field);
 
 	if(filter->inject_noise) {
 		result = inject_noise(srcbuf, filter->bitdensity == BKR_HIGH ? 10 : 4);
@@ -681,7 +497,8 @@ enum dec_property {
 	ARG_DEC_BEST_NONKEY,
 	ARG_DEC_FRAME_WARNINGS,
 	ARG_DEC_SMALLEST_FIELD,
-	ARG_DEC_LARGEST_FIELD
+	ARG_DEC_LARGEST_FIELD,
+	ARG_DEC_KEY_LENGTH
 };
 
 
@@ -691,11 +508,11 @@ static void dec_set_property(GObject *object, enum dec_property id, const GValue
 
 	switch(id) {
 	case ARG_DEC_WORST_KEY:
-		filter->worst_key = g_value_get_int(value);
+		filter->stats.worst_key = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_BEST_NONKEY:
-		filter->best_nonkey = g_value_get_int(value);
+		filter->stats.best_nonkey = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_FRAME_WARNINGS:
@@ -719,11 +536,11 @@ static void dec_get_property(GObject *object, enum dec_property id, GValue *valu
 
 	switch(id) {
 	case ARG_DEC_WORST_KEY:
-		g_value_set_int(value, filter->worst_key);
+		g_value_set_int(value, filter->stats.worst_key);
 		break;
 
 	case ARG_DEC_BEST_NONKEY:
-		g_value_set_int(value, filter->best_nonkey);
+		g_value_set_int(value, filter->stats.best_nonkey);
 		break;
 
 	case ARG_DEC_FRAME_WARNINGS:
@@ -737,6 +554,10 @@ static void dec_get_property(GObject *object, enum dec_property id, GValue *valu
 	case ARG_DEC_LARGEST_FIELD:
 		g_value_set_int(value, filter->largest_field);
 		break;
+
+	case ARG_DEC_KEY_LENGTH:
+		g_value_set_int(value, filter->format ? filter->format->key_length : 0);
+		break;
 	}
 }
 
@@ -790,9 +611,12 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
+	/* pick up the raw stream offset from the source when it has one */
+	if(!gst_adapter_available(filter->adapter) && GST_BUFFER_OFFSET_IS_VALID(sinkbuf))
+		filter->offset = GST_BUFFER_OFFSET(sinkbuf);
 	gst_adapter_push(filter->adapter, sinkbuf);
 
-	while((data = find_field(filter, sector_key))) {
+	while((data = find_field(filter))) {
 		GstBuffer *srcbuf;
 
 		result = gst_pad_alloc_buffer(srcpad, GST_BUFFER_OFFSET_NONE, filter->format->active_size - filter->format->key_length, caps, &srcbuf);
@@ -801,9 +625,12 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 			goto done;
 		}
 
-		decode_field(filter->format, GST_BUFFER_DATA(srcbuf), data);
+		bkr_frame_decode(filter->format, GST_BUFFER_DATA(srcbuf), data);
+		GST_BUFFER_OFFSET(srcbuf) = filter->offset;
+		GST_BUFFER_OFFSET_END(srcbuf) = filter->offset + filter->format->active_size;
 
 		gst_adapter_flush(filter->adapter, filter->format->active_size);
+		filter->offset += filter->format->active_size;
 
 		result = gst_pad_push(srcpad, srcbuf);
 		if(result != GST_FLOW_OK) {
@@ -906,6 +733,7 @@ static void dec_class_init(gpointer class, gpointer class_data)
 	g_object_class_install_property(object_class, ARG_DEC_FRAME_WARNINGS, g_param_spec_int("frame_warnings", "Frame warnings", "Frame warnings", 0, INT_MAX, 0, G_PARAM_READWRITE));
 	g_object_class_install_property(object_class, ARG_DEC_SMALLEST_FIELD, g_param_spec_int("smallest_field", "Smallest field", "Smallest field", 0, INT_MAX, INT_MAX, G_PARAM_READWRITE));
 	g_object_class_install_property(object_class, ARG_DEC_LARGEST_FIELD, g_param_spec_int("largest_field", "Largest field", "Largest field", 0, INT_MAX, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_KEY_LENGTH, g_param_spec_int("key_length", "Key length", "Key length (best possible key correlation)", 0, INT_MAX, 0, G_PARAM_READABLE));
 
 	dec_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 }
@@ -940,6 +768,7 @@ static void dec_instance_init(GTypeInstance *object, gpointer class)
 
 	/* internal state */
 	filter->adapter = gst_adapter_new();
+	filter->offset = 0;
 	filter->format = NULL;
 }
 
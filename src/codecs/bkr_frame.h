@@ -26,6 +26,7 @@
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
 #include <backer.h>
+#include <bkr_codec.h>
 
 
 G_BEGIN_DECLS
@@ -59,20 +60,7 @@ typedef struct {
 
 	gint odd_field;
 
-	/*
-	 * Format information.
-	 * 	interlace = number of extra bytes in an odd field
-	 */
-
-	struct bkr_frame_format {
-		gint field_size;
-		gint interlace;
-		gint leader;
-		gint trailer;
-		gint active_size;
-		gint key_interval;
-		gint key_length;
-	} *format;
+	struct bkr_frame_format *format;
 
 	/*
 	 * Flags
@@ -113,12 +101,17 @@ typedef struct {
 	enum bkr_sectorformat sectorformat;
 	struct bkr_frame_format *format;
 
-	gint worst_key;
-	gint best_nonkey;
+	struct bkr_frame_stats stats;
 	gint frame_warnings;
 	gint last_field_offset;
 	guint smallest_field;
 	gint largest_field;
+
+	/*
+	 * offset in the raw stream of the first byte in the adapter
+	 */
+
+	guint64 offset;
 } BkrFrameDec;
 
 
@@ -0,0 +1,266 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                               Framing Codec
+ *
+ *
+ * Copyright (C) 2008  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <string.h>
+
+
+#include <backer.h>
+#include <bkr_codec.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                              PARAMETERS
+ *
+ * ========================================================================
+ */
+
+
+#define  BKR_LEADER             0xe2    /* leader is filled with this */
+#define  BKR_TRAILER            0x33    /* trailer is filled with this */
+#define  FRAME_THRESHOLD_A      21
+#define  FRAME_THRESHOLD_B      64
+
+
+/*
+ * ========================================================================
+ *
+ *                              Global Data
+ *
+ * ========================================================================
+ */
+
+
+static const unsigned char sector_key[] = {
+	0xd4, 0x7c, 0xb1, 0x93, 0x66, 0x65, 0x6a, 0xb5,
+	0x63, 0xe4, 0x56, 0x59, 0x6c, 0xbe, 0xc5, 0xca,
+	0xf4, 0x9c, 0xa3, 0xac, 0x6d, 0xb3, 0xd2, 0x7e,
+	0x74, 0xa6, 0xe1, 0xa9, 0x5c, 0x9a, 0x4b, 0x5d
+};
+
+
+/*
+ * ========================================================================
+ *
+ *                              Format Info
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Fill in the format for the given mode.  Returns 0 on success, or < 0
+ * if the mode is not recognized.
+ */
+
+
+int bkr_frame_format(struct bkr_frame_format *format, enum bkr_videomode v, enum bkr_bitdensity d, enum bkr_sectorformat f)
+{
+	switch(d) {
+	case BKR_LOW:
+		switch(v) {
+		case BKR_NTSC:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_frame_format) {1012, 4,  40, 32,  940,  44, 22};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_frame_format) {1012, 4,  32, 28,  952,  45, 22};
+				return 0;
+			default:
+				return -1;
+			}
+		case BKR_PAL:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_frame_format) {1220, 0,  48, 36, 1136,  40, 29};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_frame_format) {1220, 0,  40, 36, 1144,  49, 24};
+				return 0;
+			default:
+				return -1;
+			}
+		default:
+			return -1;
+		}
+	case BKR_HIGH:
+		switch(v) {
+		case BKR_NTSC:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_frame_format) {2530, 10, 100, 70, 2360,  84, 29};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_frame_format) {2530, 10,  80, 70, 2380, 125, 20};
+				return 0;
+			default:
+				return -1;
+			}
+		case BKR_PAL:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_frame_format) {3050, 0, 120, 90, 2840,  91, 32};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_frame_format) {3050, 0, 100, 90, 2860, 136, 22};
+				return 0;
+			default:
+				return -1;
+			}
+		default:
+			return -1;
+		}
+	default:
+		return -1;
+	}
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              CODEC Functions
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Counts the number of bytes in the frame that match the key sequence.
+ */
+
+
+static int correlate(const unsigned char *data, int key_interval, int key_length, const unsigned char *key)
+{
+	int count;
+
+	for(count = 0; key_length--; data += key_interval)
+		count += *data == *(key++);
+
+	return count;
+}
+
+
+/*
+ * Statistics
+ */
+
+
+void bkr_frame_reset_stats(const struct bkr_frame_format *format, struct bkr_frame_stats *stats)
+{
+	stats->worst_key = format->key_length;
+	stats->best_nonkey = 0;
+}
+
+
+/*
+ * Uses correlate() to scan data for a sector key sequence.  On success,
+ * the return value is a pointer to the first byte following the sector
+ * leader, and active_size bytes from there on hold the field.  Otherwise
+ * the return value is NULL, and none of the first length - active_size +
+ * 1 bytes of data (if there are that many) begins a field, so they can be
+ * discarded.
+ */
+
+
+const unsigned char *bkr_frame_find(const struct bkr_frame_format *format, const unsigned char *data, size_t length, struct bkr_frame_stats *stats)
+{
+	int threshold = format->key_length * FRAME_THRESHOLD_A / FRAME_THRESHOLD_B;
+	const unsigned char *last;
+	int corr;
+
+	if(length < (size_t) format->active_size)
+		return NULL;
+
+	for(last = data + length - format->active_size; data <= last; data++) {
+		corr = correlate(data, format->key_interval, format->key_length, sector_key);
+		if(corr >= threshold) {
+			if(corr < stats->worst_key)
+				stats->worst_key = corr;
+			return data;
+		}
+		if(corr > stats->best_nonkey)
+			stats->best_nonkey = corr;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Strips the sector data from a video field in the source buffer and
+ * places it in the destination buffer.  src points to the first byte
+ * following the sector leader, and active_size - key_length bytes are
+ * written to dst.
+ */
+
+
+void bkr_frame_decode(const struct bkr_frame_format *format, unsigned char *dst, const unsigned char *src)
+{
+	int key_length = format->key_length;
+	int key_interval_minus_1 = format->key_interval - 1;
+	int i;
+
+	for(i = 1; i < key_length; i++) {
+		src++;
+		memcpy(dst, src, key_interval_minus_1);
+		dst += key_interval_minus_1;
+		src += key_interval_minus_1;
+	}
+	src++;
+	memcpy(dst, src, format->active_size % format->key_interval - 1);
+}
+
+
+/*
+ * Moves one field of data from the source buffer to the destination
+ * buffer, adding leader trailer and sector key bytes as required.  Odd
+ * numbered fields are interlace bytes longer than even numbered ones.
+ */
+
+
+void bkr_frame_encode(const struct bkr_frame_format *format, unsigned char *dst, const unsigned char *src, int field_number)
+{
+	const unsigned char *key = sector_key;
+	int key_length = format->key_length;
+	int key_interval_minus_1 = format->key_interval - 1;
+	int i;
+
+	memset(dst, BKR_LEADER, format->leader);
+	dst += format->leader;
+
+	for(i = 1; i < key_length; i++) {
+		*dst++ = *key++;
+		memcpy(dst, src, key_interval_minus_1);
+		dst += key_interval_minus_1;
+		src += key_interval_minus_1;
+	}
+	*dst++ = *key++;
+	memcpy(dst, src, format->active_size % format->key_interval - 1);
+	dst += format->active_size % format->key_interval - 1;
+
+	memset(dst, BKR_TRAILER, format->trailer + ((field_number & 1) ? format->interlace : 0));
+}
@@ -26,194 +26,11 @@
 
 #include <gst/gst.h>
 #include <backer.h>
-#include <bkr_bytes.h>
+#include <bkr_codec.h>
 #include <bkr_elements.h>
 #include <bkr_rll.h>
 
 
-/*
- * ========================================================================
- *
- *                              PARAMETERS
- *
- * ========================================================================
- */
-
-
-/*
- * Format info.
- */
-
-
-static struct bkr_rll_format *compute_format(enum bkr_videomode v, enum bkr_bitdensity d)
-{
-	struct bkr_rll_format initializer;
-	struct bkr_rll_format *format;
-
-	switch(d) {
-	case BKR_LOW:
-		switch(v) {
-		case BKR_NTSC:
-			initializer = (struct bkr_rll_format) { 816, 102};
-			break;
-		case BKR_PAL:
-			initializer = (struct bkr_rll_format) { 984, 123};
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	case BKR_HIGH:
-		switch(v) {
-		case BKR_NTSC:
-			initializer = (struct bkr_rll_format) {2072, 259};
-			break;
-		case BKR_PAL:
-			initializer = (struct bkr_rll_format) {2496, 312};
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	default:
-		GST_DEBUG("unrecognized bitdensity");
-		return NULL;
-	}
-
-	format = malloc(sizeof(*format));
-	if(!format) {
-		GST_DEBUG("memory allocation failure");
-		return NULL;
-	}
-
-	*format = initializer;
-
-	return format;
-}
-
-
-/*
- * ========================================================================
- *
- *                              Global Data
- *
- * ========================================================================
- */
-
-
-static const guint16 rll_encode[] = {
-	0x089, 0x08a, 0x08b, 0x08c, 0x08d, 0x08e, 0x091, 0x092,
-	0x093, 0x094, 0x095, 0x096, 0x099, 0x09a, 0x09b, 0x09c,
-	0x09d, 0x09e, 0x0a2, 0x0a3, 0x0a4, 0x0a5, 0x0a6, 0x0a9,
-	0x0aa, 0x0ab, 0x0ac, 0x0ad, 0x0ae, 0x0b1, 0x0b2, 0x0b3,
-	0x0b4, 0x0b5, 0x0b6, 0x0b9, 0x0ba, 0x0bb, 0x0bc, 0x0bd,
-	0x0be, 0x0c2, 0x0c3, 0x0c4, 0x0c5, 0x0c6, 0x0c9, 0x0ca,
-	0x0cb, 0x0cc, 0x0cd, 0x0ce, 0x0d1, 0x0d2, 0x0d3, 0x0d4,
-	0x0d5, 0x0d6, 0x0d9, 0x0da, 0x0db, 0x0dc, 0x0dd, 0x0de,
-	0x0e1, 0x0e2, 0x0e3, 0x0e4, 0x0e5, 0x0e6, 0x0e9, 0x0ea,
-	0x0eb, 0x0ec, 0x0ed, 0x0ee, 0x0f1, 0x0f2, 0x0f3, 0x0f4,
-	0x0f5, 0x0f6, 0x0f9, 0x0fa, 0x0fb, 0x0fc, 0x0fd, 0x109,
-	0x10a, 0x10b, 0x10c, 0x10d, 0x10e, 0x111, 0x112, 0x113,
-	0x114, 0x115, 0x116, 0x119, 0x11a, 0x11b, 0x11c, 0x11d,
-	0x11e, 0x121, 0x122, 0x123, 0x124, 0x125, 0x126, 0x129,
-	0x12a, 0x12b, 0x12c, 0x12d, 0x12e, 0x131, 0x132, 0x133,
-	0x134, 0x135, 0x136, 0x139, 0x13a, 0x13b, 0x13c, 0x13d,
-	0x13e, 0x142, 0x143, 0x144, 0x145, 0x146, 0x149, 0x14a,
-	0x14b, 0x14c, 0x14d, 0x14e, 0x151, 0x152, 0x153, 0x154,
-	0x155, 0x156, 0x159, 0x15a, 0x15b, 0x15c, 0x15d, 0x15e,
-	0x161, 0x162, 0x163, 0x164, 0x165, 0x166, 0x169, 0x16a,
-	0x16b, 0x16c, 0x16d, 0x16e, 0x171, 0x172, 0x173, 0x174,
-	0x175, 0x176, 0x179, 0x17a, 0x17b, 0x17c, 0x17d, 0x17e,
-	0x184, 0x185, 0x186, 0x189, 0x18a, 0x18b, 0x18c, 0x18d,
-	0x18e, 0x191, 0x192, 0x193, 0x194, 0x195, 0x196, 0x199,
-	0x19a, 0x19b, 0x19c, 0x19d, 0x19e, 0x1a1, 0x1a2, 0x1a3,
-	0x1a4, 0x1a5, 0x1a6, 0x1a9, 0x1aa, 0x1ab, 0x1ac, 0x1ad,
-	0x1ae, 0x1b1, 0x1b2, 0x1b3, 0x1b4, 0x1b5, 0x1b6, 0x1b9,
-	0x1ba, 0x1bb, 0x1bc, 0x1bd, 0x1be, 0x1c2, 0x1c3, 0x1c4,
-	0x1c5, 0x1c6, 0x1c9, 0x1ca, 0x1cb, 0x1cc, 0x1cd, 0x1ce,
-	0x1d1, 0x1d2, 0x1d3, 0x1d4, 0x1d5, 0x1d6, 0x1d9, 0x1da,
-	0x1db, 0x1dc, 0x1dd, 0x1de, 0x1e1, 0x1e2, 0x1e3, 0x1e4,
-	0x1e5, 0x1e6, 0x1e9, 0x1ea, 0x1eb, 0x1ec, 0x1ed, 0x1ee
-};
-
-
-static guint8 rll_decode[512];
-
-
-#define  RLL_MASK  ((guint16) 0x01ff)
-
-
-/*
- * ========================================================================
- *
- *                              CODEC Functions
- *
- * ========================================================================
- */
-
-
-/* use inline assembly if possible */
-#if 1
-#define  rolw(x, n)  asm("rolw %2, %0" : "=r" (x) : "0" (x), "c" (n))
-#else
-#define  rolw(x, n)  do { x = bswap_16(x) >> (8 - (n)) } while(0)
-#endif
-
-
-static void rll_demodulate(const guint8 *src, guint8 *dst, gint n)
-{
-	guint16 state = 0, rgstr;
-	gint8 shift = 1;
-
-	n >>= 3;
-
-	while(1) {
-		rgstr = __le16_to_cpu(get_unaligned((guint16 *) src++));
-		rolw(rgstr, shift);
-		if(state & 1)
-			rgstr = ~rgstr;
-		state ^= rgstr;
-		*dst++ = rll_decode[rgstr & RLL_MASK];
-		if(++shift > 8) {
-			if(!--n)
-				break;
-			src++;
-			shift = 1;
-		}
-	}
-}
-
-
-static void rll_modulate(const guint8 *src, guint8 *dst, gint n)
-{
-	guint16 state = 0, rgstr = 0;
-	gint8 shift = 7;
-
-	n >>= 3;
-
-	while(1) {
-		if(state &= 1)
-			state = RLL_MASK;
-		state ^= rll_encode[*src++];
-		rgstr |= state << shift;
-		if(--shift >= 0) {
-			rgstr = bswap_16(rgstr);
-			*dst++ = rgstr; /* write low byte */
-			rgstr &= (guint16) 0xff00;
-		} else {
-			put_unaligned(__cpu_to_be16(rgstr), (guint16 *) dst);
-			if(!--n)
-				break;
-			dst += sizeof(guint16);
-			rgstr = 0;
-			shift = 7;
-		}
-	}
-}
-
-
 /*
  * ============================================================================
  *
@@ -235,6 +52,7 @@ static struct bkr_rll_format *caps_to_format(GstCaps *caps)
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
+	struct bkr_rll_format *format;
 
 	if(!bkr_parse_caps(caps, &videomode, &bitdensity, &sectorformat)) {
 		GST_DEBUG("failure parsing caps");
@@ -246,7 +64,18 @@ static struct bkr_rll_format *caps_to_format(GstCaps *caps)
 		return NULL;
 	}
 
-	return compute_format(videomode, bitdensity);
+	format = malloc(sizeof(*format));
+	if(!format) {
+		GST_DEBUG("memory allocation failure");
+		return NULL;
+	}
+	if(bkr_rll_format(format, videomode, bitdensity) < 0) {
+		GST_DEBUG("unrecognized format");
+		free(format);
+		return NULL;
+	}
+
+	return format;
 }
 
 
@@ -347,7 +176,7 @@ static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
-	rll_modulate(GST_BUFFER_DATA(sinkbuf), GST_BUFFER_DATA(srcbuf), filter->format->capacity);
+	bkr_rll_modulate(filter->format, GST_BUFFER_DATA(srcbuf), GST_BUFFER_DATA(sinkbuf));
 
 	result = gst_pad_push(srcpad, srcbuf);
 	if(result != GST_FLOW_OK) {
@@ -488,13 +317,6 @@ GType bkr_rllenc_get_type(void)
 			.instance_size = sizeof(BkrRLLEnc),
 			.instance_init = enc_instance_init,
 		};
-		int  i;
-
-		/* construct the decode look-up table */
-		memset(rll_decode, (gint8) -1, 512);
-		for(i = 0; i < 256; i++)
-			rll_decode[rll_encode[i]] = i;
-
 		type = g_type_register_static(GST_TYPE_ELEMENT, "BkrRLLEnc", &info, 0);
 	}
 	return type;
@@ -565,7 +387,8 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
-	rll_demodulate(GST_BUFFER_DATA(sinkbuf), GST_BUFFER_DATA(srcbuf), filter->format->capacity);
+	bkr_rll_demodulate(filter->format, GST_BUFFER_DATA(srcbuf), GST_BUFFER_DATA(sinkbuf));
+	gst_buffer_copy_metadata(srcbuf, sinkbuf, GST_BUFFER_COPY_TIMESTAMPS);
 
 	result = gst_pad_push(srcpad, srcbuf);
 	if(result != GST_FLOW_OK) {
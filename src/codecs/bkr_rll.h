@@ -25,6 +25,7 @@
 
 #include <gst/gst.h>
 #include <backer.h>
+#include <bkr_codec.h>
 
 
 G_BEGIN_DECLS
@@ -56,15 +57,7 @@ typedef struct {
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
 
-	/*
-	 * Format information.
-	 * 	capacity = corresponding frame codec capacity - modulation_pad
-	 */
-
-	struct bkr_rll_format {
-		gint capacity;
-		gint modulation_pad;
-	} *format;
+	struct bkr_rll_format *format;
 } BkrRLLEnc;
 
 
@@ -0,0 +1,220 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                         Run Length Limiting Codec
+ *
+ * Copyright (C) 2000,2001,2002,2008  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <string.h>
+
+
+#include <backer.h>
+#include <bkr_bytes.h>
+#include <bkr_codec.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                              Format Info
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Fill in the format for the given mode.  Returns 0 on success, or < 0
+ * if the mode is not recognized.
+ */
+
+
+int bkr_rll_format(struct bkr_rll_format *format, enum bkr_videomode v, enum bkr_bitdensity d)
+{
+	switch(d) {
+	case BKR_LOW:
+		switch(v) {
+		case BKR_NTSC:
+			*format = (struct bkr_rll_format) { 816, 102};
+			return 0;
+		case BKR_PAL:
+			*format = (struct bkr_rll_format) { 984, 123};
+			return 0;
+		default:
+			return -1;
+		}
+	case BKR_HIGH:
+		switch(v) {
+		case BKR_NTSC:
+			*format = (struct bkr_rll_format) {2072, 259};
+			return 0;
+		case BKR_PAL:
+			*format = (struct bkr_rll_format) {2496, 312};
+			return 0;
+		default:
+			return -1;
+		}
+	default:
+		return -1;
+	}
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              Global Data
+ *
+ * ========================================================================
+ */
+
+
+static const __u16 rll_encode[] = {
+	0x089, 0x08a, 0x08b, 0x08c, 0x08d, 0x08e, 0x091, 0x092,
+	0x093, 0x094, 0x095, 0x096, 0x099, 0x09a, 0x09b, 0x09c,
+	0x09d, 0x09e, 0x0a2, 0x0a3, 0x0a4, 0x0a5, 0x0a6, 0x0a9,
+	0x0aa, 0x0ab, 0x0ac, 0x0ad, 0x0ae, 0x0b1, 0x0b2, 0x0b3,
+	0x0b4, 0x0b5, 0x0b6, 0x0b9, 0x0ba, 0x0bb, 0x0bc, 0x0bd,
+	0x0be, 0x0c2, 0x0c3, 0x0c4, 0x0c5, 0x0c6, 0x0c9, 0x0ca,
+	0x0cb, 0x0cc, 0x0cd, 0x0ce, 0x0d1, 0x0d2, 0x0d3, 0x0d4,
+	0x0d5, 0x0d6, 0x0d9, 0x0da, 0x0db, 0x0dc, 0x0dd, 0x0de,
+	0x0e1, 0x0e2, 0x0e3, 0x0e4, 0x0e5, 0x0e6, 0x0e9, 0x0ea,
+	0x0eb, 0x0ec, 0x0ed, 0x0ee, 0x0f1, 0x0f2, 0x0f3, 0x0f4,
+	0x0f5, 0x0f6, 0x0f9, 0x0fa, 0x0fb, 0x0fc, 0x0fd, 0x109,
+	0x10a, 0x10b, 0x10c, 0x10d, 0x10e, 0x111, 0x112, 0x113,
+	0x114, 0x115, 0x116, 0x119, 0x11a, 0x11b, 0x11c, 0x11d,
+	0x11e, 0x121, 0x122, 0x123, 0x124, 0x125, 0x126, 0x129,
+	0x12a, 0x12b, 0x12c, 0x12d, 0x12e, 0x131, 0x132, 0x133,
+	0x134, 0x135, 0x136, 0x139, 0x13a, 0x13b, 0x13c, 0x13d,
+	0x13e, 0x142, 0x143, 0x144, 0x145, 0x146, 0x149, 0x14a,
+	0x14b, 0x14c, 0x14d, 0x14e, 0x151, 0x152, 0x153, 0x154,
+	0x155, 0x156, 0x159, 0x15a, 0x15b, 0x15c, 0x15d, 0x15e,
+	0x161, 0x162, 0x163, 0x164, 0x165, 0x166, 0x169, 0x16a,
+	0x16b, 0x16c, 0x16d, 0x16e, 0x171, 0x172, 0x173, 0x174,
+	0x175, 0x176, 0x179, 0x17a, 0x17b, 0x17c, 0x17d, 0x17e,
+	0x184, 0x185, 0x186, 0x189, 0x18a, 0x18b, 0x18c, 0x18d,
+	0x18e, 0x191, 0x192, 0x193, 0x194, 0x195, 0x196, 0x199,
+	0x19a, 0x19b, 0x19c, 0x19d, 0x19e, 0x1a1, 0x1a2, 0x1a3,
+	0x1a4, 0x1a5, 0x1a6, 0x1a9, 0x1aa, 0x1ab, 0x1ac, 0x1ad,
+	0x1ae, 0x1b1, 0x1b2, 0x1b3, 0x1b4, 0x1b5, 0x1b6, 0x1b9,
+	0x1ba, 0x1bb, 0x1bc, 0x1bd, 0x1be, 0x1c2, 0x1c3, 0x1c4,
+	0x1c5, 0x1c6, 0x1c9, 0x1ca, 0x1cb, 0x1cc, 0x1cd, 0x1ce,
+	0x1d1, 0x1d2, 0x1d3, 0x1d4, 0x1d5, 0x1d6, 0x1d9, 0x1da,
+	0x1db, 0x1dc, 0x1dd, 0x1de, 0x1e1, 0x1e2, 0x1e3, 0x1e4,
+	0x1e5, 0x1e6, 0x1e9, 0x1ea, 0x1eb, 0x1ec, 0x1ed, 0x1ee
+};
+
+
+static unsigned char rll_decode[512];
+
+
+#define  RLL_MASK  ((__u16) 0x01ff)
+
+
+/*
+ * Construct the decode look-up table.  Called by bkr_codec_init().
+ */
+
+
+void bkr_rll_init(void)
+{
+	int  i;
+
+	memset(rll_decode, (unsigned char) -1, 512);
+	for(i = 0; i < 256; i++)
+		rll_decode[rll_encode[i]] = i;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              CODEC Functions
+ *
+ * ========================================================================
+ */
+
+
+/* use inline assembly if possible */
+#if 1
+#define  rolw(x, n)  asm("rolw %2, %0" : "=r" (x) : "0" (x), "c" (n))
+#else
+#define  rolw(x, n)  do { x = bswap_16(x) >> (8 - (n)) } while(0)
+#endif
+
+
+/*
+ * Demodulate one sector.  capacity + modulation_pad bytes are read from
+ * src, and capacity bytes written to dst.
+ */
+
+
+void bkr_rll_demodulate(const struct bkr_rll_format *format, unsigned char *dst, const unsigned char *src)
+{
+	__u16 state = 0, rgstr;
+	signed char shift = 1;
+	int n = format->capacity >> 3;
+
+	while(1) {
+		rgstr = __le16_to_cpu(get_unaligned((__u16 *) src++));
+		rolw(rgstr, shift);
+		if(state & 1)
+			rgstr = ~rgstr;
+		state ^= rgstr;
+		*dst++ = rll_decode[rgstr & RLL_MASK];
+		if(++shift > 8) {
+			if(!--n)
+				break;
+			src++;
+			shift = 1;
+		}
+	}
+}
+
+
+/*
+ * Modulate one sector.  capacity bytes are read from src, and capacity +
+ * modulation_pad bytes written to dst.
+ */
+
+
+void bkr_rll_modulate(const struct bkr_rll_format *format, unsigned char *dst, const unsigned char *src)
+{
+	__u16 state = 0, rgstr = 0;
+	signed char shift = 7;
+	int n = format->capacity >> 3;
+
+	while(1) {
+		if(state &= 1)
+			state = RLL_MASK;
+		state ^= rll_encode[*src++];
+		rgstr |= state << shift;
+		if(--shift >= 0) {
+			rgstr = bswap_16(rgstr);
+			*dst++ = rgstr; /* write low byte */
+			rgstr &= (__u16) 0xff00;
+		} else {
+			put_unaligned(__cpu_to_be16(rgstr), (__u16 *) dst);
+			if(!--n)
+				break;
+			dst += sizeof(__u16);
+			rgstr = 0;
+			shift = 7;
+		}
+	}
+}
@@ -26,11 +26,9 @@
 
 #include <gst/gst.h>
 #include <backer.h>
+#include <bkr_codec.h>
 #include <bkr_elements.h>
-#include <bkr_bytes.h>
 #include <bkr_splp.h>
-#include <bkr_splp_randomize.h>
-#include <rs.h>
 
 
 /*
@@ -42,195 +40,10 @@
  */
 
 
-/*
- * 28 bit sector number = about 1243 hours of NTSC, or 1491 hours of PAL.
- */
-
-
 #define  SPLP_TIMEOUT_MULT       20
-#define  BKR_SECTOR_NUMBER_BITS  28
-#define  BKR_LOW_USED_BITS       4
-#define  BKR_FILLER              0x33
 #define  BOR_LENGTH              5		/* seconds */
 #define  EOR_LENGTH              1		/* seconds */
-
-
-/*
- * Format info.
- */
-
-
-static struct bkr_splp_format *compute_format(enum bkr_videomode v, enum bkr_bitdensity d, enum bkr_sectorformat f)
-{
-	struct bkr_splp_format initializer;
-	struct bkr_splp_format *format;
-
-	switch(d) {
-	case BKR_LOW:
-		switch(v) {
-		case BKR_NTSC:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_splp_format) { 720,  96,  716, 12};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_splp_format) { 830, 100,  826, 10};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		case BKR_PAL:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_splp_format) { 888,  96,  884, 12};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_splp_format) { 980, 140,  976, 14};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	case BKR_HIGH:
-		switch(v) {
-		case BKR_NTSC:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_splp_format) {1848, 224, 1844, 28};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_splp_format) {2160, 200, 2156, 20};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		case BKR_PAL:
-			switch(f) {
-			case BKR_EP:
-				initializer = (struct bkr_splp_format) {2288, 208, 2284, 26};
-				break;
-			case BKR_SP:
-				initializer = (struct bkr_splp_format) {2618, 220, 2614, 22};
-				break;
-			default:
-				GST_DEBUG("unrecognized sectorformat");
-				return NULL;
-			}
-			break;
-		default:
-			GST_DEBUG("unrecognized videomode");
-			return NULL;
-		}
-		break;
-	default:
-		GST_DEBUG("unrecognized bitdensity");
-		return NULL;
-	}
-
-	format = malloc(sizeof(*format));
-	if(!format) {
-		GST_DEBUG("memory allocation failure");
-		return NULL;
-	}
-
-	*format = initializer;
-
-	return format;
-}
-
-
-/*
- * ========================================================================
- *
- *                        Sector Header Handling
- *
- * ========================================================================
- */
-
-
-#if __BKR_BYTE_ORDER == __LITTLE_ENDIAN
-
-
-typedef struct {
-	gint32  sector_number : BKR_SECTOR_NUMBER_BITS;
-	guint32  low_used : BKR_LOW_USED_BITS;
-} bkr_sector_header_t;
-
-
-#else
-
-
-typedef struct {
-	guint32  low_used : BKR_LOW_USED_BITS;
-	gint32  sector_number : BKR_SECTOR_NUMBER_BITS;
-} bkr_sector_header_t;
-
-
-#endif /* __BKR_BYTE_ORDER */
-
-
-/* FIXME: the next two functions use aliasing, which is not guaranteed to
- * work on all platforms.  There are tricks to get it to work, but I don't
- * know what they are... */
-
-
-static bkr_sector_header_t get_sector_header(const guint8 *data, const struct bkr_splp_format *format)
-{
-	union {
-		guint32 as_int;
-		bkr_sector_header_t as_header;
-	} header;
-
-	header.as_int = get_unaligned((guint32 *) (data + format->capacity));
-	header.as_int = __le32_to_cpu(header.as_int);
-
-	return header.as_header;
-}
-
-
-static void put_sector_header(guint8 *data, const struct bkr_splp_format *format, int sector_number, int encoded_length)
-{
-	union {
-		guint32 as_int;
-		bkr_sector_header_t as_header;
-	} header = {
-		.as_header = {
-			.sector_number = sector_number,
-			.low_used = encoded_length
-		}
-	};
-
-	header.as_int = __cpu_to_le32(header.as_int);
-	memcpy(data + format->capacity, &header.as_header, sizeof(header));
-}
-
-
-static guint8 *high_used(guint8 *data, const struct bkr_splp_format *format)
-{
-	return data + format->capacity - 1;
-}
-
-
-static guint encode_sector_length(guint length)
-{
-	return length + (length / 15) + 1;
-}
-
-
-static guint decode_sector_length(guint high, guint low)
-{
-	return (high * 15) + low - 1;
-}
+#define  DEFAULT_LEAD            0		/* fields, 0 = no pacing */
 
 
 /*
@@ -253,66 +66,23 @@ struct sector_decode_status {
 	int sector_is_bor;	/* sector is part of BOR mark */
 	int sector_is_eor;	/* sector is part of EOR mark */
 	int sector_is_duplicate;	/* sector a repeat (ignore) */
+	int sector_is_scanned;	/* sector only scanned (ignore) */
 	int sectors_skipped;	/* this many sectors have been skipped */
 };
 
 
-/*
- * Retrieves the next sector from the I/O buffer.  The algorithm is to loop
- * until we either find an acceptable sector (it's a non-BOR sector and is
- * in the correct order) or we encounter an error.  If we find a sector we
- * like, we set it up for a read out and return 0;  otherwise we return < 0
- * on error.  On error, a retry can be attempted by simply re-calling this
- * function.  EOF is indicated by a sector being returned with no data in
- * it.
- *
- * We tolerate junk sectors for the first little while in order to
- * transparently skip over the noise found at the beginning of recordings.
- * This is done by silently skipping over all errors (except -EAGAIN) until
- * we find a valid data sector after which full error reporting is
- * restored.  When reporting errors, -ENODATA is returned exactly once for
- * each irrecoverable sector.
- */
-
-
-static struct sector_decode_status correct_sector(BkrSPLPDec *filter, guint8 *data)
+static struct sector_decode_status sector_status(const struct bkr_splp_sector *sector)
 {
-	guint8 *parity = data + filter->format->data_size;
-	int block, bytes_corrected;
 	struct sector_decode_status status = {
-		.sector_is_valid = 1,
-		.header_is_valid = 1,
+		.sector_is_valid = sector->sector_is_valid,
+		.header_is_valid = sector->header_is_valid,
 		.sector_is_bor = 0,
 		.sector_is_eor = 0,
 		.sector_is_duplicate = 0,
+		.sector_is_scanned = 0,
 		.sectors_skipped = 0
 	};
 
-	/* This pre-processor conditional disables error correction.
-	 * Useful for confirming that the decoding pipeline is, infact, the
-	 * inverse of the encoding pipeline (the error corrector could be
-	 * hiding off-by-one problems by just fixing the data). */
-#if 0
-	return status;
-#endif
-
-	for(block = 0; block < filter->format->interleave; block++) {
-		bytes_corrected = reed_solomon_decode(parity + block, data + block, 0, *filter->rs_format);
-		/* block is uncorrectable? */
-		if(bytes_corrected < 0) {
-			status.sector_is_valid = 0;
-			/* block contains header? */
-			if((unsigned) block >= filter->format->interleave - sizeof(bkr_sector_header_t))
-				status.header_is_valid = 0;
-			continue;
-		}
-		filter->bytes_corrected += bytes_corrected;
-		if(bytes_corrected > filter->worst_block)
-			filter->worst_block = bytes_corrected;
-		if(bytes_corrected > filter->recent_block)
-			filter->recent_block = bytes_corrected;
-	}
-
 	return status;
 }
 
@@ -320,19 +90,125 @@ static struct sector_decode_status correct_sector(BkrSPLPDec *filter, guint8 *da
 static void reset_statistics(BkrSPLPDec *filter)
 {
 	/* NOTE:  keep synchronized with defaults in dec_class_init() */
-	filter->bytes_corrected = 0;
-	filter->worst_block = 0;
-	filter->recent_block = 0;
+	filter->stats.bytes_corrected = 0;
+	filter->stats.worst_block = 0;
+	filter->stats.recent_block = 0;
 	filter->bad_sectors = 0;
 	filter->lost_runs = 0;	/* FIXME: not used? */
 	filter->duplicate_runs = 0;
 }
 
 
+/*
+ * Header-only decode used while skipping records and in catalog mode (see
+ * bkr_splp_decode_header()).  We count EOR marks and, once the requested
+ * number have gone by, wait for the next record's BOR mark to resume
+ * decoding.  In catalog mode decoding never resumes, and the sectors of
+ * each record are tallied instead.
+ */
+
+
+static void open_record(BkrSPLPDec *filter)
+{
+	filter->in_record = TRUE;
+	filter->first_sector = -1;
+	filter->last_sector = -1;
+	filter->record_sectors = 0;
+	filter->record_bytes = 0;
+}
+
+
+static void post_record(BkrSPLPDec *filter, gboolean complete)
+{
+	gst_element_post_message(GST_ELEMENT(filter), gst_message_new_element(GST_OBJECT(filter), gst_structure_new(
+		"bkr_record",
+		"record", G_TYPE_INT, filter->record,
+		"first_sector", G_TYPE_INT, filter->first_sector,
+		"last_sector", G_TYPE_INT, filter->last_sector,
+		"sectors", G_TYPE_INT, filter->record_sectors,
+		"bytes", G_TYPE_UINT64, filter->record_bytes,
+		"complete", G_TYPE_BOOLEAN, complete,
+		NULL
+	)));
+	filter->in_record = FALSE;
+}
+
+
+static void catalog_sector(BkrSPLPDec *filter, const struct bkr_splp_sector *sector)
+{
+	if(!filter->in_record)
+		/* no BOR mark:  the data began part way into a record */
+		open_record(filter);
+	if(sector->sector_number <= filter->last_sector)
+		/* duplicate */
+		return;
+
+	if(filter->first_sector < 0)
+		filter->first_sector = sector->sector_number;
+	filter->last_sector = sector->sector_number;
+	filter->record_sectors++;
+	filter->record_bytes += sector->length;
+}
+
+
+static struct sector_decode_status scan_sector(BkrSPLPDec *filter, GstBuffer *buffer)
+{
+	struct bkr_splp_sector sector;
+	struct sector_decode_status status;
+
+	GST_BUFFER_OFFSET(buffer) = GST_BUFFER_OFFSET_END(buffer) = GST_BUFFER_OFFSET_NONE;
+
+	bkr_splp_decode_header(filter->codec, GST_BUFFER_DATA(buffer), &sector, &filter->stats);
+	status = sector_status(&sector);
+	status.sector_is_scanned = 1;
+	if(!status.header_is_valid)
+		/* high_used might be garbage, can't tell an EOR */
+		return status;
+
+	if(sector.sector_number < 0) {
+		status.sector_is_bor = 1;
+		filter->in_eor = FALSE;
+		if(filter->scan) {
+			if(filter->in_record && filter->record_sectors)
+				/* the last recording was cut off */
+				post_record(filter, FALSE);
+			if(!filter->in_record)
+				open_record(filter);
+		} else if(!filter->skip_records) {
+			/* arrived:  decode this record */
+			filter->skipping = FALSE;
+			filter->sector_number = -1;
+			reset_statistics(filter);
+		}
+		return status;
+	}
+
+	GST_BUFFER_OFFSET(buffer) = sector.sector_number;
+
+	if(!sector.length) {
+		status.sector_is_eor = 1;
+		if(!filter->in_eor) {
+			filter->in_eor = TRUE;
+			if(filter->in_record)
+				post_record(filter, TRUE);
+			filter->record++;
+			if(filter->skip_records)
+				filter->skip_records--;
+		}
+	} else {
+		filter->in_eor = FALSE;
+		if(filter->scan)
+			catalog_sector(filter, &sector);
+	}
+	filter->sector_number = sector.sector_number;
+
+	return status;
+}
+
+
 static struct sector_decode_status decode_sector(BkrSPLPDec *filter, GstBuffer *buffer)
 {
-	guint8 *data = GST_BUFFER_DATA(buffer);
-	bkr_sector_header_t header;
+	struct bkr_splp_sector sector;
 	struct sector_decode_status status;
 
 	/*
@@ -342,27 +218,22 @@ static struct sector_decode_status decode_sector(BkrSPLPDec *filter, GstBuffer *
 	GST_BUFFER_OFFSET(buffer) = GST_BUFFER_OFFSET_END(buffer) = GST_BUFFER_OFFSET_NONE;
 
 	/*
-	 * Perform error correction.
+	 * Perform error correction, and extract the sector header.
 	 */
 
-	status = correct_sector(filter, data);
+	bkr_splp_decode_sector(filter->codec, GST_BUFFER_DATA(buffer), &sector, &filter->stats);
+	status = sector_status(&sector);
 	if(!status.sector_is_valid)
 		filter->bad_sectors++;
 	if(!status.header_is_valid)
 		/* can't do anything without a valid header */
 		return status;
 
-	/*
-	 * Extract sector header.
-	 */
-
-	header = get_sector_header(data, filter->format);
-
 	/*
 	 * If a BOR sector, reset error counters and move to next sector.
 	 */
 
-	if(header.sector_number < 0) {
+	if(sector.sector_number < 0) {
 		status.sector_is_bor = 1;
 		reset_statistics(filter);
 		return status;
@@ -373,13 +244,13 @@ static struct sector_decode_status decode_sector(BkrSPLPDec *filter, GstBuffer *
 	 * nothing meaningful to set the "end" offset to.
 	 */
 
-	GST_BUFFER_OFFSET(buffer) = header.sector_number;
+	GST_BUFFER_OFFSET(buffer) = sector.sector_number;
 
 	/*
 	 * If sector is a duplicate, then we're done.
 	 */
 
-	if(header.sector_number <= filter->sector_number) {
+	if(sector.sector_number <= filter->sector_number) {
 		filter->duplicate_runs += filter->not_underrunning;
 		filter->not_underrunning = 0;
 		status.sector_is_duplicate = 1;
@@ -396,77 +267,60 @@ static struct sector_decode_status decode_sector(BkrSPLPDec *filter, GstBuffer *
 	 * skipped some sectors
 	 */
 
-	status.sectors_skipped = header.sector_number - filter->sector_number - 1;
-	filter->sector_number = header.sector_number;
+	status.sectors_skipped = sector.sector_number - filter->sector_number - 1;
+	filter->sector_number = sector.sector_number;
 
 	/*
 	 * Sector is the one we want.
 	 */
 
 	filter->not_underrunning = 1;
-
-	/*
-	 * Determine the sector length and de-randomize it (it is safe for
-	 * the randomizer to go past the end of the sector by a few bytes).
-	 */
-
-	if(header.low_used)
-		GST_BUFFER_SIZE(buffer) = decode_sector_length(*high_used(data, filter->format), header.low_used);
-	else
-		GST_BUFFER_SIZE(buffer) = filter->format->capacity;
-	bkr_splp_sector_randomize(data, GST_BUFFER_SIZE(buffer), header.sector_number);
+	GST_BUFFER_SIZE(buffer) = sector.length;
 
 	/*
 	 * Sector length = 0 --> EOR mark
 	 */
 
-	if(GST_BUFFER_SIZE(buffer) == 0)
+	if(GST_BUFFER_SIZE(buffer) == 0) {
 		status.sector_is_eor = 1;
+		filter->record++;
+	}
 
 	return status;
 }
 
 
 /*
- * Encode one buffer by randomizing the data, inserting the sector header,
- * and computing parity bytes.
+ * Encode one buffer in place.  On input, the buffer's size is the amount
+ * of data in it, and it must have been allocated large enough to hold the
+ * encoded sector.
  */
 
 
 static void encode_sector(BkrSPLPEnc *filter, GstBuffer *buffer, int sector_number)
 {
-	guint8 *data = GST_BUFFER_DATA(buffer);
-	int size = GST_BUFFER_SIZE(buffer);
-	int block;
-
-	/*
-	 * Randomize the data (it is safe for the randomizer to go past the
-	 * end of the data area by a few bytes because there is space
-	 * allocated for the parity bytes).
-	 */
+	bkr_splp_encode_sector(filter->codec, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer), sector_number);
+	GST_BUFFER_SIZE(buffer) = filter->codec->format.data_size + filter->codec->format.parity_size;
+}
 
-	bkr_splp_sector_randomize(data, size, sector_number);
 
-	/*
-	 * Pad unused space, encode the data length, insert the header.
-	 */
+/*
+ * Push an encoded sector out the srcpad.  While pacing, the sector is
+ * counted against the field clock and kept for repeating (see
+ * pace_loop()).
+ */
 
-	if(size < filter->format->capacity) {
-		memset(data + size, BKR_FILLER, filter->format->capacity - size - 1);
-		size = encode_sector_length(size);
-		*high_used(data, filter->format) = size >> BKR_LOW_USED_BITS;
-		put_sector_header(data, filter->format, sector_number, size);
-	} else
-		put_sector_header(data, filter->format, sector_number, 0);
-	GST_BUFFER_SIZE(buffer) = filter->format->data_size;
 
-	/*
-	 * Generate parity bytes.
-	 */
+static GstFlowReturn push_sector(BkrSPLPEnc *filter, GstBuffer *buffer)
+{
+	if(filter->pacing) {
+		if(!filter->sectors_pushed)
+			g_get_current_time(&filter->start_time);
+		filter->sectors_pushed++;
+		gst_buffer_replace(&filter->last_sector, buffer);
+	}
 
-	for(block = 0; block < filter->format->interleave; block++)
-		reed_solomon_encode(data + filter->format->data_size + block, data + block, *filter->rs_format);
-	GST_BUFFER_SIZE(buffer) += filter->format->parity_size;
+	return gst_pad_push(filter->srcpad, buffer);
 }
 
 
@@ -474,10 +328,10 @@ static void encode_sector(BkrSPLPEnc *filter, GstBuffer *buffer, int sector_numb
  * Generate beginning-of-record and end-of-record marks.
  *
  * NOTE:  write_empty_sectors() requires the caps argument to be the caps
- * from which the filter's format structure was computed.  This function
- * will screw up if caps corresponds to a different format.  This is
- * enforced in enc_chain(), where write_empty_sectors() gets called (via
- * write_bor()) after a check for caps consistency.
+ * from which the filter's codec was created.  This function will screw up
+ * if caps corresponds to a different format.  This is enforced in
+ * enc_chain(), where write_empty_sectors() gets called (via write_bor())
+ * after a check for caps consistency.
  */
 
 
@@ -486,13 +340,13 @@ static GstFlowReturn write_empty_sectors(BkrSPLPEnc *filter, GstCaps *caps, int
 	size_t buffer_size;
 	GstFlowReturn result = GST_FLOW_OK;
 
-	if(!filter->format) {
-		GST_DEBUG("format == NULL");
+	if(!filter->codec) {
+		GST_DEBUG("codec == NULL");
 		result = GST_FLOW_NOT_NEGOTIATED;
 		goto done;
 	}
 
-	buffer_size = filter->format->data_size + filter->format->parity_size;
+	buffer_size = filter->codec->format.data_size + filter->codec->format.parity_size;
 
 	while(n--) {
 		GstBuffer *buf;
@@ -510,7 +364,7 @@ static GstFlowReturn write_empty_sectors(BkrSPLPEnc *filter, GstCaps *caps, int
 		 * gotten upto when the recording ended */
 		encode_sector(filter, buf, filter->sector_number);
 
-		result = gst_pad_push(filter->srcpad, buf);
+		result = push_sector(filter, buf);
 		if(result != GST_FLOW_OK) {
 			GST_DEBUG("gst_pad_alloc_buffer() failed");
 			goto done;
@@ -565,7 +419,7 @@ static GstFlowReturn write_eor(BkrSPLPEnc *filter, GstCaps *caps)
 
 static GstFlowReturn write_sector(BkrSPLPEnc *filter, GstCaps *caps)
 {
-	size_t size = min(gst_adapter_available(filter->adapter), (unsigned) filter->format->capacity);
+	size_t size = min(gst_adapter_available(filter->adapter), (unsigned) filter->codec->format.capacity);
 	GstBuffer *srcbuf;
 	const guint8 *data;
 	GstFlowReturn result;
@@ -575,7 +429,7 @@ static GstFlowReturn write_sector(BkrSPLPEnc *filter, GstCaps *caps)
 	/* buffer is allocated to be large enough to hold the encoded
 	 * sector, then its size is reduced to tell encode_sector() how
 	 * much data is really there */
-	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, filter->format->data_size + filter->format->parity_size, caps, &srcbuf);
+	result = gst_pad_alloc_buffer(filter->srcpad, GST_BUFFER_OFFSET_NONE, filter->codec->format.data_size + filter->codec->format.parity_size, caps, &srcbuf);
 	if(result != GST_FLOW_OK) {
 		GST_DEBUG("gst_pad_alloc_buffer() failed");
 		return result;
@@ -587,7 +441,7 @@ static GstFlowReturn write_sector(BkrSPLPEnc *filter, GstCaps *caps)
 
 	gst_adapter_flush(filter->adapter, size);
 
-	result = gst_pad_push(filter->srcpad, srcbuf);
+	result = push_sector(filter, srcbuf);
 	if(result != GST_FLOW_OK) {
 		GST_DEBUG("gst_pad_push() failed");
 		return result;
@@ -606,6 +460,45 @@ static GstFlowReturn write_sector(BkrSPLPEnc *filter, GstCaps *caps)
  */
 
 
+/*
+ * Properties
+ */
+
+
+enum enc_property {
+	ARG_ENC_LEAD = 1,
+	ARG_ENC_FILL_SECTORS
+};
+
+
+static void enc_set_property(GObject *object, enum enc_property id, const GValue *value, GParamSpec *pspec)
+{
+	BkrSPLPEnc *filter = BKR_SPLPENC(object);
+
+	switch(id) {
+	case ARG_ENC_LEAD:
+		filter->lead = g_value_get_int(value);
+		break;
+	}
+}
+
+
+static void enc_get_property(GObject *object, enum enc_property id, GValue *value, GParamSpec *pspec)
+{
+	BkrSPLPEnc *filter = BKR_SPLPENC(object);
+
+	switch(id) {
+	case ARG_ENC_LEAD:
+		g_value_set_int(value, filter->lead);
+		break;
+
+	case ARG_ENC_FILL_SECTORS:
+		g_value_set_uint(value, filter->fill_sectors);
+		break;
+	}
+}
+
+
 /*
  * Sink pad setcaps function.  See
  *
@@ -613,18 +506,23 @@ static GstFlowReturn write_sector(BkrSPLPEnc *filter, GstCaps *caps)
  */
 
 
-static struct bkr_splp_format *caps_to_format(GstCaps *caps)
+static struct bkr_splp_codec *caps_to_codec(GstCaps *caps)
 {
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
+	struct bkr_splp_codec *codec;
 
 	if(!bkr_parse_caps(caps, &videomode, &bitdensity, &sectorformat)) {
 		GST_DEBUG("failure parsing caps");
 		return NULL;
 	}
 
-	return compute_format(videomode, bitdensity, sectorformat);
+	codec = bkr_splp_codec_new(videomode, bitdensity, sectorformat);
+	if(!codec)
+		GST_DEBUG("bkr_splp_codec_new() failed");
+
+	return codec;
 }
 
 
@@ -633,22 +531,15 @@ static gboolean enc_setcaps(GstPad *pad, GstCaps *caps)
 	BkrSPLPEnc *filter = BKR_SPLPENC(gst_pad_get_parent(pad));
 	gboolean result;
 
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
+	g_mutex_lock(filter->pace_lock);
+	bkr_splp_codec_free(filter->codec);
+	filter->codec = caps_to_codec(caps);
+	if(filter->codec)
+		/* for the BOR and EOR lengths, and the field clock */
+		bkr_parse_caps(caps, &filter->videomode, &filter->bitdensity, &filter->sectorformat);
+	g_mutex_unlock(filter->pace_lock);
 
-	free(filter->format);
-	filter->format = caps_to_format(caps);
-
-	if(filter->format) {
-		filter->rs_format = reed_solomon_codec_new((filter->format->data_size + filter->format->parity_size) / filter->format->interleave, filter->format->data_size / filter->format->interleave, filter->format->interleave);
-		if(!filter->rs_format) {
-			GST_DEBUG("reed_solomon_codec_new() failed");
-			free(filter->format);
-			filter->format = NULL;
-		}
-	}
-
-	result = filter->format ? TRUE : FALSE;
+	result = filter->codec ? TRUE : FALSE;
 
 	gst_object_unref(filter);
 
@@ -682,6 +573,179 @@ static GstFlowReturn enc_flush(BkrSPLPEnc *filter, GstCaps *caps)
 }
 
 
+/*
+ * Pacing.  bkr_splpenc normally pushes sectors out as fast as data
+ * arrives, and when the source can't keep up the tape is left to run dry:
+ * the driver pads the gap with filler, which does not decode.  With the
+ * lead property set, sectors are instead pushed by a task on the src pad
+ * that keeps lead fields queued ahead of the tape.  When it runs short of
+ * data the task repeats the last sector it pushed, which the decoder
+ * discards as a duplicate (or, before any data, as more of the BOR
+ * mark).  Empty sectors can't be used for this:  inside a record a
+ * sector of length 0 is the EOR mark to a decoder that has not seen the
+ * sector before it.
+ *
+ * The lead is asked of the sink (see bkr_query_new_lead()), and if it
+ * can't tell, as before the transfer has started or when not writing to
+ * a Backer device, it is estimated from the field clock.
+ */
+
+
+static gint pace_lead(BkrSPLPEnc *filter)
+{
+	GstQuery *query = bkr_query_new_lead();
+	gint fields = -1;
+	GTimeVal now;
+	double elapsed;
+
+	if(gst_pad_peer_query(filter->srcpad, query))
+		bkr_query_parse_lead(query, &fields);
+	gst_query_unref(query);
+	if(fields >= 0)
+		return fields;
+
+	g_get_current_time(&now);
+	elapsed = (now.tv_sec - filter->start_time.tv_sec) + (now.tv_usec - filter->start_time.tv_usec) / 1e6;
+
+	return filter->sectors_pushed - elapsed * bkr_fields_per_second(filter->videomode);
+}
+
+
+static GstFlowReturn pace_end_record(BkrSPLPEnc *filter)
+{
+	GstEvent *event;
+	GstFlowReturn result;
+
+	result = enc_flush(filter, filter->pace_caps);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("enc_flush() failed");
+		return result;
+	}
+
+	result = write_eor(filter, filter->pace_caps);
+	if(result != GST_FLOW_OK) {
+		GST_DEBUG("failure writing EOR mark");
+		return result;
+	}
+
+	event = filter->pace_eos;
+	filter->pace_eos = NULL;
+	if(!gst_pad_push_event(filter->srcpad, event)) {
+		GST_DEBUG("failure forwarding EOS");
+		return GST_FLOW_ERROR;
+	}
+
+	/*
+	 * idle until the next record
+	 */
+
+	gst_caps_replace(&filter->pace_caps, NULL);
+	gst_buffer_replace(&filter->last_sector, NULL);
+	filter->sectors_pushed = 0;
+
+	return GST_FLOW_OK;
+}
+
+
+static void pace_loop(gpointer data)
+{
+	BkrSPLPEnc *filter = BKR_SPLPENC(data);
+	GstFlowReturn result = GST_FLOW_OK;
+	GTimeVal timeout;
+
+	g_mutex_lock(filter->pace_lock);
+
+	if(filter->pace_flushing) {
+		result = GST_FLOW_WRONG_STATE;
+		goto done;
+	}
+
+	if(!filter->pace_caps) {
+		/* no data since the last record */
+		g_cond_wait(filter->pace_cond, filter->pace_lock);
+		goto done;
+	}
+
+	if(filter->sector_number < 0) {
+		result = write_bor(filter, filter->pace_caps);
+		if(result != GST_FLOW_OK)
+			GST_DEBUG("failure writing BOR mark");
+	} else if((int) gst_adapter_available(filter->adapter) >= filter->codec->format.capacity) {
+		result = write_sector(filter, filter->pace_caps);
+		if(result != GST_FLOW_OK)
+			GST_DEBUG("write_sector() failed");
+	} else if(filter->pace_eos) {
+		result = pace_end_record(filter);
+		if(result != GST_FLOW_OK && result != GST_FLOW_WRONG_STATE)
+			/* nobody upstream is left to report it */
+			GST_ELEMENT_ERROR(filter, STREAM, FAILED, ("failure ending record"), (NULL));
+	} else if(filter->last_sector && pace_lead(filter) < filter->lead) {
+		/* starved */
+		filter->fill_sectors++;
+		result = push_sector(filter, gst_buffer_ref(filter->last_sector));
+		if(result != GST_FLOW_OK)
+			GST_DEBUG("push_sector() failed");
+	} else {
+		/* ahead of the tape:  wait a field, or for data */
+		g_get_current_time(&timeout);
+		g_time_val_add(&timeout, 1e6 / bkr_fields_per_second(filter->videomode));
+		g_cond_timed_wait(filter->pace_cond, filter->pace_lock, &timeout);
+	}
+
+done:
+	if(result != GST_FLOW_OK) {
+		filter->pace_result = result;
+		gst_pad_pause_task(filter->srcpad);
+	}
+	/* wake the chain function */
+	g_cond_broadcast(filter->pace_cond);
+	g_mutex_unlock(filter->pace_lock);
+}
+
+
+/*
+ * Src pad activatepush function.  Starts and stops the pacing task.
+ */
+
+
+static gboolean enc_src_activate_push(GstPad *pad, gboolean active)
+{
+	BkrSPLPEnc *filter = BKR_SPLPENC(gst_pad_get_parent(pad));
+	gboolean result = TRUE;
+
+	if(active) {
+		g_mutex_lock(filter->pace_lock);
+		filter->pacing = filter->lead > 0;
+		filter->pace_flushing = FALSE;
+		filter->pace_result = GST_FLOW_OK;
+		filter->sectors_pushed = 0;
+		filter->fill_sectors = 0;
+		g_mutex_unlock(filter->pace_lock);
+		if(filter->pacing)
+			result = gst_pad_start_task(pad, pace_loop, filter);
+	} else {
+		g_mutex_lock(filter->pace_lock);
+		filter->pace_flushing = TRUE;
+		g_cond_broadcast(filter->pace_cond);
+		g_mutex_unlock(filter->pace_lock);
+
+		result = gst_pad_stop_task(pad);
+
+		g_mutex_lock(filter->pace_lock);
+		if(filter->pace_eos) {
+			gst_event_unref(filter->pace_eos);
+			filter->pace_eos = NULL;
+		}
+		gst_caps_replace(&filter->pace_caps, NULL);
+		gst_buffer_replace(&filter->last_sector, NULL);
+		g_mutex_unlock(filter->pace_lock);
+	}
+
+	gst_object_unref(filter);
+	return result;
+}
+
+
 static gboolean enc_event(GstPad *pad, GstEvent *event)
 {
 	BkrSPLPEnc *filter = BKR_SPLPENC(gst_pad_get_parent(pad));
@@ -695,22 +759,43 @@ static gboolean enc_event(GstPad *pad, GstEvent *event)
 		 */
 
 		/*
-		 * forward the new segment event
+		 * forward the new segment event.  the lock keeps it from
+		 * overtaking sectors being pushed by the pacing task
 		 */
 
+		g_mutex_lock(filter->pace_lock);
 		result = gst_pad_push_event(filter->srcpad, event);
-		if(!result)
-			break;
 
 		/*
 		 * initialize the sector number so as to induce a BOR mark
 		 * to be written
 		 */
 
-		filter->sector_number = -1;
+		if(result)
+			filter->sector_number = -1;
+		g_mutex_unlock(filter->pace_lock);
 		break;
 
 	case GST_EVENT_EOS:
+		if(filter->pacing) {
+			/*
+			 * the pacing task ends the record and forwards the
+			 * event once it has pushed the data before it
+			 */
+
+			g_mutex_lock(filter->pace_lock);
+			if(filter->pace_caps) {
+				if(filter->pace_eos)
+					gst_event_unref(filter->pace_eos);
+				filter->pace_eos = event;
+				g_cond_broadcast(filter->pace_cond);
+				result = TRUE;
+			} else
+				result = gst_pad_push_event(filter->srcpad, event);
+			g_mutex_unlock(filter->pace_lock);
+			break;
+		}
+
 		/*
 		 * flush the adapter.
 		 */
@@ -775,6 +860,23 @@ static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
 		goto done;
 	}
 
+	if(filter->pacing) {
+		/*
+		 * hand the data to the pacing task, and wait for it to
+		 * encode the whole sectors
+		 */
+
+		g_mutex_lock(filter->pace_lock);
+		gst_caps_replace(&filter->pace_caps, caps);
+		gst_adapter_push(filter->adapter, sinkbuf);
+		g_cond_broadcast(filter->pace_cond);
+		while(!filter->pace_flushing && filter->pace_result == GST_FLOW_OK && (int) gst_adapter_available(filter->adapter) >= filter->codec->format.capacity)
+			g_cond_wait(filter->pace_cond, filter->pace_lock);
+		result = filter->pace_flushing ? GST_FLOW_WRONG_STATE : filter->pace_result;
+		g_mutex_unlock(filter->pace_lock);
+		goto done;
+	}
+
 	gst_adapter_push(filter->adapter, sinkbuf);
 
 	if(filter->sector_number < 0) {
@@ -785,7 +887,7 @@ static GstFlowReturn enc_chain(GstPad *pad, GstBuffer *sinkbuf)
 		}
 	}
 
-	while((int) gst_adapter_available(filter->adapter) >= filter->format->capacity) {
+	while((int) gst_adapter_available(filter->adapter) >= filter->codec->format.capacity) {
 		result = write_sector(filter, caps);
 		if(result != GST_FLOW_OK) {
 			GST_DEBUG("write_sector() failed");
@@ -823,10 +925,12 @@ static void enc_finalize(GObject *object)
 	filter->adapter = NULL;
 	gst_object_unref(filter->srcpad);
 	filter->srcpad = NULL;
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-	free(filter->format);
-	filter->format = NULL;
+	bkr_splp_codec_free(filter->codec);
+	filter->codec = NULL;
+	g_mutex_free(filter->pace_lock);
+	filter->pace_lock = NULL;
+	g_cond_free(filter->pace_cond);
+	filter->pace_cond = NULL;
 
 	G_OBJECT_CLASS(enc_parent_class)->finalize(object);
 }
@@ -880,6 +984,14 @@ static void enc_base_init(gpointer class)
 
 static void enc_class_init(gpointer class, gpointer class_data)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+	object_class->set_property = enc_set_property;
+	object_class->get_property = enc_get_property;
+
+	g_object_class_install_property(object_class, ARG_ENC_LEAD, g_param_spec_int("lead", "Lead", "Fields to keep queued ahead of the tape, repeating sectors if the data can't keep up (0 = don't pace)", 0, INT_MAX, DEFAULT_LEAD, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_ENC_FILL_SECTORS, g_param_spec_uint("fill_sectors", "Fill sectors", "Sectors repeated to keep the lead", 0, UINT_MAX, 0, G_PARAM_READABLE));
+
 	enc_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 }
 
@@ -908,15 +1020,23 @@ static void enc_instance_init(GTypeInstance *object, gpointer class)
 
 	/* configure src pad */
 	pad = gst_element_get_static_pad(element, "src");
+	gst_pad_set_activatepush_function(pad, enc_src_activate_push);
 
 	/* consider this to consume the reference */
 	filter->srcpad = pad;
 
 	/* internal state */
 	filter->adapter = gst_adapter_new();
-	filter->rs_format = NULL;
-	filter->format = NULL;
+	filter->codec = NULL;
 	filter->sector_number = 0;
+	filter->lead = DEFAULT_LEAD;
+	filter->pace_lock = g_mutex_new();
+	filter->pace_cond = g_cond_new();
+	filter->pacing = FALSE;
+	filter->pace_eos = NULL;
+	filter->pace_caps = NULL;
+	filter->last_sector = NULL;
+	filter->fill_sectors = 0;
 }
 
 
@@ -963,7 +1083,13 @@ enum property {
 	ARG_DEC_RECENT_BLOCK,
 	ARG_DEC_BAD_SECTORS,
 	ARG_DEC_LOST_RUNS,
-	ARG_DEC_DUPLICATE_RUNS
+	ARG_DEC_DUPLICATE_RUNS,
+	ARG_DEC_RECORD,
+	ARG_DEC_SECTOR_NUMBER,
+	ARG_DEC_SKIP_RECORDS,
+	ARG_DEC_BLOCK_PARITY,
+	ARG_DEC_POST_SECTORS,
+	ARG_DEC_SCAN
 };
 
 
@@ -973,15 +1099,15 @@ static void dec_set_property(GObject *object, enum property id, const GValue *va
 
 	switch(id) {
 	case ARG_DEC_BYTES_CORRECTED:
-		filter->bytes_corrected = g_value_get_int(value);
+		filter->stats.bytes_corrected = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_WORST_BLOCK:
-		filter->worst_block = g_value_get_int(value);
+		filter->stats.worst_block = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_RECENT_BLOCK:
-		filter->recent_block = g_value_get_int(value);
+		filter->stats.recent_block = g_value_get_int(value);
 		break;
 
 	case ARG_DEC_BAD_SECTORS:
@@ -995,6 +1121,26 @@ static void dec_set_property(GObject *object, enum property id, const GValue *va
 	case ARG_DEC_DUPLICATE_RUNS:
 		filter->duplicate_runs = g_value_get_int(value);
 		break;
+
+	case ARG_DEC_RECORD:
+		filter->record = g_value_get_int(value);
+		break;
+
+	case ARG_DEC_SKIP_RECORDS:
+		filter->skip_records = g_value_get_int(value);
+		if(filter->skip_records)
+			filter->skipping = TRUE;
+		break;
+
+	case ARG_DEC_POST_SECTORS:
+		filter->post_sectors = g_value_get_boolean(value);
+		break;
+
+	case ARG_DEC_SCAN:
+		filter->scan = g_value_get_boolean(value);
+		if(filter->scan)
+			filter->skipping = TRUE;
+		break;
 	}
 }
 
@@ -1005,15 +1151,15 @@ static void dec_get_property(GObject *object, enum property id, GValue *value, G
 
 	switch(id) {
 	case ARG_DEC_BYTES_CORRECTED:
-		g_value_set_int(value, filter->bytes_corrected);
+		g_value_set_int(value, filter->stats.bytes_corrected);
 		break;
 
 	case ARG_DEC_WORST_BLOCK:
-		g_value_set_int(value, filter->worst_block);
+		g_value_set_int(value, filter->stats.worst_block);
 		break;
 
 	case ARG_DEC_RECENT_BLOCK:
-		g_value_set_int(value, filter->recent_block);
+		g_value_set_int(value, filter->stats.recent_block);
 		break;
 
 	case ARG_DEC_BAD_SECTORS:
@@ -1027,10 +1173,54 @@ static void dec_get_property(GObject *object, enum property id, GValue *value, G
 	case ARG_DEC_DUPLICATE_RUNS:
 		g_value_set_int(value, filter->duplicate_runs);
 		break;
+
+	case ARG_DEC_RECORD:
+		g_value_set_int(value, filter->record);
+		break;
+
+	case ARG_DEC_SECTOR_NUMBER:
+		g_value_set_int(value, filter->sector_number);
+		break;
+
+	case ARG_DEC_SKIP_RECORDS:
+		g_value_set_int(value, filter->skip_records);
+		break;
+
+	case ARG_DEC_BLOCK_PARITY:
+		g_value_set_int(value, filter->codec ? filter->codec->format.parity_size / filter->codec->format.interleave : 0);
+		break;
+
+	case ARG_DEC_POST_SECTORS:
+		g_value_set_boolean(value, filter->post_sectors);
+		break;
+
+	case ARG_DEC_SCAN:
+		g_value_set_boolean(value, filter->scan);
+		break;
 	}
 }
 
 
+/*
+ * Post a sector's position on the bus.  record is the number of EOR marks
+ * passed before the sector.
+ */
+
+
+static void post_sector(BkrSPLPDec *filter, guint64 offset, gint sector_number, gint record, struct sector_decode_status status)
+{
+	gst_element_post_message(GST_ELEMENT(filter), gst_message_new_element(GST_OBJECT(filter), gst_structure_new(
+		"bkr_sector",
+		"offset", G_TYPE_UINT64, offset,
+		"sector_number", G_TYPE_INT, sector_number,
+		"record", G_TYPE_INT, record,
+		"bor", G_TYPE_BOOLEAN, status.sector_is_bor ? TRUE : FALSE,
+		"eor", G_TYPE_BOOLEAN, status.sector_is_eor ? TRUE : FALSE,
+		NULL
+	)));
+}
+
+
 /*
  * Sink pad setcaps function.  See
  *
@@ -1043,22 +1233,12 @@ static gboolean dec_setcaps(GstPad *pad, GstCaps *caps)
 	BkrSPLPDec *filter = BKR_SPLPDEC(gst_pad_get_parent(pad));
 	gboolean result;
 
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-
-	free(filter->format);
-	filter->format = caps_to_format(caps);
-	if(filter->format) {
+	bkr_splp_codec_free(filter->codec);
+	filter->codec = caps_to_codec(caps);
+	if(filter->codec)
 		reset_statistics(filter);
-		filter->rs_format = reed_solomon_codec_new((filter->format->data_size + filter->format->parity_size) / filter->format->interleave, filter->format->data_size / filter->format->interleave, filter->format->interleave);
-		if(!filter->rs_format) {
-			GST_DEBUG("reed_solomon_codec_new() failed");
-			free(filter->format);
-			filter->format = NULL;
-		}
-	}
 
-	result = filter->format ? TRUE : FALSE;
+	result = filter->codec ? TRUE : FALSE;
 
 	gst_object_unref(filter);
 
@@ -1066,6 +1246,26 @@ static gboolean dec_setcaps(GstPad *pad, GstCaps *caps)
 }
 
 
+/*
+ * Sink pad event function.  In catalog mode, a record still open at the
+ * end of the data was cut off, and is posted as such.
+ */
+
+
+static gboolean dec_event(GstPad *pad, GstEvent *event)
+{
+	BkrSPLPDec *filter = BKR_SPLPDEC(gst_pad_get_parent(pad));
+	gboolean result;
+
+	if(GST_EVENT_TYPE(event) == GST_EVENT_EOS && filter->scan && filter->in_record)
+		post_record(filter, FALSE);
+	result = gst_pad_event_default(pad, event);
+
+	gst_object_unref(filter);
+	return result;
+}
+
+
 /*
  * Chain function.  See
  *
@@ -1079,6 +1279,8 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 	GstCaps *caps = gst_buffer_get_caps(sinkbuf);
 	GstPad *srcpad = filter->srcpad;
 	struct sector_decode_status status;
+	guint64 raw_offset = GST_BUFFER_OFFSET(sinkbuf);
+	gint record = filter->record;
 	GstFlowReturn result;
 
 	if(!caps || (caps != GST_PAD_CAPS(pad))) {
@@ -1094,17 +1296,29 @@ static GstFlowReturn dec_chain(GstPad *pad, GstBuffer *sinkbuf)
 	 * perform an in-place decode of the sector
 	 */
 
-	status = decode_sector(filter, sinkbuf);
+	if(filter->skipping)
+		status = scan_sector(filter, sinkbuf);
+	else
+		status = decode_sector(filter, sinkbuf);
+
+	/*
+	 * report where the sector came from.  the offset of the field in
+	 * the raw stream arrives in the buffer's offset, and the sector
+	 * number leaves in it.
+	 */
+
+	if(filter->post_sectors && raw_offset != GST_BUFFER_OFFSET_NONE && (status.sector_is_bor || GST_BUFFER_OFFSET(sinkbuf) != GST_BUFFER_OFFSET_NONE))
+		post_sector(filter, raw_offset, status.sector_is_bor ? -1 : (gint) GST_BUFFER_OFFSET(sinkbuf), record, status);
 
 	/*
-	 * ignore beginning-of-record and duplicate sectors.  can't
-	 * determine anything about a sector without a valid header, so
-	 * ignore those too.  NOTE:  it's normal to get some completely
-	 * hosed sectors at the start of a recording as the VCR seeks
-	 * around to lock onto the signal.
+	 * ignore beginning-of-record and duplicate sectors, and sectors in
+	 * records being skipped.  can't determine anything about a sector
+	 * without a valid header, so ignore those too.  NOTE:  it's normal
+	 * to get some completely hosed sectors at the start of a recording
+	 * as the VCR seeks around to lock onto the signal.
 	 */
 
-	if(!status.header_is_valid || status.sector_is_bor || status.sector_is_duplicate) {
+	if(!status.header_is_valid || status.sector_is_bor || status.sector_is_duplicate || status.sector_is_scanned) {
 		gst_buffer_unref(sinkbuf);
 		result = GST_FLOW_OK;
 		goto done;
@@ -1186,10 +1400,8 @@ static void dec_finalize(GObject *object)
 
 	gst_object_unref(filter->srcpad);
 	filter->srcpad = NULL;
-	reed_solomon_codec_free(filter->rs_format);
-	filter->rs_format = NULL;
-	free(filter->format);
-	filter->format = NULL;
+	bkr_splp_codec_free(filter->codec);
+	filter->codec = NULL;
 
 	G_OBJECT_CLASS(dec_parent_class)->finalize(object);
 }
@@ -1253,6 +1465,12 @@ static void dec_class_init(gpointer class, gpointer class_data)
 	g_object_class_install_property(object_class, ARG_DEC_BAD_SECTORS, g_param_spec_int("bad_sectors", "Bad sectors", "Bad Sectors", 0, INT_MAX, 0, G_PARAM_READWRITE));
 	g_object_class_install_property(object_class, ARG_DEC_LOST_RUNS, g_param_spec_int("lost_runs", "Lost runs", "Lost runs", 0, INT_MAX, 0, G_PARAM_READWRITE));
 	g_object_class_install_property(object_class, ARG_DEC_DUPLICATE_RUNS, g_param_spec_int("duplicate_runs", "Duplicate runs", "Duplicate runs", 0, INT_MAX, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_RECORD, g_param_spec_int("record", "Record", "End-of-record marks passed, including any before the start of the input", 0, INT_MAX, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_SECTOR_NUMBER, g_param_spec_int("sector_number", "Sector number", "Last sector number in the current record", -1, INT_MAX, -1, G_PARAM_READABLE));
+	g_object_class_install_property(object_class, ARG_DEC_SKIP_RECORDS, g_param_spec_int("skip_records", "Skip records", "Records still to be skipped by scanning sector headers only", 0, INT_MAX, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_BLOCK_PARITY, g_param_spec_int("block_parity", "Block parity", "Parity bytes per Reed-Solomon block", 0, INT_MAX, 0, G_PARAM_READABLE));
+	g_object_class_install_property(object_class, ARG_DEC_POST_SECTORS, g_param_spec_boolean("post_sectors", "Post sectors", "Post a bkr_sector element message for each sector header read", FALSE, G_PARAM_READWRITE));
+	g_object_class_install_property(object_class, ARG_DEC_SCAN, g_param_spec_boolean("scan", "Scan", "Only scan sector headers, and post a bkr_record element message cataloguing each record", FALSE, G_PARAM_READWRITE));
 
 	dec_parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 }
@@ -1277,6 +1495,7 @@ static void dec_instance_init(GTypeInstance *object, gpointer class)
 	pad = gst_element_get_static_pad(element, "sink");
 	gst_pad_set_setcaps_function(pad, dec_setcaps);
 	gst_pad_set_chain_function(pad, dec_chain);
+	gst_pad_set_event_function(pad, dec_event);
 	gst_object_unref(pad);
 
 	/* configure src pad */
@@ -1286,9 +1505,15 @@ static void dec_instance_init(GTypeInstance *object, gpointer class)
 	filter->srcpad = pad;
 
 	/* internal state */
-	filter->rs_format = NULL;
-	filter->format = NULL;
+	filter->codec = NULL;
 	filter->sector_number = -1;	/* first sector we want is 0 */
+	filter->record = 0;
+	filter->skip_records = 0;
+	filter->skipping = FALSE;
+	filter->in_eor = FALSE;
+	filter->post_sectors = FALSE;
+	filter->scan = FALSE;
+	filter->in_record = FALSE;
 }
 
 
@@ -28,7 +28,7 @@
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
 #include <backer.h>
-#include <rs.h>
+#include <bkr_codec.h>
 
 
 G_BEGIN_DECLS
@@ -61,21 +61,30 @@ typedef struct {
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
 
-	/*
-	 * Format information.
-	 *	capacity = data_size - sizeof(header)
-	 */
+	struct bkr_splp_codec *codec;
 
-	struct bkr_splp_format {
-		gint data_size;
-		gint parity_size;
-		gint capacity;
-		gint interleave;
-	} *format;
+	gint sector_number;
 
-	rs_format_t *rs_format;
+	/*
+	 * pacing (see pace_loop()).  lead is the number of fields to keep
+	 * queued ahead of the tape, 0 to disable pacing.  while pacing,
+	 * the adapter, codec, sector number and pace_ members are shared
+	 * between the streaming thread and the pacing task and are
+	 * protected by pace_lock;  the rest belong to the task.
+	 */
 
-	gint sector_number;
+	gint lead;
+	GMutex *pace_lock;
+	GCond *pace_cond;
+	gboolean pacing;		/* task is running */
+	gboolean pace_flushing;		/* task is being stopped */
+	GstEvent *pace_eos;		/* end of record, to be forwarded */
+	GstCaps *pace_caps;		/* caps of the data in the adapter */
+	GstFlowReturn pace_result;	/* last push result from the task */
+	GTimeVal start_time;		/* when the first sector was pushed */
+	guint64 sectors_pushed;		/* sectors pushed since then */
+	GstBuffer *last_sector;		/* repeated when starved */
+	guint fill_sectors;		/* sectors repeated so far */
 } BkrSPLPEnc;
 
 
@@ -107,18 +116,45 @@ typedef struct {
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
-	struct bkr_splp_format *format;
-	rs_format_t *rs_format;
+	struct bkr_splp_codec *codec;
 
 	gint header_is_good;
-	gint bytes_corrected;
-	gint worst_block;
-	gint recent_block;
+	struct bkr_splp_stats stats;
 	gint bad_sectors;
 	gint lost_runs;
 	gint duplicate_runs;
 	gint not_underrunning;
 	gint sector_number;
+
+	/*
+	 * Record position.  record counts the EOR marks passed, while
+	 * skip_records > 0 sectors are only scanned for their headers
+	 * and discarded.
+	 */
+
+	gint record;
+	gint skip_records;
+	gboolean skipping;
+	gboolean in_eor;
+
+	/*
+	 * post a "bkr_sector" element message for each sector header read
+	 */
+
+	gboolean post_sectors;
+
+	/*
+	 * Catalog mode.  All sectors are only scanned for their headers,
+	 * and a "bkr_record" element message is posted for each record
+	 * describing the sectors found in it.
+	 */
+
+	gboolean scan;
+	gboolean in_record;
+	gint first_sector;
+	gint last_sector;
+	gint record_sectors;
+	guint64 record_bytes;
 } BkrSPLPDec;
 
 
@@ -0,0 +1,401 @@
+/*
+ * Driver for Danmere's Backer 16/32 video tape backup cards.
+ *
+ *                             Formating Layer
+ *
+ * Copyright (C) 2000,2001,2002  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#include <backer.h>
+#include <bkr_bytes.h>
+#include <bkr_codec.h>
+#include <bkr_splp_randomize.h>
+#include <rs.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                              PARAMETERS
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * 28 bit sector number = about 1243 hours of NTSC, or 1491 hours of PAL.
+ */
+
+
+#define  BKR_SECTOR_NUMBER_BITS  28
+#define  BKR_LOW_USED_BITS       4
+#define  BKR_FILLER              0x33
+
+
+/*
+ * Format info.  Returns 0 on success, or < 0 if the mode is not
+ * recognized.
+ */
+
+
+int bkr_splp_format(struct bkr_splp_format *format, enum bkr_videomode v, enum bkr_bitdensity d, enum bkr_sectorformat f)
+{
+	switch(d) {
+	case BKR_LOW:
+		switch(v) {
+		case BKR_NTSC:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_splp_format) { 720,  96,  716, 12};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_splp_format) { 830, 100,  826, 10};
+				return 0;
+			default:
+				return -1;
+			}
+		case BKR_PAL:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_splp_format) { 888,  96,  884, 12};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_splp_format) { 980, 140,  976, 14};
+				return 0;
+			default:
+				return -1;
+			}
+		default:
+			return -1;
+		}
+	case BKR_HIGH:
+		switch(v) {
+		case BKR_NTSC:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_splp_format) {1848, 224, 1844, 28};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_splp_format) {2160, 200, 2156, 20};
+				return 0;
+			default:
+				return -1;
+			}
+		case BKR_PAL:
+			switch(f) {
+			case BKR_EP:
+				*format = (struct bkr_splp_format) {2288, 208, 2284, 26};
+				return 0;
+			case BKR_SP:
+				*format = (struct bkr_splp_format) {2618, 220, 2614, 22};
+				return 0;
+			default:
+				return -1;
+			}
+		default:
+			return -1;
+		}
+	default:
+		return -1;
+	}
+}
+
+
+/*
+ * Create and destroy a codec.  bkr_splp_codec_new() returns NULL if the
+ * mode is not recognized or on memory allocation failure.
+ */
+
+
+struct bkr_splp_codec *bkr_splp_codec_new(enum bkr_videomode v, enum bkr_bitdensity d, enum bkr_sectorformat f)
+{
+	struct bkr_splp_codec *codec = malloc(sizeof(*codec));
+
+	if(!codec)
+		return NULL;
+	if(bkr_splp_format(&codec->format, v, d, f) < 0) {
+		free(codec);
+		return NULL;
+	}
+	codec->rs_format = reed_solomon_codec_new((codec->format.data_size + codec->format.parity_size) / codec->format.interleave, codec->format.data_size / codec->format.interleave, codec->format.interleave);
+	if(!codec->rs_format) {
+		free(codec);
+		return NULL;
+	}
+
+	return codec;
+}
+
+
+void bkr_splp_codec_free(struct bkr_splp_codec *codec)
+{
+	if(!codec)
+		return;
+	reed_solomon_codec_free(codec->rs_format);
+	free(codec);
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                        Sector Header Handling
+ *
+ * ========================================================================
+ */
+
+
+#if __BKR_BYTE_ORDER == __LITTLE_ENDIAN
+
+
+typedef struct {
+	__s32  sector_number : BKR_SECTOR_NUMBER_BITS;
+	__u32  low_used : BKR_LOW_USED_BITS;
+} bkr_sector_header_t;
+
+
+#else
+
+
+typedef struct {
+	__u32  low_used : BKR_LOW_USED_BITS;
+	__s32  sector_number : BKR_SECTOR_NUMBER_BITS;
+} bkr_sector_header_t;
+
+
+#endif /* __BKR_BYTE_ORDER */
+
+
+/* FIXME: the next two functions use aliasing, which is not guaranteed to
+ * work on all platforms.  There are tricks to get it to work, but I don't
+ * know what they are... */
+
+
+static bkr_sector_header_t get_sector_header(const unsigned char *data, const struct bkr_splp_format *format)
+{
+	union {
+		__u32 as_int;
+		bkr_sector_header_t as_header;
+	} header;
+
+	header.as_int = get_unaligned((__u32 *) (data + format->capacity));
+	header.as_int = __le32_to_cpu(header.as_int);
+
+	return header.as_header;
+}
+
+
+static void put_sector_header(unsigned char *data, const struct bkr_splp_format *format, int sector_number, int encoded_length)
+{
+	union {
+		__u32 as_int;
+		bkr_sector_header_t as_header;
+	} header = {
+		.as_header = {
+			.sector_number = sector_number,
+			.low_used = encoded_length
+		}
+	};
+
+	header.as_int = __cpu_to_le32(header.as_int);
+	memcpy(data + format->capacity, &header.as_header, sizeof(header));
+}
+
+
+static unsigned char *high_used(unsigned char *data, const struct bkr_splp_format *format)
+{
+	return data + format->capacity - 1;
+}
+
+
+static unsigned encode_sector_length(unsigned length)
+{
+	return length + (length / 15) + 1;
+}
+
+
+static unsigned decode_sector_length(unsigned high, unsigned low)
+{
+	return (high * 15) + low - 1;
+}
+
+
+/*
+ * Read the sector number and data length from the header.  The high_used
+ * byte is not randomized, so this can be done before the payload is
+ * de-randomized.  If high_used has been corrupted it can claim more data
+ * than the sector holds, so the length is clipped to the capacity.
+ */
+
+
+static void read_sector_header(unsigned char *data, const struct bkr_splp_format *format, struct bkr_splp_sector *sector)
+{
+	bkr_sector_header_t header = get_sector_header(data, format);
+
+	sector->sector_number = header.sector_number;
+	if(header.low_used)
+		sector->length = decode_sector_length(*high_used(data, format), header.low_used);
+	else
+		sector->length = format->capacity;
+	if(sector->length > format->capacity)
+		sector->length = format->capacity;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              SP/LP CODEC
+ *
+ * ========================================================================
+ */
+
+
+/*
+ * Error correct a sector in place, starting at the given interleave
+ * column.  Columns before first_block are left as they are.
+ */
+
+
+static void correct_sector(const struct bkr_splp_codec *codec, unsigned char *data, int first_block, struct bkr_splp_sector *sector, struct bkr_splp_stats *stats)
+{
+	unsigned char *parity = data + codec->format.data_size;
+	int block, bytes_corrected;
+
+	sector->sector_is_valid = 1;
+	sector->header_is_valid = 1;
+	sector->sector_number = -1;
+	sector->length = 0;
+
+	/* This pre-processor conditional disables error correction.
+	 * Useful for confirming that the decoding pipeline is, infact, the
+	 * inverse of the encoding pipeline (the error corrector could be
+	 * hiding off-by-one problems by just fixing the data). */
+#if 0
+	return;
+#endif
+
+	for(block = first_block; block < codec->format.interleave; block++) {
+		bytes_corrected = reed_solomon_decode(parity + block, data + block, 0, *codec->rs_format);
+		/* block is uncorrectable? */
+		if(bytes_corrected < 0) {
+			sector->sector_is_valid = 0;
+			/* block contains header? */
+			if((unsigned) block >= codec->format.interleave - sizeof(bkr_sector_header_t))
+				sector->header_is_valid = 0;
+			continue;
+		}
+		stats->bytes_corrected += bytes_corrected;
+		if(bytes_corrected > stats->worst_block)
+			stats->worst_block = bytes_corrected;
+		if(bytes_corrected > stats->recent_block)
+			stats->recent_block = bytes_corrected;
+	}
+}
+
+
+/*
+ * Decode a sector in place:  error correct it, read its header, and
+ * de-randomize its data (it is safe for the randomizer to go past the end
+ * of the data by a few bytes).  The sector buffer holds data_size +
+ * parity_size bytes, and on return the first length bytes of it are the
+ * sector's data.  Without a valid header nothing can be determined about
+ * the sector, and the data is left as it is.
+ */
+
+
+void bkr_splp_decode_sector(const struct bkr_splp_codec *codec, unsigned char *data, struct bkr_splp_sector *sector, struct bkr_splp_stats *stats)
+{
+	correct_sector(codec, data, 0, sector, stats);
+	if(!sector->header_is_valid)
+		return;
+
+	read_sector_header(data, &codec->format, sector);
+	if(sector->sector_number >= 0)
+		bkr_splp_sector_randomize(data, sector->length, sector->sector_number);
+}
+
+
+/*
+ * Header-only decode, for when only the sector's number and length are
+ * needed.  The header occupies the last interleave columns of the sector,
+ * and the byte before it (high_used) the column in front of those, so
+ * only those columns are corrected and the data is not de-randomized.
+ * If any of those columns is uncorrectable the length cannot be trusted,
+ * so both sector_is_valid and header_is_valid are cleared.
+ */
+
+
+void bkr_splp_decode_header(const struct bkr_splp_codec *codec, unsigned char *data, struct bkr_splp_sector *sector, struct bkr_splp_stats *stats)
+{
+	/* data_size is a multiple of interleave in all formats */
+	correct_sector(codec, data, codec->format.interleave - sizeof(bkr_sector_header_t) - 1, sector, stats);
+	if(!sector->sector_is_valid) {
+		sector->header_is_valid = 0;
+		return;
+	}
+
+	read_sector_header(data, &codec->format, sector);
+}
+
+
+/*
+ * Encode a sector in place by randomizing the data, inserting the sector
+ * header, and computing parity bytes.  The sector buffer holds
+ * data_size + parity_size bytes, the first length (<= capacity) of which
+ * are the data.  A length of 0 encodes an empty sector:  BOR sectors are
+ * empty sectors with a negative sector number, and EOR sectors empty
+ * sectors with the number of the last data sector.
+ */
+
+
+void bkr_splp_encode_sector(const struct bkr_splp_codec *codec, unsigned char *data, int length, int sector_number)
+{
+	int block;
+
+	/*
+	 * Randomize the data (it is safe for the randomizer to go past the
+	 * end of the data area by a few bytes because there is space
+	 * allocated for the parity bytes).
+	 */
+
+	bkr_splp_sector_randomize(data, length, sector_number);
+
+	/*
+	 * Pad unused space, encode the data length, insert the header.
+	 */
+
+	if(length < codec->format.capacity) {
+		memset(data + length, BKR_FILLER, codec->format.capacity - length - 1);
+		length = encode_sector_length(length);
+		*high_used(data, &codec->format) = length >> BKR_LOW_USED_BITS;
+		put_sector_header(data, &codec->format, sector_number, length);
+	} else
+		put_sector_header(data, &codec->format, sector_number, 0);
+
+	/*
+	 * Generate parity bytes.
+	 */
+
+	for(block = 0; block < codec->format.interleave; block++)
+		reed_solomon_encode(data + codec->format.data_size + block, data + block, *codec->rs_format);
+}
@@ -22,7 +22,7 @@
  */
 
 
-#include <gst/gst.h>
+#include <linux/types.h>
 #include <bkr_bytes.h>
 #include <bkr_splp_randomize.h>
 
@@ -38,11 +38,11 @@
  */
 
 
-void bkr_splp_sector_randomize(void *buff, gint count, guint32 seed)
+void bkr_splp_sector_randomize(void *buff, int count, __u32 seed)
 {
-	guint32 *location = buff;
-	gint index;
-	guint32 history[4];
+	__u32 *location = buff;
+	int index;
+	__u32 history[4];
 
 	if(count <= 0)
 		return;
@@ -23,10 +23,10 @@
 #define __BKR_SECTOR_RANDOMIZE_H__
 
 
-#include <gst/gst.h>
+#include <linux/types.h>
 
 
-void bkr_splp_sector_randomize(void *, gint, guint32);
+void bkr_splp_sector_randomize(void *, int, __u32);
 
 
 #endif /* __BKR_SECTOR_RANDOMIZE_H__ */
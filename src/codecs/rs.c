@@ -306,6 +306,47 @@ static void generator_polynomial_init(gf *g, gf *log_beta, int num_parity)
 }
 
 
+/*
+ * position_parity_init()
+ *
+ * Constructs the table used by the incremental encoder.  The parity
+ * symbols are the remainder of x^parity * d(x) divided by g(x), which is
+ * the sum over the data symbols d_i of d_i * (x^(parity+i) mod g(x)).
+ * The i-th row of the table holds the coefficients of x^(parity+i) mod
+ * g(x) in alpha-rep.  Each row is obtained from the previous by
+ * multiplying by x and reducing by g(x), which is monic.
+ */
+
+static void position_parity_init(gf *table, const gf *g, int k, int num_parity)
+{
+	gf  r[num_parity + 1];
+	gf  feedback;
+	int  i, j;
+
+	if(!num_parity)
+		return;
+
+	/* x^parity mod g(x) = g(x) - x^parity */
+	for(j = 0; j < num_parity; j++)
+		r[j] = g[j] == INFINITY ? 0 : Alpha_exp[g[j]];
+
+	for(i = 0; i < k; i++, table += num_parity) {
+		for(j = 0; j < num_parity; j++)
+			table[j] = Log_alpha[r[j]];
+
+		/* r(x) <-- x * r(x) mod g(x) */
+		feedback = Log_alpha[r[num_parity - 1]];
+		for(j = num_parity - 1; j > 0; j--)
+			r[j] = r[j - 1];
+		r[0] = 0;
+		if(feedback != INFINITY)
+			for(j = 0; j < num_parity; j++)
+				if(g[j] != INFINITY)
+					r[j] ^= Alpha_exp[feedback + g[j]];
+	}
+}
+
+
 /*
  * Encoder/decoder instance creation
  *
@@ -340,13 +381,15 @@ rs_format_t *reed_solomon_codec_new(unsigned int n, unsigned int k, int interlea
 	format->g = malloc((format->parity+1) * sizeof(*format->g));
 	format->erasure = malloc(format->parity * sizeof(*format->erasure));
 	format->log_beta = malloc((NN + 1) * sizeof(*format->log_beta));
+	format->position_parity = malloc((format->k * format->parity + 1) * sizeof(*format->position_parity));
 
-	if(!format->g || !format->erasure || !format->log_beta) {
+	if(!format->g || !format->erasure || !format->log_beta || !format->position_parity) {
 		reed_solomon_codec_free(format);
 		return NULL;
 	}
 
 	generator_polynomial_init(format->g, format->log_beta, format->parity);
+	position_parity_init(format->position_parity, format->g, format->k, format->parity);
 
 	return format;
 }
@@ -362,6 +405,7 @@ void reed_solomon_codec_free(rs_format_t *format)
 		free(format->g);
 		free(format->erasure);
 		free(format->log_beta);
+		free(format->position_parity);
 	}
 	free(format);
 }
@@ -459,6 +503,32 @@ void reed_solomon_encode(rs_symbol_t *parity, const rs_symbol_t *data, rs_format
 }
 
 
+/*
+ * reed_solomon_encode_accumulate()
+ *
+ * Each data symbol is multiplied by its row of the position_parity table
+ * and added to the parity.  The per-symbol cost is the same as one step
+ * of the long division in reed_solomon_encode().
+ */
+
+void reed_solomon_encode_accumulate(rs_symbol_t *parity, const rs_symbol_t *data, int position, rs_format_t format)
+{
+	const gf  *r = &format.position_parity[position * format.parity];
+	rs_symbol_t  *p;
+	gf  log_d;
+	int  i, j;
+
+	for(i = 0; i < format.interleave; i++) {
+		log_d = Log_alpha[data[i]];
+		if(log_d == INFINITY)
+			continue;
+		for(j = 0, p = &parity[i]; j < format.parity; j++, p += format.interleave)
+			if(r[j] != INFINITY)
+				*p ^= Alpha_exp[log_d + r[j]];
+	}
+}
+
+
 /*
  * reed_solomon_decode()
  *
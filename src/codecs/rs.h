@@ -67,6 +67,7 @@ typedef struct {
 	gf  *g;                 /* generator polynomial g(x) in alpha rep */
 	gf  *erasure;           /* error locations */
 	gf  *log_beta;          /* return the power of beta equal to alpha^i */
+	gf  *position_parity;   /* x^(parity+i) mod g(x) in alpha rep */
 } rs_format_t;
 
 
@@ -196,6 +197,24 @@ void reed_solomon_codec_free(rs_format_t *format);
 void reed_solomon_encode(rs_symbol_t *parity, const rs_symbol_t *data, rs_format_t format);
 
 
+/*
+ * Reed-Solomon incremental encoder
+ *
+ * Adds the contribution of one data symbol from each of format.interleave
+ * interleaved code words to their parity symbols.  data[] holds the
+ * format.interleave symbols, contiguously, found at the given position
+ * (0 to format.k - 1) in their code words.  parity[] holds the parity
+ * symbols, interleaved as for reed_solomon_encode(), and must be zeroed
+ * before the first call.  Since the code is linear, the data symbols can
+ * be supplied in any order, and once all positions have been supplied
+ * (omitted ones are taken to be 0) parity[] contains the same result as
+ * would be computed by reed_solomon_encode() for each of the code words.
+ */
+
+
+void reed_solomon_encode_accumulate(rs_symbol_t *parity, const rs_symbol_t *data, int position, rs_format_t format);
+
+
 /*
  * Reed-Solomon erasures-and-errors decoding
  *
@@ -142,6 +142,10 @@
 #define  _BACKER_H
 
 
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+
 /*
  * Hardware stuff
  */
@@ -199,6 +203,155 @@ enum bkr_sectorformat {
 };
 
 
+/*
+ * mmap() interface.
+ *
+ * The device can be mapped into a process' address space to give direct
+ * access to the I/O ring buffer.  This takes two mappings.  The page at
+ * offset 0 is a control page, described by struct bkr_ring_control and
+ * written only by the driver;  it must be mapped by itself and read-only.
+ * The ring buffer itself is mapped starting at offset getpagesize(), with
+ * the protection the transfer direction needs, and at most the ring size
+ * rounded up to a whole page.  The head is the next location to be
+ * written, and the tail the next location to be read.
+ * The hardware's side of the ring (the head when reading, the tail when
+ * writing) is updated by the driver as data moves to or from the tape.
+ * The process moves its own side with the BKRIOCADVANCE ioctl after
+ * consuming or producing that many bytes in place.  The transfer is
+ * started by BKRIOCSTART, or by the first read() or write().  Use poll()
+ * to wait for activity.
+ *
+ * The driver publishes new offsets after the data they cover, so reading
+ * the offset before the data is sufficient.
+ */
+
+
+struct bkr_ring_control {
+	__u32  size;            /* ring size in bytes */
+	__u32  head;            /* next location to be written */
+	__u32  tail;            /* next location to be read */
+	__u32  frame_size;      /* bytes per video frame */
+	__u64  bytes;           /* bytes moved by the hardware since start */
+	__u32  frames;          /* complete frames moved by the hardware */
+	__u32  overruns;        /* times the ring was too full to read into */
+	__u32  underruns;       /* times the ring ran dry while writing */
+};
+
+
+#define  BKR_IOC_MAGIC  'b'
+#define  BKRIOCSTART    _IOW(BKR_IOC_MAGIC, 0, int)            /* BKRIOCSTART_* */
+#define  BKRIOCADVANCE  _IOW(BKR_IOC_MAGIC, 1, unsigned int)   /* byte count */
+
+#define  BKRIOCSTART_READ   1
+#define  BKRIOCSTART_WRITE  2
+
+
+/*
+ * I/O wake-up threshold.
+ *
+ * A process blocked in read() or poll() is woken once the given amount of
+ * data is in the ring, and one blocked in write() or poll() once the given
+ * amount of space is.  The threshold can be set in bytes or in video
+ * frames, and is reset to 1 byte each time the device is opened.  A
+ * blocked read() or write() that finds less than the threshold times out
+ * by moving what it can rather than failing.
+ */
+
+
+struct bkr_wakeup {
+	__u32  count;
+	__u32  units;           /* BKR_WAKEUP_* */
+};
+
+
+#define  BKR_WAKEUP_BYTES   0
+#define  BKR_WAKEUP_FRAMES  1
+
+#define  BKRIOCSETWAKEUP  _IOW(BKR_IOC_MAGIC, 2, struct bkr_wakeup)
+#define  BKRIOCGETWAKEUP  _IOR(BKR_IOC_MAGIC, 3, struct bkr_wakeup)
+
+
+/*
+ * Tape position.
+ *
+ * The driver moves raw video and cannot see the record and sector
+ * structure in it, so the position is reported to it by the process
+ * decoding the data.  fileno counts the end-of-record marks passed since
+ * the transfer started, and blkno is the number of the last sector
+ * decoded in the current record (-1 if none).  MTIOCGET and MTIOCPOS
+ * report the position to everybody else.  It is reset when a transfer
+ * starts.
+ */
+
+
+struct bkr_position {
+	__s32  fileno;
+	__s32  blkno;
+};
+
+
+#define  BKRIOCSETPOS  _IOW(BKR_IOC_MAGIC, 4, struct bkr_position)
+
+
+/*
+ * Statistics.
+ *
+ * A unit's statistics are available as one binary record, struct
+ * bkr_stats, from the "stats" file in the unit's /proc/sys/dev/backer
+ * directory, or from the BKRIOCGETSTATS ioctl.  The file can be read by
+ * anybody while the unit is in use, and re-read from offset 0 to sample
+ * it again (use pread()).  Readers must check version and size:  fields
+ * are only ever added to the end, and version is bumped when they are.
+ *
+ * The hardware's half is filled in by the driver.  Like the position,
+ * the decoder's half is reported by the process decoding the data with
+ * BKRIOCSETSTATS.  sequence counts those reports, so a monitor that sees
+ * it unchanged knows the decoder's numbers are too.
+ */
+
+
+#define  BKR_STATS_VERSION  1
+
+
+struct bkr_decoder_stats {
+	__u32  bad_sectors;     /* sectors that could not be corrected */
+	__u32  lost_runs;       /* runs of missing sectors */
+	__u32  duplicate_runs;  /* runs of repeated sectors */
+	__u32  bytes_corrected; /* bytes corrected since the record began */
+	__u32  worst_block;     /* most bytes corrected in one block */
+	__u32  recent_block;    /* most since the last report */
+	__u32  block_parity;    /* parity bytes per block */
+	__u32  frame_warnings;  /* framing problems */
+	__u32  worst_key;       /* worst key correlation seen */
+	__u32  best_nonkey;     /* best non-key correlation seen */
+	__u32  key_length;      /* perfect key correlation */
+	__u32  smallest_field;  /* bytes in the smallest video field */
+	__u32  largest_field;   /* bytes in the largest video field */
+};
+
+
+struct bkr_stats {
+	__u32  version;         /* BKR_STATS_VERSION */
+	__u32  size;            /* sizeof(struct bkr_stats) */
+	__u32  sequence;        /* decoder reports so far */
+	__u32  state;           /* 0 or BKRIOCSTART_{READ,WRITE} */
+	__u32  mode;            /* see the mode masks above */
+	__u32  frame_size;      /* bytes per video frame */
+	__u32  ring_size;       /* I/O ring size in bytes */
+	__u32  ring_fill;       /* bytes in the I/O ring */
+	__u64  bytes;           /* bytes moved by the hardware since start */
+	__u32  frames;          /* complete frames moved by the hardware */
+	__u32  overruns;        /* times the ring was too full to read into */
+	__u32  underruns;       /* times the ring ran dry while writing */
+	struct bkr_position  position;
+	struct bkr_decoder_stats  decoder;
+};
+
+
+#define  BKRIOCSETSTATS  _IOW(BKR_IOC_MAGIC, 5, struct bkr_decoder_stats)
+#define  BKRIOCGETSTATS  _IOR(BKR_IOC_MAGIC, 6, struct bkr_stats)
+
+
 /*
  * _sysctl() interface
  */
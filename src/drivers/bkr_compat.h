@@ -0,0 +1,92 @@
+/*
+ * Kernel compatibility shim for building the ring buffer and stream layer
+ * in user space.
+ *
+ * Copyright (C) 2002,2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Only the handful of kernel facilities used by bkr_ring_buffer.[ch] and
+ * bkr_stream.h are provided.  "User" memory is just memory, so the
+ * copy_*_user() functions never fail, and the memory barriers map onto
+ * the compiler's C11-style atomics.
+ */
+
+#ifndef _BKR_COMPAT_H
+#define _BKR_COMPAT_H
+
+#ifdef __KERNEL__
+#error "bkr_compat.h is for user space builds only"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <linux/types.h>
+
+
+/*
+ * Memory ordering
+ */
+
+#define ACCESS_ONCE(x)  (*(volatile __typeof__(x) *) &(x))
+#define READ_ONCE(x)  ACCESS_ONCE(x)
+#define smp_load_acquire(p)  __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_mb()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb()  __atomic_thread_fence(__ATOMIC_RELEASE)
+
+
+/*
+ * Memory allocation and user space access
+ */
+
+#define GFP_KERNEL  0
+#define kmalloc(size, flags)  malloc(size)
+#define kfree(ptr)  free(ptr)
+
+static unsigned long copy_to_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static unsigned long copy_from_user(void *to, const void *from, unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+
+/*
+ * Arithmetic
+ */
+
+#define min(x, y) ({ __typeof__(x) _x = (x); __typeof__(y) _y = (y); _x < _y ? _x : _y; })
+#define max(x, y) ({ __typeof__(x) _x = (x); __typeof__(y) _y = (y); _x > _y ? _x : _y; })
+#define min_t(type, x, y) ({ type _x = (x); type _y = (y); _x < _y ? _x : _y; })
+#define max_t(type, x, y) ({ type _x = (x); type _y = (y); _x > _y ? _x : _y; })
+#define clamp_t(type, val, lo, hi)  min_t(type, max_t(type, val, lo), hi)
+
+static __u64 div_u64(__u64 dividend, __u32 divisor)
+{
+	return dividend / divisor;
+}
+
+#endif /* _BKR_COMPAT_H */
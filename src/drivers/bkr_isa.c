@@ -26,8 +26,12 @@
 
 #include <linux/delay.h>
 #include <linux/errno.h>
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
 #include <linux/ioport.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/pci.h>
 #include <linux/slab.h>
 #include <linux/string.h>
@@ -64,6 +68,10 @@ static int  adjust = 0;
 module_param(adjust, int, 0);
 MODULE_PARM_DESC(adjust, "adjustment to start delay in microseconds");
 
+static unsigned int  buffer = 1024;
+module_param(buffer, uint, 0);
+MODULE_PARM_DESC(buffer, "I/O buffer size in kilobytes (default 1024)");
+
 
 /*
  * ========================================================================
@@ -84,11 +92,18 @@ MODULE_PARM_DESC(adjust, "adjustment to start delay in microseconds");
 #define  MODULE_NAME            "backer_isa"
 #define  DMA_IO_TO_MEM          0x14    /* demand mode, inc addr, auto-init */
 #define  DMA_MEM_TO_IO          0x18    /* demand mode, inc addr, auto-init */
-#define  DMA_BUFFER_SIZE        65536
+#define  DMA_BUFFER_SIZE        65536   /* ISA DMA window */
+#define  MIN_BUFFER_SIZE        DMA_BUFFER_SIZE
+#define  MAX_BUFFER_SIZE        (PAGE_SIZE << (MAX_ORDER - 1))
 #define  BKR_FRAME_TIME         HZ/BKR_MIN_FRAME_FREQ   /* jiffies */
 #define  BKR_ISA_TIMEOUT        (30*BKR_FRAME_TIME)     /* ~1 second */
 #define  DMA_HOLD_OFF           0x0200  /* stay this far back from transfer */
 #define  INTERNAL_BUFFER        4
+#define  TICK_NS                (NSEC_PER_SEC / BKR_MIN_FRAME_FREQ)
+#define  SAMPLE_RETRY_NS        (BKR_LINE_PERIOD * NSEC_PER_USEC / 4)
+#define  SAMPLE_RETRIES         8
+#define  FRAME_NS_NTSC          33366667        /* 1001/30000 s */
+#define  FRAME_NS_PAL           40000000        /* 1/25 s */
 
 #if BKR_FRAME_TIME < 2
 #error "Your kernel's HZ parameter is too low for this driver.  To use this driver with your kernel, try decreasing BKR_MIN_FRAME_FREQ in backer.h"
@@ -111,7 +126,15 @@ struct bkr_stream_private_t {
 	struct resource  ioresource;    /* I/O port */
 	unsigned int  dma;              /* DMA channel number */
 	dma_addr_t  dma_addr;           /* DMA buffer's bus address */
-	struct timer_list  timer;       /* data mover timer entry */
+	struct ring  *dma_ring;         /* the DMA buffer */
+	size_t  buffer_size;            /* allocated size of the I/O ring */
+	int  primed;                    /* data has reached the DMA buffer */
+	int  draining;                  /* flushing at end of write */
+	struct hrtimer  timer;          /* DMA position tracker */
+	struct bkr_stream_t  *stream;   /* link back to stream for timer_tick() */
+	size_t  position;               /* DMA offset at last good sample */
+	ktime_t  sampled;               /* time of last good sample */
+	int  retries;                   /* failed samples since then */
 	int  adjust;                    /* adjustment to start-up pause */
 };
 
@@ -139,80 +162,171 @@ static inline int get_dma_dreq(unsigned int dmanr)
 
 
 /*
- * Waits for a high-to-low transition of the DREQ status bit then retrieves
- * the offset within the DMA buffer at which the next transfer will occur.
+ * DMA position tracking.
+ *
+ * The DMA controller's residue count can only be read reliably while no
+ * transfer is in progress, that is between the bursts of data the card
+ * requests during each line of video.  Rather than spin waiting for the
+ * end of a burst, the position is sampled from an hrtimer.  If DREQ is
+ * found active, the sample is retried a fraction of a line period later.
+ * If no quiet moment is found after SAMPLE_RETRIES attempts, the position
+ * is predicted from the time elapsed since the last good sample at the
+ * video frame rate, less a field of data to allow for the vertical
+ * blanking intervals.
  */
 
-static size_t get_dma_offset(struct bkr_stream_t *stream)
+static int sample_dma_position(struct bkr_stream_t *stream, size_t *position)
 {
 	unsigned long  flags;
-	unsigned int  microsecs;
-	int  dma = stream->private->dma;
-	size_t  residue;
+	struct bkr_stream_private_t  *private = stream->private;
+	int  dma = private->dma;
+	int  quiet;
+	size_t  residue = 0;
 
 	flags = claim_dma_lock();
-	clear_dma_ff(dma);
-	if(!get_dma_dreq(dma))
-		udelay(BKR_LINE_PERIOD/2);
-	for(microsecs = 0; get_dma_dreq(dma) && (microsecs < 2*BKR_LINE_PERIOD); microsecs++)
-		udelay(1);
-	residue = get_dma_residue(dma);
+	quiet = !get_dma_dreq(dma);
+	if(quiet) {
+		clear_dma_ff(dma);
+		residue = get_dma_residue(dma);
+		quiet = !get_dma_dreq(dma);
+	}
 	release_dma_lock(flags);
 
-	return ring_offset_sub(stream->ring, stream->ring->size - residue, DMA_HOLD_OFF);
+	if(quiet)
+		*position = (private->dma_ring->size - residue) % private->dma_ring->size;
+
+	return quiet;
+}
+
+
+static size_t predict_dma_position(struct bkr_stream_t *stream, ktime_t now)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	u64  elapsed = ktime_to_ns(ktime_sub(now, private->sampled));
+	u64  bytes = div_u64(elapsed * stream->frame_size, BKR_VIDEOMODE(stream->mode) == BKR_NTSC ? FRAME_NS_NTSC : FRAME_NS_PAL);
+	u32  advance;
+
+	if(bytes <= stream->frame_size / 2)
+		return private->position;
+	div_u64_rem(bytes - stream->frame_size / 2, private->dma_ring->size, &advance);
+
+	return ring_offset_add(private->dma_ring, private->position, advance);
 }
 
 
 /*
  * Periodically checks and updates the hardware's side of the DMA ring
- * buffer.
+ * buffer, and moves data between it and the I/O ring.  The hardware's side
+ * is never moved backwards, in case a prediction has overshot.
+ *
+ * The ISA DMA controller can only reach a 64 kB buffer, so the I/O ring,
+ * which can be much larger, is bounced through it.  When reading, data
+ * that doesn't fit in the I/O ring is discarded and counted as an
+ * overrun.  When writing, the DMA buffer is kept as full as the I/O ring
+ * allows, and the hardware overtaking the data in it is counted as an
+ * underrun, except before the first data arrives and while draining at
+ * the end of the transfer.
  */
 
-static void timer_tick(unsigned long data)
+static void bounce_read(struct bkr_stream_t *stream)
 {
-	struct bkr_stream_t  *stream = (struct bkr_stream_t *) data;
-	struct ring  *ring = stream->ring;
-	struct timer_list  *timer = &stream->private->timer;
-	size_t  offset;
+	struct ring  *dma_ring = stream->private->dma_ring;
+	size_t  bytes = bytes_in_ring(dma_ring);
+	size_t  space = space_in_ring(stream->ring);
+
+	if(bytes > space) {
+		stream->overruns++;
+		memcpy_ring_to_ring(stream->ring, dma_ring, space);
+		ring_drain(dma_ring, bytes - space);
+	} else
+		memcpy_ring_to_ring(stream->ring, dma_ring, bytes);
+}
+
+
+static void bounce_write(struct bkr_stream_t *stream, size_t tail)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	struct ring  *dma_ring = private->dma_ring;
+	size_t  n;
+
+	if(ring_offset_sub(dma_ring, tail, dma_ring->tail) > bytes_in_ring(dma_ring)) {
+		if(private->primed && !private->draining)
+			stream->underruns++;
+		ring_set_head(dma_ring, tail);
+	}
+	ring_set_tail(dma_ring, tail);
+
+	n = min(space_in_ring(dma_ring), bytes_in_ring(stream->ring));
+	if(n)
+		private->primed = 1;
+	memcpy_ring_to_ring(dma_ring, stream->ring, n);
+}
+
+
+static void advance_offset(struct ring *ring, size_t *offset, size_t new)
+{
+	if(ring_offset_sub(ring, new, *offset) < ring->size / 2)
+		*offset = new;
+}
+
+
+static enum hrtimer_restart timer_tick(struct hrtimer *timer)
+{
+	struct bkr_stream_private_t  *private = container_of(timer, struct bkr_stream_private_t, timer);
+	struct bkr_stream_t  *stream = private->stream;
+	struct ring  *dma_ring = private->dma_ring;
+	ktime_t  now = ktime_get();
+	size_t  position, offset;
+
+	if(stream->direction == BKR_STOPPED)
+		return HRTIMER_NORESTART;
+
+	if(sample_dma_position(stream, &position)) {
+		private->position = position;
+		private->sampled = now;
+	} else if(++private->retries < SAMPLE_RETRIES) {
+		hrtimer_forward(timer, now, ns_to_ktime(SAMPLE_RETRY_NS));
+		return HRTIMER_RESTART;
+	} else
+		position = predict_dma_position(stream, now);
+	private->retries = 0;
+	position = ring_offset_sub(dma_ring, position, DMA_HOLD_OFF);
 
 	switch(stream->direction) {
 	case BKR_READING:
-		offset = get_dma_offset(stream);
-		ring_lock(ring);
-		ring->head = offset;
-		ring_unlock(ring);
+		offset = dma_ring->head;
+		advance_offset(dma_ring, &offset, position);
+		ring_set_head(dma_ring, offset);
+		bounce_read(stream);
 		break;
 
 	case BKR_WRITING:
-		offset = get_dma_offset(stream);
-		ring_lock(ring);
-		ring->tail = offset;
-		ring_unlock(ring);
+		offset = dma_ring->tail;
+		advance_offset(dma_ring, &offset, position);
+		bounce_write(stream, offset);
 		break;
 
 	default:
-		return;
+		break;
 	}
-	timer->expires = jiffies + BKR_FRAME_TIME;
-	add_timer(timer);
 	bkr_stream_do_callback(stream);
+
+	hrtimer_forward(timer, now, ns_to_ktime(TICK_NS));
+	return HRTIMER_RESTART;
 }
 
 
 /*
- * Ensure the DMA buffer is filled to a frame boundary, and check if it's
- * empty.
+ * Ensure the I/O ring is filled to a frame boundary, and check if it and
+ * the DMA buffer are empty.
  */
 
 static int flush(struct bkr_stream_t *stream)
 {
-	int result;
-
-	ring_lock(stream->ring);
-	result = ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) >= 2 * stream->frame_size ? -EAGAIN : 0;
-	ring_unlock(stream->ring);
+	struct bkr_stream_private_t  *private = stream->private;
 
-	return result;
+	private->draining = 1;
+	return ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) ? -EAGAIN : bytes_in_ring(private->dma_ring) >= 2 * stream->frame_size ? -EAGAIN : 0;
 }
 
 
@@ -244,12 +358,12 @@ static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
 	disable_dma(private->dma);
 	clear_dma_ff(private->dma);
 	if(direction == BKR_WRITING) {
-		stream->ring->size -= DMA_BUFFER_SIZE % stream->frame_size;
+		private->dma_ring->size -= DMA_BUFFER_SIZE % stream->frame_size;
 		set_dma_mode(private->dma, DMA_MEM_TO_IO);
 	} else
 		set_dma_mode(private->dma, DMA_IO_TO_MEM);
 	set_dma_addr(private->dma, private->dma_addr);
-	set_dma_count(private->dma, stream->ring->size);
+	set_dma_count(private->dma, private->dma_ring->size);
 	enable_dma(private->dma);
 	release_dma_lock(flags);
 
@@ -269,15 +383,18 @@ static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
 	outb(control, private->ioresource.start);
 
 	/*
-	 * Force an immediate update of the DMA buffer and add the timer
-	 * tick function to the kernel timer list.  Both birds are killed
-	 * by simply calling the function directly.
+	 * Start the position tracker, with an immediate update of the DMA
+	 * buffer.
 	 */
 
-	init_timer(&private->timer);
+	private->position = 0;
+	private->sampled = ktime_get();
+	private->retries = 0;
+	private->primed = 0;
+	private->draining = 0;
+	hrtimer_init(&private->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	private->timer.function = timer_tick;
-	private->timer.data = (unsigned long) stream;
-	timer_tick((unsigned long) stream);
+	hrtimer_start(&private->timer, ktime_set(0, 0), HRTIMER_MODE_REL);
 
 	return 0;
 }
@@ -297,10 +414,10 @@ static int release(struct bkr_stream_t *stream)
 
 		outb(0, private->ioresource.start);
 		stream->direction = BKR_STOPPED;
-		del_timer_sync(&private->timer);
+		hrtimer_cancel(&private->timer);
 		free_dma(private->dma);
 		/* resize buffer after we know nobody else is listening */
-		stream->ring->size = DMA_BUFFER_SIZE;
+		private->dma_ring->size = DMA_BUFFER_SIZE;
 	}
 	return 0;
 }
@@ -331,8 +448,12 @@ static struct bkr_stream_t *ready(struct bkr_stream_t *stream, int mode, unsigne
 	outb(0, private->ioresource.start);
 	stream->direction = BKR_STOPPED;
 	stream->frame_size = frame_size;
+	/* a whole number of frames, so flush() can pad to a frame boundary */
+	ring->size = private->buffer_size - private->buffer_size % frame_size;
 	ring_reset(ring);
 	memset_ring(ring, 0, ring->size);
+	ring_reset(private->dma_ring);
+	memset_ring(private->dma_ring, 0, private->dma_ring->size);
 
 	return stream;
 }
@@ -352,7 +473,7 @@ static struct bkr_stream_t *ready(struct bkr_stream_t *stream, int mode, unsigne
 
 static struct bkr_stream_private_t __init *isa_alloc_private(int ioport)
 {
-	struct bkr_stream_private_t  *private = kmalloc(GFP_KERNEL, sizeof(*private));
+	struct bkr_stream_private_t  *private = kmalloc(sizeof(*private), GFP_KERNEL);
 
 	if(private) {
 		private->ioresource = (struct resource) {
@@ -393,6 +514,7 @@ static struct bkr_unit_t * __init bkr_isa_new(struct bkr_stream_private_t *priva
 
 	private->dma = dma;
 	private->adjust = adjust;
+	private->stream = stream;
 
 	stream->ops = (struct bkr_stream_ops_t) {
 		.ready = ready,
@@ -405,15 +527,26 @@ static struct bkr_unit_t * __init bkr_isa_new(struct bkr_stream_private_t *priva
 	bkr_stream_set_callback(stream, NULL, NULL);
 	stream->timeout = BKR_ISA_TIMEOUT;
 
-	stream->ring = ring_new(NULL, DMA_BUFFER_SIZE);
-	if(!stream->ring);
-		goto no_stream;
-	stream->ring->buffer = dma_alloc_coherent(NULL, stream->ring->size, &private->dma_addr, GFP_ATOMIC);
-	if(!stream->ring->buffer) {
+	private->dma_ring = ring_new(NULL, DMA_BUFFER_SIZE);
+	if(!private->dma_ring)
+		goto no_dma_ring;
+	private->dma_ring->buffer = dma_alloc_coherent(NULL, DMA_BUFFER_SIZE, &private->dma_addr, GFP_ATOMIC);
+	if(!private->dma_ring->buffer) {
 		sprintf(err_msg, "can't allocate DMA buffer");
 		goto no_dma_buffer;
 	}
 
+	/* physically contiguous, for mmap(), but needn't be DMA-able */
+	private->buffer_size = clamp_t(size_t, (size_t) buffer * 1024, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+	stream->ring = ring_new(NULL, private->buffer_size);
+	if(!stream->ring)
+		goto no_ring;
+	stream->ring->buffer = alloc_pages_exact(private->buffer_size, GFP_KERNEL | __GFP_NOWARN);
+	if(!stream->ring->buffer) {
+		sprintf(err_msg, "can't allocate %zu byte I/O buffer", private->buffer_size);
+		goto no_ring_buffer;
+	}
+
 	down(&bkr_unit_list_lock);
 	unit = bkr_unit_register(stream);
 	if(!unit) {
@@ -423,7 +556,7 @@ static struct bkr_unit_t * __init bkr_isa_new(struct bkr_stream_private_t *priva
 	unit->owner = THIS_MODULE;
 	up(&bkr_unit_list_lock);
 
-	printk(KERN_INFO MODULE_NAME ": unit %s: %s I/O port %#x, DMA channel %u", unit->name, msg, (int) private->ioresource.start, private->dma);
+	printk(KERN_INFO MODULE_NAME ": unit %s: %s I/O port %#x, DMA channel %u, %zu kB buffer", unit->name, msg, (int) private->ioresource.start, private->dma, private->buffer_size / 1024);
 	if(private->adjust)
 		printk(", adjusted %+d s", private->adjust);
 	printk("\n");
@@ -432,9 +565,14 @@ static struct bkr_unit_t * __init bkr_isa_new(struct bkr_stream_private_t *priva
 
 no_unit:
 	up(&bkr_unit_list_lock);
-	dma_free_coherent(NULL, DMA_BUFFER_SIZE, stream->ring->buffer, private->dma_addr);
-no_dma_buffer:
+	free_pages_exact(stream->ring->buffer, private->buffer_size);
+no_ring_buffer:
 	ring_free(stream->ring);
+no_ring:
+	dma_free_coherent(NULL, DMA_BUFFER_SIZE, private->dma_ring->buffer, private->dma_addr);
+no_dma_buffer:
+	ring_free(private->dma_ring);
+no_dma_ring:
 no_stream:
 	kfree(stream);
 	printk(KERN_INFO MODULE_NAME ": %s\n", err_msg);
@@ -571,8 +709,10 @@ static void __exit bkr_isa_exit(void)
 			stream = unit->stream;
 			private = stream->private;
 			bkr_unit_unregister(unit);
-			dma_free_coherent(NULL, DMA_BUFFER_SIZE, stream->ring->buffer, private->dma_addr);
+			free_pages_exact(stream->ring->buffer, private->buffer_size);
 			ring_free(stream->ring);
+			dma_free_coherent(NULL, DMA_BUFFER_SIZE, private->dma_ring->buffer, private->dma_addr);
+			ring_free(private->dma_ring);
 			kfree(stream);
 			isa_free_private(private);
 			break;
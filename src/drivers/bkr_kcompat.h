@@ -0,0 +1,196 @@
+/*
+ * Kernel version compatibility for the Backer driver modules.
+ *
+ * Copyright (C) 2002,2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * The driver builds against kernels 3.5 through 5.4.  Facilities that
+ * appeared or disappeared within that range are written the new way in
+ * the driver, and given a definition here for the kernels that lack them.
+ * The exceptions are interruptible_sleep_on_timeout(), which the driver
+ * still uses and which is defined here for the kernels that removed it,
+ * and kernel_read() and kernel_write(), which changed signature and are
+ * wrapped as bkr_kernel_read() and bkr_kernel_write().
+ * Nothing outside this file tests LINUX_VERSION_CODE.
+ */
+
+#ifndef _BKR_KCOMPAT_H
+#define _BKR_KCOMPAT_H
+
+#ifndef __KERNEL__
+#error "bkr_kcompat.h is for kernel builds only"
+#endif
+
+#include <linux/version.h>
+#include <linux/dma-mapping.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,4,0)
+#include <asm/system.h>
+#else
+#include <asm/barrier.h>
+#endif
+
+
+/*
+ * VM_DONTDUMP replaced VM_RESERVED in 3.7.
+ */
+
+#ifndef VM_DONTDUMP
+#define VM_DONTDUMP  VM_RESERVED
+#endif
+
+
+/*
+ * smp_load_acquire() and smp_store_release() appeared in 3.14, READ_ONCE()
+ * in 3.19.  ACCESS_ONCE(), which READ_ONCE() replaced, is gone from 4.15.
+ * The full barrier is stronger than acquire/release needs, but correct.
+ */
+
+#ifndef READ_ONCE
+#define READ_ONCE(x)  ACCESS_ONCE(x)
+#endif
+
+#ifndef smp_load_acquire
+#define smp_load_acquire(p) ({ \
+	typeof(*(p)) ___v = ACCESS_ONCE(*(p)); \
+	smp_mb(); \
+	___v; \
+})
+#endif
+
+#ifndef smp_store_release
+#define smp_store_release(p, v) do { \
+	smp_mb(); \
+	ACCESS_ONCE(*(p)) = (v); \
+} while(0)
+#endif
+
+
+/*
+ * dma_mmap_coherent() became generic in 3.6.  Before that, where the
+ * architecture doesn't provide it, coherent memory is ordinary memory.
+ */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,6,0) && !defined(CONFIG_ARM)
+static inline int dma_mmap_coherent(struct device *dev, struct vm_area_struct *vma, void *cpu_addr, dma_addr_t dma_addr, size_t size)
+{
+	unsigned long  length = vma->vm_end - vma->vm_start;
+
+	if((vma->vm_pgoff << PAGE_SHIFT) + length > PAGE_ALIGN(size))
+		return -ENXIO;
+	return remap_pfn_range(vma, vma->vm_start, (virt_to_phys(cpu_addr) >> PAGE_SHIFT) + vma->vm_pgoff, length, vma->vm_page_prot);
+}
+#endif
+
+
+/*
+ * interruptible_sleep_on_timeout() was removed in 3.15.  Its race, a
+ * wake-up between the caller's check and the sleep, costs the driver no
+ * more than a timeout period, as every sleeper re-checks after waking.
+ */
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,15,0)
+static inline long interruptible_sleep_on_timeout(wait_queue_head_t *q, long timeout)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait(q, &wait, TASK_INTERRUPTIBLE);
+	timeout = schedule_timeout(timeout);
+	finish_wait(q, &wait);
+
+	return timeout;
+}
+#endif
+
+
+/*
+ * Pipe buffers lost their map() and unmap() methods in 3.15.
+ */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,15,0)
+#define BKR_PIPE_BUF_MAP_OPS \
+	.map = generic_pipe_buf_map, \
+	.unmap = generic_pipe_buf_unmap,
+#else
+#define BKR_PIPE_BUF_MAP_OPS
+#endif
+
+
+/*
+ * Until 4.9, splice_to_pipe() takes the pipe lock itself and waits for
+ * room unless the descriptor's flags include SPLICE_F_NONBLOCK.  From 4.9
+ * the caller holds the lock and has already waited, and the flags are
+ * gone.  Either way the room check and the insertion happen under the
+ * pipe lock, so ->splice_read() must not take it.
+ */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,9,0)
+#define BKR_SPD_FLAGS(f)  .flags = (f),
+#else
+#define BKR_SPD_FLAGS(f)
+#endif
+
+
+/*
+ * From 4.14 kernel_read() and kernel_write() take their arguments in the
+ * same order and advance a file position passed by pointer.  Before that
+ * the position is passed by value, and kernel_read() takes it first.
+ * kernel_write() appeared in 3.9.
+ */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
+static inline ssize_t bkr_kernel_read(struct file *file, void *buf, size_t count, loff_t *pos)
+{
+	ssize_t  result = kernel_read(file, *pos, buf, count);
+
+	if(result > 0)
+		*pos += result;
+	return result;
+}
+
+static inline ssize_t bkr_kernel_write(struct file *file, const void *buf, size_t count, loff_t *pos)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,9,0)
+	mm_segment_t  old_fs = get_fs();
+	ssize_t  result;
+
+	set_fs(KERNEL_DS);
+	result = vfs_write(file, (const char __user *) buf, count, pos);
+	set_fs(old_fs);
+
+	return result;
+#else
+	ssize_t  result = kernel_write(file, buf, count, *pos);
+
+	if(result > 0)
+		*pos += result;
+	return result;
+#endif
+}
+#else
+#define bkr_kernel_read  kernel_read
+#define bkr_kernel_write  kernel_write
+#endif
+
+#endif /* _BKR_KCOMPAT_H */
@@ -26,23 +26,31 @@
 #include <linux/init.h>
 
 #include <linux/errno.h>
+#include <linux/highmem.h>
 #include <linux/kernel.h>
 #include <linux/kmod.h>
 #include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/mtio.h>
+#include <linux/pipe_fs_i.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/splice.h>
 #include <linux/string.h>
 #include <linux/sysctl.h>
 #include <linux/wait.h>
 
 #include <linux/semaphore.h>
+#include <asm/io.h>
 #include <asm/uaccess.h>
 
 #include <backer.h>
+#include <bkr_kcompat.h>
 #include <bkr_unit.h>
 #include <bkr_ring_buffer.h>
+#include <bkr_stream_io.h>
 
 #define  __STRINGIFY(x)  #x
 #define  STRINGIFY(x)    __STRINGIFY(x)
@@ -79,12 +87,18 @@ EXPORT_SYMBOL_GPL(memset_ring);
 
 static int open(struct inode *, struct file *);
 static int release(struct inode *, struct file *);
+static int start(struct file *, enum bkr_direction_t);
 static ssize_t start_read(struct file *, char *, size_t, loff_t *);
 static ssize_t start_write(struct file *, const char *, size_t, loff_t *);
 static ssize_t read(struct file *, char *, size_t, loff_t *);
 static ssize_t write(struct file *, const char *, size_t, loff_t *);
 static unsigned int poll(struct file *, struct poll_table_struct *);
 static long ioctl(struct file *, unsigned int, unsigned long);
+static int mmap(struct file *, struct vm_area_struct *);
+static ssize_t start_splice_read(struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+static ssize_t start_splice_write(struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
+static ssize_t splice_read(struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+static ssize_t splice_write(struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
 
 
 /*
@@ -100,34 +114,46 @@ struct semaphore  bkr_unit_list_lock;   /* unit list locking semaphore */
  * File operations array.  Order MUST match bkr_direction_t.
  */
 
-#define STOPPED_OPS {         \
-	.owner = THIS_MODULE, \
-	.read = start_read,   \
-	.write = start_write, \
-	.poll = poll,         \
-	.compat_ioctl = ioctl,       \
-	.open = open,         \
-	.release = release    \
+#define STOPPED_OPS {                       \
+	.owner = THIS_MODULE,               \
+	.read = start_read,                 \
+	.write = start_write,               \
+	.splice_read = start_splice_read,   \
+	.splice_write = start_splice_write, \
+	.poll = poll,                       \
+	.unlocked_ioctl = ioctl,            \
+	.compat_ioctl = ioctl,              \
+	.mmap = mmap,                       \
+	.open = open,                       \
+	.release = release                  \
 }
 
-#define READING_OPS {         \
-	.owner = THIS_MODULE, \
-	.read = read,         \
-	.write = start_write, \
-	.poll = poll,         \
-	.compat_ioctl = ioctl,       \
-	.open = open,         \
-	.release = release    \
+#define READING_OPS {                       \
+	.owner = THIS_MODULE,               \
+	.read = read,                       \
+	.write = start_write,               \
+	.splice_read = splice_read,         \
+	.splice_write = start_splice_write, \
+	.poll = poll,                       \
+	.unlocked_ioctl = ioctl,            \
+	.compat_ioctl = ioctl,              \
+	.mmap = mmap,                       \
+	.open = open,                       \
+	.release = release                  \
 }
 
-#define WRITING_OPS {         \
-	.owner = THIS_MODULE, \
-	.read = start_read,   \
-	.write = write,       \
-	.poll = poll,         \
-	.compat_ioctl = ioctl,       \
-	.open = open,         \
-	.release = release    \
+#define WRITING_OPS {                       \
+	.owner = THIS_MODULE,               \
+	.read = start_read,                 \
+	.write = write,                     \
+	.splice_read = start_splice_read,   \
+	.splice_write = splice_write,       \
+	.poll = poll,                       \
+	.unlocked_ioctl = ioctl,            \
+	.compat_ioctl = ioctl,              \
+	.mmap = mmap,                       \
+	.open = open,                       \
+	.release = release                  \
 }
 
 static struct file_operations file_ops[] = {
@@ -145,32 +171,142 @@ static struct file_operations file_ops[] = {
 
 
 /*
- * Convert a mode (see the format enums in backer.h) to a video frame size
- * (count of bytes in two full video fields).  Return < 0 if the mode is
- * invalid.
+ * Publish the ring's offsets in the unit's mmap() control page.  Like the
+ * ring itself, each field has only one writer:  the hardware's side of the
+ * ring and the transfer counters are updated from the stream call-back,
+ * and the process' side after it moves data.  The distance the hardware's
+ * side has moved since the last update is added to the transfer counters.
  */
 
 
-static int bkr_mode_to_frame_size(int mode)
+static void bkr_unit_update_hardware(struct bkr_unit_t *unit)
 {
-	static unsigned int frame_size[] = {
-		2028,	/* nl */
-		2440,	/* pl */
-		5070,	/* nh */
-		6100    /* ph */
-	};
-	unsigned int *result = frame_size;
+	struct bkr_stream_t  *stream = unit->stream;
+	struct ring  *ring = stream->ring;
+	struct bkr_ring_control  *control = unit->control;
+	size_t  offset;
+
+	switch(stream->direction) {
+	case BKR_READING:
+		offset = ring_head(ring);
+		control->bytes += ring_offset_sub(ring, offset, control->head);
+		control->frames = div_u64(control->bytes, stream->frame_size);
+		smp_wmb();
+		control->head = offset;
+		break;
+
+	case BKR_WRITING:
+		offset = ring_tail(ring);
+		control->bytes += ring_offset_sub(ring, offset, control->tail);
+		control->frames = div_u64(control->bytes, stream->frame_size);
+		smp_wmb();
+		control->tail = offset;
+		break;
+
+	default:
+		break;
+	}
+	control->overruns = stream->overruns;
+	control->underruns = stream->underruns;
+}
+
+
+static void bkr_unit_update_process(struct bkr_unit_t *unit)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+	struct ring  *ring = stream->ring;
+
+	switch(stream->direction) {
+	case BKR_READING:
+		smp_store_release(&unit->control->tail, ring->tail);
+		break;
+
+	case BKR_WRITING:
+		smp_store_release(&unit->control->head, ring->head);
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/*
+ * Only to be used while the stream is stopped.
+ */
+
+
+static void bkr_unit_reset_control(struct bkr_unit_t *unit)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+	struct bkr_ring_control  *control = unit->control;
+
+	control->size = stream->ring->size;
+	control->frame_size = stream->frame_size;
+	control->bytes = 0;
+	control->frames = 0;
+	control->overruns = 0;
+	control->underruns = 0;
+	control->head = stream->ring->head;
+	control->tail = stream->ring->tail;
+}
+
+
+/*
+ * The decoder's half of the statistics.  Reports come from ioctl()s, so
+ * there can be more than one writer at a time;  the seqlock serializes
+ * them and lets readers take a consistent copy without blocking the
+ * writers.
+ */
+
+
+static void bkr_unit_reset_stats(struct bkr_unit_t *unit)
+{
+	write_seqlock(&unit->stats_lock);
+	unit->stats_sequence = 0;
+	unit->position = (struct bkr_position) {0, -1};
+	memset(&unit->decoder, 0, sizeof(unit->decoder));
+	write_sequnlock(&unit->stats_lock);
+}
+
 
-	if(BKR_DENSITY(mode) == BKR_HIGH)
-		result += 2;
-	else if(BKR_DENSITY(mode) != BKR_LOW)
-		return -1;
-	if(BKR_VIDEOMODE(mode) == BKR_PAL)
-		result += 1;
-	else if(BKR_VIDEOMODE(mode) != BKR_NTSC)
-		return -1;
+static void bkr_unit_get_stats(struct bkr_unit_t *unit, struct bkr_stats *stats)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+	unsigned int  seq;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->version = BKR_STATS_VERSION;
+	stats->size = sizeof(*stats);
+	switch(stream->direction) {
+	case BKR_READING:
+		stats->state = BKRIOCSTART_READ;
+		break;
+
+	case BKR_WRITING:
+		stats->state = BKRIOCSTART_WRITE;
+		break;
 
-	return *result;
+	default:
+		break;
+	}
+	stats->mode = stream->mode;
+	stats->frame_size = stream->frame_size;
+	if(stream->ring) {
+		stats->ring_size = stream->ring->size;
+		stats->ring_fill = bytes_in_ring(stream->ring);
+	}
+	stats->bytes = unit->control->bytes;
+	stats->frames = unit->control->frames;
+	stats->overruns = stream->overruns;
+	stats->underruns = stream->underruns;
+
+	do {
+		seq = read_seqbegin(&unit->stats_lock);
+		stats->sequence = unit->stats_sequence;
+		stats->position = unit->position;
+		stats->decoder = unit->decoder;
+	} while(read_seqretry(&unit->stats_lock, seq));
 }
 
 
@@ -245,12 +381,11 @@ static int bkr_do_status(struct ctl_table *table, int write, void __user *buf, s
 		break;
 	}
 	pos += sprintf(pos, "\nCurrent Mode    : %u\nI/O Buffer      : ", stream->mode);
-	if(stream->ring) {
-		ring_lock(stream->ring);
+	if(stream->ring)
 		pos += sprintf(pos, "%zu / %zu\n", bytes_in_ring(stream->ring), stream->ring->size);
-		ring_unlock(stream->ring);
-	} else
+	else
 		pos += sprintf(pos, "0 / 0\n");
+	pos += sprintf(pos, "Overruns        : %lu\nUnderruns       : %lu\n", stream->overruns, stream->underruns);
 
 	if(pos - message < *len)
 		*len = pos - message;
@@ -259,6 +394,32 @@ static int bkr_do_status(struct ctl_table *table, int write, void __user *buf, s
 }
 
 
+/*
+ * The binary statistics record.  Unlike the status file, this one honours
+ * the file position so a reader sees end-of-file after the record, and
+ * can pread() it again from offset 0.
+ */
+
+static int bkr_do_stats(struct ctl_table *table, int write, void __user *buf, size_t *len, loff_t *ppos)
+{
+	struct bkr_unit_t  *unit = table->data;
+	struct bkr_stats  stats;
+
+	if(!unit->stream || *ppos >= sizeof(stats)) {
+		*len = 0;
+		return 0;
+	}
+
+	bkr_unit_get_stats(unit, &stats);
+	*len = min_t(size_t, *len, sizeof(stats) - *ppos);
+	if(copy_to_user(buf, (char *) &stats + *ppos, *len))
+		return -EFAULT;
+	*ppos += *len;
+
+	return 0;
+}
+
+
 /*
  * ========================================================================
  *                          UNIT CLAIM/RELEASE
@@ -320,8 +481,11 @@ static void bkr_unit_sysctl_init(struct bkr_unit_t *unit)
 			{0}
 		},
 		.entries = {
-			{.procname = "status", .mode = 0444, .proc_handler = bkr_do_status},
+			{.procname = "status", .mode = 0444, .data = unit, .proc_handler = bkr_do_status},
+			{.procname = "stats", .mode = 0444, .data = unit, .proc_handler = bkr_do_stats},
 			{.procname = "frame_size", .mode = 0444, .data = &unit->stream->frame_size, .maxlen = 1, .proc_handler = proc_dointvec},
+			{.procname = "overruns", .mode = 0444, .data = &unit->stream->overruns, .maxlen = sizeof(unsigned long), .proc_handler = proc_doulongvec_minmax},
+			{.procname = "underruns", .mode = 0444, .data = &unit->stream->underruns, .maxlen = sizeof(unsigned long), .proc_handler = proc_doulongvec_minmax},
 			{0}
 		}
 	};
@@ -348,6 +512,9 @@ struct bkr_unit_t *bkr_unit_register(struct bkr_stream_t *stream)
 	unit = kmalloc(sizeof(*unit), GFP_KERNEL);
 	if(!unit)
 		goto no_mem;
+	unit->control = (struct bkr_ring_control *) get_zeroed_page(GFP_KERNEL);
+	if(!unit->control)
+		goto no_control;
 
 	/*
 	 * Find lowest available number.
@@ -376,6 +543,10 @@ struct bkr_unit_t *bkr_unit_register(struct bkr_stream_t *stream)
 #endif
 	init_waitqueue_head(&unit->queue);
 	unit->stream = stream;
+	seqlock_init(&unit->stats_lock);
+	bkr_unit_reset_stats(unit);
+	stream->overruns = 0;
+	stream->underruns = 0;
 	bkr_unit_sysctl_init(unit);
 	unit->sysctl.header = register_sysctl_table(unit->sysctl.dev_dir);
 
@@ -390,6 +561,8 @@ struct bkr_unit_t *bkr_unit_register(struct bkr_stream_t *stream)
 	 */
 
 no_number:
+	free_page((unsigned long) unit->control);
+no_control:
 	kfree(unit);
 no_mem:
 	WPRINTK("no memory creating unit descriptor\n");
@@ -402,6 +575,7 @@ void bkr_unit_unregister(struct bkr_unit_t *unit)
 	list_del(&unit->list);
 	if(unit->sysctl.header)
 		unregister_sysctl_table(unit->sysctl.header);
+	free_page((unsigned long) unit->control);
 	kfree(unit);
 }
 
@@ -413,15 +587,89 @@ void bkr_unit_unregister(struct bkr_unit_t *unit)
  */
 
 /*
- * Generic event notification for the kernel interface.
+ * I/O wake-up threshold in bytes, and a test for whether or not the ring
+ * holds at least need bytes of data (reading) or space (writing).
+ */
+
+static size_t bkr_unit_wakeup(struct bkr_unit_t *unit)
+{
+	size_t  threshold = unit->wakeup.count;
+
+	if(unit->wakeup.units == BKR_WAKEUP_FRAMES)
+		threshold *= unit->stream->frame_size;
+
+	return clamp_t(size_t, threshold, 1, unit->stream->ring->size - 1);
+}
+
+
+static int bkr_unit_io_ready(struct bkr_unit_t *unit, size_t need)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+
+	switch(stream->direction) {
+	case BKR_READING:
+		return bytes_in_ring(stream->ring) >= need;
+
+	case BKR_WRITING:
+		return space_in_ring(stream->ring) >= need;
+
+	default:
+		return 1;
+	}
+}
+
+
+/*
+ * Generic event notification for the kernel interface.  Sleepers are only
+ * woken once there's enough for them to do.
  */
 
 static void io_callback(void *data)
 {
-	wake_up_interruptible(data);
+	struct bkr_unit_t  *unit = data;
+
+	bkr_unit_update_hardware(unit);
+	if(bkr_unit_io_ready(unit, READ_ONCE(unit->waiting_for)))
+		wake_up_interruptible(&unit->queue);
 }
 
 
+/*
+ * The unit's side of bkr_stream_read() and bkr_stream_write().
+ */
+
+static size_t io_wakeup(void *data)
+{
+	return bkr_unit_wakeup(data);
+}
+
+static int io_sleep(void *data, size_t need)
+{
+	struct bkr_unit_t  *unit = data;
+	int  timed_out;
+
+	unit->waiting_for = need;
+	timed_out = !interruptible_sleep_on_timeout(&unit->queue, unit->stream->timeout);
+	unit->waiting_for = bkr_unit_wakeup(unit);
+	if(timed_out && !bkr_unit_io_ready(unit, 1))
+		return -ETIMEDOUT;
+	if(signal_pending(current))
+		return -EINTR;
+	return timed_out;
+}
+
+static void io_update(void *data)
+{
+	bkr_unit_update_process(data);
+}
+
+static const struct bkr_stream_io_ops_t unit_io_ops = {
+	.wakeup = io_wakeup,
+	.sleep = io_sleep,
+	.update = io_update
+};
+
+
 /*
  * Device open method.
  */
@@ -463,7 +711,13 @@ static int open(struct inode *inode, struct file *filp)
 	}
 
 	unit->last_error = 0;
-	bkr_stream_set_callback(unit->stream, io_callback, &unit->queue);
+	unit->wakeup = (struct bkr_wakeup) {
+		.count = 1,
+		.units = BKR_WAKEUP_BYTES
+	};
+	unit->waiting_for = 1;
+	bkr_stream_set_callback(unit->stream, io_callback, unit);
+	bkr_unit_reset_control(unit);
 	nonseekable_open(inode, filp);
 
 	return 0;
@@ -480,6 +734,7 @@ static int release(struct inode *inode, struct file *filp)
 	struct bkr_unit_t  *unit = filp->private_data;
 	struct bkr_stream_t  *stream = unit->stream;
 
+	unit->waiting_for = 1;
 	while(stream->ops.release(stream) == -EAGAIN) {
 		/* FIXME: anthing that takes us out of this loop other than a
 		 * success report from the stream's release() method causes a
@@ -514,24 +769,22 @@ static unsigned int poll(struct file *filp, struct poll_table_struct *wait)
 	struct bkr_stream_t  *stream = unit->stream;
 	unsigned int  status = 0;
 
-	poll_wait(filp, stream->callback_data, wait);
+	poll_wait(filp, &unit->queue, wait);
 
-	ring_lock(stream->ring);
 	switch(stream->direction) {
 	case BKR_READING:
-		if(bytes_in_ring(stream->ring))
+		if(bkr_unit_io_ready(unit, bkr_unit_wakeup(unit)))
 			status |= POLLIN | POLLRDNORM;
 		break;
 
 	case BKR_WRITING:
-		if(space_in_ring(stream->ring))
+		if(bkr_unit_io_ready(unit, bkr_unit_wakeup(unit)))
 			status |= POLLOUT | POLLWRNORM;
 		break;
 
 	default:
 		break;
 	}
-	ring_unlock(stream->ring);
 
 	if(unit->last_error)
 		status |= POLLERR;
@@ -540,6 +793,48 @@ static unsigned int poll(struct file *filp, struct poll_table_struct *wait)
 }
 
 
+/*
+ * Move the process' side of the ring after it has consumed or produced
+ * data in place through the mmap()ed ring.
+ */
+
+static int bkr_unit_advance(struct bkr_unit_t *unit, size_t count)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+	int  result;
+
+	switch(stream->direction) {
+	case BKR_READING:
+		result = stream->ops.read(stream);
+		break;
+
+	case BKR_WRITING:
+		result = stream->ops.write(stream);
+		break;
+
+	default:
+		result = -EINVAL;
+		break;
+	}
+	if(result == -EAGAIN)
+		result = 0;
+	if(result >= 0) {
+		if(count > (size_t) result)
+			result = -EINVAL;
+		else {
+			if(stream->direction == BKR_READING)
+				ring_drain(stream->ring, count);
+			else
+				ring_fill(stream->ring, count);
+			bkr_unit_update_process(unit);
+			result = 0;
+		}
+	}
+
+	return result;
+}
+
+
 /*
  * The general intent is for this driver to provide a standard magnetic
  * tape interface.  To this end we try to implement as many of the standard
@@ -555,6 +850,12 @@ static long ioctl(struct file *filp, unsigned int op, unsigned long argument)
 		struct mtop  mtop;
 		struct mtget  mtget;
 		struct mtpos  mtpos;
+		int  direction;
+		unsigned int  count;
+		struct bkr_wakeup  wakeup;
+		struct bkr_position  position;
+		struct bkr_decoder_stats  decoder;
+		struct bkr_stats  stats;
 	} arg;
 
 	switch(op) {
@@ -566,6 +867,17 @@ static long ioctl(struct file *filp, unsigned int op, unsigned long argument)
 		case MTRESET:
 			return 0;
 
+		/*
+		 * The driver can't see record marks, and the transport
+		 * can't be moved from here anyway.  Spacing over records
+		 * is done by the decoder (see the skip_records property
+		 * of bkr_splpdec), which scans sector headers only until
+		 * it gets there.
+		 */
+
+		case MTFSF:
+		case MTBSF:
+		case MTEOM:
 		default:
 			return -EINVAL;
 		}
@@ -582,13 +894,115 @@ static long ioctl(struct file *filp, unsigned int op, unsigned long argument)
 			.mt_dsreg = stream->mode,
 			.mt_gstat = GMT_ONLINE(-1L),
 			.mt_erreg = 0,
-			.mt_fileno = 0,
-			.mt_blkno = 0
+			.mt_fileno = unit->position.fileno,
+			.mt_blkno = unit->position.blkno
 		};
 		if(copy_to_user(p, &arg.mtget, sizeof(arg.mtget)))
 			return -EFAULT;
 		return 0;
 
+	case MTIOCPOS:
+		arg.mtpos.mt_blkno = unit->position.blkno;
+		if(copy_to_user(p, &arg.mtpos, sizeof(arg.mtpos)))
+			return -EFAULT;
+		return 0;
+
+	case BKRIOCSETPOS:
+		if(copy_from_user(&arg.position, p, sizeof(arg.position)))
+			return -EFAULT;
+		if(arg.position.fileno < 0 || arg.position.blkno < -1)
+			return -EINVAL;
+		write_seqlock(&unit->stats_lock);
+		unit->position = arg.position;
+		write_sequnlock(&unit->stats_lock);
+		return 0;
+
+	case BKRIOCSETSTATS:
+		if(copy_from_user(&arg.decoder, p, sizeof(arg.decoder)))
+			return -EFAULT;
+		write_seqlock(&unit->stats_lock);
+		unit->decoder = arg.decoder;
+		unit->stats_sequence++;
+		write_sequnlock(&unit->stats_lock);
+		return 0;
+
+	case BKRIOCGETSTATS:
+		bkr_unit_get_stats(unit, &arg.stats);
+		if(copy_to_user(p, &arg.stats, sizeof(arg.stats)))
+			return -EFAULT;
+		return 0;
+
+	case BKRIOCSTART:
+		if(get_user(arg.direction, (int *) p))
+			return -EFAULT;
+		if(arg.direction != BKRIOCSTART_READ && arg.direction != BKRIOCSTART_WRITE)
+			return -EINVAL;
+		if(stream->direction != BKR_STOPPED)
+			return -EBUSY;
+		return start(filp, arg.direction == BKRIOCSTART_READ ? BKR_READING : BKR_WRITING);
+
+	case BKRIOCADVANCE:
+		if(get_user(arg.count, (unsigned int *) p))
+			return -EFAULT;
+		return bkr_unit_advance(unit, arg.count);
+
+	case BKRIOCSETWAKEUP:
+		if(copy_from_user(&arg.wakeup, p, sizeof(arg.wakeup)))
+			return -EFAULT;
+		if(arg.wakeup.units != BKR_WAKEUP_BYTES && arg.wakeup.units != BKR_WAKEUP_FRAMES)
+			return -EINVAL;
+		unit->wakeup = arg.wakeup;
+		unit->waiting_for = bkr_unit_wakeup(unit);
+		return 0;
+
+	case BKRIOCGETWAKEUP:
+		if(copy_to_user(p, &unit->wakeup, sizeof(unit->wakeup)))
+			return -EFAULT;
+		return 0;
+
+	default:
+		return -EINVAL;
+	}
+}
+
+
+/*
+ * Device mmap method.  The control page is mapped on its own, read-only,
+ * at offset 0, and the ring buffer with a second mapping at offset
+ * PAGE_SIZE (see backer.h).  Backends whose ring is DMA-coherent memory
+ * map it themselves.
+ */
+
+static int mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct bkr_unit_t  *unit = filp->private_data;
+	struct bkr_stream_t  *stream = unit->stream;
+	unsigned long  size = vma->vm_end - vma->vm_start;
+
+	vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
+
+	switch(vma->vm_pgoff) {
+	case 0:
+		if(size != PAGE_SIZE)
+			return -EINVAL;
+		if(vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+		if(remap_pfn_range(vma, vma->vm_start, virt_to_phys(unit->control) >> PAGE_SHIFT, PAGE_SIZE, vma->vm_page_prot))
+			return -EAGAIN;
+		return 0;
+
+	case 1:
+		if(size > PAGE_ALIGN(stream->ring->size))
+			return -EINVAL;
+		/* from here on the offset is into the ring */
+		vma->vm_pgoff = 0;
+		if(stream->ops.mmap)
+			return stream->ops.mmap(stream, vma);
+		if(remap_pfn_range(vma, vma->vm_start, virt_to_phys(stream->ring->buffer) >> PAGE_SHIFT, size, vma->vm_page_prot))
+			return -EAGAIN;
+		return 0;
+
 	default:
 		return -EINVAL;
 	}
@@ -597,33 +1011,41 @@ static long ioctl(struct file *filp, unsigned int op, unsigned long argument)
 
 /*
  * These functions start data transfers when the first call to a read() or
- * write() method is made.
+ * write() method is made, or when requested with BKRIOCSTART.
  */
 
-static ssize_t start_read(struct file *filp, char *buff, size_t count, loff_t *posp)
+static int start(struct file *filp, enum bkr_direction_t direction)
 {
 	struct bkr_unit_t  *unit = filp->private_data;
 	struct bkr_stream_t  *stream = unit->stream;
+	int  result;
+
+	stream->overruns = 0;
+	stream->underruns = 0;
+	bkr_unit_reset_stats(unit);
+	bkr_unit_reset_control(unit);
+	if((result = stream->ops.start(stream, direction)) >= 0)
+		filp->f_op = &file_ops[direction];
+
+	return result;
+}
+
+static ssize_t start_read(struct file *filp, char *buff, size_t count, loff_t *posp)
+{
 	ssize_t  result;
 
-	if((result = stream->ops.start(stream, BKR_READING)) >= 0) {
-		filp->f_op = &file_ops[BKR_READING];
+	if((result = start(filp, BKR_READING)) >= 0)
 		result = filp->f_op->read(filp, buff, count, posp);
-	}
 
 	return result;
 }
 
 static ssize_t start_write(struct file *filp, const char *buff, size_t count, loff_t *posp)
 {
-	struct bkr_unit_t  *unit = filp->private_data;
-	struct bkr_stream_t  *stream = unit->stream;
 	ssize_t  result;
 
-	if((result = stream->ops.start(stream, BKR_WRITING)) >= 0) {
-		filp->f_op = &file_ops[BKR_WRITING];
+	if((result = start(filp, BKR_WRITING)) >= 0)
 		result = filp->f_op->write(filp, buff, count, posp);
-	}
 
 	return result;
 }
@@ -636,146 +1058,185 @@ static ssize_t start_write(struct file *filp, const char *buff, size_t count, lo
 static ssize_t read(struct file *filp, char *buff, size_t count, loff_t *posp)
 {
 	struct bkr_unit_t  *unit = filp->private_data;
-	struct bkr_stream_t  *stream = unit->stream;
-	ssize_t  result;
-	size_t  moved = 0;
-	size_t  chunk_size;
 
-	/* Is there an error from an earlier call? */
-	result = unit->last_error;
-	unit->last_error = 0;
-	/* No, so move data */
-	if(!result) while(1) {
-		ring_lock(stream->ring);
-		result = stream->ops.read(stream);
-		ring_unlock(stream->ring);
-
-		if(result > 0) {
-			chunk_size = min(count, (size_t) result);
-			ring_lock(stream->ring);
-			/* FIXME: check return value */
-			copy_to_user_from_ring(buff, stream->ring, chunk_size);
-			ring_unlock(stream->ring);
-			buff += chunk_size;
-			moved += chunk_size;
-			count -= chunk_size;
-			/* Are we done? */
-			if(!count) {
-				result = moved;
-				break;
-			}
-			continue;
-		}
+	return bkr_stream_read(unit->stream, &unit_io_ops, unit, filp->f_flags, &unit->last_error, buff, count);
+}
 
-		/* Need to block? */
-		if(result == -EAGAIN) {
-			/* Have we moved anything? */
-#if O_NONBLOCK == O_NDELAY
-			if(moved)
-				result = moved;
-#else
-			if(moved || ((filp->f_flags & (O_NONBLOCK | O_NDELAY)) == O_NDELAY))
-				result = moved;
-#endif
-			/* Block if its OK to do so */
-			else if(!(filp->f_flags & (O_NONBLOCK | O_NDELAY))) {
-				if(!interruptible_sleep_on_timeout(&unit->queue, stream->timeout))
-					result = -ETIMEDOUT;
-				else if(signal_pending(current))
-					result = -EINTR;
-				else
-					continue;
-			}
-			break;
-		}
 
-		/* EOF? */
-		if(result == 0) {
-			result = moved;
-			break;
-		}
+/*
+ * Device write method.
+ */
 
-		/* It's a real error! */
-		/* If we've moved anything, save error code for later */
-		if(moved) {
-			unit->last_error = result;
-			result = moved;
+static ssize_t write(struct file *filp, const char *buff, size_t count, loff_t *posp)
+{
+	struct bkr_unit_t  *unit = filp->private_data;
+
+	return bkr_stream_write(unit->stream, &unit_io_ops, unit, filp->f_flags, &unit->last_error, buff, count);
+}
+
+
+/*
+ * splice() support.  Data is copied once between the ring and freshly
+ * allocated pages, which the pipe then owns, so capturing to (or playing
+ * back from) a file doesn't bounce through a user space buffer.
+ */
+
+static const struct pipe_buf_operations ring_pipe_buf_ops = {
+	BKR_PIPE_BUF_MAP_OPS
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get
+};
+
+
+static void ring_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	put_page(spd->pages[i]);
+}
+
+
+/*
+ * Wait for the ring to have data (reading) or space (writing).  probe is
+ * the stream's read() or write() method.  Returns the number of bytes
+ * available or an error code.
+ */
+
+static ssize_t bkr_unit_wait(struct bkr_unit_t *unit, struct file *filp, int (*probe)(struct bkr_stream_t *), int nonblock)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+	int  result;
+
+	nonblock |= filp->f_flags & (O_NONBLOCK | O_NDELAY);
+	while((result = probe(stream)) == -EAGAIN && !nonblock) {
+		if(!interruptible_sleep_on_timeout(&unit->queue, stream->timeout)) {
+			result = probe(stream);
+			return result == -EAGAIN ? -ETIMEDOUT : result;
 		}
-		break;
+		if(signal_pending(current))
+			return -EINTR;
 	}
 
 	return result;
 }
 
 
-/*
- * Device write method.
- */
+static ssize_t start_splice_read(struct file *filp, loff_t *posp, struct pipe_inode_info *pipe, size_t count, unsigned int flags)
+{
+	ssize_t  result;
 
-static ssize_t write(struct file *filp, const char *buff, size_t count, loff_t *posp)
+	if((result = start(filp, BKR_READING)) >= 0)
+		result = filp->f_op->splice_read(filp, posp, pipe, count, flags);
+
+	return result;
+}
+
+static ssize_t start_splice_write(struct pipe_inode_info *pipe, struct file *filp, loff_t *posp, size_t count, unsigned int flags)
+{
+	ssize_t  result;
+
+	if((result = start(filp, BKR_WRITING)) >= 0)
+		result = filp->f_op->splice_write(pipe, filp, posp, count, flags);
+
+	return result;
+}
+
+
+static ssize_t splice_read(struct file *filp, loff_t *posp, struct pipe_inode_info *pipe, size_t count, unsigned int flags)
 {
 	struct bkr_unit_t  *unit = filp->private_data;
 	struct bkr_stream_t  *stream = unit->stream;
-	ssize_t  result;
-	size_t  moved = 0;
+	struct page  *pages[PIPE_DEF_BUFFERS];
+	struct partial_page  partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc  spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages = 0,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		BKR_SPD_FLAGS(flags)
+		.ops = &ring_pipe_buf_ops,
+		.spd_release = ring_spd_release
+	};
+	size_t  copied = 0;
 	size_t  chunk_size;
+	ssize_t  result;
 
 	/* Is there an error from an earlier call? */
-	result = unit->last_error;
-	unit->last_error = 0;
-	/* No, so move data */
-	if(!result) while(1) {
-		ring_lock(stream->ring);
-		result = stream->ops.write(stream);
-		ring_unlock(stream->ring);
-
-		if(result >= 0) {
-			chunk_size = min(count, (size_t) result);
-			ring_lock(stream->ring);
-			/* FIXME: check return value */
-			copy_to_ring_from_user(stream->ring, buff, chunk_size);
-			ring_unlock(stream->ring);
-			buff += chunk_size;
-			moved += chunk_size;
-			count -= chunk_size;
-			/* Are we done? */
-			if(!count) {
-				result = moved;
-				break;
-			}
-			continue;
-		}
+	if((result = unit->last_error)) {
+		unit->last_error = 0;
+		return result;
+	}
 
-		/* Need to block? */
-		if(result == -EAGAIN) {
-			/* Have we moved anything? */
-#if O_NONBLOCK == O_NDELAY
-			if(moved)
-				result = moved;
-#else
-			if(moved || ((filp->f_flags & (O_NONBLOCK | O_NDELAY)) == O_NDELAY))
-				result = moved;
-#endif
-			/* Is it OK to block? */
-			else if(!(filp->f_flags & (O_NONBLOCK | O_NDELAY))) {
-				if(!interruptible_sleep_on_timeout(&unit->queue, stream->timeout))
-					result = -ETIMEDOUT;
-				else if(signal_pending(current))
-					result = -EINTR;
-				else
-					continue;
-			}
+	result = bkr_unit_wait(unit, filp, stream->ops.read, flags & SPLICE_F_NONBLOCK);
+	if(result <= 0)
+		return result;
+	count = min(count, (size_t) result);
+
+	/* The data is copied out without draining the ring.  splice_to_pipe()
+	 * checks for room and adds the pages with the pipe locked, and the
+	 * ring is drained by only as much as it accepted.  Whatever it
+	 * doesn't take is released with its pages, and read again by the
+	 * next call. */
+	while(count && spd.nr_pages < PIPE_DEF_BUFFERS) {
+		chunk_size = min(count, (size_t) PAGE_SIZE);
+		pages[spd.nr_pages] = alloc_page(GFP_KERNEL);
+		if(!pages[spd.nr_pages])
 			break;
-		}
+		peek_ring(page_address(pages[spd.nr_pages]), stream->ring, copied, chunk_size);
+		partial[spd.nr_pages] = (struct partial_page) {
+			.offset = 0,
+			.len = chunk_size
+		};
+		spd.nr_pages++;
+		copied += chunk_size;
+		count -= chunk_size;
+	}
 
-		/* It's a real error! */
-		/* If we've moved anything, save error code for later */
-		if(moved) {
-			unit->last_error = result;
-			result = moved;
-		}
-		break;
+	if(!spd.nr_pages)
+		return -ENOMEM;
+
+	result = splice_to_pipe(pipe, &spd);
+	if(result > 0) {
+		ring_drain(stream->ring, result);
+		bkr_unit_update_process(unit);
 	}
 
 	return result;
 }
+
+
+static int pipe_to_ring(struct pipe_inode_info *pipe, struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct file  *filp = sd->u.file;
+	struct bkr_unit_t  *unit = filp->private_data;
+	struct bkr_stream_t  *stream = unit->stream;
+	ssize_t  result;
+	void  *data;
+
+	result = bkr_unit_wait(unit, filp, stream->ops.write, sd->flags & SPLICE_F_NONBLOCK);
+	if(result <= 0)
+		return result;
+	result = min((size_t) sd->len, (size_t) result);
+
+	data = kmap(buf->page);
+	memcpy_to_ring(stream->ring, data + buf->offset, result);
+	kunmap(buf->page);
+	bkr_unit_update_process(unit);
+
+	return result;
+}
+
+
+static ssize_t splice_write(struct pipe_inode_info *pipe, struct file *filp, loff_t *posp, size_t count, unsigned int flags)
+{
+	struct bkr_unit_t  *unit = filp->private_data;
+	ssize_t  result;
+
+	/* Is there an error from an earlier call? */
+	if((result = unit->last_error)) {
+		unit->last_error = 0;
+		return result;
+	}
+
+	return splice_from_pipe(pipe, filp, posp, count, flags, pipe_to_ring);
+}
@@ -78,6 +78,7 @@
 #include <linux/init.h>
 
 #include <linux/errno.h>
+#include <linux/interrupt.h>
 #include <linux/list.h>
 #include <linux/parport.h>
 #include <linux/pci.h>
@@ -91,6 +92,7 @@
 #include <asm/dma.h>
 
 #include <backer.h>
+#include <bkr_kcompat.h>
 #include <bkr_unit.h>
 #include <bkr_ring_buffer.h>
 
@@ -130,6 +132,7 @@ module_param(adjust, int, 0);
 #define  DMA_MEM_TO_IO          0x58    /* single mode, inc addr, auto-init */
 #define  ECR_MODE               0x68    /* Linux parport and Backers suck */
 #define  DMA_BUFFER_SIZE        65536
+#define  DMA_QUEUE_LENGTH       8       /* frames queued ahead of the DMA controller */
 #define  FRAME_TIME             HZ/BKR_MIN_FRAME_FREQ	/* jiffies */
 #define  BKR_PARPORT_TIMEOUT    (30*FRAME_TIME)         /* ~1 second */
 #define  REQUIRED_MODES         (PARPORT_MODE_PCSPP | PARPORT_MODE_ECP | PARPORT_MODE_DMA)
@@ -159,6 +162,21 @@ struct bkr_stream_private_t {
 	struct parport_state  state;    /* Linux parport and Backers suck */
 	jiffies_t  last_io;             /* jiffies counter at last I/O */
 	int  adjust;                    /* adjustment to start-up pause */
+	struct tasklet_struct  tasklet; /* completion processing */
+	struct {
+		size_t  offset[DMA_QUEUE_LENGTH];      /* frames, in order */
+		unsigned int  head;     /* frames queued (tasklet) */
+		unsigned int  tail;     /* frames armed (IRQ) */
+	} queue;                        /* DMA descriptor queue */
+	size_t  next;                   /* ring offset of next frame to queue */
+	size_t  spill;                  /* offset of the spill frame */
+	int  spilling;                  /* DMA controller is on the spill frame */
+	unsigned int  retired;          /* queued frames completed (IRQ) */
+	unsigned int  spilled;          /* spill frames completed (IRQ) */
+	unsigned int  accounted;        /* frames added to the ring (tasklet) */
+	unsigned int  spills_seen;      /* spills counted (tasklet) */
+	int  primed;                    /* data has been queued for writing */
+	int  draining;                  /* flushing at end of write */
 };
 
 
@@ -181,43 +199,112 @@ static inline void write_ecr(struct parport *port, char byte)
 
 
 /*
- * Round-robins the DMA controller through sequential frame-sized chunks of
- * the ring buffer and updates the hardware side of the ring.
+ * The DMA controller is walked through the ring one frame at a time.  The
+ * interrupt handler does no more than re-arm it with the next frame from
+ * a queue of descriptors kept DMA_QUEUE_LENGTH frames deep and count the
+ * frame just finished;  moving the ring and waking up processes is left
+ * to the tasklet, which also refills the queue.  The queue only holds
+ * frames that are ready for the hardware (empty when reading, full when
+ * writing), and when it runs dry the controller is pointed at a spare
+ * "spill" frame past the end of the ring, so a late process costs a
+ * counted overrun or underrun rather than the ring.
+ *
+ * The queue has a single producer, the tasklet, and a single consumer,
+ * the interrupt handler, and the counters each have one writer, so none
+ * of this needs a lock.
  */
 
+static size_t dma_queue_pop(struct bkr_stream_private_t *private)
+{
+	unsigned int  tail = private->queue.tail;
+
+	if(tail == smp_load_acquire(&private->queue.head)) {
+		private->spilling = 1;
+		return private->spill;
+	}
+	private->queue.tail = tail + 1;
+	private->spilling = 0;
+	return private->queue.offset[tail % DMA_QUEUE_LENGTH];
+}
+
+
+static void dma_queue_fill(struct bkr_stream_t *stream)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	struct ring  *ring = stream->ring;
+	unsigned int  head = private->queue.head;
+	size_t  ready;
+
+	while(head - smp_load_acquire(&private->retired) < DMA_QUEUE_LENGTH) {
+		/* bytes needed for this frame and those already queued */
+		ready = (head - private->accounted + 1) * stream->frame_size;
+		if(stream->direction == BKR_READING ? space_in_ring(ring) < ready : bytes_in_ring(ring) < ready)
+			break;
+		private->queue.offset[head % DMA_QUEUE_LENGTH] = private->next;
+		ring_offset_inc(ring, &private->next, stream->frame_size);
+		smp_store_release(&private->queue.head, ++head);
+		private->primed = 1;
+	}
+}
+
+
 static void bkr_parport_irq(void *handle)
 {
 	struct bkr_stream_t  *stream = handle;
-	struct ring  *ring = stream->ring;
 	struct bkr_stream_private_t  *private = stream->private;
 	struct parport  *port = private->dev->port;
 	unsigned long  flags;
+	size_t  offset;
+
+	if(stream->direction == BKR_STOPPED)
+		return;
+
+	if(private->spilling)
+		smp_store_release(&private->spilled, private->spilled + 1);
+	else
+		smp_store_release(&private->retired, private->retired + 1);
+	offset = dma_queue_pop(private);
 
 	flags = claim_dma_lock();
-	ring_lock(ring);	/* FIXME:  ok in an interrupt? */
 	clear_dma_ff(port->dma);
+	set_dma_addr(port->dma, private->dma_addr + offset);
+	write_ecr(port, ECR_MODE);
+	release_dma_lock(flags);
+	private->last_io = jiffies;
+
+	tasklet_schedule(&private->tasklet);
+}
+
+
+static void bkr_parport_tasklet(unsigned long data)
+{
+	struct bkr_stream_t  *stream = (struct bkr_stream_t *) data;
+	struct bkr_stream_private_t  *private = stream->private;
+	unsigned int  retired = smp_load_acquire(&private->retired);
+	unsigned int  spilled = READ_ONCE(private->spilled);
+	unsigned int  spills = spilled - private->spills_seen;
+	size_t  n = (retired - private->accounted) * stream->frame_size;
+
+	private->accounted = retired;
+	private->spills_seen = spilled;
+
 	switch(stream->direction) {
 	case BKR_READING:
-		ring_fill(ring, stream->frame_size);
-		set_dma_addr(port->dma, private->dma_addr + ring->head);
+		ring_fill(stream->ring, n);
+		stream->overruns += spills;
 		break;
 
 	case BKR_WRITING:
-		ring_drain(ring, stream->frame_size);
-		set_dma_addr(port->dma, private->dma_addr + ring->tail);
+		ring_drain(stream->ring, n);
+		if(private->primed && !private->draining)
+			stream->underruns += spills;
 		break;
 
 	default:
-		ring_unlock(ring);	/* FIXME:  ok in an interrupt? */
-		release_dma_lock(flags);
 		return;
 	}
-	write_ecr(port, ECR_MODE);
-	ring_unlock(ring);	/* FIXME:  ok in an interrupt? */
-	release_dma_lock(flags);
-	private->last_io = jiffies;
 
-	/* FIXME: don't do this here --- schedule it on a queue */
+	dma_queue_fill(stream);
 	bkr_stream_do_callback(stream);
 }
 
@@ -255,13 +342,8 @@ static void transmit_control_byte(struct parport *port, unsigned char byte)
 
 static int flush(struct bkr_stream_t *stream)
 {
-	int result;
-
-	ring_lock(stream->ring);
-	result = ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) ? -EAGAIN : 0;
-	ring_unlock(stream->ring);
-
-	return result;
+	stream->private->draining = 1;
+	return ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) ? -EAGAIN : 0;
 }
 
 
@@ -302,6 +384,13 @@ static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
 	 */
 
 	stream->direction = direction;
+	private->queue.head = private->queue.tail = 0;
+	private->next = direction == BKR_READING ? ring_head(stream->ring) : ring_tail(stream->ring);
+	private->retired = private->spilled = 0;
+	private->accounted = private->spills_seen = 0;
+	private->primed = private->draining = 0;
+	memset(stream->ring->buffer + private->spill, BKR_FILLER, stream->frame_size);
+	dma_queue_fill(stream);
 
 	if(BKR_VIDEOMODE(stream->mode) == BKR_NTSC)
 		pause = BKR_LINE_PERIOD * (BKR_FIRST_LINE_NTSC - 1);
@@ -321,7 +410,7 @@ static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
 	flags = claim_dma_lock();
 	disable_dma(port->dma);
 	clear_dma_ff(port->dma);
-	set_dma_addr(port->dma, private->dma_addr);
+	set_dma_addr(port->dma, private->dma_addr + dma_queue_pop(private));
 	set_dma_count(port->dma, stream->frame_size);
 	if(direction == BKR_WRITING) {
 		set_dma_mode(port->dma, DMA_MEM_TO_IO);
@@ -362,6 +451,7 @@ static int release(struct bkr_stream_t *stream)
 		stream->direction = BKR_STOPPED;
 		/* note: we get woken up before the IRQ handler is called */
 		parport_wait_event(port, HZ/BKR_MIN_FRAME_FREQ);
+		tasklet_kill(&private->tasklet);
 		/* FIXME: should restore be done after transmit and negotiate? */
 		port->ops->restore_state(port, &private->state);
 		transmit_control_byte(port, 0);
@@ -399,12 +489,25 @@ static int write(struct bkr_stream_t *stream)
 }
 
 
+/*
+ * The ring is DMA-coherent memory, which is mapped with the DMA API rather
+ * than by physical address.
+ */
+
+static int mmap(struct bkr_stream_t *stream, struct vm_area_struct *vma)
+{
+	return dma_mmap_coherent(NULL, vma, stream->ring->buffer, stream->private->dma_addr, stream->ring->size);
+}
+
+
 static struct bkr_stream_t *ready(struct bkr_stream_t *stream, int mode, unsigned int frame_size)
 {
 	stream->mode = mode;
 	stream->direction = BKR_STOPPED;
 	stream->frame_size = frame_size;
-	stream->ring->size = DMA_BUFFER_SIZE - DMA_BUFFER_SIZE % frame_size;
+	/* the last whole frame of the DMA buffer is the spill frame */
+	stream->ring->size = (DMA_BUFFER_SIZE / frame_size - 1) * frame_size;
+	stream->private->spill = stream->ring->size;
 	ring_reset(stream->ring);
 	memset_ring(stream->ring, 0, stream->ring->size);
 
@@ -429,6 +532,7 @@ static void do_detach(struct work_struct *work)
 	down(&bkr_unit_list_lock);
 	bkr_unit_unregister(unit);
 	parport_unregister_device(private->dev);
+	tasklet_kill(&private->tasklet);
 	dma_free_coherent(NULL, DMA_BUFFER_SIZE, stream->ring->buffer, private->dma_addr);
 	ring_free(stream->ring);
 	kfree(stream);
@@ -510,8 +614,10 @@ static void attach(struct parport *port)
 		.release = release,
 		.read = read,
 		.write = write,
+		.mmap = mmap,
 	};
 	stream->private = private;
+	tasklet_init(&private->tasklet, bkr_parport_tasklet, (unsigned long) stream);
 	bkr_stream_set_callback(stream, NULL, NULL);
 	stream->timeout = BKR_PARPORT_TIMEOUT;
 
@@ -3,7 +3,9 @@
  *
  * This implementation is thread-safe when there is only one "producer"
  * thread and one "consumer" thread (i.e. if two treads try to write to the
- * buffer at once, there are problems).
+ * buffer at once, there are problems).  No locking is required, see
+ * bkr_ring_buffer.h.  The functions that move data update the head or tail
+ * only once the data has been moved.
  *
  * Copyright (C) 2002,2010  Kipp C. Cannon
  *
@@ -32,10 +34,13 @@
  * overflows will occur!
  */
 
+#ifdef __KERNEL__
 #include <asm/uaccess.h>
 #include <linux/slab.h>
-#include <linux/spinlock.h>
 #include <linux/string.h>
+#else
+#include <bkr_compat.h>
+#endif
 
 #include <bkr_ring_buffer.h>
 
@@ -49,10 +54,11 @@
 struct ring *ring_new(void *buffer, size_t size)
 {
 	struct ring *new = kmalloc(sizeof(*new), GFP_KERNEL);
-	new->buffer = buffer;
-	new->size = size;
-	new->head = new->tail = 0;
-	spin_lock_init(&new->lock);
+	if(new) {
+		new->buffer = buffer;
+		new->size = size;
+		new->head = new->tail = 0;
+	}
 	return new;
 }
 
@@ -83,11 +89,10 @@ size_t memset_ring(struct ring *dst, ring_data_t val, size_t n)
 	remainder = dst->size - dst->head;
 	if(remainder <= n) {
 		memset(dst->buffer + dst->head, val, remainder);
-		memset(dst->buffer, val, dst->head = n - remainder);
-	} else {
+		memset(dst->buffer, val, n - remainder);
+	} else
 		memset(dst->buffer + dst->head, val, n);
-		dst->head += n;
-	}
+	ring_fill(dst, n);
 
 	return n;
 }
@@ -107,27 +112,62 @@ size_t memcpy_to_ring(struct ring *dst, void *src, size_t n)
 	remainder = dst->size - dst->head;
 	if(remainder <= n) {
 		memcpy(dst->buffer + dst->head, src, remainder);
-		memcpy(dst->buffer, src + remainder, dst->head = n - remainder);
-	} else {
+		memcpy(dst->buffer, src + remainder, n - remainder);
+	} else
 		memcpy(dst->buffer + dst->head, src, n);
-		dst->head += n;
-	}
+	ring_fill(dst, n);
 
 	return n;
 }
 
 size_t memcpy_from_ring(void *dst, struct ring *src, size_t n)
+{
+	ring_drain(src, peek_ring(dst, src, 0, n));
+
+	return n;
+}
+
+
+/*
+ * peek_ring()
+ *
+ * Copy data to a linear buffer from a ring, starting offset bytes past the
+ * tail, without draining it.
+ */
+
+size_t peek_ring(void *dst, struct ring *src, size_t offset, size_t n)
+{
+	size_t  start = ring_offset_add(src, src->tail, offset);
+	size_t  remainder;
+
+	remainder = src->size - start;
+	if(remainder <= n) {
+		memcpy(dst, src->buffer + start, remainder);
+		memcpy(dst + remainder, src->buffer, n - remainder);
+	} else
+		memcpy(dst, src->buffer + start, n);
+
+	return n;
+}
+
+
+/*
+ * memcpy_ring_to_ring()
+ *
+ * Move data from one ring to another.
+ */
+
+size_t memcpy_ring_to_ring(struct ring *dst, struct ring *src, size_t n)
 {
 	size_t  remainder;
 
 	remainder = src->size - src->tail;
 	if(remainder <= n) {
-		memcpy(dst, src->buffer + src->tail, remainder);
-		memcpy(dst + remainder, src->buffer, src->tail = n - remainder);
-	} else {
-		memcpy(dst, src->buffer + src->tail, n);
-		src->tail += n;
-	}
+		memcpy_to_ring(dst, src->buffer + src->tail, remainder);
+		memcpy_to_ring(dst, src->buffer, n - remainder);
+	} else
+		memcpy_to_ring(dst, src->buffer + src->tail, n);
+	ring_drain(src, n);
 
 	return n;
 }
@@ -146,11 +186,10 @@ size_t copy_to_user_from_ring(char *dst, struct ring *src, size_t n)
 	remainder = src->size - src->tail;
 	if(remainder <= n) {
 		success &= copy_to_user(dst, src->buffer + src->tail, remainder) == 0;
-		success &= copy_to_user(dst + remainder, src->buffer, src->tail = n - remainder) == 0;
-	} else {
+		success &= copy_to_user(dst + remainder, src->buffer, n - remainder) == 0;
+	} else
 		success &= copy_to_user(dst, src->buffer + src->tail, n) == 0;
-		src->tail += n;
-	}
+	ring_drain(src, n);
 
 	return n;
 }
@@ -164,11 +203,10 @@ size_t copy_to_ring_from_user(struct ring *dst, const char *src, size_t n)
 	remainder = dst->size - dst->head;
 	if(remainder <= n) {
 		success &= copy_from_user(dst->buffer + dst->head, src, remainder) == 0;
-		success &= copy_from_user(dst->buffer, src + remainder, dst->head = n - remainder) == 0;
-	} else {
+		success &= copy_from_user(dst->buffer, src + remainder, n - remainder) == 0;
+	} else
 		success &= copy_from_user(dst->buffer + dst->head, src, n) == 0;
-		dst->head += n;
-	}
+	ring_fill(dst, n);
 
 	return n;
 }
@@ -185,7 +223,7 @@ int ring_fill_to(struct ring *ring, int interval, unsigned char data)
 
 	if(count) {
 		count = interval - count;
-		if(space_in_ring(ring) >= count) {
+		if(space_in_ring(ring) >= (size_t) count) {
 			memset_ring(ring, data, count);
 			count = 0;
 		}
@@ -32,13 +32,23 @@
  *
  *	0 <= space_in_ring(), bytes_in_ring() < size
  *	space_in_ring() + bytes_in_ring() == size - 1
+ *
+ * The ring is lock-free for a single producer and a single consumer.  The
+ * head is written only by the producer and the tail only by the consumer.
+ * Each side publishes its offset with release semantics after it has
+ * finished with the data the offset covers, and loads the other side's
+ * offset with acquire semantics before touching the data it covers.
  */
 
 #ifndef _BKR_RING_BUFFER_H
 #define _BKR_RING_BUFFER_H
 
-#include <linux/spinlock.h>
+#ifdef __KERNEL__
 #include <linux/types.h>
+#include <bkr_kcompat.h>
+#else
+#include <bkr_compat.h>
+#endif
 
 
 typedef unsigned char  ring_data_t;
@@ -49,29 +59,38 @@ struct ring {
 	size_t  size;
 	size_t  head;
 	size_t  tail;
-	unsigned long  flags;
-	spinlock_t  lock;
 };
 
 
 /*
- * Aquire and release ring locks
+ * Load and publish the head and tail offsets.
  */
 
 
-static void ring_lock(struct ring *ring)
+static size_t ring_head(struct ring *ring)
+{
+	return smp_load_acquire(&ring->head);
+}
+
+static size_t ring_tail(struct ring *ring)
+{
+	return smp_load_acquire(&ring->tail);
+}
+
+static void ring_set_head(struct ring *ring, size_t head)
 {
-	spin_lock_irqsave(&ring->lock, ring->flags);
+	smp_store_release(&ring->head, head);
 }
 
-static void ring_unlock(struct ring *ring)
+static void ring_set_tail(struct ring *ring, size_t tail)
 {
-	spin_unlock_irqrestore(&ring->lock, ring->flags);
+	smp_store_release(&ring->tail, tail);
 }
 
 
 /*
- * Reset the head and tail offsets of a ring buffer to 0.
+ * Reset the head and tail offsets of a ring buffer to 0.  Only to be used
+ * when neither side is active.
  */
 
 static void ring_reset(struct ring *ring)
@@ -102,13 +121,13 @@ static size_t ring_offset_add(struct ring *ring, size_t x, size_t y)
 static size_t ring_offset_sub(struct ring *ring, size_t x, size_t y)
 {
 	const ring_soffset_t z = x - y;
-	return(z < 0 ? z + ring->size : z);
+	return(z < 0 ? (size_t) z + ring->size : (size_t) z);
 }
 #else
 #define ring_offset_sub(ring,x,y) ({         \
 	const ring_soffset_t _z = (x) - (y); \
 	const struct ring *_r = ring;        \
-	_z < 0 ? _z + _r->size : _z; })
+	_z < 0 ? (size_t) _z + _r->size : (size_t) _z; })
 #endif
 
 #if 0
@@ -133,13 +152,13 @@ static void ring_offset_dec(struct ring *ring, size_t *offset, int n)
 
 static void ring_fill(struct ring *ring, size_t n)
 {
-	ring_offset_inc(ring, ring->head, n);
+	ring_set_head(ring, ring_offset_add(ring, ring->head, n));
 }
 
 
 static void ring_drain(struct ring *ring, size_t n)
 {
-	ring_offset_inc(ring, ring->tail, n);
+	ring_set_tail(ring, ring_offset_add(ring, ring->tail, n));
 }
 
 
@@ -151,25 +170,25 @@ static void ring_drain(struct ring *ring, size_t n)
 
 static size_t space_in_ring(struct ring *ring)
 {
-	return ring_offset_sub(ring, ring->tail - 1, ring->head);
+	return ring_offset_sub(ring, ring_tail(ring) - 1, ring_head(ring));
 }
 
 
 static size_t bytes_in_ring(struct ring *ring)
 {
-	return ring_offset_sub(ring, ring->head, ring->tail);
+	return ring_offset_sub(ring, ring_head(ring), ring_tail(ring));
 }
 
 
 static int ring_is_full(struct ring *ring)
 {
-	return ring_offset_add(ring, ring->head, 1) == ring->tail;
+	return ring_offset_add(ring, ring_head(ring), 1) == ring_tail(ring);
 }
 
 
 static int ring_is_empty(struct ring *ring)
 {
-	return ring->head == ring->tail;
+	return ring_head(ring) == ring_tail(ring);
 }
 
 
@@ -182,6 +201,8 @@ void ring_free(struct ring *);
 size_t memset_ring(struct ring *, ring_data_t, size_t);
 size_t memcpy_to_ring(struct ring *, void *, size_t);
 size_t memcpy_from_ring(void *, struct ring *, size_t);
+size_t peek_ring(void *, struct ring *, size_t, size_t);
+size_t memcpy_ring_to_ring(struct ring *, struct ring *, size_t);
 size_t copy_to_user_from_ring(char *, struct ring *, size_t);
 size_t copy_to_ring_from_user(struct ring *, const char *, size_t);
 int ring_fill_to(struct ring *, int, unsigned char);
@@ -0,0 +1,150 @@
+/*
+ * Stream description for Backer device driver.
+ *
+ * Copyright (C) 2000,2001,2002,2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A stream is one hardware back-end's I/O ring and the methods for
+ * driving it.  Nothing in here depends on the kernel beyond the ring
+ * buffer, so together with bkr_ring_buffer.c and bkr_compat.h this header
+ * also builds in user space.
+ */
+
+#ifndef  _BACKER_STREAM_H
+#define  _BACKER_STREAM_H
+
+#include <backer.h>
+#include <bkr_ring_buffer.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                          STREAM DESCRIPTIONS
+ *
+ * ========================================================================
+ */
+
+
+#define BKR_FILLER 0x33         /* Generic filler */
+
+
+enum bkr_direction_t {
+	BKR_STOPPED = 0,
+	BKR_READING,
+	BKR_WRITING
+};
+
+
+struct bkr_stream_private_t;
+struct vm_area_struct;
+
+
+struct bkr_stream_t {
+	struct ring  *ring;             /* this stream's I/O ring */
+	unsigned int frame_size;        /* two video fields */
+	struct bkr_stream_ops_t {
+		struct bkr_stream_t  *(*ready)(struct bkr_stream_t *, int, unsigned int);
+		int  (*start)(struct bkr_stream_t *, enum bkr_direction_t);
+		int  (*release)(struct bkr_stream_t *);
+		int  (*read)(struct bkr_stream_t *);
+		int  (*write)(struct bkr_stream_t *);
+		int  (*mmap)(struct bkr_stream_t *, struct vm_area_struct *);
+	} ops;                          /* stream control functions */
+	int  mode;                      /* stream settings */
+	volatile enum bkr_direction_t  direction;     /* stream state */
+	void  (*callback)(void *);      /* I/O activity call-back */
+	void  *callback_data;           /* call-back data */
+	unsigned int  timeout;          /* I/O activity timeout */
+	unsigned long  overruns;        /* times data was lost reading */
+	unsigned long  underruns;       /* times data was late writing */
+	struct bkr_stream_private_t  *private; /* per-stream private data */
+};
+
+
+/*
+ * Convert a mode (see the format enums in backer.h) to a video frame size
+ * (count of bytes in two full video fields).  Return < 0 if the mode is
+ * invalid.
+ */
+
+
+static int bkr_mode_to_frame_size(int mode)
+{
+	static unsigned int frame_size[] = {
+		2028,	/* nl */
+		2440,	/* pl */
+		5070,	/* nh */
+		6100    /* ph */
+	};
+	unsigned int *result = frame_size;
+
+	if(BKR_DENSITY(mode) == BKR_HIGH)
+		result += 2;
+	else if(BKR_DENSITY(mode) != BKR_LOW)
+		return -1;
+	if(BKR_VIDEOMODE(mode) == BKR_PAL)
+		result += 1;
+	else if(BKR_VIDEOMODE(mode) != BKR_NTSC)
+		return -1;
+
+	return *result;
+}
+
+
+/*
+ * Generate the Backer device control byte from the given video mode,
+ * density and transfer direction.
+ */
+
+
+static unsigned char bkr_control(int mode, enum bkr_direction_t direction)
+{
+	unsigned char  control;
+
+	control = BKR_BIT_DMA_REQUEST;
+	if(BKR_DENSITY(mode) == BKR_HIGH)
+		control |= BKR_BIT_HIGH_DENSITY;
+	if(BKR_VIDEOMODE(mode) == BKR_NTSC)
+		control |= BKR_BIT_NTSC_VIDEO;
+	control |= direction == BKR_WRITING ? BKR_BIT_TRANSMIT : BKR_BIT_RECEIVE;
+
+	return control;
+}
+
+
+/*
+ * Stream callback manipulation
+ */
+
+
+static void bkr_stream_set_callback(struct bkr_stream_t *stream, void (*callback)(void *), void *data)
+{
+	stream->callback_data = data;
+	stream->callback = callback;
+}
+
+
+static void bkr_stream_do_callback(struct bkr_stream_t *stream)
+{
+	if(stream->callback)
+		stream->callback(stream->callback_data);
+}
+
+
+#endif /* _BACKER_STREAM_H */
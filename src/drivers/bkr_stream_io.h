@@ -0,0 +1,214 @@
+/*
+ * Blocking read() and write() loops for Backer device driver.
+ *
+ * Copyright (C) 2000,2001,2002,2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The loops that move data between a stream's ring and a caller's buffer
+ * on behalf of the device's read() and write() methods.  What it means to
+ * sleep, and what to do after moving data, is left to the caller's
+ * bkr_stream_io_ops_t, so the same loops run in the driver and, against a
+ * simulated stream, in user space.
+ */
+
+#ifndef  _BACKER_STREAM_IO_H
+#define  _BACKER_STREAM_IO_H
+
+#ifdef __KERNEL__
+#include <linux/fcntl.h>
+#else
+#include <fcntl.h>
+#endif
+
+#include <bkr_stream.h>
+
+
+struct bkr_stream_io_ops_t {
+	/* the wake-up threshold in bytes */
+	size_t  (*wakeup)(void *);
+	/* sleep until there might be the given number of bytes of data or
+	 * space.  returns 1 if the sleep timed out but there is something
+	 * to move, 0 if woken, < 0 on error */
+	int  (*sleep)(void *, size_t);
+	/* called after each transfer to or from the ring */
+	void  (*update)(void *);
+};
+
+
+/*
+ * Move up to count bytes out of the stream's ring into buff.  flags are
+ * the file's f_flags, last_error holds an error code to report on the
+ * next call after a partial transfer.
+ */
+
+
+static inline ssize_t bkr_stream_read(struct bkr_stream_t *stream, const struct bkr_stream_io_ops_t *ops, void *data, unsigned int flags, int *last_error, char *buff, size_t count)
+{
+	ssize_t  result;
+	size_t  moved = 0;
+	size_t  chunk_size;
+	size_t  need;
+	int  timed_out = 0;
+
+	/* Is there an error from an earlier call? */
+	result = *last_error;
+	*last_error = 0;
+	/* No, so move data */
+	if(!result) while(1) {
+		result = stream->ops.read(stream);
+
+		/* Hold off until the wake-up threshold is reached, unless
+		 * we've already timed out waiting for it */
+		need = min(count, ops->wakeup(data));
+		if(result > 0 && (size_t) result < need && !moved && !timed_out && !(flags & (O_NONBLOCK | O_NDELAY)))
+			result = -EAGAIN;
+
+		if(result > 0) {
+			chunk_size = min(count, (size_t) result);
+			/* FIXME: check return value */
+			copy_to_user_from_ring(buff, stream->ring, chunk_size);
+			ops->update(data);
+			buff += chunk_size;
+			moved += chunk_size;
+			count -= chunk_size;
+			/* Are we done? */
+			if(!count) {
+				result = moved;
+				break;
+			}
+			continue;
+		}
+
+		/* Need to block? */
+		if(result == -EAGAIN) {
+			/* Have we moved anything? */
+#if O_NONBLOCK == O_NDELAY
+			if(moved)
+				result = moved;
+#else
+			if(moved || ((flags & (O_NONBLOCK | O_NDELAY)) == O_NDELAY))
+				result = moved;
+#endif
+			/* Block if its OK to do so */
+			else if(!(flags & (O_NONBLOCK | O_NDELAY))) {
+				result = ops->sleep(data, need);
+				if(result >= 0) {
+					timed_out = result;
+					continue;
+				}
+			}
+			break;
+		}
+
+		/* EOF? */
+		if(result == 0) {
+			result = moved;
+			break;
+		}
+
+		/* It's a real error! */
+		/* If we've moved anything, save error code for later */
+		if(moved) {
+			*last_error = result;
+			result = moved;
+		}
+		break;
+	}
+
+	return result;
+}
+
+
+/*
+ * Move up to count bytes from buff into the stream's ring.  Arguments as
+ * for bkr_stream_read().
+ */
+
+
+static inline ssize_t bkr_stream_write(struct bkr_stream_t *stream, const struct bkr_stream_io_ops_t *ops, void *data, unsigned int flags, int *last_error, const char *buff, size_t count)
+{
+	ssize_t  result;
+	size_t  moved = 0;
+	size_t  chunk_size;
+	size_t  need;
+	int  timed_out = 0;
+
+	/* Is there an error from an earlier call? */
+	result = *last_error;
+	*last_error = 0;
+	/* No, so move data */
+	if(!result) while(1) {
+		result = stream->ops.write(stream);
+
+		/* Hold off until the wake-up threshold is reached, unless
+		 * we've already timed out waiting for it */
+		need = min(count, ops->wakeup(data));
+		if(result >= 0 && (size_t) result < need && !moved && !timed_out && !(flags & (O_NONBLOCK | O_NDELAY)))
+			result = -EAGAIN;
+
+		if(result >= 0) {
+			chunk_size = min(count, (size_t) result);
+			/* FIXME: check return value */
+			copy_to_ring_from_user(stream->ring, buff, chunk_size);
+			ops->update(data);
+			buff += chunk_size;
+			moved += chunk_size;
+			count -= chunk_size;
+			/* Are we done? */
+			if(!count) {
+				result = moved;
+				break;
+			}
+			continue;
+		}
+
+		/* Need to block? */
+		if(result == -EAGAIN) {
+			/* Have we moved anything? */
+#if O_NONBLOCK == O_NDELAY
+			if(moved)
+				result = moved;
+#else
+			if(moved || ((flags & (O_NONBLOCK | O_NDELAY)) == O_NDELAY))
+				result = moved;
+#endif
+			/* Is it OK to block? */
+			else if(!(flags & (O_NONBLOCK | O_NDELAY))) {
+				result = ops->sleep(data, need);
+				if(result >= 0) {
+					timed_out = result;
+					continue;
+				}
+			}
+			break;
+		}
+
+		/* It's a real error! */
+		/* If we've moved anything, save error code for later */
+		if(moved) {
+			*last_error = result;
+			result = moved;
+		}
+		break;
+	}
+
+	return result;
+}
+
+
+#endif /* _BACKER_STREAM_IO_H */
@@ -25,10 +25,12 @@
 #include <linux/semaphore.h>
 
 #include <linux/list.h>
+#include <linux/seqlock.h>
 #include <linux/sysctl.h>
 
 #include <backer.h>
 #include <bkr_ring_buffer.h>
+#include <bkr_stream.h>
 
 
 /*
@@ -40,29 +42,18 @@
  */
 
 
-#define BKR_FILLER 0x33         /* Generic filler */
 #define  BKR_NAME_LENGTH  (sizeof("99"))        /* limits driver to 100 units */
 
 
-enum bkr_direction_t {
-	BKR_STOPPED = 0,
-	BKR_READING,
-	BKR_WRITING
-};
-
-
 struct bkr_sysctl_table_t {
 	struct ctl_table_header  *header;
 	struct ctl_table  dev_dir[2];
 	struct ctl_table  driver_dir[2];
 	struct ctl_table  unit_dir[2];
-	struct ctl_table  entries[3];
+	struct ctl_table  entries[6];
 };
 
 
-struct bkr_stream_private_t;
-
-
 struct bkr_unit_t {
 	struct list_head  list;         /* next/prev in list */
 	char  name[BKR_NAME_LENGTH];    /* name */
@@ -72,23 +63,14 @@ struct bkr_unit_t {
 	wait_queue_head_t  queue;       /* I/O event queue */
 	struct bkr_sysctl_table_t  sysctl;     /* sysctl interface table */
 	int  last_error;                /* Pending error code if != 0 */
-	struct bkr_stream_t {
-		struct ring  *ring;             /* this stream's I/O ring */
-		unsigned int frame_size;        /* two video fields */
-		struct bkr_stream_ops_t {
-			struct bkr_stream_t  *(*ready)(struct bkr_stream_t *, int, unsigned int);
-			int  (*start)(struct bkr_stream_t *, enum bkr_direction_t);
-			int  (*release)(struct bkr_stream_t *);
-			int  (*read)(struct bkr_stream_t *);
-			int  (*write)(struct bkr_stream_t *);
-		} ops;                          /* stream control functions */
-		int  mode;                      /* stream settings */
-		volatile enum bkr_direction_t  direction;     /* stream state */
-		void  (*callback)(void *);      /* I/O activity call-back */
-		void  *callback_data;           /* call-back data */
-		unsigned int  timeout;          /* I/O activity timeout */
-		struct bkr_stream_private_t  *private; /* per-stream private data */
-	} *stream;                      /* this unit's data stream */
+	struct bkr_ring_control  *control;     /* mmap() control page */
+	struct bkr_wakeup  wakeup;      /* I/O wake-up threshold */
+	size_t  waiting_for;            /* bytes/space the sleeper needs */
+	seqlock_t  stats_lock;          /* protects the next three */
+	unsigned int  stats_sequence;   /* decoder reports so far */
+	struct bkr_position  position;  /* as reported by the decoder */
+	struct bkr_decoder_stats  decoder;     /* ditto */
+	struct bkr_stream_t  *stream;   /* this unit's data stream */
 };                                      /* unit information */
 
 
@@ -98,44 +80,4 @@ extern struct bkr_unit_t *bkr_unit_register(struct bkr_stream_t *);
 extern void bkr_unit_unregister(struct bkr_unit_t *);
 
 
-/*
- * Generate the Backer device control byte from the given video mode,
- * density and transfer direction.
- */
-
-
-static unsigned char bkr_control(int mode, enum bkr_direction_t direction)
-{
-	unsigned char  control;
-
-	control = BKR_BIT_DMA_REQUEST;
-	if(BKR_DENSITY(mode) == BKR_HIGH)
-		control |= BKR_BIT_HIGH_DENSITY;
-	if(BKR_VIDEOMODE(mode) == BKR_NTSC)
-		control |= BKR_BIT_NTSC_VIDEO;
-	control |= direction == BKR_WRITING ? BKR_BIT_TRANSMIT : BKR_BIT_RECEIVE;
-
-	return control;
-}
-
-
-/*
- * Stream callback manipulation
- */
-
-
-static void bkr_stream_set_callback(struct bkr_stream_t *stream, void (*callback)(void *), void *data)
-{
-	stream->callback_data = data;
-	stream->callback = callback;
-}
-
-
-static void bkr_stream_do_callback(struct bkr_stream_t *stream)
-{
-	if(stream->callback)
-		stream->callback(stream->callback_data);
-}
-
-
 #endif /* _BACKER_UNIT_H */
@@ -0,0 +1,555 @@
+/*
+ * Linux device driver for Danmere's Backer 16/32 video tape backup devices.
+ *
+ *                            Virtual Device I/O
+ *
+ * Copyright (C) 2000,2001,2002,2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * A software Backer.  The "tape" is either a file or a region of memory,
+ * and a kernel thread standing in for the hardware moves one video field
+ * of data between it and the unit's ring at the field rate of the selected
+ * video mode.  The tape is rewound each time a transfer is started, so
+ * data recorded by one transfer can be played back by the next.  Reading
+ * past the end of the tape returns blank (zero) data;  recording past the
+ * end of a memory tape discards the data.  A file tape grows as needed.
+ *
+ * To exercise the rest of the driver, the hardware can be made to run
+ * late by a random amount of up to "jitter" microseconds on each field,
+ * and to lose a "dropout" in 1000 fields, which are then read or recorded
+ * as zeros.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/vmalloc.h>
+
+#include <backer.h>
+#include <bkr_kcompat.h>
+#include <bkr_unit.h>
+#include <bkr_ring_buffer.h>
+
+
+/*
+ * ========================================================================
+ *                          Module info and options
+ * ========================================================================
+ */
+
+MODULE_AUTHOR("Kipp Cannon (kcannon@users.sourceforge.net)");
+MODULE_DESCRIPTION("Backer 16 & 32 device driver --- virtual device support");
+MODULE_SUPPORTED_DEVICE("backer_virtual");
+MODULE_LICENSE("GPL");
+
+static char  *file = "";
+module_param(file, charp, 0);
+MODULE_PARM_DESC(file, "tape image file (default: use memory)");
+
+static unsigned int  size = 16384;
+module_param(size, uint, 0);
+MODULE_PARM_DESC(size, "size of memory tape in kilobytes");
+
+static unsigned int  jitter = 0;
+module_param(jitter, uint, 0);
+MODULE_PARM_DESC(jitter, "maximum random delay of each field in microseconds");
+
+static unsigned int  dropout = 0;
+module_param(dropout, uint, 0);
+MODULE_PARM_DESC(dropout, "fields lost per 1000");
+
+static unsigned int  buffer = 1024;
+module_param(buffer, uint, 0);
+MODULE_PARM_DESC(buffer, "I/O buffer size in kilobytes (default 1024)");
+
+
+/*
+ * ========================================================================
+ *
+ *                         Constants/macros/etc.
+ *
+ * ========================================================================
+ */
+
+#define  MODULE_NAME            "backer_virtual"
+#define  MIN_BUFFER_SIZE        65536
+#define  MAX_BUFFER_SIZE        (PAGE_SIZE << (MAX_ORDER - 1))
+#define  BKR_VIRTUAL_TIMEOUT    HZ      /* 1 second */
+#define  FIELD_NS_NTSC          16683333        /* 1001/60000 s */
+#define  FIELD_NS_PAL           20000000        /* 1/50 s */
+
+
+/*
+ * ========================================================================
+ *
+ *                                 Data
+ *
+ * ========================================================================
+ */
+
+struct bkr_stream_private_t {
+	struct task_struct  *thread;    /* the "hardware" */
+	struct file  *file;             /* tape image file, or */
+	unsigned char  *memory;         /* memory tape */
+	loff_t  size;                   /* memory tape size in bytes */
+	loff_t  position;               /* current tape position */
+	unsigned long  field;           /* fields since start */
+	size_t  buffer_size;            /* allocated size of the I/O ring */
+	int  primed;                    /* data has been recorded */
+	int  draining;                  /* flushing at end of write */
+	int  error;                     /* first tape image write error */
+};
+
+
+/*
+ * ========================================================================
+ *
+ *                              TAPE ACCESS
+ *
+ * ========================================================================
+ */
+
+/*
+ * Read or write n bytes at offset bytes past the current tape position.
+ * What can't be read is taken to be blank tape.  tape_write() returns 0
+ * on success or < 0 if the tape image can't be written.
+ */
+
+static void tape_read(struct bkr_stream_private_t *private, void *buf, size_t n, size_t offset)
+{
+	loff_t  pos = private->position + offset;
+	int  got = 0;
+
+	if(private->file) {
+		got = bkr_kernel_read(private->file, buf, n, &pos);
+		if(got < 0)
+			got = 0;
+	} else if(pos < private->size) {
+		got = min_t(loff_t, n, private->size - pos);
+		memcpy(buf, private->memory + pos, got);
+	}
+	memset(buf + got, 0, n - got);
+}
+
+
+static int tape_write(struct bkr_stream_private_t *private, const void *buf, size_t n, size_t offset)
+{
+	loff_t  pos = private->position + offset;
+	ssize_t  result;
+
+	if(private->file) {
+		while(n) {
+			result = bkr_kernel_write(private->file, buf, n, &pos);
+			if(result <= 0)
+				return result < 0 ? result : -EIO;
+			buf += result;
+			n -= result;
+		}
+	} else if(pos < private->size)
+		memcpy(private->memory + pos, buf, min_t(loff_t, n, private->size - pos));
+
+	return 0;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                               HARDWARE
+ *
+ * ========================================================================
+ */
+
+/*
+ * Move a field of n bytes from the tape into the ring or from the ring to
+ * the tape.  The ring is only touched on the hardware's side, so this
+ * runs without locks like a DMA transfer.
+ */
+
+static void tape_to_ring(struct bkr_stream_t *stream, size_t n, int lost)
+{
+	struct ring  *ring = stream->ring;
+	size_t  head = ring->head;
+	size_t  chunk = min(n, ring->size - head);
+
+	if(lost) {
+		memset(ring->buffer + head, 0, chunk);
+		memset(ring->buffer, 0, n - chunk);
+	} else {
+		tape_read(stream->private, ring->buffer + head, chunk, 0);
+		tape_read(stream->private, ring->buffer, n - chunk, chunk);
+	}
+	ring_fill(ring, n);
+}
+
+
+static int ring_to_tape(struct bkr_stream_t *stream, size_t n, int lost)
+{
+	struct ring  *ring = stream->ring;
+	size_t  tail = ring->tail;
+	size_t  chunk = min(n, ring->size - tail);
+	int  result;
+
+	if(lost) {
+		memset(ring->buffer + tail, 0, chunk);
+		memset(ring->buffer, 0, n - chunk);
+	}
+	result = tape_write(stream->private, ring->buffer + tail, chunk, 0);
+	if(!result)
+		result = tape_write(stream->private, ring->buffer, n - chunk, chunk);
+	ring_drain(ring, n);
+
+	return result;
+}
+
+
+/*
+ * The hardware thread.  Fields are scheduled at exact multiples of the
+ * field period from the start of the transfer, so jitter delays a field
+ * without moving the ones after it.  The two fields of a frame split the
+ * frame between them.  When reading, whatever doesn't fit in the ring is
+ * lost and counted as an overrun, as with the real hardware, and the tape
+ * moves on by a full field.  When writing, only what the process has
+ * supplied is recorded, and a short field is counted as an underrun except
+ * before the first data arrives and while draining at the end.  The first
+ * failure to write the tape image is kept for write() to report, and the
+ * ring goes on draining so nothing waits on it.
+ */
+
+static int hardware(void *data)
+{
+	struct bkr_stream_t  *stream = data;
+	struct bkr_stream_private_t  *private = stream->private;
+	u64  period = BKR_VIDEOMODE(stream->mode) == BKR_NTSC ? FIELD_NS_NTSC : FIELD_NS_PAL;
+	ktime_t  deadline = ktime_get();
+	ktime_t  wake;
+	size_t  field_size;
+	size_t  n;
+	int  lost;
+	int  result;
+
+	while(!kthread_should_stop()) {
+		deadline = ktime_add_ns(deadline, period);
+		wake = jitter ? ktime_add_ns(deadline, prandom_u32() % (jitter * NSEC_PER_USEC)) : deadline;
+		set_current_state(TASK_INTERRUPTIBLE);
+		if(!kthread_should_stop())
+			schedule_hrtimeout(&wake, HRTIMER_MODE_ABS);
+		__set_current_state(TASK_RUNNING);
+		if(kthread_should_stop())
+			break;
+
+		field_size = private->field & 1 ? stream->frame_size - stream->frame_size / 2 : stream->frame_size / 2;
+		lost = dropout && prandom_u32() % 1000 < dropout;
+
+		switch(stream->direction) {
+		case BKR_READING:
+			n = space_in_ring(stream->ring);
+			if(n < field_size)
+				stream->overruns++;
+			else
+				n = field_size;
+			tape_to_ring(stream, n, lost);
+			private->position += field_size;
+			break;
+
+		case BKR_WRITING:
+			n = bytes_in_ring(stream->ring);
+			if(n >= field_size)
+				n = field_size;
+			else if(private->primed && !private->draining)
+				stream->underruns++;
+			if(n)
+				private->primed = 1;
+			result = ring_to_tape(stream, n, lost);
+			if(result < 0 && !private->error) {
+				printk(KERN_WARNING MODULE_NAME ": tape image write failed (%d)\n", result);
+				private->error = result;
+			}
+			private->position += n;
+			break;
+
+		default:
+			break;
+		}
+		private->field++;
+
+		bkr_stream_do_callback(stream);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Ensure the ring is filled to a frame boundary, and check if it's empty.
+ */
+
+static int flush(struct bkr_stream_t *stream)
+{
+	stream->private->draining = 1;
+	return ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) ? -EAGAIN : 0;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              Stream API
+ *
+ * ========================================================================
+ */
+
+static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	struct task_struct  *thread;
+
+	private->position = 0;
+	private->field = 0;
+	private->primed = 0;
+	private->draining = 0;
+	private->error = 0;
+	stream->direction = direction;
+
+	thread = kthread_run(hardware, stream, MODULE_NAME);
+	if(IS_ERR(thread)) {
+		stream->direction = BKR_STOPPED;
+		return PTR_ERR(thread);
+	}
+	private->thread = thread;
+
+	return 0;
+}
+
+
+static int release(struct bkr_stream_t *stream)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	int  result;
+
+	if(stream->direction != BKR_STOPPED) {
+		/* no point waiting for the ring to drain if the tape
+		 * image can't be written */
+		if(stream->direction == BKR_WRITING && !private->error) {
+			result = flush(stream);
+			if(result < 0)
+				return result;
+		}
+
+		kthread_stop(private->thread);
+		stream->direction = BKR_STOPPED;
+		if(private->file)
+			vfs_fsync(private->file, 0);
+	}
+	return private->error;
+}
+
+
+static int read(struct bkr_stream_t *stream)
+{
+	int bytes = bytes_in_ring(stream->ring);
+
+	return bytes ? bytes : -EAGAIN;
+}
+
+
+static int write(struct bkr_stream_t *stream)
+{
+	int error = READ_ONCE(stream->private->error);
+	int space = space_in_ring(stream->ring);
+
+	if(error)
+		return error;
+	return space ? space : -EAGAIN;
+}
+
+
+static struct bkr_stream_t *ready(struct bkr_stream_t *stream, int mode, unsigned int frame_size)
+{
+	struct ring  *ring = stream->ring;
+	size_t  buffer_size = stream->private->buffer_size;
+
+	stream->mode = mode;
+	stream->direction = BKR_STOPPED;
+	stream->frame_size = frame_size;
+	/* a whole number of frames, so flush() can pad to a frame boundary */
+	ring->size = buffer_size - buffer_size % frame_size;
+	ring_reset(ring);
+	memset_ring(ring, 0, ring->size);
+
+	return stream;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              Entry/Exit
+ *
+ * ========================================================================
+ */
+
+/*
+ * Creates the virtual Backer device.
+ */
+
+static int __init bkr_virtual_init(void)
+{
+	struct bkr_unit_t  *unit;
+	struct bkr_stream_t  *stream;
+	struct bkr_stream_private_t  *private;
+	char  err_msg[50];
+	int  result = -ENOMEM;
+
+	sprintf(err_msg, "out of memory");
+	stream = kmalloc(sizeof(*stream), GFP_KERNEL);
+	if(!stream)
+		goto no_stream;
+	private = kzalloc(sizeof(*private), GFP_KERNEL);
+	if(!private)
+		goto no_private;
+
+	if(*file) {
+		private->file = filp_open(file, O_RDWR | O_CREAT | O_LARGEFILE, 0600);
+		if(IS_ERR(private->file)) {
+			result = PTR_ERR(private->file);
+			sprintf(err_msg, "can't open tape image file");
+			goto no_tape;
+		}
+	} else {
+		private->size = (loff_t) size * 1024;
+		private->memory = vzalloc(private->size);
+		if(!private->memory) {
+			sprintf(err_msg, "can't allocate memory tape");
+			goto no_tape;
+		}
+	}
+
+	stream->ops = (struct bkr_stream_ops_t) {
+		.ready = ready,
+		.start = start,
+		.release = release,
+		.read = read,
+		.write = write,
+	};
+	stream->private = private;
+	bkr_stream_set_callback(stream, NULL, NULL);
+	stream->timeout = BKR_VIRTUAL_TIMEOUT;
+	stream->direction = BKR_STOPPED;
+
+	private->buffer_size = clamp_t(size_t, (size_t) buffer * 1024, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+	stream->ring = ring_new(NULL, private->buffer_size);
+	if(!stream->ring)
+		goto no_ring;
+	/* physically contiguous, for mmap() */
+	stream->ring->buffer = alloc_pages_exact(private->buffer_size, GFP_KERNEL | __GFP_NOWARN);
+	if(!stream->ring->buffer) {
+		sprintf(err_msg, "can't allocate %zu byte I/O buffer", private->buffer_size);
+		goto no_ring_buffer;
+	}
+
+	down(&bkr_unit_list_lock);
+	unit = bkr_unit_register(stream);
+	if(!unit) {
+		up(&bkr_unit_list_lock);
+		sprintf(err_msg, "device creation failed");
+		result = -ENODEV;
+		goto no_unit;
+	}
+	unit->owner = THIS_MODULE;
+	up(&bkr_unit_list_lock);
+
+	if(private->file)
+		printk(KERN_INFO MODULE_NAME ": unit %s: tape image %s", unit->name, file);
+	else
+		printk(KERN_INFO MODULE_NAME ": unit %s: %u kB memory tape", unit->name, size);
+	if(jitter)
+		printk(", %u us jitter", jitter);
+	if(dropout)
+		printk(", %u/1000 dropouts", dropout);
+	printk("\n");
+
+	return 0;
+
+no_unit:
+	free_pages_exact(stream->ring->buffer, private->buffer_size);
+no_ring_buffer:
+	ring_free(stream->ring);
+no_ring:
+	if(private->file)
+		filp_close(private->file, NULL);
+	vfree(private->memory);
+no_tape:
+	kfree(private);
+no_private:
+	kfree(stream);
+no_stream:
+	printk(KERN_INFO MODULE_NAME ": %s\n", err_msg);
+	return result;
+}
+
+
+/*
+ * Unregister the device when we get unloaded.
+ */
+
+static void __exit bkr_virtual_exit(void)
+{
+	struct bkr_unit_t  *unit;
+	struct bkr_stream_t  *stream;
+	struct bkr_stream_private_t  *private;
+	struct list_head  *curr;
+
+	down(&bkr_unit_list_lock);
+	do
+		list_for_each(curr, &bkr_unit_list) {
+			unit = list_entry(curr, struct bkr_unit_t, list);
+			if(unit->owner != THIS_MODULE)
+				continue;
+			stream = unit->stream;
+			private = stream->private;
+			bkr_unit_unregister(unit);
+			free_pages_exact(stream->ring->buffer, private->buffer_size);
+			ring_free(stream->ring);
+			kfree(stream);
+			if(private->file)
+				filp_close(private->file, NULL);
+			vfree(private->memory);
+			kfree(private);
+			break;
+		}
+	while(curr != &bkr_unit_list);
+	up(&bkr_unit_list_lock);
+}
+
+
+module_init(bkr_virtual_init);
+module_exit(bkr_virtual_exit);
@@ -0,0 +1,278 @@
+/*
+ * Indexed tape image container.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bkr_image.h>
+
+
+/*
+ * Fill in a header for an image that has no data or index yet.
+ */
+
+void bkr_image_init_header(struct bkr_image_header *header, unsigned int mode, unsigned int frame_size)
+{
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, BKR_IMAGE_MAGIC, sizeof(header->magic));
+	header->version = BKR_IMAGE_VERSION;
+	header->header_size = sizeof(*header);
+	header->mode = mode;
+	header->frame_size = frame_size;
+	header->data_offset = BKR_IMAGE_DATA_OFFSET;
+	header->index_offset = BKR_IMAGE_DATA_OFFSET;
+	header->record_offset = BKR_IMAGE_DATA_OFFSET;
+}
+
+
+/*
+ * Check that n entries of entry_size bytes starting at offset fit in a
+ * file of size bytes, without letting the arithmetic overflow.
+ */
+
+static int in_file(__u64 offset, __u64 n, __u64 entry_size, off_t size)
+{
+	return offset <= (__u64) size && n <= ((__u64) size - offset) / entry_size;
+}
+
+
+/*
+ * Check a header just read from a file.
+ */
+
+static int check_header(const struct bkr_image_header *header, off_t size)
+{
+	if(memcmp(header->magic, BKR_IMAGE_MAGIC, sizeof(header->magic)))
+		return -1;
+	if(header->version != BKR_IMAGE_VERSION || header->header_size != sizeof(*header))
+		return -1;
+	if(!in_file(header->data_offset, header->data_length, 1, size))
+		return -1;
+	if(header->index_entries && !in_file(header->index_offset, header->index_entries, sizeof(struct bkr_image_field), size))
+		return -1;
+	if(header->records && !in_file(header->record_offset, header->records, sizeof(struct bkr_image_record), size))
+		return -1;
+	return 0;
+}
+
+
+/*
+ * Check the record table of a mapped image against its field index.
+ */
+
+static int check_records(const struct bkr_image *image)
+{
+	unsigned int i;
+
+	for(i = 0; i < image->header->records; i++)
+		if(image->records[i].first_field > image->records[i].last_field || image->records[i].last_field >= image->header->index_entries)
+			return -1;
+	return 0;
+}
+
+
+/*
+ * Read and check the header of an image without disturbing the file
+ * position, so it also works on stdin.  Returns 0 on success, or < 0 with
+ * errno set to EINVAL if the file is not an image.
+ */
+
+int bkr_image_read_header(int fd, struct bkr_image_header *header)
+{
+	struct stat st;
+
+	if(fstat(fd, &st) < 0)
+		return -1;
+	if(!S_ISREG(st.st_mode) || pread(fd, header, sizeof(*header), 0) != sizeof(*header) || check_header(header, st.st_size) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+
+/*
+ * Map an image for reading.  bkr_image_map() leaves the file descriptor
+ * open;  the mapping does not need it.
+ */
+
+int bkr_image_map(int fd, struct bkr_image *image)
+{
+	struct stat st;
+
+	if(fstat(fd, &st) < 0)
+		return -1;
+	if(!S_ISREG(st.st_mode) || st.st_size < BKR_IMAGE_DATA_OFFSET) {
+		errno = EINVAL;
+		return -1;
+	}
+	image->map_length = st.st_size;
+	image->map = mmap(NULL, image->map_length, PROT_READ, MAP_SHARED, fd, 0);
+	if(image->map == MAP_FAILED)
+		return -1;
+
+	image->header = image->map;
+	if(check_header(image->header, st.st_size) < 0)
+		goto invalid;
+	image->fields = (const void *) ((const char *) image->map + image->header->index_offset);
+	image->records = (const void *) ((const char *) image->map + image->header->record_offset);
+	if(check_records(image) < 0)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	munmap(image->map, image->map_length);
+	errno = EINVAL;
+	return -1;
+}
+
+
+int bkr_image_open(const char *filename, struct bkr_image *image)
+{
+	int fd = open(filename, O_RDONLY);
+	int result;
+
+	if(fd < 0)
+		return -1;
+	result = bkr_image_map(fd, image);
+	close(fd);
+
+	return result;
+}
+
+
+void bkr_image_close(struct bkr_image *image)
+{
+	munmap(image->map, image->map_length);
+	image->map = NULL;
+}
+
+
+/*
+ * Find the range of raw data, relative to data_offset, holding a
+ * record:  from its first BOR field to the end of its first EOR field.  A
+ * record with no EOR mark runs to the next record or the end of the data.
+ * Returns < 0 if the image has no such record.
+ */
+
+int bkr_image_record_range(const struct bkr_image *image, unsigned int record, __u64 *start, __u64 *end)
+{
+	const struct bkr_image_record *r;
+
+	if(record >= image->header->records)
+		return -1;
+	r = &image->records[record];
+	*start = image->fields[r->first_field].offset;
+	if(r->last_field + 1 < image->header->index_entries)
+		*end = image->fields[r->last_field + 1].offset;
+	else
+		*end = image->header->data_length;
+
+	return 0;
+}
+
+
+/*
+ * Write everything, retrying short writes.
+ */
+
+static int write_all(int fd, const void *data, size_t length)
+{
+	const char *p = data;
+
+	while(length) {
+		ssize_t n = write(fd, p, length);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+
+/*
+ * Replace the index of an image:  the file is truncated at the end of the
+ * data, the field index and record table are appended, and the header is
+ * updated to point to them.
+ */
+
+int bkr_image_write_index(int fd, struct bkr_image_header *header, const struct bkr_image_field *fields, unsigned int n_fields, const struct bkr_image_record *records, unsigned int n_records)
+{
+	/* mark the image unindexed while the index is being replaced, so
+	 * an interruption leaves a usable image */
+	header->index_entries = 0;
+	header->records = 0;
+	if(pwrite(fd, header, sizeof(*header), 0) != sizeof(*header) || fdatasync(fd) < 0)
+		return -1;
+
+	header->index_offset = header->data_offset + header->data_length;
+	/* keep the index entries aligned for use in place */
+	header->index_offset = (header->index_offset + 7) & ~(__u64) 7;
+	header->index_entries = n_fields;
+	header->record_offset = header->index_offset + n_fields * sizeof(*fields);
+	header->records = n_records;
+
+	if(ftruncate(fd, header->index_offset) < 0)
+		return -1;
+	if(lseek(fd, header->index_offset, SEEK_SET) < 0)
+		return -1;
+	if(write_all(fd, fields, n_fields * sizeof(*fields)) < 0)
+		return -1;
+	if(write_all(fd, records, n_records * sizeof(*records)) < 0)
+		return -1;
+	if(fdatasync(fd) < 0)
+		return -1;
+
+	if(pwrite(fd, header, sizeof(*header), 0) != sizeof(*header))
+		return -1;
+	return fdatasync(fd);
+}
+
+
+#ifdef BKR_IMAGE_GSTREAMER
+/*
+ * Restrict the pipeline's element named "source" to bytes [start, stop)
+ * of its input, or from start to the end if stop is (guint64) -1.  fdsrc
+ * holds on to a seek sent before it starts and performs it once it does,
+ * so this leaves the pipeline in the READY state.
+ */
+
+gboolean bkr_image_seek_source(GstElement *pipeline, guint64 start, guint64 stop)
+{
+	GstElement *source = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+	gboolean result;
+
+	if(!source)
+		return FALSE;
+	gst_element_set_state(pipeline, GST_STATE_READY);
+	result = gst_element_send_event(source, gst_event_new_seek(1.0, GST_FORMAT_BYTES, GST_SEEK_FLAG_NONE, GST_SEEK_TYPE_SET, start, stop == (guint64) -1 ? GST_SEEK_TYPE_NONE : GST_SEEK_TYPE_SET, stop));
+	gst_object_unref(source);
+
+	return result;
+}
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Indexed tape image container.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * An image file holds the raw byte stream captured from a unit, exactly
+ * as read from a raw device file, behind a one-page header and ahead of an
+ * optional index.  The header is written by bkrcapture, and the index
+ * appended later by bkrindex, which scans the sector headers.
+ *
+ *	+--------+------------------------------+-------------+---------+
+ *	| header | raw data                     | field index | records |
+ *	+--------+------------------------------+-------------+---------+
+ *	0        data_offset                    index_offset  record_offset
+ *
+ * There is one field index entry per video field whose sector header
+ * could be read, in stream order, and one record entry per recording.
+ * Offsets in the index are relative to data_offset, so a record can be
+ * handed to the decoder by reading the data from its first field onwards.
+ * All structures are fixed size and naturally aligned so the file can be
+ * mmap()ed and used in place.  Multi-byte fields are in the byte order of
+ * the machine that wrote the file (the driver only runs on x86, so in
+ * practice little-endian).
+ */
+
+#ifndef _BKR_IMAGE_H
+#define _BKR_IMAGE_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+
+#define  BKR_IMAGE_MAGIC        "BkrImage"
+#define  BKR_IMAGE_VERSION      1
+#define  BKR_IMAGE_DATA_OFFSET  4096    /* keeps O_DIRECT writes aligned */
+
+
+struct bkr_image_header {
+	char  magic[8];         /* BKR_IMAGE_MAGIC, not NUL terminated */
+	__u32  version;         /* BKR_IMAGE_VERSION */
+	__u32  header_size;     /* sizeof(struct bkr_image_header) */
+	__u32  mode;            /* see backer.h, 0 if unknown */
+	__u32  frame_size;      /* bytes per video frame, 0 if unknown */
+	__u64  data_offset;     /* start of the raw data */
+	__u64  data_length;     /* bytes of raw data */
+	__u64  index_offset;    /* start of the field index */
+	__u32  index_entries;   /* 0 if the image has not been indexed */
+	__u32  records;         /* entries in the record table */
+	__u64  record_offset;   /* start of the record table */
+};
+
+
+#define  BKR_IMAGE_BOR  0x0001  /* field holds a beginning-of-record sector */
+#define  BKR_IMAGE_EOR  0x0002  /* field holds an end-of-record sector */
+
+
+struct bkr_image_field {
+	__u64  offset;          /* of the field, from data_offset */
+	__s32  sector_number;   /* -1 for BOR sectors */
+	__u32  record;          /* EOR marks passed before this field */
+	__u32  flags;           /* BKR_IMAGE_* */
+	__u32  reserved;
+};
+
+
+struct bkr_image_record {
+	__u32  first_field;     /* index entry of the first BOR field */
+	__u32  last_field;      /* index entry of the first EOR field */
+	__s32  last_sector;     /* highest data sector number seen */
+	__u32  reserved;
+};
+
+
+/*
+ * An image opened for reading.  Everything points into the mapping.
+ */
+
+
+struct bkr_image {
+	void  *map;
+	size_t  map_length;
+	const struct bkr_image_header  *header;
+	const struct bkr_image_field  *fields;
+	const struct bkr_image_record  *records;
+};
+
+
+void bkr_image_init_header(struct bkr_image_header *, unsigned int mode, unsigned int frame_size);
+int bkr_image_read_header(int fd, struct bkr_image_header *);
+int bkr_image_map(int fd, struct bkr_image *);
+int bkr_image_open(const char *, struct bkr_image *);
+void bkr_image_close(struct bkr_image *);
+int bkr_image_record_range(const struct bkr_image *, unsigned int record, __u64 *start, __u64 *end);
+int bkr_image_write_index(int fd, struct bkr_image_header *, const struct bkr_image_field *, unsigned int, const struct bkr_image_record *, unsigned int);
+
+/*
+ * For the GStreamer tools, which build with BKR_IMAGE_GSTREAMER defined.
+ */
+
+#ifdef BKR_IMAGE_GSTREAMER
+#include <gst/gst.h>
+
+gboolean bkr_image_seek_source(GstElement *pipeline, guint64 start, guint64 stop);
+#endif
+
+#endif	/* _BKR_IMAGE_H */
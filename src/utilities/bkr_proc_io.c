@@ -18,7 +18,10 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/poll.h>
 #include <backer.h>
 #include <bkr_proc_io.h>
@@ -62,6 +65,74 @@ static int ready_for_write(FILE *file)
 }
 
 
+/*
+ * bkr_proc_read_stats()
+ *
+ * Read the binary statistics record from a unit's stats file.  The
+ * record is re-read from the start of the file each time, so the file
+ * need only be opened once.  Records from a newer driver are accepted
+ * (the fields we know about don't move), older or foreign ones are not.
+ * On success the return value is 0, otherwise < 0 is returned and errno
+ * is set to indicate the error.
+ */
+
+int bkr_proc_read_stats(FILE *file, struct bkr_stats *stats)
+{
+	ssize_t  result;
+
+	result = pread(fileno(file), stats, sizeof(*stats), 0);
+	if(result < 0)
+		return -1;
+	if(result < (ssize_t) sizeof(*stats) || stats->version < BKR_STATS_VERSION || stats->size < sizeof(*stats)) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * bkr_proc_stats_to_status()
+ *
+ * Translate a binary statistics record into the old status structure.
+ */
+
+void bkr_proc_stats_to_status(const struct bkr_stats *stats, struct bkr_proc_status_t *status)
+{
+	switch(stats->state) {
+	case BKRIOCSTART_READ:
+		strcpy(status->state, "READING");
+		break;
+
+	case BKRIOCSTART_WRITE:
+		strcpy(status->state, "WRITING");
+		break;
+
+	default:
+		strcpy(status->state, "STOPPED");
+		break;
+	}
+	status->mode = stats->mode;
+	status->sector_number = stats->position.blkno;
+	status->total_errors = stats->decoder.bytes_corrected;
+	status->worst_block = stats->decoder.worst_block;
+	status->parity = stats->decoder.block_parity;
+	status->recent_block = stats->decoder.recent_block;
+	status->bad_sectors = stats->decoder.bad_sectors;
+	status->bad_sector_runs = stats->decoder.lost_runs;
+	status->frame_errors = stats->decoder.frame_warnings;
+	status->underrun_errors = stats->overruns + stats->underruns;
+	status->worst_key = stats->decoder.worst_key;
+	status->max_key_weight = stats->decoder.key_length;
+	status->best_nonkey = stats->decoder.best_nonkey;
+	status->smallest_field = stats->decoder.smallest_field;
+	status->largest_field = stats->decoder.largest_field;
+	status->bytes_in_buffer = stats->ring_fill;
+	status->buffer_size = stats->ring_size;
+}
+
+
 /*
  * bkr_proc_read_status()
  *
@@ -44,6 +44,8 @@ struct bkr_proc_status_t
 	unsigned int  buffer_size;
 	};
 
+int bkr_proc_read_stats(FILE *, struct bkr_stats *);
+void bkr_proc_stats_to_status(const struct bkr_stats *, struct bkr_proc_status_t *);
 int bkr_proc_read_status(FILE *, struct bkr_proc_status_t *);
 int bkr_proc_write_status(FILE *, struct bkr_proc_status_t *);
 int bkr_proc_read_format_table(FILE *, bkr_format_info_t *);
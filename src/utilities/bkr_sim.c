@@ -0,0 +1,293 @@
+/*
+ * Simulated Backer device.
+ *
+ * Copyright (C) 2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#include <bkr_sim.h>
+
+
+/*
+ * ========================================================================
+ *
+ *                              Parameters
+ *
+ * ========================================================================
+ */
+
+
+#define  FIELD_NS_NTSC  16683333        /* 1001/60000 s */
+#define  FIELD_NS_PAL   20000000        /* 1/50 s */
+
+
+struct bkr_stream_private_t {
+	pthread_t  thread;              /* the "hardware" */
+	int  running;                   /* cleared to stop the thread */
+	int  primed;                    /* a full field has been written */
+	int  draining;                  /* set once the stream is released */
+	struct bkr_sim_stats  stats;    /* transfer statistics */
+};
+
+
+/*
+ * ========================================================================
+ *
+ *                               Hardware
+ *
+ * ========================================================================
+ */
+
+
+long bkr_sim_field_period(int mode)
+{
+	return BKR_VIDEOMODE(mode) == BKR_NTSC ? FIELD_NS_NTSC : FIELD_NS_PAL;
+}
+
+
+static void timespec_add_ns(struct timespec *t, long ns)
+{
+	t->tv_nsec += ns;
+	while(t->tv_nsec >= 1000000000) {
+		t->tv_nsec -= 1000000000;
+		t->tv_sec++;
+	}
+}
+
+
+/*
+ * Move one field per field period.  The two fields of a frame split the
+ * frame between them, so the byte rate is exact.
+ */
+
+static void *hardware(void *data)
+{
+	struct bkr_stream_t  *stream = data;
+	struct bkr_stream_private_t  *private = stream->private;
+	struct ring  *ring = stream->ring;
+	long  period = bkr_sim_field_period(stream->mode);
+	struct timespec  next;
+	size_t  field_size;
+	size_t  n;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while(__atomic_load_n(&private->running, __ATOMIC_ACQUIRE)) {
+		timespec_add_ns(&next, period);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+
+		field_size = private->stats.fields & 1 ? stream->frame_size - stream->frame_size / 2 : stream->frame_size / 2;
+
+		switch(stream->direction) {
+		case BKR_READING:
+			n = space_in_ring(ring);
+			if(n < field_size)
+				private->stats.overruns++;
+			else
+				n = field_size;
+			memset_ring(ring, (ring_data_t) private->stats.fields, n);
+			break;
+
+		case BKR_WRITING:
+			/* the ring is allowed to run short before the
+			 * first full field and while it drains */
+			n = bytes_in_ring(ring);
+			if(n >= field_size) {
+				n = field_size;
+				private->primed = 1;
+			} else if(private->primed && !__atomic_load_n(&private->draining, __ATOMIC_ACQUIRE))
+				private->stats.underruns++;
+			ring_drain(ring, n);
+			break;
+
+		default:
+			break;
+		}
+		private->stats.fields++;
+
+		bkr_stream_do_callback(stream);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Pad the ring to a frame boundary and wait for the hardware to transmit
+ * everything but the last frame.
+ */
+
+static int flush(struct bkr_stream_t *stream)
+{
+	return ring_fill_to(stream->ring, stream->frame_size, BKR_FILLER) ? -EAGAIN : bytes_in_ring(stream->ring) >= stream->frame_size ? -EAGAIN : 0;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              Stream API
+ *
+ * ========================================================================
+ */
+
+static int start(struct bkr_stream_t *stream, enum bkr_direction_t direction)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	int  result;
+
+	private->stats = (struct bkr_sim_stats) {0,};
+	private->running = 1;
+	private->primed = 0;
+	private->draining = 0;
+	stream->direction = direction;
+	result = pthread_create(&private->thread, NULL, hardware, stream);
+	if(result) {
+		stream->direction = BKR_STOPPED;
+		return -result;
+	}
+
+	return 0;
+}
+
+
+static int release(struct bkr_stream_t *stream)
+{
+	struct bkr_stream_private_t  *private = stream->private;
+	int  result;
+
+	if(stream->direction != BKR_STOPPED) {
+		if(stream->direction == BKR_WRITING) {
+			__atomic_store_n(&private->draining, 1, __ATOMIC_RELEASE);
+			result = flush(stream);
+			if(result < 0)
+				return result;
+		}
+
+		__atomic_store_n(&private->running, 0, __ATOMIC_RELEASE);
+		pthread_join(private->thread, NULL);
+		stream->direction = BKR_STOPPED;
+	}
+	return 0;
+}
+
+
+static int read(struct bkr_stream_t *stream)
+{
+	int bytes = bytes_in_ring(stream->ring);
+
+	return bytes ? bytes : -EAGAIN;
+}
+
+
+static int write(struct bkr_stream_t *stream)
+{
+	int space = space_in_ring(stream->ring);
+
+	return space ? space : -EAGAIN;
+}
+
+
+static struct bkr_stream_t *ready(struct bkr_stream_t *stream, int mode, unsigned int frame_size)
+{
+	struct ring  *ring = stream->ring;
+
+	stream->mode = mode;
+	stream->direction = BKR_STOPPED;
+	stream->frame_size = frame_size;
+	ring_reset(ring);
+	memset_ring(ring, 0, ring->size);
+
+	return stream;
+}
+
+
+/*
+ * ========================================================================
+ *
+ *                              Entry/Exit
+ *
+ * ========================================================================
+ */
+
+struct bkr_stream_t *bkr_sim_new(size_t ring_size)
+{
+	struct bkr_stream_t  *stream;
+
+	stream = malloc(sizeof(*stream));
+	if(!stream)
+		goto no_stream;
+	stream->private = calloc(1, sizeof(*stream->private));
+	if(!stream->private)
+		goto no_private;
+
+	stream->ops = (struct bkr_stream_ops_t) {
+		.ready = ready,
+		.start = start,
+		.release = release,
+		.read = read,
+		.write = write,
+	};
+	bkr_stream_set_callback(stream, NULL, NULL);
+	stream->timeout = 1000;
+	stream->direction = BKR_STOPPED;
+
+	stream->ring = ring_new(NULL, ring_size);
+	if(!stream->ring)
+		goto no_ring;
+	stream->ring->buffer = malloc(ring_size);
+	if(!stream->ring->buffer)
+		goto no_buffer;
+
+	return stream;
+
+no_buffer:
+	ring_free(stream->ring);
+no_ring:
+	free(stream->private);
+no_private:
+	free(stream);
+no_stream:
+	return NULL;
+}
+
+
+void bkr_sim_free(struct bkr_stream_t *stream)
+{
+	if(stream) {
+		/* stop without flushing */
+		if(stream->direction != BKR_STOPPED) {
+			__atomic_store_n(&stream->private->running, 0, __ATOMIC_RELEASE);
+			pthread_join(stream->private->thread, NULL);
+		}
+		free(stream->ring->buffer);
+		ring_free(stream->ring);
+		free(stream->private);
+	}
+	free(stream);
+}
+
+
+struct bkr_sim_stats bkr_sim_get_stats(struct bkr_stream_t *stream)
+{
+	return stream->private->stats;
+}
@@ -0,0 +1,53 @@
+/*
+ * Simulated Backer device.
+ *
+ * Copyright (C) 2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _BKR_SIM_H
+#define _BKR_SIM_H
+
+#include <bkr_stream.h>
+
+
+/*
+ * A user space implementation of the driver's stream interface.  A thread
+ * standing in for the hardware moves one video field of data into
+ * (reading) or out of (writing) the ring at the exact field rate of the
+ * stream's video mode, and invokes the stream's call-back after each
+ * field, as the ISA driver's DMA tracker does.  Reading produces a field
+ * counter as data, writing discards the data.  The stream's timeout is in
+ * milliseconds.
+ */
+
+
+struct bkr_sim_stats {
+	unsigned long  fields;          /* fields moved since start */
+	unsigned long  overruns;        /* fields that didn't fit (reading) */
+	unsigned long  underruns;       /* fields that weren't ready (writing),
+	                                 * not counting before the ring first
+	                                 * holds a field or while it drains */
+};
+
+
+struct bkr_stream_t *bkr_sim_new(size_t ring_size);
+void bkr_sim_free(struct bkr_stream_t *stream);
+struct bkr_sim_stats bkr_sim_get_stats(struct bkr_stream_t *stream);
+long bkr_sim_field_period(int mode);
+
+
+#endif /* _BKR_SIM_H */
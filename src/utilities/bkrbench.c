@@ -0,0 +1,423 @@
+/*
+ * bkrbench
+ *
+ * Command line utility for benchmarking the driver's ring buffer and
+ * stream layer against a simulated Backer device.
+ *
+ * Copyright (C) 2010  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+
+#include <backer.h>
+#include <bkr_sim.h>
+#include <bkr_stream_io.h>
+
+
+#define  PROGRAM_NAME  "bkrbench"
+#define  RING_SIZE     65536    /* same as the ISA driver's DMA buffer */
+
+
+/*
+ * ============================================================================
+ *
+ *                                Command Line
+ *
+ * ============================================================================
+ */
+
+
+struct options {
+	int verbose;
+	enum bkr_videomode videomode;
+	enum bkr_bitdensity bitdensity;
+	enum bkr_direction_t direction;
+	size_t block_size;
+	unsigned int wakeup_frames;
+	double duration;
+};
+
+
+static struct options default_options(void)
+{
+	struct options defaults = {
+		.verbose = 0,
+		.videomode = BKR_NTSC,
+		.bitdensity = BKR_HIGH,
+		.direction = BKR_WRITING,
+		.block_size = 16384,
+		.wakeup_frames = 0,
+		.duration = 10.0
+	};
+
+	return defaults;
+}
+
+
+static void usage(void)
+{
+	fputs(
+	"Backer driver data path benchmark.\n" \
+	"Usage: " PROGRAM_NAME " [options]\n" \
+	"the following options are recognized:\n" \
+	"	-b bytes Set the read()/write() block size (default 16384)\n" \
+	"	-Dh      Set the data rate to high\n" \
+	"	-Dl      Set the data rate to low\n" \
+	"	-t secs  Set the length of the run (default 10)\n" \
+	"	-u       Read (\"unencode\") rather than write\n" \
+	"	-Vn      Set the video mode to NTSC\n" \
+	"	-Vp      Set the video mode to PAL\n" \
+	"	-w n     Wake up after n frames rather than any data\n" \
+	"	-h       Display this usage message\n" \
+	"	-v       Be verbose\n", stderr);
+}
+
+
+static struct options parse_command_line(int *argc, char **argv[])
+{
+	struct options options = default_options();
+	struct option long_options[] = {
+		{"block-size",	required_argument,	NULL,	'b'},
+		{"bit-density",	required_argument,	NULL,	'D'},
+		{"help",	no_argument,	NULL,	'h'},
+		{"time",	required_argument,	NULL,	't'},
+		{"unencode",	no_argument,	NULL,	'u'},
+		{"video-mode",	required_argument,	NULL,	'V'},
+		{"verbose",	no_argument,	NULL,	'v'},
+		{"wakeup",	required_argument,	NULL,	'w'},
+		{NULL,	0,	NULL,	0}
+	};
+	int c, index;
+
+	opterr = 1;	/* enable error messages */
+	do switch(c = getopt_long(*argc, *argv, "b:D:ht:uV:vw:", long_options, &index)) {
+	case 'b':
+		options.block_size = strtoul(optarg, NULL, 0);
+		if(!options.block_size) {
+			usage();
+			exit(1);
+		}
+		break;
+
+	case 'D':
+		switch(tolower(optarg[0])) {
+		case 'h':
+			options.bitdensity = BKR_HIGH;
+			break;
+		case 'l':
+			options.bitdensity = BKR_LOW;
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+		break;
+
+	case 't':
+		options.duration = atof(optarg);
+		break;
+
+	case 'u':
+		options.direction = BKR_READING;
+		break;
+
+	case 'V':
+		switch(tolower(optarg[0])) {
+		case 'n':
+			options.videomode = BKR_NTSC;
+			break;
+		case 'p':
+			options.videomode = BKR_PAL;
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+		break;
+
+	case 'w':
+		options.wakeup_frames = strtoul(optarg, NULL, 0);
+		break;
+
+	case 'h':
+		usage();
+		exit(1);
+
+	case 'v':
+		options.verbose = 1;
+		break;
+
+	case 0:
+		/* option sets a flag */
+		break;
+
+	case -1:
+		/* end of arguments */
+		break;
+
+	case '?':
+		/* unrecognized option */
+		usage();
+		exit(1);
+
+	case ':':
+		/* missing argument for an option */
+		usage();
+		exit(1);
+
+	default:
+		/* FIXME: print bug warning */
+		break;
+	} while(c != -1);
+
+	/* remove parsed arguments */
+	*argc += optind;
+	*argv += optind;
+
+	return options;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                          Simulated File Operations
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Stands in for the unit's wait queue.  The stream call-back records when
+ * the hardware last moved data so the delay to the process moving data in
+ * response can be measured.  The read and write loops themselves are the
+ * driver's, from bkr_stream_io.h.
+ */
+
+
+struct unit {
+	struct bkr_stream_t  *stream;
+	pthread_mutex_t  lock;
+	pthread_cond_t  queue;
+	struct timespec  last_field;
+	size_t  wakeup;
+	size_t  waiting_for;
+	int  last_error;
+	/* wake-up latency statistics */
+	unsigned long  wakeups;
+	double  latency_total;
+	double  latency_max;
+};
+
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
+
+
+static int io_ready(struct unit *unit, size_t need)
+{
+	struct bkr_stream_t  *stream = unit->stream;
+
+	switch(stream->direction) {
+	case BKR_READING:
+		return bytes_in_ring(stream->ring) >= need;
+
+	case BKR_WRITING:
+		return space_in_ring(stream->ring) >= need;
+
+	default:
+		return 1;
+	}
+}
+
+
+static void io_callback(void *data)
+{
+	struct unit  *unit = data;
+
+	pthread_mutex_lock(&unit->lock);
+	clock_gettime(CLOCK_MONOTONIC, &unit->last_field);
+	if(io_ready(unit, unit->waiting_for))
+		pthread_cond_broadcast(&unit->queue);
+	pthread_mutex_unlock(&unit->lock);
+}
+
+
+/*
+ * The unit's side of bkr_stream_read() and bkr_stream_write().
+ */
+
+
+static size_t io_wakeup(void *data)
+{
+	struct unit  *unit = data;
+
+	return unit->wakeup;
+}
+
+
+static int io_sleep(void *data, size_t need)
+{
+	struct unit  *unit = data;
+	struct bkr_stream_t  *stream = unit->stream;
+	struct timespec  deadline, now;
+	int  timed_out = 0;
+	int  waited = 0;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += stream->timeout / 1000;
+	deadline.tv_nsec += (stream->timeout % 1000) * 1000000;
+	if(deadline.tv_nsec >= 1000000000) {
+		deadline.tv_nsec -= 1000000000;
+		deadline.tv_sec++;
+	}
+
+	pthread_mutex_lock(&unit->lock);
+	unit->waiting_for = need;
+	while(!io_ready(unit, need)) {
+		if(pthread_cond_timedwait(&unit->queue, &unit->lock, &deadline) == ETIMEDOUT) {
+			timed_out = 1;
+			break;
+		}
+		waited = 1;
+	}
+	unit->waiting_for = unit->wakeup;
+	if(waited && !timed_out) {
+		double  latency;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		latency = elapsed(&unit->last_field, &now);
+		unit->wakeups++;
+		unit->latency_total += latency;
+		if(latency > unit->latency_max)
+			unit->latency_max = latency;
+	}
+	pthread_mutex_unlock(&unit->lock);
+
+	if(timed_out && !io_ready(unit, 1))
+		return -ETIMEDOUT;
+	return timed_out;
+}
+
+
+static void io_update(void *data)
+{
+	/* there's no control page to publish the ring offsets to */
+}
+
+
+static const struct bkr_stream_io_ops_t unit_io_ops = {
+	.wakeup = io_wakeup,
+	.sleep = io_sleep,
+	.update = io_update
+};
+
+
+/*
+ * ============================================================================
+ *
+ *                                Entry Point
+ *
+ * ============================================================================
+ */
+
+
+int main(int argc, char *argv[])
+{
+	struct options  options;
+	struct unit  unit = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.queue = PTHREAD_COND_INITIALIZER
+	};
+	struct bkr_stream_t  *stream;
+	struct bkr_sim_stats  stats;
+	struct timespec  start, now;
+	struct rusage  usage;
+	unsigned char  *buffer;
+	unsigned long long  bytes = 0;
+	double  run_time, nominal;
+	ssize_t  result;
+	int  mode;
+
+	options = parse_command_line(&argc, &argv);
+	mode = options.videomode | options.bitdensity | BKR_SP;
+
+	stream = bkr_sim_new(RING_SIZE);
+	buffer = calloc(options.block_size, 1);
+	if(!stream || !buffer) {
+		fprintf(stderr, PROGRAM_NAME ": error: out of memory\n");
+		exit(1);
+	}
+	unit.stream = stream;
+	stream->ops.ready(stream, mode, bkr_mode_to_frame_size(mode));
+	unit.wakeup = options.wakeup_frames ? min_t(size_t, options.wakeup_frames * stream->frame_size, stream->ring->size - 1) : 1;
+	unit.waiting_for = unit.wakeup;
+	bkr_stream_set_callback(stream, io_callback, &unit);
+	nominal = stream->frame_size * 1e9 / (2 * bkr_sim_field_period(mode));
+
+	if(options.verbose)
+		fprintf(stderr, PROGRAM_NAME ": %s %u byte frames in %zu byte blocks for %g s\n", options.direction == BKR_READING ? "reading" : "writing", stream->frame_size, options.block_size, options.duration);
+
+	if((result = stream->ops.start(stream, options.direction)) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", strerror(-result));
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		if(options.direction == BKR_READING)
+			result = bkr_stream_read(stream, &unit_io_ops, &unit, 0, &unit.last_error, (char *) buffer, options.block_size);
+		else
+			result = bkr_stream_write(stream, &unit_io_ops, &unit, 0, &unit.last_error, (const char *) buffer, options.block_size);
+		if(result < 0) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s\n", strerror(-result));
+			break;
+		}
+		bytes += result;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while(elapsed(&start, &now) < options.duration);
+
+	while(stream->ops.release(stream) == -EAGAIN)
+		if(io_sleep(&unit, stream->ring->size - 1) < 0)
+			break;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	run_time = elapsed(&start, &now);
+	stats = bkr_sim_get_stats(stream);
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(stderr, PROGRAM_NAME ": moved %llu bytes in %.3f s: %.1f bytes/s (nominal %.1f bytes/s)\n", bytes, run_time, bytes / run_time, nominal);
+	fprintf(stderr, PROGRAM_NAME ": %lu fields, %lu overruns, %lu underruns\n", stats.fields, stats.overruns, stats.underruns);
+	if(unit.wakeups)
+		fprintf(stderr, PROGRAM_NAME ": %lu wake-ups, latency mean %.1f us, max %.1f us\n", unit.wakeups, unit.latency_total / unit.wakeups * 1e6, unit.latency_max * 1e6);
+	fprintf(stderr, PROGRAM_NAME ": CPU time %.3f s user, %.3f s system\n", usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6, usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6);
+
+	bkr_sim_free(stream);
+	free(buffer);
+
+	exit(0);
+}
@@ -0,0 +1,731 @@
+/*
+ * bkrcapture
+ *
+ * Capture a raw tape image from a Backer unit to disk.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * The tape can't be paused, so whatever the disk is doing the device must
+ * be read at the tape rate.  The main thread does nothing but read the
+ * device, in whole video frames, into a pool of large page-aligned
+ * buffers;  a second thread writes the full buffers to the image file
+ * with O_DIRECT, so the page cache never makes the reader wait for
+ * write-back, and calls fdatasync() only once every so many bytes.  When
+ * the disk stalls, full buffers pile up in memory and the pool grows, up
+ * to a limit, to absorb them.  Only if the limit is reached does the
+ * reader have to wait, and then the driver's ring is all that stands
+ * between the tape and lost fields;  such stalls are counted, as are the
+ * driver's own overruns, so a capture that lost data says so.
+ */
+
+
+#define _GNU_SOURCE     /* O_DIRECT */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+#include <sys/stat.h>
+
+
+#include <backer.h>
+#include <bkr_stream.h>
+#include <bkr_image.h>
+
+
+#define  PROGRAM_NAME   "bkrcapture"
+#define  ALIGNMENT      4096    /* O_DIRECT buffer and size alignment */
+#define  FALLBACK_READ  65536   /* read size if not reading a Backer */
+
+
+/*
+ * ============================================================================
+ *
+ *                                Command Line
+ *
+ * ============================================================================
+ */
+
+
+struct options {
+	int verbose;
+	size_t buffer_size;
+	unsigned int buffers;
+	unsigned int max_buffers;
+	unsigned int frames;
+	size_t sync_interval;
+	int direct;
+	int image;
+};
+
+
+static struct options default_options(void)
+{
+	struct options defaults = {
+		.verbose = 0,
+		.buffer_size = 4 << 20,
+		.buffers = 8,
+		.max_buffers = 64,
+		.frames = 4,
+		.sync_interval = 64 << 20,
+		.direct = 1,
+		.image = 0
+	};
+
+	return defaults;
+}
+
+
+static void usage(void)
+{
+	fputs(
+	"Backer tape image capture utility.\n" \
+	"Usage: " PROGRAM_NAME " [options] device image\n" \
+	"Reads device until end of data or SIGINT and writes it to image.\n" \
+	"the following options are recognized:\n" \
+	"	-b count Allocate this many buffers at start (default 8)\n" \
+	"	-m count Let the pool grow to this many buffers (default 64)\n" \
+	"	-s MiB   Set the buffer size (default 4)\n" \
+	"	-n frames Read this many video frames at a time (default 4)\n" \
+	"	-S MiB   Call fdatasync() after writing this much (default 64, 0 = at end only)\n" \
+	"	-B       Use ordinary buffered writes instead of O_DIRECT\n" \
+	"	-i       Write an image file with a header, for bkrindex(8)\n" \
+	"	-h       Display this usage message\n" \
+	"	-v       Be verbose\n", stderr);
+}
+
+
+static struct options parse_command_line(int *argc, char **argv[])
+{
+	struct options options = default_options();
+	struct option long_options[] = {
+		{"buffered",	no_argument,	NULL,	'B'},
+		{"buffers",	required_argument,	NULL,	'b'},
+		{"help",	no_argument,	NULL,	'h'},
+		{"image",	no_argument,	NULL,	'i'},
+		{"max-buffers",	required_argument,	NULL,	'm'},
+		{"frames",	required_argument,	NULL,	'n'},
+		{"buffer-size",	required_argument,	NULL,	's'},
+		{"sync-interval",	required_argument,	NULL,	'S'},
+		{"verbose",	no_argument,	NULL,	'v'},
+		{NULL,	0,	NULL,	0}
+	};
+	int c, index;
+
+	opterr = 1;	/* enable error messages */
+	do switch(c = getopt_long(*argc, *argv, "b:Bhim:n:s:S:v", long_options, &index)) {
+	case 'b':
+		options.buffers = strtoul(optarg, NULL, 0);
+		break;
+
+	case 'B':
+		options.direct = 0;
+		break;
+
+	case 'i':
+		options.image = 1;
+		break;
+
+	case 'm':
+		options.max_buffers = strtoul(optarg, NULL, 0);
+		break;
+
+	case 'n':
+		options.frames = strtoul(optarg, NULL, 0);
+		break;
+
+	case 's':
+		options.buffer_size = strtoul(optarg, NULL, 0) << 20;
+		break;
+
+	case 'S':
+		options.sync_interval = strtoul(optarg, NULL, 0) << 20;
+		break;
+
+	case 'h':
+		usage();
+		exit(1);
+
+	case 'v':
+		options.verbose = 1;
+		break;
+
+	case 0:
+		/* option sets a flag */
+		break;
+
+	case -1:
+		/* end of arguments */
+		break;
+
+	case '?':
+		/* unrecognized option */
+		usage();
+		exit(1);
+
+	case ':':
+		/* missing argument for an option */
+		usage();
+		exit(1);
+
+	default:
+		/* FIXME: print bug warning */
+		break;
+	} while(c != -1);
+
+	if(options.buffers < 2 || options.max_buffers < options.buffers || !options.buffer_size || !options.frames) {
+		usage();
+		exit(1);
+	}
+
+	/* remove parsed arguments */
+	*argc -= optind;
+	*argv += optind;
+
+	return options;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Buffer Pool
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Buffers move from the free list to the reader, from the reader to the
+ * full list, from the full list to the writer, and back to the free list.
+ * Both lists are protected by the pool's lock.
+ */
+
+
+struct buffer {
+	struct buffer *next;
+	unsigned char *data;
+	size_t length;                  /* bytes of data in the buffer */
+};
+
+
+struct list {
+	struct buffer *head;
+	struct buffer *tail;
+};
+
+
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t freed;           /* a buffer was put on the free list */
+	pthread_cond_t filled;          /* ditto the full list, or done set */
+	struct list free;
+	struct list full;
+	size_t buffer_size;
+	unsigned int allocated;
+	unsigned int max_buffers;
+	unsigned int queued;            /* buffers on the full list */
+	int done;                       /* reader has finished */
+	int failed;                     /* writer has given up */
+
+	/* statistics */
+	unsigned int high_water;        /* most buffers queued at once */
+	unsigned long stalls;           /* reader waited for a buffer */
+};
+
+
+static void list_push(struct list *list, struct buffer *buffer)
+{
+	buffer->next = NULL;
+	if(list->tail)
+		list->tail->next = buffer;
+	else
+		list->head = buffer;
+	list->tail = buffer;
+}
+
+
+static struct buffer *list_pop(struct list *list)
+{
+	struct buffer *buffer = list->head;
+
+	if(buffer) {
+		list->head = buffer->next;
+		if(!list->head)
+			list->tail = NULL;
+	}
+	return buffer;
+}
+
+
+static struct buffer *buffer_new(size_t size)
+{
+	struct buffer *buffer = malloc(sizeof(*buffer));
+
+	if(!buffer)
+		return NULL;
+	if(posix_memalign((void **) &buffer->data, ALIGNMENT, size)) {
+		free(buffer);
+		return NULL;
+	}
+	/* touch the pages now rather than in the middle of the capture */
+	memset(buffer->data, 0, size);
+	buffer->length = 0;
+	return buffer;
+}
+
+
+static int pool_init(struct pool *pool, size_t buffer_size, unsigned int buffers, unsigned int max_buffers)
+{
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->freed, NULL);
+	pthread_cond_init(&pool->filled, NULL);
+	pool->free = pool->full = (struct list) {NULL, NULL};
+	pool->buffer_size = buffer_size;
+	pool->allocated = 0;
+	pool->max_buffers = max_buffers;
+	pool->queued = 0;
+	pool->done = 0;
+	pool->failed = 0;
+	pool->high_water = 0;
+	pool->stalls = 0;
+
+	while(pool->allocated < buffers) {
+		struct buffer *buffer = buffer_new(buffer_size);
+		if(!buffer)
+			return -1;
+		list_push(&pool->free, buffer);
+		pool->allocated++;
+	}
+	return 0;
+}
+
+
+/*
+ * Get an empty buffer for the reader.  If none is free the pool grows,
+ * and only once it can't grow any more does the reader wait.  Returns
+ * NULL if the writer has failed.
+ */
+
+
+static struct buffer *pool_get_free(struct pool *pool)
+{
+	struct buffer *buffer;
+
+	pthread_mutex_lock(&pool->lock);
+	buffer = list_pop(&pool->free);
+	if(!buffer && pool->allocated < pool->max_buffers) {
+		/* the allocation is done with the lock held, but the only
+		 * other party is the writer, which is behind anyway */
+		buffer = buffer_new(pool->buffer_size);
+		if(buffer)
+			pool->allocated++;
+	}
+	if(!buffer && !pool->failed) {
+		pool->stalls++;
+		while(!(buffer = list_pop(&pool->free)) && !pool->failed)
+			pthread_cond_wait(&pool->freed, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if(buffer)
+		buffer->length = 0;
+	return buffer;
+}
+
+
+static void pool_put_full(struct pool *pool, struct buffer *buffer)
+{
+	pthread_mutex_lock(&pool->lock);
+	list_push(&pool->full, buffer);
+	if(++pool->queued > pool->high_water)
+		pool->high_water = pool->queued;
+	pthread_cond_signal(&pool->filled);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+ * Get a full buffer for the writer.  Returns NULL once the reader is done
+ * and everything has been written.
+ */
+
+
+static struct buffer *pool_get_full(struct pool *pool)
+{
+	struct buffer *buffer;
+
+	pthread_mutex_lock(&pool->lock);
+	while(!(buffer = list_pop(&pool->full)) && !pool->done)
+		pthread_cond_wait(&pool->filled, &pool->lock);
+	if(buffer)
+		pool->queued--;
+	pthread_mutex_unlock(&pool->lock);
+
+	return buffer;
+}
+
+
+static void pool_put_free(struct pool *pool, struct buffer *buffer)
+{
+	pthread_mutex_lock(&pool->lock);
+	list_push(&pool->free, buffer);
+	pthread_cond_signal(&pool->freed);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+static void pool_finish(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->done = 1;
+	pthread_cond_signal(&pool->filled);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+static void pool_fail(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->failed = 1;
+	pthread_cond_signal(&pool->freed);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Writer
+ *
+ * ============================================================================
+ */
+
+
+struct writer {
+	struct pool *pool;
+	int fd;
+	int direct;                     /* fd is open with O_DIRECT */
+	size_t sync_interval;
+	unsigned long long written;
+	unsigned long syncs;
+	int error;                      /* errno of the failure, or 0 */
+};
+
+
+static int write_all(int fd, const unsigned char *data, size_t length)
+{
+	while(length) {
+		ssize_t n = write(fd, data, length);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+
+/*
+ * O_DIRECT needs aligned sizes.  Every buffer but the last is full, and
+ * the tail of the last one is written after turning O_DIRECT off.
+ */
+
+
+static int write_buffer(struct writer *writer, struct buffer *buffer)
+{
+	size_t aligned = writer->direct ? buffer->length & ~(size_t) (ALIGNMENT - 1) : buffer->length;
+
+	if(aligned && write_all(writer->fd, buffer->data, aligned) < 0)
+		return -1;
+	if(aligned < buffer->length) {
+		if(fcntl(writer->fd, F_SETFL, fcntl(writer->fd, F_GETFL) & ~O_DIRECT) < 0)
+			return -1;
+		writer->direct = 0;
+		if(write_all(writer->fd, buffer->data + aligned, buffer->length - aligned) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+static void *writer_thread(void *data)
+{
+	struct writer *writer = data;
+	struct buffer *buffer;
+	unsigned long long unsynced = 0;
+
+	while((buffer = pool_get_full(writer->pool))) {
+		if(write_buffer(writer, buffer) < 0)
+			goto error;
+		writer->written += buffer->length;
+		unsynced += buffer->length;
+		pool_put_free(writer->pool, buffer);
+
+		if(writer->sync_interval && unsynced >= writer->sync_interval) {
+			if(fdatasync(writer->fd) < 0)
+				goto error;
+			writer->syncs++;
+			unsynced = 0;
+		}
+	}
+	if(fdatasync(writer->fd) < 0 && errno != EINVAL)
+		goto error;
+	writer->syncs++;
+	return NULL;
+
+error:
+	writer->error = errno;
+	pool_fail(writer->pool);
+	return NULL;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Entry Point
+ *
+ * ============================================================================
+ */
+
+
+static volatile sig_atomic_t stop;
+
+
+static void sigint_handler(int num)
+{
+	stop = 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct options options;
+	struct pool pool;
+	struct writer writer;
+	struct buffer *buffer = NULL;
+	struct mtget mtget;
+	struct bkr_stats stats;
+	struct bkr_image_header header;
+	struct sigaction action;
+	pthread_t thread;
+	const char *device, *image;
+	size_t read_size;
+	int frame_size;
+	int mode;
+	int backer;
+	int in;
+	int flags;
+	int result = 0;
+
+
+	/*
+	 * Init.
+	 */
+
+
+	options = parse_command_line(&argc, &argv);
+	if(argc != 2) {
+		usage();
+		exit(1);
+	}
+	device = argv[0];
+	image = argv[1];
+	options.buffer_size = (options.buffer_size + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+
+
+	/*
+	 * Open the device and size the reads.
+	 */
+
+
+	in = open(device, O_RDONLY);
+	if(in < 0) {
+		perror(PROGRAM_NAME ": error: opening device");
+		exit(1);
+	}
+	backer = ioctl(in, MTIOCGET, &mtget) >= 0;
+	if(backer) {
+		struct bkr_wakeup wakeup = {
+			.count = options.frames,
+			.units = BKR_WAKEUP_FRAMES
+		};
+
+		mode = mtget.mt_dsreg & BKR_MODE_MASK;
+		frame_size = bkr_mode_to_frame_size(mode);
+		if(frame_size < 0) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s reports an invalid mode\n", device);
+			exit(1);
+		}
+		if(ioctl(in, BKRIOCSETWAKEUP, &wakeup) < 0) {
+			perror(PROGRAM_NAME ": error: setting wake-up threshold");
+			exit(1);
+		}
+		read_size = options.frames * frame_size;
+	} else {
+		fprintf(stderr, PROGRAM_NAME ": warning: %s is not a Backer device\n", device);
+		mode = 0;
+		frame_size = 0;
+		read_size = FALLBACK_READ;
+	}
+
+
+	/*
+	 * Open the image.  Not every file system does O_DIRECT.
+	 */
+
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC;
+	writer.fd = options.direct ? open(image, flags | O_DIRECT, 0666) : -1;
+	writer.direct = writer.fd >= 0;
+	if(!writer.direct) {
+		if(options.direct && options.verbose)
+			fprintf(stderr, PROGRAM_NAME ": %s: O_DIRECT not available, using buffered writes\n", image);
+		writer.fd = open(image, flags, 0666);
+	}
+	if(writer.fd < 0) {
+		perror(PROGRAM_NAME ": error: opening image");
+		exit(1);
+	}
+
+
+	/*
+	 * Set up buffers and start the writer.
+	 */
+
+
+	if(pool_init(&pool, options.buffer_size, options.buffers, options.max_buffers) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: cannot allocate buffers\n");
+		exit(1);
+	}
+	if(options.image) {
+		/* the header page goes out at the start of the first
+		 * buffer, ahead of the data */
+		buffer = pool_get_free(&pool);
+		memset(buffer->data, 0, BKR_IMAGE_DATA_OFFSET);
+		bkr_image_init_header(&header, mode, frame_size);
+		memcpy(buffer->data, &header, sizeof(header));
+		buffer->length = BKR_IMAGE_DATA_OFFSET;
+	}
+	writer.pool = &pool;
+	writer.sync_interval = options.sync_interval;
+	writer.written = 0;
+	writer.syncs = 0;
+	writer.error = 0;
+	if(pthread_create(&thread, NULL, writer_thread, &writer)) {
+		fprintf(stderr, PROGRAM_NAME ": error: cannot start writer thread\n");
+		exit(1);
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = sigint_handler;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if(options.verbose) {
+		if(backer)
+			fprintf(stderr, PROGRAM_NAME ": reading %u frames of %d bytes at a time\n", options.frames, frame_size);
+		fprintf(stderr, PROGRAM_NAME ": %u to %u buffers of %zu bytes\n", options.buffers, options.max_buffers, options.buffer_size);
+	}
+
+
+	/*
+	 * Capture.  A buffer is handed to the writer as soon as it's full,
+	 * so reads straddle buffers when the read size doesn't divide the
+	 * buffer size.
+	 */
+
+
+	while(!stop) {
+		ssize_t n;
+
+		if(!buffer && !(buffer = pool_get_free(&pool)))
+			break;	/* writer failed */
+
+		n = read(in, buffer->data + buffer->length, min(read_size, pool.buffer_size - buffer->length));
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			perror(PROGRAM_NAME ": error: reading device");
+			result = 1;
+			break;
+		}
+		if(!n)
+			break;
+		buffer->length += n;
+		if(buffer->length == pool.buffer_size) {
+			pool_put_full(&pool, buffer);
+			buffer = NULL;
+		}
+	}
+	if(buffer && buffer->length)
+		pool_put_full(&pool, buffer);
+	pool_finish(&pool);
+	pthread_join(thread, NULL);
+
+
+	/*
+	 * Report.
+	 */
+
+
+	if(writer.error) {
+		fprintf(stderr, PROGRAM_NAME ": error: writing image: %s\n", strerror(writer.error));
+		result = 1;
+	} else if(options.image) {
+		header.data_length = writer.written - BKR_IMAGE_DATA_OFFSET;
+		if(writer.direct)
+			fcntl(writer.fd, F_SETFL, fcntl(writer.fd, F_GETFL) & ~O_DIRECT);
+		if(pwrite(writer.fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(writer.fd) < 0) {
+			perror(PROGRAM_NAME ": error: writing image header");
+			result = 1;
+		}
+	}
+	if(close(writer.fd) < 0) {
+		perror(PROGRAM_NAME ": error: closing image");
+		result = 1;
+	}
+	if(backer && ioctl(in, BKRIOCGETSTATS, &stats) >= 0 && stats.overruns) {
+		fprintf(stderr, PROGRAM_NAME ": warning: device overran %u time(s), fields have been lost\n", stats.overruns);
+		result = 1;
+	}
+	if(pool.stalls)
+		fprintf(stderr, PROGRAM_NAME ": warning: disk fell behind by %u buffers, reading stalled %lu time(s)\n", pool.max_buffers, pool.stalls);
+	if(options.verbose) {
+		fprintf(stderr, PROGRAM_NAME ": %llu bytes", writer.written);
+		if(backer)
+			fprintf(stderr, " (%llu frames)", (writer.written - (options.image ? BKR_IMAGE_DATA_OFFSET : 0)) / frame_size);
+		fprintf(stderr, " written, %lu sync(s)\n", writer.syncs);
+		fprintf(stderr, PROGRAM_NAME ": %u buffers allocated, at most %u waiting to be written\n", pool.allocated, pool.high_water);
+	}
+	close(in);
+
+	exit(result);
+}
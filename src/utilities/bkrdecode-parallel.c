@@ -0,0 +1,713 @@
+/*
+ * bkrdecode-parallel
+ *
+ * Decode a recording from an indexed tape image using several threads.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * The frame decoder finds fields by correlating against the sector key,
+ * and every sector carries its sector number, so a recording can be cut
+ * into chunks at field boundaries and each chunk decoded on its own.  The
+ * image's index says where the fields are and which sector each one
+ * holds.  Each chunk is read starting a few fields early and ending a few
+ * fields late, and is run through bkr_framedec, bkr_rlldec and
+ * bkr_splpdec in a pipeline of its own on a pool of threads.  Each chunk
+ * keeps only the sectors whose numbers fall in its share of the
+ * recording, which removes the duplicates decoded in the overlaps, and
+ * spools them to a temporary file.  The main thread replays the spool
+ * files in order.
+ *
+ * The EP format's second error correction layer can't be split this way:
+ * its groups straddle chunk boundaries, and their geometry is in a
+ * descriptor at the start of the recording.  So in EP mode the replayed
+ * sectors go through a single bkr_ecc2dec, with gaps and bad sectors
+ * reported to it exactly as bkr_splpdec would have.  That stage is cheap
+ * next to the others, which do all the per-byte work.
+ */
+
+
+/*
+ * ============================================================================
+ *
+ *                                  Preamble
+ *
+ * ============================================================================
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#include <gst/gst.h>
+
+
+#include <backer.h>
+#include <bkr_disp_mode.h>
+#include <bkr_image.h>
+
+
+#define  PROGRAM_NAME    "bkrdecode-parallel"
+
+
+/*
+ * ============================================================================
+ *
+ *                                Command Line
+ *
+ * ============================================================================
+ */
+
+
+struct options {
+	gboolean verbose;
+	gint jobs;
+	gint chunks;
+	gint overlap;
+	gint record;
+};
+
+
+static struct options parse_command_line(int *argc, char **argv[])
+{
+	struct options options = {
+		.verbose = FALSE,
+		.jobs = sysconf(_SC_NPROCESSORS_ONLN),
+		.chunks = 0,
+		.overlap = 4,
+		.record = 0
+	};
+	GOptionEntry entries[] = {
+		{"jobs", 'j', 0, G_OPTION_ARG_INT, &options.jobs, "Decode this many chunks at once (default is the number of CPUs)", "threads"},
+		{"chunks", 'n', 0, G_OPTION_ARG_INT, &options.chunks, "Cut the recording into this many chunks (default is 4 per thread)", "chunks"},
+		{"overlap", 'o', 0, G_OPTION_ARG_INT, &options.overlap, "Decode this many extra fields at each end of a chunk (default 4)", "fields"},
+		{"record", 'r', 0, G_OPTION_ARG_INT, &options.record, "Decode this record (default 0, the first)", "record"},
+		{"verbose", 'v', 0, G_OPTION_ARG_NONE, &options.verbose, "Be verbose", NULL},
+		{NULL}
+	};
+	GError *error = NULL;
+	GOptionContext *context;
+
+	context = g_option_context_new("image - parallel Backer tape image decoder");
+
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+
+	if(!g_option_context_parse(context, argc, argv, &error)) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", error->message);
+		exit(1);
+	}
+
+	g_option_context_free(context);
+
+	if(*argc != 2) {
+		fprintf(stderr, PROGRAM_NAME ": error: need exactly one image\n");
+		exit(1);
+	}
+	if(options.jobs < 1)
+		options.jobs = 1;
+	if(options.chunks < 1)
+		options.chunks = 4 * options.jobs;
+	if(options.overlap < 0 || options.record < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: --overlap and --record must be >= 0\n");
+		exit(1);
+	}
+
+	return options;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Chunks
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * A chunk decodes bytes [start, stop) of the image and keeps sectors
+ * numbered [first_sector, end_sector).  Sectors are spooled as a struct
+ * spool_sector followed by the sector's data.
+ */
+
+
+#define  SECTOR_INVALID  0x0001
+
+
+struct spool_sector {
+	gint32 sector_number;
+	guint32 flags;
+	guint32 length;
+};
+
+
+struct chunk {
+	const char *image;
+	unsigned int mode;
+	guint64 start;
+	guint64 stop;
+	gint first_sector;
+	gint end_sector;
+
+	FILE *spool;
+	gboolean next_invalid;
+	gboolean failed;	/* spool is unusable */
+	gboolean done;
+};
+
+
+static GMutex *chunk_lock;
+static GCond *chunk_done;
+
+
+static gboolean event_probe(GstPad *pad, GstEvent *event, gpointer data)
+{
+	struct chunk *chunk = data;
+
+	if(GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_DOWNSTREAM && gst_structure_has_name(gst_event_get_structure(event), "bkr_next_sector_invalid"))
+		chunk->next_invalid = TRUE;
+	return TRUE;
+}
+
+
+static void handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, gpointer data)
+{
+	struct chunk *chunk = data;
+	struct spool_sector sector = {
+		.sector_number = GST_BUFFER_OFFSET(buffer),
+		.flags = chunk->next_invalid ? SECTOR_INVALID : 0,
+		.length = GST_BUFFER_SIZE(buffer)
+	};
+
+	chunk->next_invalid = FALSE;
+	if(sector.sector_number < chunk->first_sector || sector.sector_number >= chunk->end_sector)
+		/* another chunk's */
+		return;
+
+	if(fwrite(&sector, sizeof(sector), 1, chunk->spool) != 1 || fwrite(GST_BUFFER_DATA(buffer), 1, sector.length, chunk->spool) != sector.length)
+		chunk->failed = TRUE;
+}
+
+
+static GstElement *chunk_pipeline(struct chunk *chunk, int fd)
+{
+	GstElement *pipeline = gst_pipeline_new(NULL);
+	GstElement *source = gst_element_factory_make("fdsrc", "source");
+	GstElement *frame = gst_element_factory_make("bkr_framedec", NULL);
+	GstElement *splp = gst_element_factory_make("bkr_splpdec", NULL);
+	GstElement *sink = gst_element_factory_make("fakesink", NULL);
+	GstCaps *caps = gst_caps_new_simple(
+		"application/x-backer",
+		"videomode", G_TYPE_INT, BKR_VIDEOMODE(chunk->mode),
+		"bitdensity", G_TYPE_INT, BKR_DENSITY(chunk->mode),
+		"sectorformat", G_TYPE_INT, BKR_CODEC(chunk->mode),
+		NULL
+	);
+	GstPad *pad;
+
+	if(!pipeline || !source || !frame || !splp || !sink || !caps)
+		return NULL;
+
+	g_object_set(G_OBJECT(source), "fd", fd, NULL);
+	g_object_set(G_OBJECT(sink), "sync", FALSE, "signal-handoffs", TRUE, NULL);
+	g_signal_connect(G_OBJECT(sink), "handoff", G_CALLBACK(handoff), chunk);
+	pad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_add_event_probe(pad, G_CALLBACK(event_probe), chunk);
+	gst_object_unref(pad);
+
+	gst_bin_add_many(GST_BIN(pipeline), source, frame, splp, sink, NULL);
+	gst_element_link_filtered(source, frame, caps);
+	if(BKR_CODEC(chunk->mode) == BKR_EP) {
+		GstElement *rll = gst_element_factory_make("bkr_rlldec", NULL);
+		if(!rll)
+			return NULL;
+		gst_bin_add(GST_BIN(pipeline), rll);
+		gst_element_link_many(frame, rll, splp, sink, NULL);
+	} else
+		gst_element_link_many(frame, splp, sink, NULL);
+
+	if(!bkr_image_seek_source(pipeline, chunk->start, chunk->stop))
+		return NULL;
+
+	gst_caps_unref(caps);
+	return pipeline;
+}
+
+
+/*
+ * Decode a chunk into its spool file.  Returns FALSE on failure.
+ */
+
+
+static gboolean spool_chunk(struct chunk *chunk)
+{
+	GstElement *pipeline;
+	GstBus *bus;
+	GstMessage *msg;
+	GError *error = NULL;
+	gchar *name;
+	gboolean result;
+	int fd;
+
+	fd = g_file_open_tmp(PROGRAM_NAME "-XXXXXX", &name, &error);
+	if(fd < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	unlink(name);
+	g_free(name);
+	chunk->spool = fdopen(fd, "w+");
+	if(!chunk->spool) {
+		perror(PROGRAM_NAME ": error: spool file");
+		close(fd);
+		return FALSE;
+	}
+
+	fd = open(chunk->image, O_RDONLY);
+	if(fd < 0) {
+		perror(PROGRAM_NAME ": error: opening image");
+		return FALSE;
+	}
+	pipeline = chunk_pipeline(chunk, fd);
+	if(!pipeline) {
+		fprintf(stderr, PROGRAM_NAME ": failure building pipeline.\n");
+		close(fd);
+		return FALSE;
+	}
+
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+	msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	gst_object_unref(bus);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(GST_OBJECT(pipeline));
+	close(fd);
+
+	result = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+	if(!result) {
+		gchar *debug;
+		GError *err;
+
+		gst_message_parse_error(msg, &err, &debug);
+		g_free(debug);
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", err->message);
+		g_error_free(err);
+	}
+	gst_message_unref(msg);
+
+	if(chunk->failed || fflush(chunk->spool)) {
+		perror(PROGRAM_NAME ": error: spool file");
+		return FALSE;
+	}
+	rewind(chunk->spool);
+
+	return result;
+}
+
+
+/*
+ * Thread pool function.
+ */
+
+
+static void decode_chunk(gpointer data, gpointer user_data)
+{
+	struct chunk *chunk = data;
+	gboolean failed = !spool_chunk(chunk);
+
+	g_mutex_lock(chunk_lock);
+	chunk->failed = failed;
+	chunk->done = TRUE;
+	g_cond_broadcast(chunk_done);
+	g_mutex_unlock(chunk_lock);
+}
+
+
+/*
+ * Cut a record into chunks.  The chunk boundaries are at fields evenly
+ * spaced through the index, and each chunk keeps the sectors from the
+ * first numbered one at or after its boundary up to the next chunk's.
+ */
+
+
+static gint sector_at(const struct bkr_image *image, guint field, guint last_field)
+{
+	for(; field <= last_field; field++)
+		if(!(image->fields[field].flags & BKR_IMAGE_BOR) && image->fields[field].sector_number >= 0)
+			return image->fields[field].sector_number;
+	return G_MAXINT;
+}
+
+
+static struct chunk *make_chunks(const struct bkr_image *image, const char *filename, unsigned int record, gint *n, gint overlap)
+{
+	const struct bkr_image_record *r = &image->records[record];
+	guint fields = r->last_field - r->first_field + 1;
+	__u64 start, end;
+	struct chunk *chunks;
+	gint i;
+
+	bkr_image_record_range(image, record, &start, &end);
+	if((guint) *n > fields)
+		*n = fields;
+	chunks = g_new0(struct chunk, *n);
+
+	for(i = 0; i < *n; i++) {
+		guint first = r->first_field + (guint64) fields * i / *n;
+		guint last = r->first_field + (guint64) fields * (i + 1) / *n;
+
+		chunks[i].image = filename;
+		chunks[i].mode = image->header->mode;
+		chunks[i].start = image->header->data_offset + image->fields[first >= r->first_field + overlap ? first - overlap : r->first_field].offset;
+		if(i == *n - 1 || last + overlap > r->last_field)
+			chunks[i].stop = image->header->data_offset + end;
+		else
+			chunks[i].stop = image->header->data_offset + image->fields[last + overlap].offset;
+		chunks[i].first_sector = i ? sector_at(image, first, r->last_field) : G_MININT;
+		if(i && chunks[i].first_sector < chunks[i - 1].first_sector)
+			chunks[i].first_sector = chunks[i - 1].first_sector;
+		if(i)
+			chunks[i - 1].end_sector = chunks[i].first_sector;
+	}
+	chunks[*n - 1].end_sector = G_MAXINT;
+
+	return chunks;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Output
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * SP/LP sectors are written straight out.  EP sectors are pushed from our
+ * own pad into bkr_ecc2dec, preceded by the events bkr_splpdec would have
+ * sent with them.
+ */
+
+
+struct output {
+	GstElement *pipeline;
+	GstPad *pad;
+	GstCaps *caps;
+	gint next_sector;
+	guint64 sectors;
+	guint64 bad_sectors;
+	guint64 missing_sectors;
+};
+
+
+static gboolean output_open(struct output *output, unsigned int mode)
+{
+	GstElement *ecc2, *sink;
+	GstPad *pad;
+
+	output->pipeline = NULL;
+	output->next_sector = 0;
+	output->sectors = output->bad_sectors = output->missing_sectors = 0;
+
+	if(BKR_CODEC(mode) != BKR_EP)
+		return TRUE;
+
+	output->pipeline = gst_pipeline_new(NULL);
+	ecc2 = gst_element_factory_make("bkr_ecc2dec", NULL);
+	sink = gst_element_factory_make("fdsink", NULL);
+	output->caps = gst_caps_new_simple(
+		"application/x-backer",
+		"videomode", G_TYPE_INT, BKR_VIDEOMODE(mode),
+		"bitdensity", G_TYPE_INT, BKR_DENSITY(mode),
+		"sectorformat", G_TYPE_INT, BKR_CODEC(mode),
+		NULL
+	);
+	output->pad = gst_pad_new("src", GST_PAD_SRC);
+	if(!output->pipeline || !ecc2 || !sink || !output->caps || !output->pad)
+		return FALSE;
+
+	g_object_set(G_OBJECT(sink), "fd", STDOUT_FILENO, NULL);
+	gst_bin_add_many(GST_BIN(output->pipeline), ecc2, sink, NULL);
+	gst_element_link(ecc2, sink);
+
+	pad = gst_element_get_static_pad(ecc2, "sink");
+	gst_pad_set_caps(output->pad, output->caps);
+	if(gst_pad_link(output->pad, pad) != GST_PAD_LINK_OK) {
+		gst_object_unref(pad);
+		return FALSE;
+	}
+	gst_object_unref(pad);
+	gst_pad_set_active(output->pad, TRUE);
+
+	gst_element_set_state(output->pipeline, GST_STATE_PLAYING);
+	return gst_pad_push_event(output->pad, gst_event_new_new_segment(FALSE, 1.0, GST_FORMAT_BYTES, 0, -1, 0));
+}
+
+
+static gboolean write_all(int fd, const guint8 *data, size_t length)
+{
+	while(length) {
+		ssize_t n = write(fd, data, length);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += n;
+		length -= n;
+	}
+	return TRUE;
+}
+
+
+static gboolean push_event(struct output *output, const char *name)
+{
+	return gst_pad_push_event(output->pad, gst_event_new_custom(GST_EVENT_CUSTOM_DOWNSTREAM, gst_structure_empty_new(name)));
+}
+
+
+/*
+ * Report the ECC decoder refusing a sector.  There's no errno for this;
+ * the reason, if any, is an error message on the pipeline's bus.
+ */
+
+
+static void output_error(struct output *output, gint sector_number)
+{
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(output->pipeline));
+	GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+
+	gst_object_unref(bus);
+	if(msg) {
+		gchar *debug;
+		GError *err;
+
+		gst_message_parse_error(msg, &err, &debug);
+		g_free(debug);
+		fprintf(stderr, PROGRAM_NAME ": error: sector %d: %s\n", sector_number, err->message);
+		g_error_free(err);
+		gst_message_unref(msg);
+	} else
+		fprintf(stderr, PROGRAM_NAME ": error: sector %d: ECC decoder refused data\n", sector_number);
+}
+
+
+static gboolean output_sector(struct output *output, const struct spool_sector *sector, GstBuffer *buffer)
+{
+	output->sectors++;
+	if(sector->flags & SECTOR_INVALID)
+		output->bad_sectors++;
+	output->missing_sectors += sector->sector_number - output->next_sector;
+
+	if(!output->pipeline) {
+		output->next_sector = sector->sector_number + 1;
+		if(!write_all(STDOUT_FILENO, GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer))) {
+			fprintf(stderr, PROGRAM_NAME ": error: writing output: %s\n", strerror(errno));
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	for(; output->next_sector < sector->sector_number; output->next_sector++)
+		if(!push_event(output, "bkr_skipped_sector")) {
+			output_error(output, sector->sector_number);
+			return FALSE;
+		}
+	output->next_sector++;
+	if((sector->flags & SECTOR_INVALID) && !push_event(output, "bkr_next_sector_invalid")) {
+		output_error(output, sector->sector_number);
+		return FALSE;
+	}
+
+	gst_buffer_set_caps(buffer, output->caps);
+	if(gst_pad_push(output->pad, gst_buffer_ref(buffer)) != GST_FLOW_OK) {
+		output_error(output, sector->sector_number);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+static gboolean output_close(struct output *output)
+{
+	GstBus *bus;
+	GstMessage *msg;
+	gboolean result;
+
+	if(!output->pipeline)
+		return TRUE;
+
+	gst_pad_push_event(output->pad, gst_event_new_eos());
+	bus = gst_pipeline_get_bus(GST_PIPELINE(output->pipeline));
+	msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	gst_object_unref(bus);
+	result = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+	if(!result) {
+		gchar *debug;
+		GError *err;
+
+		gst_message_parse_error(msg, &err, &debug);
+		g_free(debug);
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", err->message);
+		g_error_free(err);
+	}
+	gst_message_unref(msg);
+
+	gst_element_set_state(output->pipeline, GST_STATE_NULL);
+	gst_object_unref(GST_OBJECT(output->pipeline));
+	gst_object_unref(output->pad);
+	gst_caps_unref(output->caps);
+
+	return result;
+}
+
+
+/*
+ * Replay a chunk's spool file.
+ */
+
+
+static gboolean replay_chunk(struct output *output, struct chunk *chunk)
+{
+	struct spool_sector sector;
+	gboolean result = TRUE;
+
+	while(result && fread(&sector, sizeof(sector), 1, chunk->spool) == 1) {
+		GstBuffer *buffer = gst_buffer_new_and_alloc(sector.length);
+		if(fread(GST_BUFFER_DATA(buffer), 1, sector.length, chunk->spool) != sector.length) {
+			fprintf(stderr, PROGRAM_NAME ": error: reading spool file: %s\n", ferror(chunk->spool) ? strerror(errno) : "truncated");
+			result = FALSE;
+		} else
+			result = output_sector(output, &sector, buffer);
+		gst_buffer_unref(buffer);
+	}
+	if(result && ferror(chunk->spool)) {
+		fprintf(stderr, PROGRAM_NAME ": error: reading spool file: %s\n", strerror(errno));
+		result = FALSE;
+	}
+	fclose(chunk->spool);
+
+	return result;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Entry Point
+ *
+ * ============================================================================
+ */
+
+
+int main(int argc, char *argv[])
+{
+	struct options options;
+	struct bkr_image image;
+	struct chunk *chunks;
+	struct output output;
+	GThreadPool *pool;
+	const char *filename;
+	gint i;
+
+
+	/*
+	 * Init.
+	 */
+
+
+	if(!g_thread_supported())
+		g_thread_init(NULL);
+	options = parse_command_line(&argc, &argv);
+	gst_init(NULL, NULL);
+	filename = argv[1];
+
+	if(bkr_image_open(filename, &image) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s: %s\n", filename, errno == EINVAL ? "not a Backer tape image" : strerror(errno));
+		exit(1);
+	}
+	if(!image.header->index_entries) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s has not been indexed, run bkrindex first\n", filename);
+		exit(1);
+	}
+	if(!BKR_CODEC(image.header->mode)) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s does not record its sector format, re-index it with bkrindex --sector-format\n", filename);
+		exit(1);
+	}
+	if((unsigned) options.record >= image.header->records) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s has only %u records\n", filename, image.header->records);
+		exit(1);
+	}
+
+	chunks = make_chunks(&image, filename, options.record, &options.chunks, options.overlap);
+	if(options.verbose) {
+		fprintf(stderr, PROGRAM_NAME ": decoding record %d in %d chunks with %d threads, tape format:\n", options.record, options.chunks, options.jobs);
+		bkr_display_mode(stderr, BKR_VIDEOMODE(image.header->mode), BKR_DENSITY(image.header->mode), BKR_CODEC(image.header->mode));
+	}
+	if(!output_open(&output, image.header->mode)) {
+		fprintf(stderr, PROGRAM_NAME ": failure building pipeline.\n");
+		exit(1);
+	}
+
+
+	/*
+	 * Decode.  The pool takes the chunks in order, so the one we want
+	 * next is always among the first to finish.
+	 */
+
+
+	chunk_lock = g_mutex_new();
+	chunk_done = g_cond_new();
+	pool = g_thread_pool_new(decode_chunk, NULL, options.jobs, TRUE, NULL);
+	for(i = 0; i < options.chunks; i++)
+		g_thread_pool_push(pool, &chunks[i], NULL);
+
+	for(i = 0; i < options.chunks; i++) {
+		g_mutex_lock(chunk_lock);
+		while(!chunks[i].done)
+			g_cond_wait(chunk_done, chunk_lock);
+		g_mutex_unlock(chunk_lock);
+
+		if(chunks[i].failed) {
+			fprintf(stderr, PROGRAM_NAME ": error: chunk %d failed\n", i);
+			exit(1);
+		}
+		if(!replay_chunk(&output, &chunks[i]))
+			exit(1);
+	}
+	if(!output_close(&output))
+		exit(1);
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+	if(options.verbose)
+		fprintf(stderr, PROGRAM_NAME ": %" G_GUINT64_FORMAT " sectors, %" G_GUINT64_FORMAT " bad, %" G_GUINT64_FORMAT " missing\n", output.sectors, output.bad_sectors, output.missing_sectors);
+
+	g_free(chunks);
+	bkr_image_close(&image);
+	exit(0);
+}
@@ -31,10 +31,14 @@
 
 
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
 
 
 #include <gst/gst.h>
@@ -42,6 +46,7 @@
 
 #include <backer.h>
 #include <bkr_disp_mode.h>
+#include <bkr_image.h>
 
 
 #define  PROGRAM_NAME    "bkrencode"
@@ -85,9 +90,27 @@ struct options {
 	gboolean ignore_bad;
 	gboolean inject_noise;
 	gboolean decode;
+	gboolean catalog;
+	gboolean low_latency;
+	gboolean compress;
+	gint compress_level;
+	gint lead;
 	enum bkr_videomode videomode;
 	enum bkr_bitdensity bitdensity;
 	enum bkr_sectorformat sectorformat;
+	gint ecc2_group_length;
+	gint ecc2_parity;
+	gint skip_records;
+	gint first_record;
+	gchar *device;
+
+	/*
+	 * byte range of stdin to decode, set when stdin is a tape image
+	 */
+
+	gboolean image;
+	guint64 start;
+	guint64 stop;
 };
 
 
@@ -99,15 +122,96 @@ static struct options default_options(void)
 		.ignore_bad = FALSE,
 		.inject_noise = FALSE,
 		.decode = FALSE,
+		.catalog = FALSE,
+		.low_latency = FALSE,
+		.compress = FALSE,
+		.compress_level = 6,
+		.lead = 0,
 		.videomode = BKR_NTSC,
 		.bitdensity = BKR_HIGH,
-		.sectorformat = BKR_SP
+		.sectorformat = BKR_SP,
+		.ecc2_group_length = 255,
+		.ecc2_parity = 20,
+		.skip_records = 0,
+		.first_record = 0,
+		.device = NULL,
+		.image = FALSE,
+		.start = 0,
+		.stop = 0
 	};
 
 	return defaults;
 }
 
 
+/*
+ * Retrieve the format from a Backer device file.  Returns the mode, or
+ * < 0 on failure.
+ */
+
+
+static int device_mode(const char *device)
+{
+	struct mtget mtget;
+	int fd = open(device, O_RDONLY | O_NONBLOCK);
+	int result;
+
+	if(fd < 0)
+		return -1;
+	result = ioctl(fd, MTIOCGET, &mtget);
+	close(fd);
+	if(result < 0)
+		return -1;
+
+	return mtget.mt_dsreg & BKR_MODE_MASK;
+}
+
+
+/*
+ * When decoding an image, take the format from its header and, if it has
+ * been indexed, go straight to the record wanted instead of scanning for
+ * it.  Does nothing if stdin is not an image.
+ */
+
+
+static void image_range(struct options *options)
+{
+	struct bkr_image image;
+	struct bkr_image_header header;
+	__u64 start, end;
+
+	if(bkr_image_read_header(STDIN_FILENO, &header) < 0)
+		return;
+
+	options->image = TRUE;
+	if(header.mode) {
+		options->videomode = BKR_VIDEOMODE(header.mode);
+		options->bitdensity = BKR_DENSITY(header.mode);
+		if(BKR_CODEC(header.mode))
+			options->sectorformat = BKR_CODEC(header.mode);
+	}
+	options->start = header.data_offset;
+	options->stop = header.data_length ? header.data_offset + header.data_length : (guint64) -1;
+
+	if(!header.records || !options->skip_records || options->catalog)
+		return;
+	if(bkr_image_map(STDIN_FILENO, &image) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: cannot map image: %s\n", errno == EINVAL ? "not a Backer tape image" : strerror(errno));
+		exit(1);
+	}
+	if(bkr_image_record_range(&image, options->skip_records, &start, &end) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: image has only %u records\n", header.records);
+		exit(1);
+	}
+	options->start = header.data_offset + start;
+	options->stop = header.data_offset + end;
+	/* the input now starts at the record wanted, keep its number */
+	options->first_record = options->skip_records;
+	options->skip_records = 0;
+	bkr_image_close(&image);
+}
+
+
 static struct options parse_command_line(int *argc, char **argv[])
 {
 	struct options options = default_options();
@@ -116,8 +220,17 @@ static struct options parse_command_line(int *argc, char **argv[])
 		{"bit-density", 'D', 0, G_OPTION_ARG_STRING, &bitdensity, "Set the data rate to high or low", "{h,l}"},
 		{"sector-format", 'F', 0, G_OPTION_ARG_STRING, &sectorformat, "Set the data format to EP or SP/LP", "{e,s}"},
 		{"video-mode", 'V', 0, G_OPTION_ARG_STRING, &videomode, "Set the video mode to NTSC or PAL", "{n,p}"},
+		{"device", 'f', 0, G_OPTION_ARG_FILENAME, &options.device, "Write (or read) tape data directly to (from) this Backer device instead of stdout (stdin), with the format defaulting to the device's", "devname"},
+		{"ecc2-group-length", 0, 0, G_OPTION_ARG_INT, &options.ecc2_group_length, "Set the number of sectors in an EP error correction group (only during encode)", "sectors"},
+		{"ecc2-parity", 0, 0, G_OPTION_ARG_INT, &options.ecc2_parity, "Set the number of parity sectors in an EP error correction group (only during encode)", "sectors"},
+		{"compress", 'z', 0, G_OPTION_ARG_NONE, &options.compress, "Compress the data while encoding, and decompress it while decoding", NULL},
+		{"compress-level", 0, 0, G_OPTION_ARG_INT, &options.compress_level, "Set the compression level from 0 (none) to 9 (best) (only during encode)", "level"},
+		{"lead", 0, 0, G_OPTION_ARG_INT, &options.lead, "Keep this many video fields queued ahead of the tape, repeating sectors when the data can't keep up, 0 to disable (only during encode)", "fields"},
 		{"skip-bad-sectors", 's', 0, G_OPTION_ARG_NONE, &options.ignore_bad, "Skip bad sectors", NULL},
 		{"inject-noise", 'n', 0, G_OPTION_ARG_NONE, &options.inject_noise, "Inject simulated tape noise (only during encode)", NULL},
+		{"low-latency", 0, 0, G_OPTION_ARG_NONE, &options.low_latency, "Output EP data as soon as the sector codec finds it good, before error correction can check it (only during decode)", NULL},
+		{"skip-records", 'r', 0, G_OPTION_ARG_INT, &options.skip_records, "Skip this many records, scanning sector headers only (or using the index of a tape image), and decode the next (only during decode)", "records"},
+		{"catalog", 'c', 0, G_OPTION_ARG_NONE, &options.catalog, "List the records in tape data, scanning sector headers only (implies --unencode)", NULL},
 		{"time-only", 't', 0, G_OPTION_ARG_NONE, &options.time_only, "Compute time only (do not encode or decode data)", NULL},
 		{"unencode", 'u', 0, G_OPTION_ARG_NONE, &options.decode, "Unencode tape data (default is to encode)", NULL},
 		{"verbose", 'v', 0, G_OPTION_ARG_NONE, &options.verbose, "Be verbose", NULL},
@@ -138,6 +251,42 @@ static struct options parse_command_line(int *argc, char **argv[])
 
 	g_option_context_free(context);
 
+	if(options.skip_records < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: --skip-records must be >= 0\n");
+		exit(1);
+	}
+	if(options.ecc2_group_length < 2 || options.ecc2_group_length > 255) {
+		fprintf(stderr, PROGRAM_NAME ": error: --ecc2-group-length must be in [2, 255]\n");
+		exit(1);
+	}
+	if(options.ecc2_parity < 1 || options.ecc2_parity >= options.ecc2_group_length) {
+		fprintf(stderr, PROGRAM_NAME ": error: --ecc2-parity must be >= 1 and less than the group length\n");
+		exit(1);
+	}
+	if(options.compress_level < 0 || options.compress_level > 9) {
+		fprintf(stderr, PROGRAM_NAME ": error: --compress-level must be in [0, 9]\n");
+		exit(1);
+	}
+	if(options.lead < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: --lead must be >= 0\n");
+		exit(1);
+	}
+	if(options.catalog)
+		options.decode = TRUE;
+
+	if(options.device) {
+		int mode = device_mode(options.device);
+		if(mode < 0) {
+			fprintf(stderr, PROGRAM_NAME ": error: cannot get format from %s: %s\n", options.device, strerror(errno));
+			exit(1);
+		}
+		options.videomode = BKR_VIDEOMODE(mode);
+		options.bitdensity = BKR_DENSITY(mode);
+		if(BKR_CODEC(mode))
+			options.sectorformat = BKR_CODEC(mode);
+	} else if(options.decode)
+		image_range(&options);
+
 	if(bitdensity)
 		switch(tolower(bitdensity[0])) {
 		case 'h':
@@ -177,6 +326,10 @@ static struct options parse_command_line(int *argc, char **argv[])
 
 	if(options.inject_noise && options.decode)
 		fprintf(stderr, PROGRAM_NAME ": warning: ignoring --inject-noise\n");
+	if(options.lead && options.decode)
+		fprintf(stderr, PROGRAM_NAME ": warning: ignoring --lead\n");
+	if(options.skip_records && (!options.decode || options.catalog))
+		fprintf(stderr, PROGRAM_NAME ": warning: ignoring --skip-records\n");
 
 	return options;
 }
@@ -191,11 +344,44 @@ static struct options parse_command_line(int *argc, char **argv[])
  */
 
 
+/*
+ * Print a catalog entry posted by bkr_splpdec.
+ */
+
+
+static void print_record(const GstStructure *s)
+{
+	gint record, first_sector, last_sector, sectors;
+	guint64 bytes;
+	gboolean complete;
+
+	gst_structure_get_int(s, "record", &record);
+	gst_structure_get_int(s, "first_sector", &first_sector);
+	gst_structure_get_int(s, "last_sector", &last_sector);
+	gst_structure_get_int(s, "sectors", &sectors);
+	gst_structure_get_uint64(s, "bytes", &bytes);
+	gst_structure_get_boolean(s, "complete", &complete);
+
+	printf("record %d: ", record);
+	if(sectors)
+		printf("sectors %d--%d, %d missing, %" G_GUINT64_FORMAT " bytes", first_sector, last_sector, last_sector - first_sector + 1 - sectors, bytes);
+	else
+		printf("empty");
+	printf("%s\n", complete ? "" : " (incomplete)");
+	fflush(stdout);
+}
+
+
 static gboolean message_handler(GstBus *bus, GstMessage *msg, gpointer data)
 {
 	GMainLoop *loop = (GMainLoop *) data;
 
 	switch(GST_MESSAGE_TYPE(msg)) {
+	case GST_MESSAGE_ELEMENT:
+		if(gst_structure_has_name(gst_message_get_structure(msg), "bkr_record"))
+			print_record(gst_message_get_structure(msg));
+		break;
+
 	case GST_MESSAGE_EOS:
 		g_main_loop_quit(loop);
 		break;
@@ -214,6 +400,18 @@ static gboolean message_handler(GstBus *bus, GstMessage *msg, gpointer data)
 		break;
 	}
 
+	case GST_MESSAGE_WARNING: {
+		gchar *debug;
+		GError *err;
+
+		gst_message_parse_warning(msg, &err, &debug);
+		g_free(debug);
+
+		fprintf(stderr, PROGRAM_NAME ": warning: %s\n", err->message);
+		g_error_free(err);
+		break;
+	}
+
 	default:
 		break;
 	}
@@ -222,13 +420,14 @@ static gboolean message_handler(GstBus *bus, GstMessage *msg, gpointer data)
 }
 
 
-static GstElement *encoder_pipeline(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity, enum bkr_sectorformat sectorformat, gboolean inject_noise)
+static GstElement *encoder_pipeline(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity, enum bkr_sectorformat sectorformat, gboolean inject_noise, gint ecc2_group_length, gint ecc2_parity, gint compress_level, gint lead, const gchar *device)
 {
 	GstElement *pipeline = gst_pipeline_new("pipeline");
 	GstElement *source = gst_element_factory_make("fdsrc", NULL);
+	GstElement *head;
 	GstElement *splp = gst_element_factory_make("bkr_splpenc", NULL);
 	GstElement *frame = gst_element_factory_make("bkr_frameenc", NULL);
-	GstElement *sink = gst_element_factory_make("fdsink", NULL);
+	GstElement *sink = gst_element_factory_make(device ? "bkr_devsink" : "fdsink", NULL);
 	GstCaps *caps = gst_caps_new_simple(
 		"application/x-backer",
 		"videomode", G_TYPE_INT, videomode,
@@ -248,8 +447,31 @@ static GstElement *encoder_pipeline(enum bkr_videomode videomode, enum bkr_bitde
 	gst_bin_add_many(GST_BIN(pipeline), source, splp, frame, sink, NULL);
 
 	g_object_set(G_OBJECT(source), "fd", STDIN_FILENO, NULL);
+	g_object_set(G_OBJECT(splp), "lead", lead, NULL);
 	g_object_set(G_OBJECT(frame), "inject_noise", inject_noise, NULL);
-	g_object_set(G_OBJECT(sink), "fd", STDOUT_FILENO, NULL);
+	if(device)
+		g_object_set(G_OBJECT(sink), "device", device, NULL);
+	else
+		g_object_set(G_OBJECT(sink), "fd", STDOUT_FILENO, NULL);
+
+	/*
+	 * compression goes in a thread of its own (that's what the queue
+	 * is for), so it runs in parallel with the sector codecs instead of
+	 * in series with them.
+	 */
+
+	if(compress_level >= 0) {
+		GstElement *queue = gst_element_factory_make("queue", NULL);
+		GstElement *compress = gst_element_factory_make("bkr_compress", NULL);
+		if(!queue || !compress)
+			return NULL;
+		gst_bin_add_many(GST_BIN(pipeline), queue, compress, NULL);
+		g_object_set(G_OBJECT(compress), "level", compress_level, NULL);
+		gst_element_link_filtered(source, compress, caps);
+		gst_element_link(compress, queue);
+		head = queue;
+	} else
+		head = source;
 
 	if(sectorformat == BKR_EP) {
 		GstElement *ecc2 = gst_element_factory_make("bkr_ecc2enc", NULL);
@@ -257,10 +479,11 @@ static GstElement *encoder_pipeline(enum bkr_videomode videomode, enum bkr_bitde
 		if(!ecc2 || !rll)
 			return NULL;
 		gst_bin_add_many(GST_BIN(pipeline), ecc2, rll, NULL);
-		gst_element_link_filtered(source, ecc2, caps);
+		g_object_set(G_OBJECT(ecc2), "group_length", ecc2_group_length, "parity", ecc2_parity, NULL);
+		gst_element_link_filtered(head, ecc2, caps);
 		gst_element_link_many(ecc2, splp, rll, frame, sink, NULL);
 	} else {
-		gst_element_link_filtered(source, splp, caps);
+		gst_element_link_filtered(head, splp, caps);
 		gst_element_link_many(splp, frame, sink, NULL);
 	}
 
@@ -269,13 +492,14 @@ static GstElement *encoder_pipeline(enum bkr_videomode videomode, enum bkr_bitde
 }
 
 
-static GstElement *decoder_pipeline(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity, enum bkr_sectorformat sectorformat)
+static GstElement *decoder_pipeline(enum bkr_videomode videomode, enum bkr_bitdensity bitdensity, enum bkr_sectorformat sectorformat, gboolean low_latency, gint skip_records, gint first_record, gboolean catalog, gboolean decompress, const gchar *device)
 {
 	GstElement *pipeline = gst_pipeline_new("pipeline");
-	GstElement *source = gst_element_factory_make("fdsrc", NULL);
-	GstElement *frame = gst_element_factory_make("bkr_framedec", NULL);
-	GstElement *splp = gst_element_factory_make("bkr_splpdec", NULL);
-	GstElement *sink = gst_element_factory_make("fdsink", NULL);
+	GstElement *source = gst_element_factory_make(device ? "bkr_devsrc" : "fdsrc", "source");
+	GstElement *frame = gst_element_factory_make("bkr_framedec", "frame");
+	GstElement *splp = gst_element_factory_make("bkr_splpdec", "splp");
+	GstElement *tail = splp;
+	GstElement *sink = gst_element_factory_make(catalog ? "fakesink" : "fdsink", NULL);
 	GstCaps *caps = gst_caps_new_simple(
 		"application/x-backer",
 		"videomode", G_TYPE_INT, videomode,
@@ -292,12 +516,27 @@ static GstElement *decoder_pipeline(enum bkr_videomode videomode, enum bkr_bitde
 	if(!pipeline || !source || !frame || !splp || !sink || !caps)
 		return NULL;
 
-	g_object_set(G_OBJECT(source), "fd", STDIN_FILENO, NULL);
-	g_object_set(G_OBJECT(sink), "fd", STDOUT_FILENO, NULL);
+	if(device)
+		g_object_set(G_OBJECT(source), "device", device, NULL);
+	else
+		g_object_set(G_OBJECT(source), "fd", STDIN_FILENO, NULL);
+	if(catalog)
+		g_object_set(G_OBJECT(splp), "scan", TRUE, NULL);
+	else {
+		g_object_set(G_OBJECT(splp), "skip_records", skip_records, "record", first_record, NULL);
+		g_object_set(G_OBJECT(sink), "fd", STDOUT_FILENO, NULL);
+	}
 
 	gst_bin_add_many(GST_BIN(pipeline), source, frame, splp, sink, NULL);
 	gst_element_link_filtered(source, frame, caps);
-	if(sectorformat == BKR_EP) {
+	if(sectorformat == BKR_EP && catalog) {
+		/* nothing gets past bkr_splpdec, so no need for bkr_ecc2dec */
+		GstElement *rll = gst_element_factory_make("bkr_rlldec", NULL);
+		if(!rll)
+			return NULL;
+		gst_bin_add(GST_BIN(pipeline), rll);
+		gst_element_link_many(frame, rll, splp, NULL);
+	} else if(sectorformat == BKR_EP) {
 		GstElement *rll = gst_element_factory_make("bkr_rlldec", NULL);
 		GstElement *ecc2 = gst_element_factory_make("bkr_ecc2dec", NULL);
 		if(!rll || !ecc2) {
@@ -305,15 +544,119 @@ static GstElement *decoder_pipeline(enum bkr_videomode videomode, enum bkr_bitde
 			 * going to exit now anyway */
 			return NULL;
 		}
-		gst_element_link_many(frame, rll, splp, ecc2, sink, NULL);
+		gst_bin_add_many(GST_BIN(pipeline), rll, ecc2, NULL);
+		g_object_set(G_OBJECT(ecc2), "low_latency", low_latency, NULL);
+		gst_element_link_many(frame, rll, splp, ecc2, NULL);
+		tail = ecc2;
+	} else
+		gst_element_link(frame, splp);
+
+	if(decompress && !catalog) {
+		GstElement *decompressor = gst_element_factory_make("bkr_decompress", NULL);
+		if(!decompressor)
+			return NULL;
+		gst_bin_add(GST_BIN(pipeline), decompressor);
+		gst_element_link_many(tail, decompressor, sink, NULL);
 	} else
-		gst_element_link_many(frame, splp, sink, NULL);
+		gst_element_link(tail, sink);
 
 	gst_caps_unref(caps);
 	return pipeline;
 }
 
 
+/*
+ * ============================================================================
+ *
+ *                              Status Reports
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * When decoding straight from the device, tell the driver where we are
+ * in the recording and how the decode is going so MTIOCGET and the
+ * unit's stats file can report it.  Stops itself if the input turns out
+ * not to be a Backer device.
+ */
+
+
+struct reporter {
+	GstElement *source;
+	GstElement *frame;
+	GstElement *splp;
+};
+
+
+static gboolean report_status(gpointer data)
+{
+	struct reporter *reporter = data;
+	struct bkr_position position;
+	struct bkr_decoder_stats stats;
+	gint record, sector_number;
+	gint bad_sectors, lost_runs, duplicate_runs, bytes_corrected, worst_block, recent_block, block_parity;
+	gint frame_warnings, worst_key, best_nonkey, key_length, smallest_field, largest_field;
+	gint fd;
+
+	/* bkr_devsrc's device isn't open until the pipeline is running */
+	g_object_get(G_OBJECT(reporter->source), "fd", &fd, NULL);
+	if(fd < 0)
+		return TRUE;
+
+	g_object_get(G_OBJECT(reporter->splp),
+		"record", &record,
+		"sector_number", &sector_number,
+		"bad_sectors", &bad_sectors,
+		"lost_runs", &lost_runs,
+		"duplicate_runs", &duplicate_runs,
+		"bytes_corrected", &bytes_corrected,
+		"worst_block", &worst_block,
+		"recent_block", &recent_block,
+		"block_parity", &block_parity,
+		NULL);
+	/* recent_block is the worst since the last report */
+	g_object_set(G_OBJECT(reporter->splp), "recent_block", 0, NULL);
+	g_object_get(G_OBJECT(reporter->frame),
+		"frame_warnings", &frame_warnings,
+		"worst_key", &worst_key,
+		"best_nonkey", &best_nonkey,
+		"key_length", &key_length,
+		"smallest_field", &smallest_field,
+		"largest_field", &largest_field,
+		NULL);
+
+	position = (struct bkr_position) {
+		.fileno = record,
+		.blkno = sector_number
+	};
+	stats = (struct bkr_decoder_stats) {
+		.bad_sectors = bad_sectors,
+		.lost_runs = lost_runs,
+		.duplicate_runs = duplicate_runs,
+		.bytes_corrected = bytes_corrected,
+		.worst_block = worst_block,
+		.recent_block = recent_block,
+		.block_parity = block_parity,
+		.frame_warnings = frame_warnings,
+		.worst_key = worst_key,
+		.best_nonkey = best_nonkey,
+		.key_length = key_length,
+		.smallest_field = smallest_field,
+		.largest_field = largest_field
+	};
+
+	if(ioctl(fd, BKRIOCSETPOS, &position) < 0 || ioctl(fd, BKRIOCSETSTATS, &stats) < 0) {
+		gst_object_unref(reporter->source);
+		gst_object_unref(reporter->frame);
+		gst_object_unref(reporter->splp);
+		g_free(reporter);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
 /*
  * ============================================================================
  *
@@ -354,9 +697,9 @@ int main(int argc, char *argv[])
 
 	loop = g_main_loop_new(NULL, FALSE);
 	if(options.decode)
-		pipeline = decoder_pipeline(options.videomode, options.bitdensity, options.sectorformat);
+		pipeline = decoder_pipeline(options.videomode, options.bitdensity, options.sectorformat, options.low_latency, options.skip_records, options.first_record, options.catalog, options.compress, options.device);
 	else
-		pipeline = encoder_pipeline(options.videomode, options.bitdensity, options.sectorformat, options.inject_noise);
+		pipeline = encoder_pipeline(options.videomode, options.bitdensity, options.sectorformat, options.inject_noise, options.ecc2_group_length, options.ecc2_parity, options.compress ? options.compress_level : -1, options.lead, options.device);
 	if(!pipeline) {
 		fprintf(stderr, PROGRAM_NAME ": failure building pipeline.\n");
 		exit(1);
@@ -364,6 +707,13 @@ int main(int argc, char *argv[])
 	bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
 	gst_bus_add_watch(bus, message_handler, loop);
 	gst_object_unref(bus);
+	if(options.decode) {
+		struct reporter *reporter = g_new(struct reporter, 1);
+		reporter->source = gst_bin_get_by_name(GST_BIN(pipeline), "source");
+		reporter->frame = gst_bin_get_by_name(GST_BIN(pipeline), "frame");
+		reporter->splp = gst_bin_get_by_name(GST_BIN(pipeline), "splp");
+		g_timeout_add(100, report_status, reporter);
+	}
 
 
 	/*
@@ -384,6 +734,10 @@ int main(int argc, char *argv[])
 	 */
 
 
+	if(options.image && !bkr_image_seek_source(pipeline, options.start, options.stop)) {
+		fprintf(stderr, PROGRAM_NAME ": error: cannot seek tape image\n");
+		exit(1);
+	}
 	gst_element_set_state(pipeline, GST_STATE_PLAYING);
 	g_main_loop_run(loop);
 
@@ -0,0 +1,467 @@
+/*
+ * bkrindex
+ *
+ * Build the field index and record table of a Backer tape image.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * bkrcapture can't decode while it captures, so an image is indexed
+ * afterwards.  The image is run through the frame decoder and the SP/LP
+ * decoder with the latter in catalog mode, so only the sector headers are
+ * error corrected, and the decoder reports the position of each field it
+ * finds on the bus.
+ */
+
+
+/*
+ * ============================================================================
+ *
+ *                                  Preamble
+ *
+ * ============================================================================
+ */
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+#include <gst/gst.h>
+
+
+#include <backer.h>
+#include <bkr_disp_mode.h>
+#include <bkr_image.h>
+
+
+#define  PROGRAM_NAME    "bkrindex"
+
+
+/*
+ * ============================================================================
+ *
+ *                                Command Line
+ *
+ * ============================================================================
+ */
+
+
+struct options {
+	gboolean verbose;
+	gchar *bitdensity;
+	gchar *sectorformat;
+	gchar *videomode;
+};
+
+
+static struct options parse_command_line(int *argc, char **argv[])
+{
+	struct options options = {
+		.verbose = FALSE,
+		.bitdensity = NULL,
+		.sectorformat = NULL,
+		.videomode = NULL
+	};
+	GOptionEntry entries[] = {
+		{"bit-density", 'D', 0, G_OPTION_ARG_STRING, &options.bitdensity, "Set the data rate to high or low (default is the image's)", "{h,l}"},
+		{"sector-format", 'F', 0, G_OPTION_ARG_STRING, &options.sectorformat, "Set the data format to EP or SP/LP (default is the image's, or SP/LP)", "{e,s}"},
+		{"video-mode", 'V', 0, G_OPTION_ARG_STRING, &options.videomode, "Set the video mode to NTSC or PAL (default is the image's)", "{n,p}"},
+		{"verbose", 'v', 0, G_OPTION_ARG_NONE, &options.verbose, "Be verbose", NULL},
+		{NULL}
+	};
+	GError *error = NULL;
+	GOptionContext *context;
+
+	context = g_option_context_new("image - Backer tape image indexer");
+
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+
+	if(!g_option_context_parse(context, argc, argv, &error)) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", error->message);
+		exit(1);
+	}
+
+	g_option_context_free(context);
+
+	if(*argc != 2) {
+		fprintf(stderr, PROGRAM_NAME ": error: need exactly one image\n");
+		exit(1);
+	}
+
+	return options;
+}
+
+
+/*
+ * Fill in the parts of the mode the command line sets.
+ */
+
+
+static unsigned int apply_options(unsigned int mode, const struct options *options)
+{
+	if(options->bitdensity)
+		switch(tolower(options->bitdensity[0])) {
+		case 'h':
+			mode = (mode & ~BKR_DENSITY_MASK) | BKR_HIGH;
+			break;
+		case 'l':
+			mode = (mode & ~BKR_DENSITY_MASK) | BKR_LOW;
+			break;
+		default:
+			fprintf(stderr, PROGRAM_NAME ": error: Unknown bit density %s\n", options->bitdensity);
+			exit(1);
+		}
+	if(options->sectorformat)
+		switch(tolower(options->sectorformat[0])) {
+		case 'e':
+			mode = (mode & ~BKR_CODEC_MASK) | BKR_EP;
+			break;
+		case 's':
+			mode = (mode & ~BKR_CODEC_MASK) | BKR_SP;
+			break;
+		default:
+			fprintf(stderr, PROGRAM_NAME ": error: Unknown sector format %s\n", options->sectorformat);
+			exit(1);
+		}
+	if(options->videomode)
+		switch(tolower(options->videomode[0])) {
+		case 'n':
+			mode = (mode & ~BKR_VIDEOMODE_MASK) | BKR_NTSC;
+			break;
+		case 'p':
+			mode = (mode & ~BKR_VIDEOMODE_MASK) | BKR_PAL;
+			break;
+		default:
+			fprintf(stderr, PROGRAM_NAME ": error: Unknown video mode %s\n", options->videomode);
+			exit(1);
+		}
+	if(!BKR_CODEC(mode))
+		mode |= BKR_SP;
+
+	return mode;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                               Index Assembly
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * A record opens with the first field of a BOR mark and closes with the
+ * first field of the EOR mark that follows.  A BOR mark arriving after
+ * data sectors in an open record means the recording was cut off without
+ * an EOR mark;  that record closes with the field before it.
+ */
+
+
+struct index {
+	guint64 data_offset;
+	GArray *fields;
+	GArray *records;
+	struct bkr_image_record current;
+	gboolean open;
+};
+
+
+static void close_record(struct index *index, guint last_field)
+{
+	index->current.last_field = last_field;
+	g_array_append_val(index->records, index->current);
+	index->open = FALSE;
+}
+
+
+static void add_field(struct index *index, const GstStructure *s)
+{
+	struct bkr_image_field field;
+	guint64 offset;
+	gint sector_number, record;
+	gboolean bor, eor;
+	guint n = index->fields->len;
+
+	gst_structure_get_uint64(s, "offset", &offset);
+	gst_structure_get_int(s, "sector_number", &sector_number);
+	gst_structure_get_int(s, "record", &record);
+	gst_structure_get_boolean(s, "bor", &bor);
+	gst_structure_get_boolean(s, "eor", &eor);
+
+	if(bor) {
+		if(index->open && index->current.last_sector >= 0)
+			close_record(index, n - 1);
+		if(!index->open) {
+			index->current = (struct bkr_image_record) {
+				.first_field = n,
+				.last_field = n,
+				.last_sector = -1
+			};
+			index->open = TRUE;
+		}
+	} else if(eor) {
+		if(index->open)
+			close_record(index, n);
+	} else if(index->open && sector_number > index->current.last_sector)
+		index->current.last_sector = sector_number;
+
+	field = (struct bkr_image_field) {
+		.offset = offset - index->data_offset,
+		.sector_number = sector_number,
+		.record = record,
+		.flags = (bor ? BKR_IMAGE_BOR : 0) | (eor ? BKR_IMAGE_EOR : 0)
+	};
+	g_array_append_val(index->fields, field);
+}
+
+
+/*
+ * The decoder posts a message for every field, so they are collected in
+ * the streaming thread rather than queued for the main loop.
+ */
+
+
+static GstBusSyncReply sync_handler(GstBus *bus, GstMessage *msg, gpointer data)
+{
+	const GstStructure *s;
+
+	if(GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ELEMENT)
+		return GST_BUS_PASS;
+	s = gst_message_get_structure(msg);
+	if(!gst_structure_has_name(s, "bkr_sector"))
+		return GST_BUS_PASS;
+
+	add_field(data, s);
+	gst_message_unref(msg);
+	return GST_BUS_DROP;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                           Pipeline Construction
+ *
+ * ============================================================================
+ */
+
+
+static gboolean message_handler(GstBus *bus, GstMessage *msg, gpointer data)
+{
+	GMainLoop *loop = (GMainLoop *) data;
+
+	switch(GST_MESSAGE_TYPE(msg)) {
+	case GST_MESSAGE_EOS:
+		g_main_loop_quit(loop);
+		break;
+
+	case GST_MESSAGE_ERROR: {
+		gchar *debug;
+		GError *err;
+
+		gst_message_parse_error(msg, &err, &debug);
+		g_free(debug);
+
+		fprintf(stderr, PROGRAM_NAME ": error: %s\n", err->message);
+		g_error_free(err);
+
+		exit(1);
+	}
+
+	default:
+		break;
+	}
+
+	return TRUE;
+}
+
+
+static GstElement *scan_pipeline(unsigned int mode, int fd)
+{
+	GstElement *pipeline = gst_pipeline_new("pipeline");
+	GstElement *source = gst_element_factory_make("fdsrc", "source");
+	GstElement *frame = gst_element_factory_make("bkr_framedec", NULL);
+	GstElement *splp = gst_element_factory_make("bkr_splpdec", NULL);
+	GstElement *sink = gst_element_factory_make("fakesink", NULL);
+	GstCaps *caps = gst_caps_new_simple(
+		"application/x-backer",
+		"videomode", G_TYPE_INT, BKR_VIDEOMODE(mode),
+		"bitdensity", G_TYPE_INT, BKR_DENSITY(mode),
+		"sectorformat", G_TYPE_INT, BKR_CODEC(mode),
+		NULL
+	);
+
+	/*
+	 * in error paths, we don't bother unref()ing things, because we're
+	 * going to exit the program anyway
+	 */
+
+	if(!pipeline || !source || !frame || !splp || !sink || !caps)
+		return NULL;
+
+	g_object_set(G_OBJECT(source), "fd", fd, NULL);
+	g_object_set(G_OBJECT(splp), "scan", TRUE, "post_sectors", TRUE, NULL);
+	g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+
+	gst_bin_add_many(GST_BIN(pipeline), source, frame, splp, sink, NULL);
+	gst_element_link_filtered(source, frame, caps);
+	if(BKR_CODEC(mode) == BKR_EP) {
+		GstElement *rll = gst_element_factory_make("bkr_rlldec", NULL);
+		if(!rll)
+			return NULL;
+		gst_bin_add(GST_BIN(pipeline), rll);
+		gst_element_link_many(frame, rll, splp, sink, NULL);
+	} else
+		gst_element_link_many(frame, splp, sink, NULL);
+
+	gst_caps_unref(caps);
+	return pipeline;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Entry Point
+ *
+ * ============================================================================
+ */
+
+
+int main(int argc, char *argv[])
+{
+	struct options options;
+	struct bkr_image_header header;
+	struct index index;
+	struct stat st;
+	unsigned int mode;
+	GMainLoop *loop;
+	GstElement *pipeline;
+	GstBus *bus;
+	const char *image;
+	int fd;
+	guint i;
+
+
+	/*
+	 * Init.
+	 */
+
+
+	if(!g_thread_supported())
+		g_thread_init(NULL);
+	options = parse_command_line(&argc, &argv);
+	gst_init(NULL, NULL);
+	image = argv[1];
+
+	fd = open(image, O_RDWR);
+	if(fd < 0 || fstat(fd, &st) < 0) {
+		perror(PROGRAM_NAME ": error: opening image");
+		exit(1);
+	}
+	if(bkr_image_read_header(fd, &header) < 0) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s is not a Backer tape image\n", image);
+		exit(1);
+	}
+	/* the capture didn't finish:  take all that made it to disk */
+	if(!header.data_length && !header.index_entries)
+		header.data_length = st.st_size - header.data_offset;
+
+	mode = apply_options(header.mode, &options);
+	if(!BKR_VIDEOMODE(mode) || !BKR_DENSITY(mode)) {
+		fprintf(stderr, PROGRAM_NAME ": error: %s does not record its format, use --video-mode and --bit-density\n", image);
+		exit(1);
+	}
+	header.mode = mode;
+
+	if(options.verbose) {
+		fprintf(stderr, PROGRAM_NAME ": indexing %llu bytes, tape format:\n", (unsigned long long) header.data_length);
+		bkr_display_mode(stderr, BKR_VIDEOMODE(mode), BKR_DENSITY(mode), BKR_CODEC(mode));
+	}
+
+
+	/*
+	 * Scan the image.
+	 */
+
+
+	index.data_offset = header.data_offset;
+	index.fields = g_array_new(FALSE, FALSE, sizeof(struct bkr_image_field));
+	index.records = g_array_new(FALSE, FALSE, sizeof(struct bkr_image_record));
+	index.open = FALSE;
+
+	loop = g_main_loop_new(NULL, FALSE);
+	pipeline = scan_pipeline(mode, fd);
+	if(!pipeline) {
+		fprintf(stderr, PROGRAM_NAME ": failure building pipeline.\n");
+		exit(1);
+	}
+	bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+	gst_bus_set_sync_handler(bus, sync_handler, &index);
+	gst_bus_add_watch(bus, message_handler, loop);
+	gst_object_unref(bus);
+
+	if(!bkr_image_seek_source(pipeline, header.data_offset, header.data_offset + header.data_length)) {
+		fprintf(stderr, PROGRAM_NAME ": error: cannot seek %s\n", image);
+		exit(1);
+	}
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	g_main_loop_run(loop);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(GST_OBJECT(pipeline));
+
+	if(index.open)
+		close_record(&index, index.fields->len - 1);
+
+
+	/*
+	 * Write the index.
+	 */
+
+
+	if(bkr_image_write_index(fd, &header, (struct bkr_image_field *) index.fields->data, index.fields->len, (struct bkr_image_record *) index.records->data, index.records->len) < 0) {
+		perror(PROGRAM_NAME ": error: writing index");
+		exit(1);
+	}
+	if(close(fd) < 0) {
+		perror(PROGRAM_NAME ": error: closing image");
+		exit(1);
+	}
+
+	if(options.verbose) {
+		fprintf(stderr, PROGRAM_NAME ": %u fields, %u records\n", index.fields->len, index.records->len);
+		for(i = 0; i < index.records->len; i++) {
+			const struct bkr_image_record *r = &g_array_index(index.records, struct bkr_image_record, i);
+			fprintf(stderr, PROGRAM_NAME ": record %u: fields %u--%u, %d sectors\n", i, r->first_field, r->last_field, r->last_sector + 1);
+		}
+	}
+
+	g_array_free(index.fields, TRUE);
+	g_array_free(index.records, TRUE);
+	exit(0);
+}
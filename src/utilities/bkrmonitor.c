@@ -43,6 +43,8 @@
 
 struct unit_t {
 	FILE  *file;
+	int  binary;                    /* file is a unit's stats file */
+	unsigned int  sequence;         /* last decoder report seen */
 	struct {
 		GtkWidget  *state;
 		GtkWidget  *vmode, *density, *format;
@@ -74,9 +76,18 @@ gint update_status(gpointer data)
 {
 	struct unit_t  *unit = (struct unit_t *) data;
 	struct bkr_proc_status_t  proc_status;
+	struct bkr_stats  stats;
 	char  text[20];
 
-	if(bkr_proc_read_status(unit->file, &proc_status) < 0)
+	if(unit->binary) {
+		if(bkr_proc_read_stats(unit->file, &stats) < 0)
+			return TRUE;
+		bkr_proc_stats_to_status(&stats, &proc_status);
+		/* recent_block is only good once per report */
+		if(stats.sequence == unit->sequence)
+			proc_status.recent_block = 0;
+		unit->sequence = stats.sequence;
+	} else if(bkr_proc_read_status(unit->file, &proc_status) < 0)
 		return TRUE;
 
 	gtk_label_set_text(GTK_LABEL(unit->widget.state), proc_status.state);
@@ -420,13 +431,15 @@ int main(int argc, char *argv[])
 	if(dir) {
 		readdir(dir); readdir(dir);	/* skip "." and ".." */
 		for(i = 0; (dirent = readdir(dir)); ) {
-			sprintf(message, PROC_DIR"/%s/status", dirent->d_name);
+			sprintf(message, PROC_DIR"/%s/stats", dirent->d_name);
 			unit = realloc(unit, (i + 1) * sizeof(*unit));
 			unit[i].file = fopen(message, "r");
 			if(!unit[i].file) {
 				unit = realloc(unit, i * sizeof(*unit));
 				continue;
 			}
+			unit[i].binary = 1;
+			unit[i].sequence = 0;
 			sprintf(message, "Unit %s", dirent->d_name);
 			widget = create_unit_page(&unit[i]);
 			gtk_notebook_append_page(GTK_NOTEBOOK(notebook), widget, gtk_label_new(message));
@@ -437,6 +450,7 @@ int main(int argc, char *argv[])
 
 	if(include_file) {
 		unit = realloc(unit, (i + 1) * sizeof(*unit));
+		unit[i].binary = 0;
 		if(include_file[0]) {
 			unit[i].file = fopen(include_file, "r");
 			sprintf(message, "%s", include_file);
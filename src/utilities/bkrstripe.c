@@ -0,0 +1,653 @@
+/*
+ * bkrstripe
+ *
+ * Stripe a data stream across several Backer units and merge it back.
+ *
+ * Copyright (C) 2011  Kipp C. Cannon
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * The input is cut into chunks which are dealt round-robin to the
+ * stripes, one stripe per unit, each chunk preceded by a small header
+ * giving the stripe set, the stripe's index and the chunk's place in the
+ * original stream.  Each stripe is an ordinary byte stream to be encoded
+ * with bkrencode and recorded on its own unit and VCR, so the tapes stay
+ * in the normal tape format and can be checked and decoded on their own.
+ * On restore the decoded stripes are read back in any order and the
+ * chunks put back in sequence.
+ *
+ * The units all run at the tape rate, so no stripe may be kept waiting
+ * while another is being served:  all stripes are handled with
+ * non-blocking I/O, when splitting stdin is read only as poll() finds it
+ * ready, and when merging, the stripes are read as fast as they arrive and
+ * buffered until their chunks are due.
+ */
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define  PROGRAM_NAME   "bkrstripe"
+#define  HEADER_SIZE    24
+#define  READ_SIZE      65536
+
+
+/*
+ * ============================================================================
+ *
+ *                                Command Line
+ *
+ * ============================================================================
+ */
+
+
+struct options {
+	int verbose;
+	int merge;
+	size_t chunk_size;
+};
+
+
+static struct options default_options(void)
+{
+	struct options defaults = {
+		.verbose = 0,
+		.merge = 0,
+		.chunk_size = 65536
+	};
+
+	return defaults;
+}
+
+
+static void usage(void)
+{
+	fputs(
+	"Backer multi-unit striping utility.\n" \
+	"Usage: " PROGRAM_NAME " [options] stripe...\n" \
+	"Splits stdin across the stripes, or with -u merges them to stdout.\n" \
+	"the following options are recognized:\n" \
+	"	-c bytes Set the chunk size (default 65536, only when splitting)\n" \
+	"	-u       Merge (\"unencode\") rather than split\n" \
+	"	-h       Display this usage message\n" \
+	"	-v       Be verbose\n", stderr);
+}
+
+
+static struct options parse_command_line(int *argc, char **argv[])
+{
+	struct options options = default_options();
+	struct option long_options[] = {
+		{"chunk-size",	required_argument,	NULL,	'c'},
+		{"help",	no_argument,	NULL,	'h'},
+		{"unencode",	no_argument,	NULL,	'u'},
+		{"verbose",	no_argument,	NULL,	'v'},
+		{NULL,	0,	NULL,	0}
+	};
+	int c, index;
+
+	opterr = 1;	/* enable error messages */
+	do switch(c = getopt_long(*argc, *argv, "c:huv", long_options, &index)) {
+	case 'c':
+		options.chunk_size = strtoul(optarg, NULL, 0);
+		if(!options.chunk_size || options.chunk_size > UINT32_MAX) {
+			usage();
+			exit(1);
+		}
+		break;
+
+	case 'u':
+		options.merge = 1;
+		break;
+
+	case 'h':
+		usage();
+		exit(1);
+
+	case 'v':
+		options.verbose = 1;
+		break;
+
+	case 0:
+		/* option sets a flag */
+		break;
+
+	case -1:
+		/* end of arguments */
+		break;
+
+	case '?':
+		/* unrecognized option */
+		usage();
+		exit(1);
+
+	case ':':
+		/* missing argument for an option */
+		usage();
+		exit(1);
+
+	default:
+		/* FIXME: print bug warning */
+		break;
+	} while(c != -1);
+
+	/* remove parsed arguments */
+	*argc -= optind;
+	*argv += optind;
+
+	return options;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Chunk Headers
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * All fields are little-endian.  A chunk with length 0 ends the stripe.
+ */
+
+
+struct header {
+	uint32_t set;                   /* stripe set identifier */
+	uint16_t index;                 /* this stripe */
+	uint16_t count;                 /* stripes in the set */
+	uint32_t length;                /* bytes of data following */
+	uint64_t sequence;              /* chunk number in the input */
+};
+
+
+static const unsigned char magic[4] = {'B', 'k', 'r', 'S'};
+
+
+static void put_le(unsigned char *p, uint64_t x, int n)
+{
+	while(n--) {
+		*p++ = x;
+		x >>= 8;
+	}
+}
+
+
+static uint64_t get_le(const unsigned char *p, int n)
+{
+	uint64_t x = 0;
+
+	while(n--)
+		x = (x << 8) | p[n];
+	return x;
+}
+
+
+static void put_header(unsigned char *p, const struct header *header)
+{
+	memcpy(p, magic, 4);
+	put_le(p + 4, header->set, 4);
+	put_le(p + 8, header->index, 2);
+	put_le(p + 10, header->count, 2);
+	put_le(p + 12, header->length, 4);
+	put_le(p + 16, header->sequence, 8);
+}
+
+
+static int get_header(const unsigned char *p, struct header *header)
+{
+	if(memcmp(p, magic, 4))
+		return -1;
+	header->set = get_le(p + 4, 4);
+	header->index = get_le(p + 8, 2);
+	header->count = get_le(p + 10, 2);
+	header->length = get_le(p + 12, 4);
+	header->sequence = get_le(p + 16, 8);
+	return 0;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                  Stripes
+ *
+ * ============================================================================
+ */
+
+
+struct stripe {
+	const char *name;
+	int fd;
+	int eof;
+	int index;                      /* from its first header (merging) */
+	unsigned char *buffer;
+	size_t size;                    /* allocated */
+	size_t start, end;              /* pending data */
+};
+
+
+static size_t pending(const struct stripe *stripe)
+{
+	return stripe->end - stripe->start;
+}
+
+
+static void *append(struct stripe *stripe, size_t n)
+{
+	if(stripe->start == stripe->end)
+		stripe->start = stripe->end = 0;
+	if(stripe->end + n > stripe->size) {
+		memmove(stripe->buffer, stripe->buffer + stripe->start, pending(stripe));
+		stripe->end -= stripe->start;
+		stripe->start = 0;
+		if(stripe->end + n > stripe->size) {
+			stripe->size = stripe->end + n;
+			stripe->buffer = realloc(stripe->buffer, stripe->size);
+			if(!stripe->buffer) {
+				perror(PROGRAM_NAME);
+				exit(1);
+			}
+		}
+	}
+	stripe->end += n;
+	return stripe->buffer + stripe->end - n;
+}
+
+
+static void open_stripes(struct stripe *stripes, int n, char *names[], int flags)
+{
+	int i;
+
+	for(i = 0; i < n; i++) {
+		stripes[i] = (struct stripe) {
+			.name = names[i],
+			.index = -1
+		};
+		/* opened blocking:  a FIFO opened O_WRONLY|O_NONBLOCK with
+		 * no reader yet fails with ENXIO */
+		stripes[i].fd = open(names[i], flags, 0666);
+		if(stripes[i].fd < 0 || fcntl(stripes[i].fd, F_SETFL, fcntl(stripes[i].fd, F_GETFL) | O_NONBLOCK) < 0) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: %s\n", names[i], strerror(errno));
+			exit(1);
+		}
+	}
+}
+
+
+/*
+ * Blocking full-length write of stdout.
+ */
+
+
+static void write_all(int fd, const void *buf, size_t n)
+{
+	ssize_t result;
+
+	while(n) {
+		result = write(fd, buf, n);
+		if(result < 0) {
+			if(errno == EINTR)
+				continue;
+			perror(PROGRAM_NAME ": error: write");
+			exit(1);
+		}
+		buf += result;
+		n -= result;
+	}
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Split
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Set up fds[] to poll the stripes that have data pending.
+ */
+
+
+static void poll_outputs(struct pollfd *fds, struct stripe *stripes, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
+		fds[i] = (struct pollfd) {
+			.fd = pending(&stripes[i]) ? stripes[i].fd : -1,
+			.events = POLLOUT
+		};
+}
+
+
+/*
+ * Write whatever the stripes poll() found ready will take.
+ */
+
+
+static void write_outputs(const struct pollfd *fds, struct stripe *stripes, int n)
+{
+	ssize_t result;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		if(!fds[i].revents)
+			continue;
+		result = write(stripes[i].fd, stripes[i].buffer + stripes[i].start, pending(&stripes[i]));
+		if(result < 0) {
+			if(errno == EAGAIN || errno == EINTR)
+				continue;
+			fprintf(stderr, PROGRAM_NAME ": error: %s: %s\n", stripes[i].name, strerror(errno));
+			exit(1);
+		}
+		stripes[i].start += result;
+	}
+}
+
+
+/*
+ * Wait until at least one of the stripes will take something, and write
+ * whatever they will take.
+ */
+
+
+static void service_outputs(struct stripe *stripes, int n)
+{
+	struct pollfd fds[n];
+
+	poll_outputs(fds, stripes, n);
+	if(poll(fds, n, -1) < 0) {
+		if(errno == EINTR)
+			return;
+		perror(PROGRAM_NAME ": error: poll");
+		exit(1);
+	}
+	write_outputs(fds, stripes, n);
+}
+
+
+/*
+ * stdin is polled along with the stripes, and read only when it's ready,
+ * so a slow producer never holds up a unit.  The chunk being read is
+ * handed to its stripe once it's complete and the stripe has finished the
+ * last one.
+ */
+
+
+static int split(const struct options *options, struct stripe *stripes, int n)
+{
+	struct header header = {
+		.set = time(NULL) ^ (getpid() << 16),
+		.count = n,
+		.sequence = 0
+	};
+	struct pollfd fds[n + 1];
+	unsigned char *chunk;
+	size_t filled = 0;
+	int eof = 0;
+	unsigned char *p;
+	struct stripe *stripe;
+	ssize_t result;
+	int i;
+
+	chunk = malloc(options->chunk_size);
+	if(!chunk) {
+		perror(PROGRAM_NAME);
+		exit(1);
+	}
+
+	while(1) {
+		stripe = &stripes[header.sequence % n];
+		if((eof || filled == options->chunk_size) && !pending(stripe)) {
+			header.index = header.sequence % n;
+			header.length = filled;
+			p = append(stripe, HEADER_SIZE + filled);
+			put_header(p, &header);
+			memcpy(p + HEADER_SIZE, chunk, filled);
+			header.sequence++;
+			filled = 0;
+			/* an empty chunk follows the last of the data */
+			if(!header.length)
+				break;
+			continue;
+		}
+
+		poll_outputs(fds, stripes, n);
+		fds[n] = (struct pollfd) {
+			.fd = eof || filled == options->chunk_size ? -1 : STDIN_FILENO,
+			.events = POLLIN
+		};
+		if(poll(fds, n + 1, -1) < 0) {
+			if(errno == EINTR)
+				continue;
+			perror(PROGRAM_NAME ": error: poll");
+			exit(1);
+		}
+		write_outputs(fds, stripes, n);
+
+		if(fds[n].revents) {
+			result = read(STDIN_FILENO, chunk + filled, options->chunk_size - filled);
+			if(result < 0) {
+				if(errno == EAGAIN || errno == EINTR)
+					continue;
+				perror(PROGRAM_NAME ": error: read");
+				exit(1);
+			}
+			if(result == 0)
+				eof = 1;
+			filled += result;
+		}
+	}
+	free(chunk);
+
+	/* the empty chunk above ended one stripe, end the rest */
+	for(i = 1; i < n; i++) {
+		stripe = &stripes[header.sequence % n];
+		header.index = header.sequence % n;
+		put_header(append(stripe, HEADER_SIZE), &header);
+		header.sequence++;
+	}
+
+	for(i = 0; i < n; i++)
+		while(pending(&stripes[i]))
+			service_outputs(stripes, n);
+
+	if(options->verbose)
+		fprintf(stderr, PROGRAM_NAME ": %llu chunks in %d stripes, set %08x\n", (unsigned long long) header.sequence - n, n, header.set);
+
+	return 0;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                   Merge
+ *
+ * ============================================================================
+ */
+
+
+/*
+ * Read whatever has arrived on the stripes, waiting first until something
+ * has if wait is set.
+ */
+
+
+static void service_inputs(struct stripe *stripes, int n, int wait)
+{
+	struct pollfd fds[n];
+	ssize_t result;
+	int i;
+
+	for(i = 0; i < n; i++)
+		fds[i] = (struct pollfd) {
+			.fd = stripes[i].eof ? -1 : stripes[i].fd,
+			.events = POLLIN
+		};
+	if(poll(fds, n, wait ? -1 : 0) < 0) {
+		if(errno == EINTR)
+			return;
+		perror(PROGRAM_NAME ": error: poll");
+		exit(1);
+	}
+
+	for(i = 0; i < n; i++) {
+		if(!fds[i].revents)
+			continue;
+		result = read(stripes[i].fd, append(&stripes[i], READ_SIZE), READ_SIZE);
+		stripes[i].end -= READ_SIZE - (result > 0 ? result : 0);
+		if(result < 0) {
+			if(errno == EAGAIN || errno == EINTR)
+				continue;
+			fprintf(stderr, PROGRAM_NAME ": error: %s: %s\n", stripes[i].name, strerror(errno));
+			exit(1);
+		}
+		if(result == 0)
+			stripes[i].eof = 1;
+	}
+}
+
+
+/*
+ * Wait for the given number of bytes to be pending on a stripe.
+ */
+
+
+static void wait_for(struct stripe *stripes, int n, struct stripe *stripe, size_t bytes)
+{
+	while(pending(stripe) < bytes) {
+		if(stripe->eof) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: stripe ends early\n", stripe->name);
+			exit(1);
+		}
+		service_inputs(stripes, n, 1);
+	}
+}
+
+
+static int merge(const struct options *options, struct stripe *stripes, int n)
+{
+	struct stripe *order[n];
+	struct header first, header;
+	struct stripe *stripe;
+	uint64_t sequence;
+	int i;
+
+	/*
+	 * Identify the stripes from their first headers.
+	 */
+
+	for(i = 0; i < n; i++)
+		order[i] = NULL;
+	for(i = 0; i < n; i++) {
+		wait_for(stripes, n, &stripes[i], HEADER_SIZE);
+		if(get_header(stripes[i].buffer + stripes[i].start, &header) < 0) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: not a stripe\n", stripes[i].name);
+			exit(1);
+		}
+		if(!i)
+			first = header;
+		if(header.set != first.set || header.count != n || header.index >= n || order[header.index]) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: not stripe %d of a %d-stripe set %08x\n", stripes[i].name, header.index, n, first.set);
+			exit(1);
+		}
+		order[header.index] = &stripes[i];
+	}
+
+	/*
+	 * Put the chunks back in order.
+	 */
+
+	for(sequence = 0; ; sequence++) {
+		stripe = order[sequence % n];
+		wait_for(stripes, n, stripe, HEADER_SIZE);
+		if(get_header(stripe->buffer + stripe->start, &header) < 0 || header.set != first.set) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: bad chunk header\n", stripe->name);
+			exit(1);
+		}
+		if(header.sequence != sequence) {
+			fprintf(stderr, PROGRAM_NAME ": error: %s: expected chunk %llu, found %llu\n", stripe->name, (unsigned long long) sequence, (unsigned long long) header.sequence);
+			exit(1);
+		}
+		if(!header.length)
+			break;
+		wait_for(stripes, n, stripe, HEADER_SIZE + header.length);
+		stripe->start += HEADER_SIZE;
+		write_all(STDOUT_FILENO, stripe->buffer + stripe->start, header.length);
+		stripe->start += header.length;
+
+		/* don't leave the others waiting */
+		service_inputs(stripes, n, 0);
+	}
+
+	if(options->verbose)
+		fprintf(stderr, PROGRAM_NAME ": %llu chunks from %d stripes, set %08x\n", (unsigned long long) sequence, n, first.set);
+
+	return 0;
+}
+
+
+/*
+ * ============================================================================
+ *
+ *                                Entry Point
+ *
+ * ============================================================================
+ */
+
+
+int main(int argc, char *argv[])
+{
+	struct options options;
+	struct stripe *stripes;
+
+	options = parse_command_line(&argc, &argv);
+	if(argc < 1 || argc > UINT16_MAX) {
+		usage();
+		exit(1);
+	}
+
+	stripes = calloc(argc, sizeof(*stripes));
+	if(!stripes) {
+		perror(PROGRAM_NAME);
+		exit(1);
+	}
+
+	if(options.merge) {
+		open_stripes(stripes, argc, argv, O_RDONLY);
+		exit(merge(&options, stripes, argc));
+	}
+	open_stripes(stripes, argc, argv, O_WRONLY | O_CREAT | O_TRUNC);
+	exit(split(&options, stripes, argc));
+}